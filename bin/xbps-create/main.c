@@ -117,7 +117,10 @@ usage(bool fail)
 	" --shlib-provides     List of provided shared libraries (blank separated list,\n"
 	"                      e.g 'libfoo.so.1 libblah.so.2')\n"
 	" --shlib-requires     List of required shared libraries (blank separated list,\n"
-	"                      e.g 'libfoo.so.1 libblah.so.2')\n\n"
+	"                      e.g 'libfoo.so.1 libblah.so.2')\n"
+	" --triggers           List of triggers in /usr/libexec/xbps-batch-triggers\n"
+	"                      run once per transaction after the packages are\n"
+	"                      configured (blank separated list)\n\n"
 	"NOTE:\n"
 	" At least three flags are required: architecture, pkgver and desc.\n\n"
 	"EXAMPLE:\n"
@@ -537,8 +540,8 @@ ftw_cb(const char *fpath, const struct stat *sb, const struct dirent *dir UNUSED
 		xbps_object_iterator_release(iter);
 
 		/*
-		 * Find out if it's a configuration file or not
-		 * and calculate sha256 hash.
+		 * Find out if it's a configuration file or not,
+		 * its sha256 hash is calculated in hash_files().
 		 */
 		if (entry_is_conf_file(filep)) {
 			xbps_dictionary_set_cstring_nocopy(fileinfo, "type", "conf_files");
@@ -548,10 +551,6 @@ ftw_cb(const char *fpath, const struct stat *sb, const struct dirent *dir UNUSED
 			xe->type = ENTRY_TYPE_FILES;
 		}
 
-		if (!xbps_file_sha256(xe->sha256, sizeof xe->sha256, fpath))
-			die("failed to process hash for: %s", fpath);
-		xbps_dictionary_set_cstring(fileinfo, "sha256", xe->sha256);
-
 		xbps_dictionary_set_uint64(fileinfo, "inode", sb->st_ino);
 		xe->inode = sb->st_ino;
 		xe->size = (uint64_t)sb->st_size;
@@ -687,12 +686,57 @@ process_xentry(enum entry_type type, const char *mutable_files)
 	xbps_object_release(a);
 }
 
+/*
+ * Calculates the sha256 hash of all regular files, many files
+ * are hashed in parallel.
+ */
+static void
+hash_files(void)
+{
+	struct xentry *xe;
+	const char **files;
+	char (*sha256)[XBPS_SHA256_SIZE];
+	size_t nfiles = 0, i = 0;
+	int r;
+
+	TAILQ_FOREACH(xe, &xentry_list, entries) {
+		if (xe->type == ENTRY_TYPE_FILES || xe->type == ENTRY_TYPE_CONF_FILES)
+			nfiles++;
+	}
+	if (nfiles == 0)
+		return;
+	files = calloc(nfiles, sizeof(*files));
+	sha256 = calloc(nfiles, sizeof(*sha256));
+	if (files == NULL || sha256 == NULL)
+		die("calloc");
+	TAILQ_FOREACH(xe, &xentry_list, entries) {
+		if (xe->type == ENTRY_TYPE_FILES || xe->type == ENTRY_TYPE_CONF_FILES)
+			files[i++] = xe->file;
+	}
+	if ((r = xbps_file_sha256_multi(files, sha256, nfiles, 0)) < 0) {
+		errno = -r;
+		for (i = 0; i < nfiles; i++) {
+			if (sha256[i][0] == '\0')
+				die("failed to process hash for: %s", files[i]);
+		}
+	}
+	i = 0;
+	TAILQ_FOREACH(xe, &xentry_list, entries) {
+		if (xe->type == ENTRY_TYPE_FILES || xe->type == ENTRY_TYPE_CONF_FILES)
+			memcpy(xe->sha256, sha256[i++], sizeof(xe->sha256));
+	}
+	free(files);
+	free(sha256);
+}
+
 static void
 process_destdir(const char *mutable_files)
 {
 	if (walk_dir(".", ftw_cb) < 0)
 		die("failed to process destdir files (nftw)");
 
+	hash_files();
+
 	/* Process regular files */
 	process_xentry(ENTRY_TYPE_FILES, mutable_files);
 
@@ -889,6 +933,7 @@ main(int argc, char **argv)
 		{ "source-revisions", required_argument, NULL, 'G' },
 		{ "sourcepkg", required_argument, NULL, '5'},
 		{ "tags", required_argument, NULL, 't' },
+		{ "triggers", required_argument, NULL, '6' },
 		{ "version", no_argument, NULL, 'V' },
 		{ NULL, 0, NULL, 0 }
 	};
@@ -901,6 +946,7 @@ main(int argc, char **argv)
 	const char *arch, *config_files, *mutable_files, *version, *changelog;
 	const char *buildopts, *shlib_provides, *shlib_requires, *alternatives;
 	const char *compression, *tags = NULL, *srcrevs = NULL, *sourcepkg = NULL;
+	const char *triggers = NULL;
 	char pkgname[XBPS_NAME_SIZE], *binpkg, *tname, *p, cwd[PATH_MAX-1];
 	bool quiet = false, preserve = false;
 	int c, pkg_fd;
@@ -1000,6 +1046,9 @@ main(int argc, char **argv)
 		case '5':
 			sourcepkg = optarg;
 			break;
+		case '6':
+			triggers = optarg;
+			break;
 		case '?':
 		default:
 			usage(true);
@@ -1092,6 +1141,7 @@ main(int argc, char **argv)
 	process_array("reverts", reverts, NULL);
 	process_array("shlib-provides", shlib_provides, NULL);
 	process_array("shlib-requires", shlib_requires, NULL);
+	process_array("triggers", triggers, NULL);
 	process_dict_of_arrays("alternatives", alternatives);
 
 	/* save cwd */
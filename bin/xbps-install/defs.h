@@ -29,11 +29,23 @@
 #include <sys/time.h>
 #include <xbps.h>
 
-struct xferstat {
+struct xfer {
+	char *name;
+	off_t dloaded;
 	struct timeval start;
 	struct timeval last;
 };
 
+/*
+ * Transfers may run concurrently, keep the stats of
+ * every active download keyed by its file name.
+ */
+struct xferstat {
+	struct xfer *xfers;
+	size_t nxfers;
+	uint64_t dlsize;
+};
+
 struct transaction {
 	struct xbps_handle *xhp;
 	xbps_dictionary_t d;
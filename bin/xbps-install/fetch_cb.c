@@ -66,9 +66,8 @@ get_time(struct timeval *tvp)
  * Compute and display ETA
  */
 static const char *
-stat_eta(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
+stat_eta(const struct xbps_fetch_cb_data *xfpd, struct xfer *xfer)
 {
-	struct xferstat *xfer = cbdata;
 	static char str[25];
 	long elapsed, eta;
 	off_t received, expected;
@@ -105,9 +104,8 @@ compare_double(const double a, const double b)
  * Compute and display transfer rate
  */
 static const char *
-stat_bps(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
+stat_bps(const struct xbps_fetch_cb_data *xfpd, struct xfer *xfer)
 {
-	struct xferstat *xfer = cbdata;
 	static char str[16];
 	char size[8];
 	double delta, bps;
@@ -128,32 +126,73 @@ stat_bps(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
  * Compute and display overall download progress
  */
 static const char *
-stat_progress(const struct xbps_fetch_cb_data *xfpd)
+stat_progress(const struct xbps_fetch_cb_data *xfpd, struct xferstat *xfs)
 {
 	static char str[48];
-	static uint64_t dlsize = 0;
-	uint64_t total_dlsize = 0;
+	uint64_t dlsize, total_dlsize = 0;
 	double ratio;
 	bool exists;
 
 	exists = xbps_dictionary_get_uint64(xfpd->xhp->transd, "total-download-size", &total_dlsize);
-	if (!exists)
+	if (exists) {
+		dlsize = xfs->dlsize;
+		for (size_t i = 0; i < xfs->nxfers; i++)
+			dlsize += xfs->xfers[i].dloaded;
+	} else {
 		total_dlsize = xfpd->file_size;
+		dlsize = xfpd->file_dloaded;
+	}
 
-	ratio = (double)(dlsize + xfpd->file_dloaded) / total_dlsize;
+	ratio = (double)dlsize / total_dlsize;
 	snprintf(str, sizeof str, "[%2d%%]", (int)(ratio * 100));
-	if (xfpd->cb_end && exists)
-		dlsize += xfpd->file_size;
 	return str;
 }
 
+static struct xfer *
+xfer_find(struct xferstat *xfs, const char *name)
+{
+	for (size_t i = 0; i < xfs->nxfers; i++) {
+		if (strcmp(xfs->xfers[i].name, name) == 0)
+			return &xfs->xfers[i];
+	}
+	return NULL;
+}
+
+static struct xfer *
+xfer_add(struct xferstat *xfs, const char *name)
+{
+	struct xfer *xfers, *xfer;
+
+	xfers = realloc(xfs->xfers, (xfs->nxfers + 1) * sizeof(*xfers));
+	if (xfers == NULL)
+		return NULL;
+	xfs->xfers = xfers;
+	xfer = &xfs->xfers[xfs->nxfers];
+	memset(xfer, 0, sizeof(*xfer));
+	if ((xfer->name = strdup(name)) == NULL)
+		return NULL;
+	xfs->nxfers++;
+	return xfer;
+}
+
+static void
+xfer_del(struct xferstat *xfs, struct xfer *xfer)
+{
+	free(xfer->name);
+	*xfer = xfs->xfers[--xfs->nxfers];
+	if (xfs->nxfers == 0) {
+		free(xfs->xfers);
+		xfs->xfers = NULL;
+	}
+}
+
 /*
  * Update the stats display
  */
 static void
-stat_display(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
+stat_display(const struct xbps_fetch_cb_data *xfpd, struct xferstat *xfs,
+		struct xfer *xfer)
 {
-	struct xferstat *xfer = cbdata;
 	struct timeval now;
 	char totsize[8];
 	int percentage;
@@ -173,7 +212,7 @@ stat_display(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
 	}
 	if (v_tty)
 		fprintf(stderr, "%s %s: [%s %d%%] %s ETA: %s\033[K\r",
-		    stat_progress(xfpd), xfpd->file_name, totsize,
+		    stat_progress(xfpd, xfs), xfpd->file_name, totsize,
 		    percentage, stat_bps(xfpd, xfer), stat_eta(xfpd, xfer));
 	else {
 		printf("%s: [%s %d%%] %s ETA: %s\n",
@@ -186,23 +225,30 @@ stat_display(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
 void
 fetch_file_progress_cb(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
 {
-	struct xferstat *xfer = cbdata;
+	struct xferstat *xfs = cbdata;
+	struct xfer *xfer;
 	char size[8];
 
 	if (xfpd->cb_start) {
 		/* start transfer stats */
 		v_tty = isatty(STDOUT_FILENO);
+		if ((xfer = xfer_add(xfs, xfpd->file_name)) == NULL)
+			return;
 		get_time(&xfer->start);
-		xfer->last.tv_sec = xfer->last.tv_usec = 0;
-	} else if (xfpd->cb_update) {
+		xfer->dloaded = xfpd->file_dloaded;
+		return;
+	}
+	if ((xfer = xfer_find(xfs, xfpd->file_name)) == NULL)
+		return;
+
+	xfer->dloaded = xfpd->file_dloaded;
+	if (xfpd->cb_update) {
 		/* update transfer stats */
-		stat_display(xfpd, xfer);
+		stat_display(xfpd, xfs, xfer);
 	} else if (xfpd->cb_end) {
 		/* end transfer stats */
 		(void)xbps_humanize_number(size, (int64_t)xfpd->file_dloaded);
 		if (v_tty) {
-			/* dumb call to sum file_size */
-			stat_progress(xfpd);
 			fprintf(stderr, "%s: %s [avg rate: %s]\033[K\n",
 			    xfpd->file_name, size, stat_bps(xfpd, xfer));
 		} else {
@@ -210,5 +256,7 @@ fetch_file_progress_cb(const struct xbps_fetch_cb_data *xfpd, void *cbdata)
 			    xfpd->file_name, size, stat_bps(xfpd, xfer));
 			fflush(stdout);
 		}
+		xfs->dlsize += xfpd->file_size;
+		xfer_del(xfs, xfer);
 	}
 }
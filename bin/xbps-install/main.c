@@ -123,7 +123,7 @@ main(int argc, char **argv)
 		{ NULL, 0, NULL, 0 }
 	};
 	struct xbps_handle xh;
-	struct xferstat xfer;
+	struct xferstat xfer = { 0 };
 	const char *rootdir, *cachedir, *confdir;
 	int i, c, flags, rv, fflag = 0;
 	bool syncf, yes, force, drun, update;
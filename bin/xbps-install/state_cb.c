@@ -159,11 +159,22 @@ state_cb(const struct xbps_state_cb_data *xscd, void *cbdata UNUSED)
 	case XBPS_STATE_UNPACK_FILE_PRESERVED:
 		printf("%s\n", xscd->desc);
 		break;
+	case XBPS_STATE_TRIGGER:
+		printf("%s\n", xscd->desc);
+		break;
+	case XBPS_STATE_TRIGGERS_DONE:
+		printf("%s\n", xscd->desc);
+		if (slog) {
+			syslog(LOG_NOTICE, "%s (rootdir: %s)", xscd->desc,
+			    xscd->xhp->rootdir);
+		}
+		break;
 	/* errors */
 	case XBPS_STATE_TRANS_FAIL:
 	case XBPS_STATE_UNPACK_FAIL:
 	case XBPS_STATE_UPDATE_FAIL:
 	case XBPS_STATE_CONFIGURE_FAIL:
+	case XBPS_STATE_TRIGGER_FAIL:
 	case XBPS_STATE_REMOVE_FAIL:
 	case XBPS_STATE_VERIFY_FAIL:
 	case XBPS_STATE_FILES_FAIL:
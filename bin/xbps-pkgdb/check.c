@@ -29,56 +29,117 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <assert.h>
 
 #include <xbps.h>
 #include "defs.h"
 
+/*
+ * Packages are checked by a pool of `jobs' threads, the files of each
+ * package are hashed by the thread that checks it. Hashing is mostly
+ * I/O bound, more jobs than CPUs help on slow storage.
+ */
 struct check_context {
+	struct xbps_handle *xhp;
+	pthread_mutex_t lock;
+	xbps_array_t pkgs;
+	unsigned int next;
+	unsigned int checks;
 	int errors;
-	unsigned ctr;
 };
 
-static int
-check_cb(struct xbps_handle *xhp UNUSED,
-		xbps_object_t obj,
-		const char *key UNUSED,
-		void *arg,
-		bool *done UNUSED)
+static void *
+check_worker(void *arg)
 {
+	struct check_context *ctx = arg;
+	xbps_dictionary_t pkgd;
 	const char *pkgver = NULL;
 	char pkgname[XBPS_NAME_SIZE];
-	struct check_context *ctx = arg;
 	int rv;
 
-	xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
-	xbps_verbose_printf("Checking %s ...\n", pkgver);
+	for (;;) {
+		pthread_mutex_lock(&ctx->lock);
+		if (ctx->next == xbps_array_count(ctx->pkgs)) {
+			pthread_mutex_unlock(&ctx->lock);
+			break;
+		}
+		pkgd = xbps_array_get(ctx->pkgs, ctx->next++);
+		pthread_mutex_unlock(&ctx->lock);
+
+		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+		xbps_verbose_printf("Checking %s ...\n", pkgver);
 
-	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
-		xbps_unreachable();
-	if ((rv = check_pkg(xhp, obj, pkgname, ctx->ctr)) != 0)
-		ctx->errors += 1;
+		if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+			xbps_unreachable();
+		if ((rv = check_pkg(ctx->xhp, pkgd, pkgname, ctx->checks, 1)) != 0) {
+			pthread_mutex_lock(&ctx->lock);
+			ctx->errors += 1;
+			pthread_mutex_unlock(&ctx->lock);
+		}
+	}
+	return NULL;
+}
 
-	return 0;
+static int
+collect_pkg_cb(struct xbps_handle *xhp UNUSED,
+		xbps_object_t obj,
+		const char *key UNUSED,
+		void *arg,
+		bool *done UNUSED)
+{
+	return xbps_array_add(arg, obj) ? 0 : -ENOMEM;
 }
 
 int
-check_all(struct xbps_handle *xhp, unsigned int checks)
+check_all(struct xbps_handle *xhp, unsigned int checks, unsigned int jobs)
 {
-	struct check_context args = {
-		.errors = 0,
-		.ctr = checks,
+	struct check_context ctx = {
+		.xhp = xhp,
+		.checks = checks,
 	};
-	xbps_pkgdb_foreach_cb_multi(xhp, check_cb, &args);
-	return args.errors ? -1 : 0;
+	pthread_t *thds = NULL;
+	unsigned int i;
+	int r;
+
+	if ((ctx.pkgs = xbps_array_create()) == NULL)
+		return xbps_error_oom();
+	if ((r = xbps_pkgdb_foreach_cb(xhp, collect_pkg_cb, ctx.pkgs)) != 0) {
+		xbps_object_release(ctx.pkgs);
+		return r;
+	}
+
+	if (jobs > xbps_array_count(ctx.pkgs))
+		jobs = xbps_array_count(ctx.pkgs);
+	if (jobs > 1 && (thds = calloc(jobs, sizeof(*thds))) == NULL)
+		jobs = 1;
+
+	pthread_mutex_init(&ctx.lock, NULL);
+	for (i = 0; i + 1 < jobs; i++) {
+		r = pthread_create(&thds[i], NULL, check_worker, &ctx);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to create thread: %s\n", strerror(r));
+			break;
+		}
+	}
+	check_worker(&ctx);
+	while (i > 0)
+		pthread_join(thds[--i], NULL);
+	pthread_mutex_destroy(&ctx.lock);
+
+	free(thds);
+	xbps_object_release(ctx.pkgs);
+	return ctx.errors ? -1 : 0;
 }
 
 int
 check_pkg(struct xbps_handle *xhp,
 		    xbps_dictionary_t pkgd,
 		    const char *pkgname,
-		    unsigned checks)
+		    unsigned checks,
+		    unsigned int jobs)
 {
 	xbps_dictionary_t opkgd, filesd;
 	const char *sha256;
@@ -125,7 +186,7 @@ check_pkg(struct xbps_handle *xhp,
 	}
 
 	if (checks & CHECK_FILES) {
-		if (check_pkg_files(xhp, pkgname, filesd))
+		if (check_pkg_files(xhp, pkgname, filesd, jobs))
 			errors++;
 		if (check_pkg_symlinks(xhp, pkgname, filesd))
 			errors++;
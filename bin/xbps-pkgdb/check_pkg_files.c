@@ -23,6 +23,7 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <sys/param.h>
+#include <sys/stat.h>
 
 #include <errno.h>
 #include <stdbool.h>
@@ -42,68 +43,138 @@
  *
  * 	o Check the hash for all installed files, except
  * 	  configuration files (which is expected if they are modified).
+ * 	  Files unchanged since they were last verified are skipped,
+ * 	  the others are hashed with up to `jobs' threads.
  *
  * 	o Compares stored file modification time.
  *
  * Return 0 if test ran successfully, 1 otherwise and -1 on error.
  */
 
+struct pkg_file {
+	xbps_dictionary_t obj;
+	const char *file;
+	const char *sha256;
+	char *path;
+	struct stat st;
+	int rv;
+};
+
+static int
+hash_pkg_files(struct pkg_file *files, unsigned int nfiles, unsigned int jobs)
+{
+	const char **paths;
+	char (*sha256)[XBPS_SHA256_SIZE];
+	unsigned int i, n = 0;
+
+	paths = calloc(nfiles, sizeof(*paths));
+	sha256 = calloc(nfiles, sizeof(*sha256));
+	if (paths == NULL || sha256 == NULL) {
+		free(paths);
+		free(sha256);
+		return -1;
+	}
+	for (i = 0; i < nfiles; i++) {
+		if (files[i].rv == EAGAIN)
+			paths[n++] = files[i].path;
+	}
+	xbps_file_sha256_multi(paths, sha256, n, jobs);
+	for (i = 0, n = 0; i < nfiles; i++) {
+		struct pkg_file *f = &files[i];
+
+		if (f->rv != EAGAIN)
+			continue;
+		if (sha256[n][0] == '\0') {
+			/* find out why it could not be read */
+			f->rv = xbps_file_sha256_check(f->path, f->sha256);
+		} else if (strcmp(sha256[n], f->sha256) == 0) {
+			f->rv = 0;
+			verify_cache_add(f->path, &f->st, f->sha256);
+		} else {
+			f->rv = ERANGE;
+		}
+		n++;
+	}
+	free(paths);
+	free(sha256);
+	return 0;
+}
+
 int
-check_pkg_files(struct xbps_handle *xhp, const char *pkgname, xbps_dictionary_t pkg_filesd)
+check_pkg_files(struct xbps_handle *xhp, const char *pkgname,
+		xbps_dictionary_t pkg_filesd, unsigned int jobs)
 {
 	xbps_array_t array;
 	xbps_object_t obj;
 	xbps_object_iterator_t iter;
-	const char *file = NULL, *sha256 = NULL;
+	struct pkg_file *files = NULL;
+	const char *file = NULL;
 	char *path;
 	bool mutable, test_broken = false;
-	int rv = 0, errors = 0;
+	unsigned int i, nfiles = 0;
+	int errors = 0;
 
 	array = xbps_dictionary_get(pkg_filesd, "files");
 	if (array != NULL && xbps_array_count(array) > 0) {
-		iter = xbps_array_iter_from_dict(pkg_filesd, "files");
-		if (iter == NULL)
+		files = calloc(xbps_array_count(array), sizeof(*files));
+		if (files == NULL)
 			return -1;
+		for (i = 0; i < xbps_array_count(array); i++) {
+			struct pkg_file *f = &files[nfiles];
 
-		while ((obj = xbps_object_iterator_next(iter))) {
-			xbps_dictionary_get_cstring_nocopy(obj, "file", &file);
+			f->obj = xbps_array_get(array, i);
+			xbps_dictionary_get_cstring_nocopy(f->obj, "file", &f->file);
 			/* skip noextract files */
-			if (xhp->noextract && xbps_patterns_match(xhp->noextract, file))
+			if (xhp->noextract && xbps_patterns_match(xhp->noextract, f->file))
 				continue;
-			path = xbps_xasprintf("%s/%s", xhp->rootdir, file);
-			xbps_dictionary_get_cstring_nocopy(obj,
-				"sha256", &sha256);
-			rv = xbps_file_sha256_check(path, sha256);
-			switch (rv) {
+			xbps_dictionary_get_cstring_nocopy(f->obj,
+				"sha256", &f->sha256);
+			f->path = xbps_xasprintf("%s/%s", xhp->rootdir, f->file);
+			if (stat(f->path, &f->st) == -1)
+				f->rv = errno;
+			else if (verify_cache_lookup(f->path, &f->st, f->sha256))
+				f->rv = 0;
+			else
+				f->rv = EAGAIN;
+			nfiles++;
+		}
+		if (hash_pkg_files(files, nfiles, jobs) < 0) {
+			for (i = 0; i < nfiles; i++)
+				free(files[i].path);
+			free(files);
+			return -1;
+		}
+
+		for (i = 0; i < nfiles; i++) {
+			struct pkg_file *f = &files[i];
+
+			switch (f->rv) {
 			case 0:
-				free(path);
 				break;
 			case ENOENT:
 				xbps_error_printf("%s: unexistent file %s.\n",
-				    pkgname, file);
-				free(path);
+				    pkgname, f->file);
 				test_broken = true;
 				break;
 			case ERANGE:
 				mutable = false;
-				xbps_dictionary_get_bool(obj,
+				xbps_dictionary_get_bool(f->obj,
 				    "mutable", &mutable);
 				if (!mutable) {
 					xbps_error_printf("%s: hash mismatch "
-					    "for %s.\n", pkgname, file);
+					    "for %s.\n", pkgname, f->file);
 					test_broken = true;
 				}
-				free(path);
 				break;
 			default:
 				xbps_error_printf(
 				    "%s: can't check `%s' (%s)\n",
-				    pkgname, file, strerror(rv));
-				free(path);
+				    pkgname, f->file, strerror(f->rv));
 				break;
 			}
-                }
-                xbps_object_iterator_release(iter);
+			free(f->path);
+		}
+		free(files);
 	}
 	if (test_broken) {
 		xbps_error_printf("%s: files check FAILED.\n", pkgname);
@@ -26,6 +26,7 @@
 #ifndef _XBPS_PKGDB_DEFS_H_
 #define _XBPS_PKGDB_DEFS_H_
 
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <xbps.h>
 
@@ -37,13 +38,14 @@ enum {
 };
 
 /* from check.c */
-int check_pkg(struct xbps_handle *, xbps_dictionary_t, const char *, unsigned);
-int check_all(struct xbps_handle *, unsigned);
+int check_pkg(struct xbps_handle *, xbps_dictionary_t, const char *, unsigned,
+    unsigned int);
+int check_all(struct xbps_handle *, unsigned, unsigned int);
 
 int check_pkg_unneeded(
     struct xbps_handle *xhp, const char *pkgname, xbps_dictionary_t pkgd);
-int check_pkg_files(
-    struct xbps_handle *xhp, const char *pkgname, xbps_dictionary_t filesd);
+int check_pkg_files(struct xbps_handle *xhp, const char *pkgname,
+    xbps_dictionary_t filesd, unsigned int jobs);
 int check_pkg_symlinks(
     struct xbps_handle *xhp, const char *pkgname, xbps_dictionary_t filesd);
 int check_pkg_rundeps(
@@ -53,6 +55,13 @@ int check_pkg_alternatives(
 
 int get_checks_to_run(unsigned *, char *);
 
+/* from verify_cache.c */
+int verify_cache_load(struct xbps_handle *, bool);
+bool verify_cache_lookup(const char *, const struct stat *, const char *);
+void verify_cache_add(const char *, const struct stat *, const char *);
+int verify_cache_flush(struct xbps_handle *, bool);
+void verify_cache_free(void);
+
 /* from convert.c */
 void	convert_pkgdb_format(struct xbps_handle *);
 
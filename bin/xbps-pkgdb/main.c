@@ -45,7 +45,10 @@ usage(int status)
 	    "                                         Choose checks to run\n"
 	    " -C, --config <dir>                      Path to confdir (xbps.d)\n"
 	    " -d, --debug                             Debug mode shown to stderr\n"
+	    " --full                                  Hash all files, ignoring the\n"
+	    "                                         verification cache\n"
 	    " -h, --help                              Show usage\n"
+	    " -j, --jobs <N>                          Number of parallel jobs\n"
 	    " -m, --mode <auto|manual|hold|unhold|repolock|repounlock>\n"
 	    "                                         Change PKGNAME to this mode\n"
 	    " -r, --rootdir <dir>                     Full path to rootdir\n"
@@ -123,26 +126,29 @@ parse_checks(char *s)
 int
 main(int argc, char **argv)
 {
-	const char *shortopts = "aC:dhm:r:uVv";
+	const char *shortopts = "aC:dhj:m:r:uVv";
 	const struct option longopts[] = {
 		{ "all", no_argument, NULL, 'a' },
 		{ "config", required_argument, NULL, 'C' },
 		{ "debug", no_argument, NULL, 'd' },
 		{ "help", no_argument, NULL, 'h' },
+		{ "jobs", required_argument, NULL, 'j' },
 		{ "mode", required_argument, NULL, 'm' },
 		{ "rootdir", required_argument, NULL, 'r' },
 		{ "update", no_argument, NULL, 'u' },
 		{ "verbose", no_argument, NULL, 'v' },
 		{ "version", no_argument, NULL, 'V' },
 		{ "checks", required_argument, NULL, 0 },
+		{ "full", no_argument, NULL, 1 },
 		{ NULL, 0, NULL, 0 }
 	};
 	struct xbps_handle xh;
 	const char *confdir = NULL, *rootdir = NULL, *instmode = NULL;
 	int c, i, rv, flags = 0;
 	/* we want all checks to run if no checks are specified */
-	unsigned int checks = ~0U;
-	bool update_format = false, all = false;
+	unsigned int checks = ~0U, jobs = 0;
+	bool update_format = false, all = false, full = false;
+	long ncpu;
 
 	while ((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
 		switch (c) {
@@ -158,6 +164,13 @@ main(int argc, char **argv)
 		case 'h':
 			usage(EXIT_SUCCESS);
 			/* NOTREACHED */
+		case 'j':
+			jobs = (unsigned int)strtoul(optarg, NULL, 10);
+			if (jobs == 0) {
+				xbps_error_printf("invalid number of jobs: '%s'\n", optarg);
+				usage(EXIT_FAILURE);
+			}
+			break;
 		case 'm':
 			instmode = optarg;
 			break;
@@ -177,6 +190,9 @@ main(int argc, char **argv)
 		case 0:
 			checks = parse_checks(optarg);
 			break;
+		case 1:
+			full = true;
+			break;
 		case '?':
 		default:
 			usage(true);
@@ -188,6 +204,11 @@ main(int argc, char **argv)
 		/* NOTREACHED */
 	}
 
+	if (jobs == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = ncpu > 0 ? (unsigned int)ncpu : 1;
+	}
+
 	memset(&xh, 0, sizeof(xh));
 	if (rootdir)
 		xbps_strlcpy(xh.rootdir, rootdir, sizeof(xh.rootdir));
@@ -227,14 +248,22 @@ main(int argc, char **argv)
 			}
 		}
 	} else if (all) {
-		rv = check_all(&xh, checks);
+		if (checks & CHECK_FILES)
+			verify_cache_load(&xh, full);
+		rv = check_all(&xh, checks, jobs);
+		verify_cache_flush(&xh, true);
+		verify_cache_free();
 	} else {
+		if (checks & CHECK_FILES)
+			verify_cache_load(&xh, full);
 		for (i = optind; i < argc; i++) {
-			rv = check_pkg(&xh, NULL, argv[i], checks);
+			rv = check_pkg(&xh, NULL, argv[i], checks, jobs);
 			if (rv != 0)
 				fprintf(stderr, "Failed to check "
 				    "`%s'\n", argv[i]);
 		}
+		verify_cache_flush(&xh, false);
+		verify_cache_free();
 	}
 
 out:
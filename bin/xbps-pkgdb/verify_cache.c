@@ -0,0 +1,305 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xbps.h>
+#include "uthash.h"
+#include "defs.h"
+
+/*
+ * The verification cache records the files whose hash matched the files
+ * plist of their package, with the device, inode, size, mtime and ctime
+ * they had when they were hashed. A file with the same attributes and
+ * expected hash is not hashed again. The ctime cannot be set from user
+ * space, so a file modified after it was verified is always hashed.
+ *
+ * The cache is stored in the metadir, it is rewritten after the checks
+ * and only keeps the files that were seen by `xbps-pkgdb -a'.
+ */
+
+#define VERIFY_CACHE		"verify.cache"
+#define VERIFY_CACHE_MAGIC	"XBPSVCHK"
+#define VERIFY_CACHE_VERSION	1
+
+struct verify_cache_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t nentries;
+};
+
+struct verify_cache_rec {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+	char sha256[XBPS_SHA256_SIZE];
+	char pad[3];
+	uint32_t pathlen;
+};
+
+struct verify_entry {
+	struct verify_cache_rec rec;
+	bool seen;
+	UT_hash_handle hh;
+	char path[];
+};
+
+static struct verify_entry *entries;
+static pthread_mutex_t entries_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool loaded, dirty, ignore;
+
+static void
+rec_from_stat(struct verify_cache_rec *rec, const struct stat *st,
+		const char *sha256)
+{
+	memset(rec, 0, sizeof(*rec));
+	rec->dev = st->st_dev;
+	rec->ino = st->st_ino;
+	rec->size = st->st_size;
+	rec->mtime_sec = st->st_mtim.tv_sec;
+	rec->mtime_nsec = st->st_mtim.tv_nsec;
+	rec->ctime_sec = st->st_ctim.tv_sec;
+	rec->ctime_nsec = st->st_ctim.tv_nsec;
+	xbps_strlcpy(rec->sha256, sha256, sizeof(rec->sha256));
+}
+
+static struct verify_entry *
+entry_add(const struct verify_cache_rec *rec, const char *path, size_t pathlen)
+{
+	struct verify_entry *e, *old = NULL;
+
+	if ((e = malloc(sizeof(*e) + pathlen + 1)) == NULL)
+		return NULL;
+	e->rec = *rec;
+	e->rec.pathlen = pathlen;
+	e->seen = false;
+	memcpy(e->path, path, pathlen);
+	e->path[pathlen] = '\0';
+	HASH_REPLACE(hh, entries, path, pathlen, e, old);
+	free(old);
+	return e;
+}
+
+static char *
+cache_path(struct xbps_handle *xhp)
+{
+	return xbps_xasprintf("%s/%s", xhp->metadir, VERIFY_CACHE);
+}
+
+int
+verify_cache_load(struct xbps_handle *xhp, bool full)
+{
+	struct verify_cache_hdr hdr;
+	const char *p, *end;
+	char *path;
+	void *mf = NULL;
+	size_t mflen = 0, flen = 0;
+	int r = 0;
+
+	loaded = true;
+	/* a full check hashes every file and refreshes their entries */
+	ignore = full;
+
+	path = cache_path(xhp);
+	if (!xbps_mmap_file(path, &mf, &mflen, &flen)) {
+		r = -errno;
+		mf = NULL;
+		goto out;
+	}
+	if (flen < sizeof(hdr)) {
+		r = -EINVAL;
+		goto out;
+	}
+	memcpy(&hdr, mf, sizeof(hdr));
+	if (memcmp(hdr.magic, VERIFY_CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != VERIFY_CACHE_VERSION) {
+		r = -ESTALE;
+		goto out;
+	}
+	p = (const char *)mf + sizeof(hdr);
+	end = (const char *)mf + flen;
+	for (uint32_t i = 0; i < hdr.nentries; i++) {
+		struct verify_cache_rec rec;
+
+		if ((size_t)(end - p) < sizeof(rec)) {
+			r = -EINVAL;
+			break;
+		}
+		memcpy(&rec, p, sizeof(rec));
+		p += sizeof(rec);
+		if ((size_t)(end - p) < rec.pathlen ||
+		    rec.sha256[XBPS_SHA256_SIZE - 1] != '\0') {
+			r = -EINVAL;
+			break;
+		}
+		if (entry_add(&rec, p, rec.pathlen) == NULL) {
+			r = -errno;
+			break;
+		}
+		p += rec.pathlen;
+	}
+out:
+	if (r < 0) {
+		if (r != -ENOENT)
+			xbps_dbg_printf("[pkgdb] ignoring verification cache %s: %s\n",
+			    path, strerror(-r));
+		verify_cache_free();
+		loaded = true;
+		ignore = full;
+		/* rewrite it */
+		dirty = r != -ENOENT;
+	}
+	if (mf)
+		(void)munmap(mf, mflen);
+	free(path);
+	return r;
+}
+
+bool
+verify_cache_lookup(const char *path, const struct stat *st, const char *sha256)
+{
+	struct verify_cache_rec rec;
+	struct verify_entry *e;
+	bool found = false;
+
+	if (!loaded || ignore)
+		return false;
+
+	rec_from_stat(&rec, st, sha256);
+	pthread_mutex_lock(&entries_lock);
+	HASH_FIND(hh, entries, path, strlen(path), e);
+	if (e != NULL) {
+		rec.pathlen = e->rec.pathlen;
+		found = memcmp(&e->rec, &rec, sizeof(rec)) == 0;
+		e->seen = found;
+	}
+	pthread_mutex_unlock(&entries_lock);
+	return found;
+}
+
+void
+verify_cache_add(const char *path, const struct stat *st, const char *sha256)
+{
+	struct verify_cache_rec rec;
+	struct verify_entry *e;
+
+	if (!loaded)
+		return;
+
+	rec_from_stat(&rec, st, sha256);
+	pthread_mutex_lock(&entries_lock);
+	if ((e = entry_add(&rec, path, strlen(path))) != NULL)
+		e->seen = true;
+	dirty = true;
+	pthread_mutex_unlock(&entries_lock);
+}
+
+int
+verify_cache_flush(struct xbps_handle *xhp, bool prune)
+{
+	struct verify_cache_hdr hdr = { .version = VERIFY_CACHE_VERSION };
+	struct verify_entry *e, *tmp;
+	char *path, *tmppath;
+	FILE *fp;
+	int fd, r = 0;
+
+	if (!loaded)
+		return 0;
+	if (prune) {
+		HASH_ITER(hh, entries, e, tmp) {
+			if (e->seen)
+				continue;
+			HASH_DEL(entries, e);
+			free(e);
+			dirty = true;
+		}
+	}
+	if (!dirty)
+		return 0;
+
+	path = cache_path(xhp);
+	tmppath = xbps_xasprintf("%s.XXXXXX", path);
+	if ((fd = mkstemp(tmppath)) == -1) {
+		r = -errno;
+		goto out;
+	}
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		r = -errno;
+		close(fd);
+		unlink(tmppath);
+		goto out;
+	}
+	memcpy(hdr.magic, VERIFY_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.nentries = HASH_COUNT(entries);
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	HASH_ITER(hh, entries, e, tmp) {
+		fwrite(&e->rec, sizeof(e->rec), 1, fp);
+		fwrite(e->path, 1, e->rec.pathlen, fp);
+	}
+	if (fchmod(fd, 0644) == -1 || ferror(fp) || fflush(fp) == EOF ||
+	    fsync(fd) == -1)
+		r = errno ? -errno : -EIO;
+	if (fclose(fp) == EOF && r == 0)
+		r = -errno;
+	if (r == 0 && rename(tmppath, path) == -1)
+		r = -errno;
+	if (r < 0)
+		unlink(tmppath);
+	else
+		dirty = false;
+out:
+	if (r < 0)
+		xbps_warn_printf("failed to write verification cache %s: %s\n",
+		    path, strerror(-r));
+	free(tmppath);
+	free(path);
+	return r;
+}
+
+void
+verify_cache_free(void)
+{
+	struct verify_entry *e, *tmp;
+
+	HASH_ITER(hh, entries, e, tmp) {
+		HASH_DEL(entries, e);
+		free(e);
+	}
+	loaded = dirty = ignore = false;
+}
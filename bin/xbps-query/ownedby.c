@@ -39,10 +39,11 @@
 
 struct ffdata {
 	bool rematch;
-	const char *pat, *repouri;
+	const char *pat, *repouri, *exact;
 	regex_t regex;
 	xbps_array_t allkeys;
 	xbps_dictionary_t filesd;
+	xbps_dictionary_t repofiles;
 };
 
 static void
@@ -96,32 +97,34 @@ match_files_by_pattern(xbps_dictionary_t pkg_filesd,
 }
 
 static int
-ownedby_pkgdb_cb(struct xbps_handle *xhp,
-		xbps_object_t obj,
-		const char *obj_key UNUSED,
+ownedby_pkgdb_cb(struct xbps_handle *xhp UNUSED,
+		const struct xbps_pkg_file *f,
 		void *arg,
 		bool *done UNUSED)
 {
-	xbps_dictionary_t pkgmetad;
-	xbps_array_t files_keys;
 	struct ffdata *ffd = arg;
-	const char *pkgver = NULL;
-
-	(void)obj_key;
-	(void)done;
+	const char *typestr;
 
-	xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
-	pkgmetad = xbps_pkgdb_get_pkg_files(xhp, pkgver);
-	if (pkgmetad == NULL)
+	if (strcmp(f->type, "files") == 0)
+		typestr = "regular file";
+	else if (strcmp(f->type, "links") == 0)
+		typestr = "link";
+	else if (strcmp(f->type, "conf_files") == 0)
+		typestr = "configuration file";
+	else
 		return 0;
 
-	files_keys = xbps_dictionary_all_keys(pkgmetad);
-	for (unsigned int i = 0; i < xbps_array_count(files_keys); i++) {
-		match_files_by_pattern(pkgmetad,
-		    xbps_array_get(files_keys, i), ffd, pkgver);
+	if (ffd->rematch) {
+		if (regexec(&ffd->regex, f->file, 0, 0, 0) != 0)
+			return 0;
+	} else if (ffd->exact == NULL) {
+		if (fnmatch(ffd->pat, f->file, FNM_PERIOD) != 0)
+			return 0;
 	}
-	xbps_object_release(pkgmetad);
-	xbps_object_release(files_keys);
+	printf("%s: %s%s%s (%s)\n", f->pkgver, f->file,
+	    f->target ? " -> " : "",
+	    f->target ? f->target : "",
+	    typestr);
 
 	return 0;
 }
@@ -130,7 +133,7 @@ ownedby_pkgdb_cb(struct xbps_handle *xhp,
 static int
 repo_match_cb(struct xbps_handle *xhp,
 		xbps_object_t obj,
-		const char *key UNUSED,
+		const char *key,
 		void *arg,
 		bool *done UNUSED)
 {
@@ -138,11 +141,26 @@ repo_match_cb(struct xbps_handle *xhp,
 	xbps_dictionary_t filesd;
 	xbps_array_t files_keys;
 	struct ffdata *ffd = arg;
-	const char *pkgver = NULL;
+	const char *pkgver = NULL, *fpkgver = NULL;
 	int r;
 
-	xbps_dictionary_set_cstring_nocopy(obj, "repository", ffd->repouri);
 	xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
+	/*
+	 * Use the repository files index unless its entry is stale.
+	 */
+	filesd = xbps_dictionary_get(ffd->repofiles, key);
+	if (xbps_dictionary_get_cstring_nocopy(filesd, "pkgver", &fpkgver) &&
+	    strcmp(fpkgver, pkgver) == 0) {
+		files_keys = xbps_dictionary_all_keys(filesd);
+		for (unsigned int i = 0; i < xbps_array_count(files_keys); i++) {
+			match_files_by_pattern(filesd,
+			    xbps_array_get(files_keys, i), ffd, pkgver);
+		}
+		xbps_object_release(files_keys);
+		return 0;
+	}
+
+	xbps_dictionary_set_cstring_nocopy(obj, "repository", ffd->repouri);
 
 	r = xbps_pkg_path_or_url(xhp, bfile, sizeof(bfile), obj);
 	if (r < 0) {
@@ -174,9 +192,13 @@ repo_ownedby_cb(struct xbps_repo *repo, void *arg, bool *done UNUSED)
 	int rv;
 
 	ffd->repouri = repo->uri;
+	ffd->repofiles = xbps_repo_get_files(repo);
 	allkeys = xbps_dictionary_all_keys(repo->idx);
 	rv = xbps_array_foreach_cb_multi(repo->xhp, allkeys, repo->idx, repo_match_cb, ffd);
 	xbps_object_release(allkeys);
+	if (ffd->repofiles)
+		xbps_object_release(ffd->repofiles);
+	ffd->repofiles = NULL;
 
 	return rv;
 }
@@ -189,16 +211,22 @@ ownedby(struct xbps_handle *xhp, const char *pat, bool repo, bool regex)
 
 	ffd.rematch = false;
 	ffd.pat = pat;
+	ffd.exact = NULL;
+	ffd.repofiles = NULL;
 
 	if (regex) {
 		ffd.rematch = true;
 		if (regcomp(&ffd.regex, ffd.pat, REG_EXTENDED|REG_NOSUB|REG_ICASE) != 0)
 			return EINVAL;
 	}
-	if (repo)
+	if (repo) {
 		rv = xbps_rpool_foreach(xhp, repo_ownedby_cb, &ffd);
-	else
-		rv = xbps_pkgdb_foreach_cb(xhp, ownedby_pkgdb_cb, &ffd);
+	} else {
+		/* patterns without wildcards only match an exact path */
+		if (!regex && strpbrk(pat, "*?[\\") == NULL)
+			ffd.exact = pat;
+		rv = xbps_pkgdb_foreach_file(xhp, ffd.exact, ownedby_pkgdb_cb, &ffd);
+	}
 
 	if (regex)
 		regfree(&ffd.regex);
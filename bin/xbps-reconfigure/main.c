@@ -77,8 +77,17 @@ state_cb(const struct xbps_state_cb_data *xscd, void *cbd UNUSED)
 			syslog(LOG_NOTICE,
 			    "%s: configured successfully.", xscd->arg);
 		break;
+	case XBPS_STATE_TRIGGER:
+		printf("%s\n", xscd->desc);
+		break;
+	case XBPS_STATE_TRIGGERS_DONE:
+		printf("%s\n", xscd->desc);
+		if (slog)
+			syslog(LOG_NOTICE, "%s", xscd->desc);
+		break;
 	/* errors */
 	case XBPS_STATE_CONFIGURE_FAIL:
+	case XBPS_STATE_TRIGGER_FAIL:
 		xbps_error_printf("%s\n", xscd->desc);
 		if (slog)
 			syslog(LOG_ERR, "%s", xscd->desc);
@@ -110,7 +119,7 @@ main(int argc, char **argv)
 	};
 	struct xbps_handle xh;
 	const char *confdir = NULL, *rootdir = NULL;
-	int c, i, rv, flags = 0;
+	int c, i, rv, trv = 0, flags = 0;
 	bool all = false, rdeps = false, fulldeptree = false;
 	xbps_array_t ignpkgs = NULL, deps = NULL;
 
@@ -170,7 +179,8 @@ main(int argc, char **argv)
 	if (confdir)
 		xbps_strlcpy(xh.confdir, confdir, sizeof(xh.confdir));
 
-	xh.flags = flags;
+	/* the triggers are run once for all packages below */
+	xh.flags = flags | XBPS_FLAG_BATCH_TRIGGERS;
 
 	if ((rv = xbps_init(&xh)) != 0) {
 		xbps_error_printf("Failed to initialize libxbps: %s\n",
@@ -226,9 +236,14 @@ main(int argc, char **argv)
 				    "`%s': %s\n", pkg, strerror(rv));
 			}
 		}
+		if (rv == 0)
+			trv = xbps_configure_triggers(&xh);
 	}
-	if (rv == 0)
+	/* a failed trigger leaves the packages configured */
+	if (rv == 0) {
 		xbps_pkgdb_update(&xh, true, false);
+		rv = trv;
+	}
 
 	xbps_end(&xh);
 	exit(rv ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -30,12 +30,21 @@
 
 #define _XBPS_RINDEX		"xbps-rindex"
 
+#ifndef __arraycount
+# define __arraycount(a) (sizeof(a) / sizeof(*(a)))
+#endif
+
 /* From index-add.c */
-int	index_add(struct xbps_handle *, int, int, char **, bool, const char *);
+int	index_add(struct xbps_handle *, int, int, char **, bool, bool, bool,
+		const char *, unsigned int);
 
 /* From index-clean.c */
 int	index_clean(struct xbps_handle *, const char *, bool, const char *);
 
+/* From index-files.c */
+int	index_files(const char *, const char *, xbps_dictionary_t,
+		const char *, bool);
+
 /* From remove-obsoletes.c */
 int	remove_obsoletes(struct xbps_handle *, const char *);
 
@@ -47,6 +56,8 @@ int	sign_pkgs(struct xbps_handle *, int, int, char **, const char *, bool);
 /* From repoflush.c */
 int	repodata_flush(const char *repodir, const char *arch,
 		xbps_dictionary_t index, xbps_dictionary_t stage, xbps_dictionary_t meta,
-		const char *compression);
+		const char *compression, bool create_deltas);
+int	filesdata_flush(const char *repodir, const char *arch,
+		xbps_dictionary_t files, const char *compression);
 
 #endif /* !_XBPS_RINDEX_DEFS_H_ */
@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,7 +43,7 @@
 static int
 repodata_commit(const char *repodir, const char *repoarch,
 	xbps_dictionary_t index, xbps_dictionary_t stage, xbps_dictionary_t meta,
-	const char *compression)
+	const char *compression, bool deltas)
 {
 	xbps_object_iterator_t iter;
 	xbps_object_t keysym;
@@ -190,43 +191,208 @@ repodata_commit(const char *repodir, const char *repoarch,
 		stage = NULL;
 	}
 
-	r = repodata_flush(repodir, repoarch, index, stage, meta, compression);
+	r = repodata_flush(repodir, repoarch, index, stage, meta, compression,
+	    deltas);
 	xbps_object_release(usedshlibs);
 	xbps_object_release(oldshlibs);
 	return r;
 }
 
+/*
+ * Reading the metadata and hashing the binary packages is done by a pool
+ * of threads. Registering the packages in the stage is done in the order
+ * of the arguments, after all packages have been read.
+ */
+struct index_job {
+	const char *file;
+	xbps_dictionary_t binpkgd;
+	char sha256[XBPS_SHA256_SIZE];
+	uint64_t size;
+	/* negative errno if hashing failed */
+	int r;
+	bool hashed;
+};
+
+struct index_pool {
+	struct xbps_handle *xhp;
+	xbps_dictionary_t index;
+	xbps_dictionary_t stage;
+	struct index_job *jobs;
+	unsigned int njobs;
+	unsigned int next;
+	pthread_mutex_t lock;
+	bool force;
+};
+
+static xbps_dictionary_t
+registered_pkg(xbps_dictionary_t index, xbps_dictionary_t stage,
+		const char *pkgver, char *pkgname, size_t len)
+{
+	xbps_dictionary_t curpkgd;
+
+	if (!xbps_pkg_name(pkgname, len, pkgver))
+		return NULL;
+	curpkgd = xbps_dictionary_get(stage, pkgname);
+	if (!curpkgd)
+		curpkgd = xbps_dictionary_get(index, pkgname);
+	return curpkgd;
+}
+
+/*
+ * Returns true if the binary package is newer than the
+ * registered package `curpkgd'.
+ */
+static bool
+pkg_is_newer(xbps_dictionary_t binpkgd, xbps_dictionary_t curpkgd)
+{
+	const char *pkgver = NULL, *opkgver = NULL;
+	int cmp;
+
+	xbps_dictionary_get_cstring_nocopy(binpkgd, "pkgver", &pkgver);
+	xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &opkgver);
+
+	cmp = xbps_cmpver(pkgver, opkgver);
+	if (cmp < 0 && xbps_pkg_reverts(binpkgd, opkgver)) {
+		/*
+		 * If the considered package reverts the package in the index,
+		 * consider the current package as the newer one.
+		 */
+		cmp = 1;
+	} else if (cmp > 0 && xbps_pkg_reverts(curpkgd, pkgver)) {
+		/*
+		 * If package in the index reverts considered package, consider the
+		 * package in the index as the newer one.
+		 */
+		cmp = -1;
+	}
+	return cmp > 0;
+}
+
+static void
+index_job_hash(struct index_job *job)
+{
+	struct stat st;
+
+	job->hashed = true;
+	if (!xbps_file_sha256(job->sha256, sizeof(job->sha256), job->file) ||
+	    stat(job->file, &st) == -1) {
+		job->r = -errno;
+		return;
+	}
+	job->size = (uint64_t)st.st_size;
+}
+
+/*
+ * Reads the metadata of the binary package and hashes it, unless it
+ * is not going to be registered anyway.
+ */
+static void
+index_job_read(struct index_pool *pool, struct index_job *job)
+{
+	xbps_dictionary_t curpkgd;
+	char pkgname[XBPS_NAME_SIZE];
+	const char *arch = NULL, *pkgver = NULL;
+
+	job->binpkgd = xbps_archive_fetch_plist(job->file, "/props.plist");
+	if (!job->binpkgd)
+		return;
+	xbps_dictionary_get_cstring_nocopy(job->binpkgd, "architecture", &arch);
+	xbps_dictionary_get_cstring_nocopy(job->binpkgd, "pkgver", &pkgver);
+	if (!xbps_pkg_arch_match(pool->xhp, arch, NULL) || pkgver == NULL)
+		return;
+
+	/*
+	 * The stage only gets newer packages while merging, if this one
+	 * is not newer than the registered package it is skipped.
+	 */
+	curpkgd = registered_pkg(pool->index, pool->stage, pkgver,
+	    pkgname, sizeof(pkgname));
+	if (curpkgd && !pool->force && !pkg_is_newer(job->binpkgd, curpkgd))
+		return;
+
+	index_job_hash(job);
+}
+
+static void *
+index_pool_worker(void *arg)
+{
+	struct index_pool *pool = arg;
+	struct index_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		if (pool->next == pool->njobs) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		index_job_read(pool, job);
+	}
+	return NULL;
+}
+
+static void
+index_pool_run(struct index_pool *pool, unsigned int nthreads)
+{
+	pthread_t *thds;
+	unsigned int i;
+	int r;
+
+	if (nthreads > pool->njobs)
+		nthreads = pool->njobs;
+	if ((thds = calloc(nthreads, sizeof(*thds))) == NULL)
+		nthreads = 0;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	for (i = 0; i < nthreads; i++) {
+		r = pthread_create(&thds[i], NULL, index_pool_worker, pool);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to create thread: %s\n", strerror(r));
+			break;
+		}
+	}
+	/* if we are unable to create any threads, just do single threaded. */
+	if (i == 0)
+		index_pool_worker(pool);
+	while (i > 0) {
+		r = pthread_join(thds[--i], NULL);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to wait on thread: %s\n", strerror(r));
+		}
+	}
+	pthread_mutex_destroy(&pool->lock);
+	free(thds);
+}
+
 static int
 index_add_pkg(struct xbps_handle *xhp, xbps_dictionary_t index, xbps_dictionary_t stage,
-		const char *file, bool force)
+		struct index_job *job, bool force)
 {
-	char sha256[XBPS_SHA256_SIZE];
 	char pkgname[XBPS_NAME_SIZE];
-	struct stat st;
 	const char *arch = NULL;
 	const char *pkgver = NULL;
-	xbps_dictionary_t binpkgd, curpkgd;
-	int r;
+	xbps_dictionary_t binpkgd = job->binpkgd, curpkgd;
 
 	/*
 	 * Read metadata props plist dictionary from binary package.
 	 */
-	binpkgd = xbps_archive_fetch_plist(file, "/props.plist");
 	if (!binpkgd) {
 		xbps_error_printf("index: failed to read %s metadata for "
-		    "`%s', skipping!\n", XBPS_PKGPROPS, file);
+		    "`%s', skipping!\n", XBPS_PKGPROPS, job->file);
 		return 0;
 	}
 	xbps_dictionary_get_cstring_nocopy(binpkgd, "architecture", &arch);
 	xbps_dictionary_get_cstring_nocopy(binpkgd, "pkgver", &pkgver);
 	if (!xbps_pkg_arch_match(xhp, arch, NULL)) {
 		fprintf(stderr, "index: ignoring %s, unmatched arch (%s)\n", pkgver, arch);
-		goto out;
-	}
-	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
-		r = -EINVAL;
-		goto err;
+		return 0;
 	}
+	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+		return -EINVAL;
 
 	/*
 	 * Check if this package exists already in the index, but first
@@ -234,45 +400,20 @@ index_add_pkg(struct xbps_handle *xhp, xbps_dictionary_t index, xbps_dictionary_
 	 * than current registered package, update the index; otherwise
 	 * pass to the next one.
 	 */
-	curpkgd = xbps_dictionary_get(stage, pkgname);
-	if (!curpkgd)
-		curpkgd = xbps_dictionary_get(index, pkgname);
-
-	if (curpkgd && !force) {
-		const char *opkgver = NULL, *oarch = NULL;
-		int cmp;
-
-		xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &opkgver);
-		xbps_dictionary_get_cstring_nocopy(curpkgd, "architecture", &oarch);
-
-		cmp = xbps_cmpver(pkgver, opkgver);
-		if (cmp < 0 && xbps_pkg_reverts(binpkgd, opkgver)) {
-			/*
-			 * If the considered package reverts the package in the index,
-			 * consider the current package as the newer one.
-			 */
-			cmp = 1;
-		} else if (cmp > 0 && xbps_pkg_reverts(curpkgd, pkgver)) {
-			/*
-			 * If package in the index reverts considered package, consider the
-			 * package in the index as the newer one.
-			 */
-			cmp = -1;
-		}
-		if (cmp <= 0) {
-			fprintf(stderr, "index: skipping `%s' (%s), already registered.\n", pkgver, arch);
-			goto out;
-		}
+	curpkgd = registered_pkg(index, stage, pkgver, pkgname, sizeof(pkgname));
+	if (curpkgd && !force && !pkg_is_newer(binpkgd, curpkgd)) {
+		fprintf(stderr, "index: skipping `%s' (%s), already registered.\n", pkgver, arch);
+		return 0;
 	}
 
-	if (!xbps_file_sha256(sha256, sizeof(sha256), file))
-		goto err_errno;
-	if (!xbps_dictionary_set_cstring(binpkgd, "filename-sha256", sha256))
-		goto err_errno;
-	if (stat(file, &st) == -1)
-		goto err_errno;
-	if (!xbps_dictionary_set_uint64(binpkgd, "filename-size", (uint64_t)st.st_size))
-		goto err_errno;
+	if (!job->hashed)
+		index_job_hash(job);
+	if (job->r < 0)
+		return job->r;
+	if (!xbps_dictionary_set_cstring(binpkgd, "filename-sha256", job->sha256))
+		return -errno;
+	if (!xbps_dictionary_set_uint64(binpkgd, "filename-size", job->size))
+		return -errno;
 
 	xbps_dictionary_remove(binpkgd, "pkgname");
 	xbps_dictionary_remove(binpkgd, "version");
@@ -282,20 +423,58 @@ index_add_pkg(struct xbps_handle *xhp, xbps_dictionary_t index, xbps_dictionary_
 	 * Add new pkg dictionary into the stage index
 	 */
 	if (!xbps_dictionary_set(stage, pkgname, binpkgd))
-		goto err_errno;
+		return -errno;
 
-out:
-	xbps_object_release(binpkgd);
 	return 0;
-err_errno:
-	r = -errno;
-err:
-	xbps_object_release(binpkgd);
+}
+
+static int
+index_add_pkgs(struct xbps_handle *xhp, xbps_dictionary_t index, xbps_dictionary_t stage,
+		int args, int argc, char **argv, bool force, unsigned int nthreads)
+{
+	struct index_pool pool = { 0 };
+	unsigned int i;
+	int r = 0;
+	bool parallel;
+
+	pool.xhp = xhp;
+	pool.index = index;
+	pool.stage = stage;
+	pool.force = force;
+	pool.njobs = (unsigned int)(argc - args);
+	if ((pool.jobs = calloc(pool.njobs, sizeof(*pool.jobs))) == NULL)
+		return -errno;
+	for (i = 0; i < pool.njobs; i++)
+		pool.jobs[i].file = argv[args + i];
+
+	parallel = nthreads > 1 && pool.njobs > 1;
+	if (parallel) {
+		xbps_dbg_printf("index: reading packages with %u jobs.\n", nthreads);
+		index_pool_run(&pool, nthreads);
+	}
+
+	for (i = 0; i < pool.njobs; i++) {
+		struct index_job *job = &pool.jobs[i];
+
+		/*
+		 * Without threads the packages are read one by one, only
+		 * packages to be registered are hashed by index_add_pkg().
+		 */
+		if (!parallel && r == 0)
+			job->binpkgd = xbps_archive_fetch_plist(job->file,
+			    "/props.plist");
+		if (r == 0)
+			r = index_add_pkg(xhp, index, stage, job, force);
+		if (job->binpkgd)
+			xbps_object_release(job->binpkgd);
+	}
+	free(pool.jobs);
 	return r;
 }
 
 int
-index_add(struct xbps_handle *xhp, int args, int argc, char **argv, bool force, const char *compression)
+index_add(struct xbps_handle *xhp, int args, int argc, char **argv, bool force,
+		bool files, bool deltas, const char *compression, unsigned int nthreads)
 {
 	xbps_dictionary_t index, stage, meta;
 	struct xbps_repo *repo;
@@ -332,19 +511,24 @@ index_add(struct xbps_handle *xhp, int args, int argc, char **argv, bool force,
 		meta = NULL;
 	}
 
-	for (int i = args; i < argc; i++) {
-		r = index_add_pkg(xhp, index, stage, argv[i], force);
-		if (r < 0)
-			goto err2;
-	}
+	r = index_add_pkgs(xhp, index, stage, args, argc, argv, force, nthreads);
+	if (r < 0)
+		goto err2;
 
-	r = repodata_commit(repodir, repoarch, index, stage, meta, compression);
+	r = repodata_commit(repodir, repoarch, index, stage, meta, compression,
+	    deltas);
 	if (r < 0) {
 		xbps_error_printf("failed to write repodata: %s\n", strerror(-r));
 		goto err2;
 	}
 	printf("index: %u packages registered.\n", xbps_dictionary_count(index));
 
+	r = index_files(repodir, repoarch, index, compression, files);
+	if (r < 0) {
+		xbps_error_printf("failed to write files index: %s\n", strerror(-r));
+		goto err2;
+	}
+
 	xbps_object_release(index);
 	xbps_object_release(stage);
 	if (meta)
@@ -134,7 +134,8 @@ cleanup_repo(struct xbps_handle *xhp, const char *repodir, struct xbps_repo *rep
 		return 0;
 	}
 
-	r = repodata_flush(repodir, repoarch, index, stage, repo->idxmeta, compression);
+	r = repodata_flush(repodir, repoarch, index, stage, repo->idxmeta,
+	    compression, false);
 	if (r < 0) {
 		xbps_error_printf("failed to write repodata: %s\n", strerror(-r));
 		xbps_object_release(index);
@@ -143,9 +144,12 @@ cleanup_repo(struct xbps_handle *xhp, const char *repodir, struct xbps_repo *rep
 	}
 	printf("stage: %u packages registered.\n", xbps_dictionary_count(stage));
 	printf("index: %u packages registered.\n", xbps_dictionary_count(index));
+	r = index_files(repodir, repoarch, index, compression, false);
+	if (r < 0)
+		xbps_error_printf("failed to write files index: %s\n", strerror(-r));
 	xbps_object_release(index);
 	xbps_object_release(stage);
-	return 0;
+	return r;
 }
 
 /*
@@ -0,0 +1,164 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xbps.h>
+#include "defs.h"
+
+/*
+ * The files index contains the files.plist of every package in the
+ * repository index, keyed by pkgname and reduced to the "file" and
+ * "target" objects of files, links and configuration files. The
+ * "pkgver" and "filename-sha256" of the binary package are recorded to
+ * find out stale entries.
+ */
+static const char *const filekeys[] = { "conf_files", "files", "links" };
+
+static xbps_dictionary_t
+files_from_binpkg(const char *repodir, xbps_dictionary_t pkgd)
+{
+	xbps_dictionary_t filesd, d;
+	const char *pkgver = NULL, *arch = NULL, *sha256 = NULL;
+	char path[PATH_MAX];
+	int r;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	xbps_dictionary_get_cstring_nocopy(pkgd, "architecture", &arch);
+	xbps_dictionary_get_cstring_nocopy(pkgd, "filename-sha256", &sha256);
+
+	r = snprintf(path, sizeof(path), "%s/%s.%s.xbps", repodir, pkgver, arch);
+	if (r < 0 || (size_t)r >= sizeof(path))
+		return NULL;
+	if ((filesd = xbps_archive_fetch_plist(path, "/files.plist")) == NULL) {
+		xbps_warn_printf("files: failed to read %s from `%s', skipping!\n",
+		    XBPS_PKGFILES, path);
+		return NULL;
+	}
+	if ((d = xbps_dictionary_create()) == NULL)
+		goto out;
+	xbps_dictionary_set_cstring(d, "pkgver", pkgver);
+	if (sha256)
+		xbps_dictionary_set_cstring(d, "filename-sha256", sha256);
+
+	for (unsigned int i = 0; i < __arraycount(filekeys); i++) {
+		xbps_array_t array, files;
+
+		array = xbps_dictionary_get(filesd, filekeys[i]);
+		if (!xbps_array_count(array))
+			continue;
+		files = xbps_array_create_with_capacity(xbps_array_count(array));
+		for (unsigned int j = 0; j < xbps_array_count(array); j++) {
+			xbps_dictionary_t obj, f;
+			const char *file = NULL, *target = NULL;
+
+			obj = xbps_array_get(array, j);
+			if (!xbps_dictionary_get_cstring_nocopy(obj, "file", &file))
+				continue;
+			xbps_dictionary_get_cstring_nocopy(obj, "target", &target);
+			f = xbps_dictionary_create_with_capacity(2);
+			xbps_dictionary_set_cstring(f, "file", file);
+			if (target)
+				xbps_dictionary_set_cstring(f, "target", target);
+			xbps_array_add(files, f);
+			xbps_object_release(f);
+		}
+		xbps_dictionary_set(d, filekeys[i], files);
+		xbps_object_release(files);
+	}
+out:
+	xbps_object_release(filesd);
+	return d;
+}
+
+int
+index_files(const char *repodir, const char *arch, xbps_dictionary_t index,
+		const char *compression, bool create)
+{
+	xbps_dictionary_t files, ofiles = NULL;
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	char path[PATH_MAX];
+	int r;
+
+	r = snprintf(path, sizeof(path), "%s/%s-files", repodir, arch);
+	if (r < 0 || (size_t)r >= sizeof(path))
+		return -ENAMETOOLONG;
+	if (access(path, F_OK) == 0)
+		ofiles = xbps_archive_fetch_plist(path, XBPS_REPODATA_FILES);
+	else if (!create)
+		return 0;
+
+	if ((files = xbps_dictionary_create()) == NULL) {
+		r = -errno;
+		goto out;
+	}
+	iter = xbps_dictionary_iterator(index);
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		xbps_dictionary_t pkgd, opkgd, d;
+		const char *pkgname, *pkgver = NULL, *sha256 = NULL;
+		const char *opkgver = NULL, *osha256 = NULL;
+
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		pkgd = xbps_dictionary_get_keysym(index, keysym);
+		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+		xbps_dictionary_get_cstring_nocopy(pkgd, "filename-sha256", &sha256);
+
+		opkgd = xbps_dictionary_get(ofiles, pkgname);
+		xbps_dictionary_get_cstring_nocopy(opkgd, "pkgver", &opkgver);
+		xbps_dictionary_get_cstring_nocopy(opkgd, "filename-sha256", &osha256);
+		if (opkgver && strcmp(opkgver, pkgver) == 0 &&
+		    (sha256 == NULL || (osha256 && strcmp(osha256, sha256) == 0))) {
+			xbps_dictionary_set(files, pkgname, opkgd);
+			continue;
+		}
+		if ((d = files_from_binpkg(repodir, pkgd)) == NULL)
+			continue;
+		xbps_dictionary_set(files, pkgname, d);
+		xbps_object_release(d);
+	}
+	xbps_object_iterator_release(iter);
+
+	if (ofiles && xbps_dictionary_equals(files, ofiles)) {
+		r = 0;
+		goto out;
+	}
+	r = filesdata_flush(repodir, arch, files, compression);
+	if (r == 0)
+		printf("files: %u packages registered.\n",
+		    xbps_dictionary_count(files));
+out:
+	if (files)
+		xbps_object_release(files);
+	if (ofiles)
+		xbps_object_release(ofiles);
+	return r;
+}
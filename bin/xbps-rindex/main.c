@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
+#include <unistd.h>
 
 #include "defs.h"
 
@@ -40,10 +41,13 @@ usage(bool fail)
 	    " -d, --debug                        Debug mode shown to stderr\n"
 	    " -f, --force                        Force mode to overwrite entry in add mode\n"
 	    " -h, --help                         Show usage\n"
+	    " -j, --jobs <N>                     Number of packages read in parallel in add mode\n"
 	    " -v, --verbose                      Verbose messages\n"
 	    " -V, --version                      Show XBPS version\n"
 	    " -C, --hashcheck                    Consider file hashes for cleaning up packages\n"
 	    "     --compression <fmt>            Compression format: none, gzip, bzip2, lz4, xz, zstd (default)\n"
+	    "     --deltas                       Publish repodata deltas in add mode\n"
+	    "     --files                        Generate the files index in add mode\n"
 	    "     --privkey <key>                Path to the private key for signing\n"
 	    "     --signedby <string>            Signature details, i.e \"name <email>\"\n\n"
 	    "MODE\n"
@@ -58,13 +62,14 @@ usage(bool fail)
 int
 main(int argc, char **argv)
 {
-	const char *shortopts = "acdfhrsCSVv";
+	const char *shortopts = "acdfhj:rsCSVv";
 	struct option longopts[] = {
 		{ "add", no_argument, NULL, 'a' },
 		{ "clean", no_argument, NULL, 'c' },
 		{ "debug", no_argument, NULL, 'd' },
 		{ "force", no_argument, NULL, 'f' },
 		{ "help", no_argument, NULL, 'h' },
+		{ "jobs", required_argument, NULL, 'j' },
 		{ "remove-obsoletes", no_argument, NULL, 'r' },
 		{ "version", no_argument, NULL, 'V' },
 		{ "verbose", no_argument, NULL, 'v' },
@@ -74,17 +79,23 @@ main(int argc, char **argv)
 		{ "sign-pkg", no_argument, NULL, 'S'},
 		{ "hashcheck", no_argument, NULL, 'C' },
 		{ "compression", required_argument, NULL, 2},
+		{ "files", no_argument, NULL, 3},
+		{ "deltas", no_argument, NULL, 4},
 		{ NULL, 0, NULL, 0 }
 	};
 	struct xbps_handle xh;
 	const char *compression = NULL;
 	const char *privkey = NULL, *signedby = NULL;
 	int rv, c, flags = 0;
+	long ncpu;
+	unsigned int jobs;
 	bool add_mode, clean_mode, rm_mode, sign_mode, sign_pkg_mode, force,
-			 hashcheck;
+			 hashcheck, files, deltas;
 
 	add_mode = clean_mode = rm_mode = sign_mode = sign_pkg_mode = force =
-		hashcheck = false;
+		hashcheck = files = deltas = false;
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	jobs = ncpu > 0 ? (unsigned int)ncpu : 1;
 
 	while ((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1) {
 		switch (c) {
@@ -97,6 +108,12 @@ main(int argc, char **argv)
 		case 2:
 			compression = optarg;
 			break;
+		case 3:
+			files = true;
+			break;
+		case 4:
+			deltas = true;
+			break;
 		case 'a':
 			add_mode = true;
 			break;
@@ -112,6 +129,13 @@ main(int argc, char **argv)
 		case 'h':
 			usage(false);
 			/* NOTREACHED */
+		case 'j':
+			jobs = (unsigned int)strtoul(optarg, NULL, 10);
+			if (jobs == 0) {
+				xbps_error_printf("invalid number of jobs: %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'r':
 			rm_mode = true;
 			break;
@@ -160,7 +184,8 @@ main(int argc, char **argv)
 	}
 
 	if (add_mode)
-		rv = index_add(&xh, optind, argc, argv, force, compression);
+		rv = index_add(&xh, optind, argc, argv, force, files, deltas,
+		    compression, jobs);
 	else if (clean_mode)
 		rv = index_clean(&xh, argv[optind], hashcheck, compression);
 	else if (rm_mode)
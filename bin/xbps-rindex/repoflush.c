@@ -36,6 +36,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <archive.h>
 #include <archive_entry.h>
@@ -44,6 +45,12 @@
 
 #include "defs.h"
 
+/*
+ * Number of deltas kept in the deltas archive, clients more
+ * changes behind fetch the whole repodata.
+ */
+#define DELTAS_MAX	32
+
 static struct archive *
 open_archive(int fd, const char *compression)
 {
@@ -130,28 +137,16 @@ archive_dict(struct archive *ar, const char *filename, xbps_dictionary_t dict)
 	return r;
 }
 
-int
-repodata_flush(const char *repodir,
-		const char *arch,
-		xbps_dictionary_t index,
-		xbps_dictionary_t stage,
-		xbps_dictionary_t meta,
-		const char *compression)
+static int
+archive_flush(const char *path, const char *const names[],
+		xbps_dictionary_t dicts[], size_t ndicts, const char *compression)
 {
-	char path[PATH_MAX];
 	char tmp[PATH_MAX];
 	struct archive *ar = NULL;
 	mode_t prevumask;
 	int r;
 	int fd;
 
-	r = snprintf(path, sizeof(path), "%s/%s-repodata", repodir, arch);
-	if (r < 0 || (size_t)r >= sizeof(tmp)) {
-		xbps_error_printf("repodata path too long: %s: %s\n", path,
-		    strerror(ENAMETOOLONG));
-		return -ENAMETOOLONG;
-	}
-
 	r = snprintf(tmp, sizeof(tmp), "%s.XXXXXXX", path);
 	if (r < 0 || (size_t)r >= sizeof(tmp)) {
 		xbps_error_printf("repodata tmp path too long: %s: %s\n", path,
@@ -175,15 +170,11 @@ repodata_flush(const char *repodir,
 		goto err;
 	}
 
-	r = archive_dict(ar, XBPS_REPODATA_INDEX, index);
-	if (r < 0)
-		goto err;
-	r = archive_dict(ar, XBPS_REPODATA_META, meta);
-	if (r < 0)
-		goto err;
-	r = archive_dict(ar, XBPS_REPODATA_STAGE, stage);
-	if (r < 0)
-		goto err;
+	for (size_t i = 0; i < ndicts; i++) {
+		r = archive_dict(ar, names[i], dicts[i]);
+		if (r < 0)
+			goto err;
+	}
 
 	/* Write data to tempfile and rename */
 	if (archive_write_close(ar) == ARCHIVE_FATAL) {
@@ -234,3 +225,299 @@ err:
 	unlink(tmp);
 	return r;
 }
+
+/*
+ * Reads the index of the repodata archive at `path', which is written
+ * as an empty entry if the index is empty.
+ */
+static xbps_dictionary_t
+read_index(const char *path)
+{
+	xbps_dictionary_t index;
+	char *buf;
+
+	errno = 0;
+	if ((buf = xbps_archive_fetch_file(path, XBPS_REPODATA_INDEX)) == NULL)
+		return NULL;
+	if (*buf == '\0')
+		index = xbps_dictionary_create();
+	else
+		index = xbps_dictionary_internalize(buf);
+	free(buf);
+	return index;
+}
+
+/*
+ * A delta holds the packages added or changed in the index, the names
+ * of packages removed from it, and the whole stage and metadata.
+ */
+static xbps_dictionary_t
+index_delta(xbps_dictionary_t oindex, xbps_dictionary_t index,
+		xbps_dictionary_t stage, xbps_dictionary_t meta,
+		const char *from, const char *to)
+{
+	xbps_dictionary_t delta, changed;
+	xbps_array_t removed;
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+
+	delta = xbps_dictionary_create();
+	changed = xbps_dictionary_create();
+	removed = xbps_array_create();
+	if (!delta || !changed || !removed)
+		goto err;
+
+	iter = xbps_dictionary_iterator(index);
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		xbps_dictionary_t pkgd, opkgd;
+
+		pkgd = xbps_dictionary_get_keysym(index, keysym);
+		opkgd = xbps_dictionary_get_keysym(oindex, keysym);
+		if (opkgd && xbps_dictionary_equals(pkgd, opkgd))
+			continue;
+		if (!xbps_dictionary_set_keysym(changed, keysym, pkgd)) {
+			xbps_object_iterator_release(iter);
+			goto err;
+		}
+	}
+	xbps_object_iterator_release(iter);
+
+	iter = xbps_dictionary_iterator(oindex);
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		const char *pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+
+		if (xbps_dictionary_get(index, pkgname))
+			continue;
+		if (!xbps_array_add_cstring(removed, pkgname)) {
+			xbps_object_iterator_release(iter);
+			goto err;
+		}
+	}
+	xbps_object_iterator_release(iter);
+
+	if (!xbps_dictionary_set_cstring(delta, "from", from) ||
+	    !xbps_dictionary_set_cstring(delta, "to", to) ||
+	    !xbps_dictionary_set_uint32(delta, "index-count",
+	    xbps_dictionary_count(index)) ||
+	    !xbps_dictionary_set(delta, "index", changed) ||
+	    !xbps_dictionary_set(delta, "index-removed", removed))
+		goto err;
+	if (stage && !xbps_dictionary_set(delta, "stage", stage))
+		goto err;
+	if (meta && !xbps_dictionary_set(delta, "index-meta", meta))
+		goto err;
+
+	xbps_object_release(changed);
+	xbps_object_release(removed);
+	return delta;
+err:
+	if (delta)
+		xbps_object_release(delta);
+	if (changed)
+		xbps_object_release(changed);
+	if (removed)
+		xbps_object_release(removed);
+	errno = ENOMEM;
+	return NULL;
+}
+
+/*
+ * Publishes the delta from the repodata `from' to the repodata at
+ * `path' and updates the list of deltas `deltas' with the new head.
+ */
+static int
+deltas_flush(const char *repodir, const char *arch, const char *path,
+		xbps_dictionary_t deltas, const char *from, xbps_dictionary_t oindex,
+		xbps_dictionary_t index, xbps_dictionary_t stage, xbps_dictionary_t meta,
+		const char *compression)
+{
+	const char *const names[] = { XBPS_REPODATA_DELTAS };
+	const char *const dnames[] = { XBPS_REPODATA_DELTA };
+	char to[XBPS_SHA256_SIZE], file[PATH_MAX], dpath[PATH_MAX];
+	xbps_dictionary_t dicts[1];
+	xbps_array_t list;
+	struct stat st;
+	const char *head = NULL;
+	int r;
+
+	if (!xbps_file_sha256(to, sizeof(to), path) || stat(path, &st) == -1)
+		return -errno;
+
+	/* a repodata written without delta support breaks the chain */
+	list = xbps_dictionary_get(deltas, "deltas");
+	xbps_dictionary_get_cstring_nocopy(deltas, "head", &head);
+	if (list == NULL || head == NULL || from == NULL || strcmp(head, from) != 0) {
+		for (unsigned int i = 0; i < xbps_array_count(list); i++) {
+			const char *f = NULL;
+
+			xbps_dictionary_get_cstring_nocopy(xbps_array_get(list, i), "file", &f);
+			if (f && snprintf(dpath, sizeof(dpath), "%s/%s", repodir, f) < (int)sizeof(dpath))
+				unlink(dpath);
+		}
+		list = xbps_array_create();
+		if (!list || !xbps_dictionary_set(deltas, "deltas", list))
+			return -ENOMEM;
+		xbps_object_release(list);
+	}
+
+	if (from && oindex && strcmp(from, to) != 0) {
+		xbps_dictionary_t delta, entry;
+		struct stat dst;
+
+		r = snprintf(file, sizeof(file), "%s-repodata.%s.delta", arch, to);
+		if (r < 0 || (size_t)r >= sizeof(file))
+			return -ENAMETOOLONG;
+		r = snprintf(dpath, sizeof(dpath), "%s/%s", repodir, file);
+		if (r < 0 || (size_t)r >= sizeof(dpath))
+			return -ENAMETOOLONG;
+		if ((delta = index_delta(oindex, index, stage, meta, from, to)) == NULL)
+			return -errno;
+		dicts[0] = delta;
+		r = archive_flush(dpath, dnames, dicts, __arraycount(dicts), compression);
+		xbps_object_release(delta);
+		if (r < 0)
+			return r;
+		if (stat(dpath, &dst) == -1)
+			return -errno;
+
+		if ((entry = xbps_dictionary_create()) == NULL)
+			return -ENOMEM;
+		if (!xbps_dictionary_set_cstring(entry, "from", from) ||
+		    !xbps_dictionary_set_cstring(entry, "to", to) ||
+		    !xbps_dictionary_set_cstring(entry, "file", file) ||
+		    !xbps_dictionary_set_uint64(entry, "size", (uint64_t)dst.st_size) ||
+		    !xbps_array_add(list, entry)) {
+			xbps_object_release(entry);
+			return -ENOMEM;
+		}
+		xbps_object_release(entry);
+	}
+
+	/* drop the oldest deltas */
+	while (xbps_array_count(list) > DELTAS_MAX) {
+		const char *f = NULL;
+
+		xbps_dictionary_get_cstring_nocopy(xbps_array_get(list, 0), "file", &f);
+		if (f && snprintf(dpath, sizeof(dpath), "%s/%s", repodir, f) < (int)sizeof(dpath))
+			unlink(dpath);
+		xbps_array_remove(list, 0);
+	}
+
+	if (!xbps_dictionary_set_cstring(deltas, "head", to) ||
+	    !xbps_dictionary_set_uint64(deltas, "size", (uint64_t)st.st_size) ||
+	    !xbps_dictionary_set_int64(deltas, "mtime", (int64_t)st.st_mtime))
+		return -ENOMEM;
+
+	r = snprintf(dpath, sizeof(dpath), "%s/%s-repodata.deltas", repodir, arch);
+	if (r < 0 || (size_t)r >= sizeof(dpath))
+		return -ENAMETOOLONG;
+	dicts[0] = deltas;
+	return archive_flush(dpath, names, dicts, __arraycount(dicts), compression);
+}
+
+int
+repodata_flush(const char *repodir,
+		const char *arch,
+		xbps_dictionary_t index,
+		xbps_dictionary_t stage,
+		xbps_dictionary_t meta,
+		const char *compression,
+		bool create_deltas)
+{
+	const char *const names[] = {
+		XBPS_REPODATA_INDEX, XBPS_REPODATA_META, XBPS_REPODATA_STAGE,
+	};
+	xbps_dictionary_t dicts[] = { index, meta, stage };
+	xbps_dictionary_t deltas = NULL, oindex = NULL;
+	char path[PATH_MAX], dpath[PATH_MAX], from[XBPS_SHA256_SIZE];
+	bool have_from = false;
+	int r;
+
+	r = snprintf(path, sizeof(path), "%s/%s-repodata", repodir, arch);
+	if (r < 0 || (size_t)r >= sizeof(path)) {
+		xbps_error_printf("repodata path too long: %s: %s\n", path,
+		    strerror(ENAMETOOLONG));
+		return -ENAMETOOLONG;
+	}
+	r = snprintf(dpath, sizeof(dpath), "%s/%s-repodata.deltas", repodir, arch);
+	if (r < 0 || (size_t)r >= sizeof(dpath)) {
+		xbps_error_printf("repodata path too long: %s: %s\n", dpath,
+		    strerror(ENAMETOOLONG));
+		return -ENAMETOOLONG;
+	}
+
+	/*
+	 * Once created, the deltas are kept up to date. The deltas archive
+	 * is removed until the new repodata is written, so that clients
+	 * never take an outdated head as the current repodata.
+	 */
+	if (access(dpath, F_OK) == 0) {
+		deltas = xbps_archive_fetch_plist(dpath, XBPS_REPODATA_DELTAS);
+		if (unlink(dpath) == -1) {
+			r = -errno;
+			xbps_error_printf("failed to remove deltas: %s: %s\n",
+			    dpath, strerror(-r));
+			if (deltas)
+				xbps_object_release(deltas);
+			return r;
+		}
+		if (deltas == NULL)
+			deltas = xbps_dictionary_create();
+	} else if (create_deltas) {
+		deltas = xbps_dictionary_create();
+	}
+	if (deltas && access(path, F_OK) == 0) {
+		have_from = xbps_file_sha256(from, sizeof(from), path);
+		if (have_from && (oindex = read_index(path)) == NULL)
+			have_from = false;
+	}
+
+	r = archive_flush(path, names, dicts, __arraycount(dicts), compression);
+	if (r < 0)
+		goto out;
+
+	/* the binary index is optional, clients fall back to the repodata */
+	r = xbps_repo_index_write(path, index, stage, meta);
+	if (r < 0) {
+		xbps_warn_printf("failed to write binary index: %s.idx: %s\n",
+		    path, strerror(-r));
+	}
+	r = 0;
+
+	/* deltas are optional, clients fall back to the repodata */
+	if (deltas) {
+		int rv = deltas_flush(repodir, arch, path, deltas,
+		    have_from ? from : NULL, oindex, index, stage, meta,
+		    compression);
+		if (rv < 0) {
+			xbps_warn_printf("failed to write deltas: %s: %s\n",
+			    dpath, strerror(-rv));
+		}
+	}
+out:
+	if (deltas)
+		xbps_object_release(deltas);
+	if (oindex)
+		xbps_object_release(oindex);
+	return r;
+}
+
+int
+filesdata_flush(const char *repodir,
+		const char *arch,
+		xbps_dictionary_t files,
+		const char *compression)
+{
+	const char *const names[] = { XBPS_REPODATA_FILES };
+	xbps_dictionary_t dicts[] = { files };
+	char path[PATH_MAX];
+	int r;
+
+	r = snprintf(path, sizeof(path), "%s/%s-files", repodir, arch);
+	if (r < 0 || (size_t)r >= sizeof(path)) {
+		xbps_error_printf("files index path too long: %s: %s\n", path,
+		    strerror(ENAMETOOLONG));
+		return -ENAMETOOLONG;
+	}
+	return archive_flush(path, names, dicts, __arraycount(dicts), compression);
+}
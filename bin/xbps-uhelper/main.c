@@ -89,7 +89,7 @@ main(int argc, char **argv)
 {
 	xbps_dictionary_t dict;
 	struct xbps_handle xh;
-	struct xferstat xfer;
+	struct xferstat xfer = { 0 };
 	const char *version, *rootdir = NULL, *confdir = NULL;
 	char pkgname[XBPS_NAME_SIZE], *filename;
 	int flags = 0, c, rv = 0, i = 0;
@@ -85,25 +85,68 @@ xbps_dictionary_t HIDDEN xbps_find_pkg_in_array(xbps_array_t, const char *,
 xbps_dictionary_t HIDDEN xbps_find_virtualpkg_in_array(struct xbps_handle *,
 		xbps_array_t, const char *, xbps_trans_type_t);
 
+/* binpkg.c */
+struct xbps_binpkg {
+	struct archive *ar;
+	struct archive_entry *entry;	/* first payload entry not yet read */
+	xbps_data_t install;
+	xbps_data_t remove;
+	xbps_dictionary_t propsd;
+	xbps_dictionary_t filesd;
+	char *pkgver;
+	char *path;
+	off_t size;
+	/* protected by the cache lock */
+	unsigned int refs;
+	int fd;
+	bool eof;
+};
+int HIDDEN xbps_binpkg_open(struct xbps_handle *, xbps_dictionary_t,
+		xbps_state_t, struct xbps_binpkg **);
+int HIDDEN xbps_binpkg_next_entry(struct xbps_binpkg *,
+		struct archive_entry **);
+void HIDDEN xbps_binpkg_close(struct xbps_binpkg *);
+void HIDDEN xbps_binpkg_cache_put(struct xbps_binpkg *);
+struct xbps_binpkg HIDDEN *xbps_binpkg_cache_get(xbps_dictionary_t);
+struct xbps_binpkg HIDDEN *xbps_binpkg_cache_take(xbps_dictionary_t);
+void HIDDEN xbps_binpkg_cache_clear(void);
+
+/* transaction_pkgidx.c */
+struct xbps_pkgidx;
+struct xbps_pkgidx HIDDEN *xbps_pkgidx_create(xbps_array_t);
+void HIDDEN xbps_pkgidx_free(struct xbps_pkgidx *);
+xbps_array_t HIDDEN xbps_pkgidx_array(struct xbps_pkgidx *);
+bool HIDDEN xbps_pkgidx_add(struct xbps_pkgidx *, xbps_dictionary_t);
+void HIDDEN xbps_pkgidx_remove_last(struct xbps_pkgidx *);
+bool HIDDEN xbps_pkgidx_remove_pkgver(struct xbps_pkgidx *, const char *);
+xbps_dictionary_t HIDDEN xbps_pkgidx_find_pkg(struct xbps_pkgidx *,
+		const char *, xbps_trans_type_t);
+xbps_dictionary_t HIDDEN xbps_pkgidx_find_virtualpkg(struct xbps_handle *,
+		struct xbps_pkgidx *, const char *, xbps_trans_type_t);
+
 /* transaction */
 bool HIDDEN xbps_transaction_check_revdeps(struct xbps_handle *, xbps_array_t);
 bool HIDDEN xbps_transaction_check_shlibs(struct xbps_handle *, xbps_array_t);
 bool HIDDEN xbps_transaction_check_replaces(struct xbps_handle *, xbps_array_t);
 int HIDDEN xbps_transaction_check_conflicts(struct xbps_handle *, xbps_array_t);
-bool HIDDEN xbps_transaction_store(struct xbps_handle *, xbps_array_t, xbps_dictionary_t, bool);
+bool HIDDEN xbps_transaction_store(struct xbps_handle *, xbps_array_t,
+		struct xbps_pkgidx *, xbps_dictionary_t, bool);
 int HIDDEN xbps_transaction_init(struct xbps_handle *);
 int HIDDEN xbps_transaction_files(struct xbps_handle *,
 		xbps_object_iterator_t);
 int HIDDEN xbps_transaction_fetch(struct xbps_handle *,
 		xbps_object_iterator_t);
-int HIDDEN xbps_transaction_pkg_deps(struct xbps_handle *, xbps_array_t, xbps_dictionary_t);
+int HIDDEN xbps_transaction_pkg_deps(struct xbps_handle *, struct xbps_pkgidx *, xbps_dictionary_t);
 int HIDDEN xbps_transaction_internalize(struct xbps_handle *, xbps_object_iterator_t);
+int HIDDEN xbps_transaction_internalize_pkg(struct xbps_handle *, xbps_dictionary_t);
 
 char HIDDEN *xbps_get_remote_repo_string(const char *);
 int HIDDEN xbps_repo_sync(struct xbps_handle *, const char *);
+int HIDDEN xbps_repo_sync_files(struct xbps_handle *, const char *, const char *);
 int HIDDEN xbps_file_hash_check_dictionary(struct xbps_handle *,
 		xbps_dictionary_t, const char *, const char *);
 int HIDDEN xbps_file_exec(struct xbps_handle *, const char *, ...);
+int HIDDEN xbps_file_execv(struct xbps_handle *, const char **);
 void HIDDEN xbps_set_cb_fetch(struct xbps_handle *, off_t, off_t, off_t,
 		const char *, bool, bool, bool);
 int HIDDEN xbps_set_cb_state(struct xbps_handle *, xbps_state_t, int,
@@ -126,6 +169,100 @@ xbps_array_t HIDDEN xbps_get_pkg_fulldeptree(struct xbps_handle *,
 		const char *, bool);
 struct xbps_repo HIDDEN *xbps_regget_repo(struct xbps_handle *,
 		const char *);
+struct xbps_repo HIDDEN *xbps_repo_open_lazy(struct xbps_handle *,
+		const char *);
+int HIDDEN xbps_repo_load(struct xbps_repo *);
+int HIDDEN xbps_repo_index_update(struct xbps_handle *, const char *);
+struct xbps_repo_index HIDDEN *xbps_repo_index_open(const char *,
+		const char *, bool);
+void HIDDEN xbps_repo_index_close(struct xbps_repo_index *);
+int HIDDEN xbps_repo_index_meta(struct xbps_repo_index *, xbps_dictionary_t *);
+xbps_dictionary_t HIDDEN xbps_repo_index_get_pkg(struct xbps_handle *,
+		struct xbps_repo_index *, const char *);
+xbps_dictionary_t HIDDEN xbps_repo_index_get_virtualpkg(struct xbps_handle *,
+		struct xbps_repo_index *, const char *);
 int HIDDEN xbps_conf_init(struct xbps_handle *);
+int HIDDEN xbps_pkgdb_map_vpkg(struct xbps_handle *, const char *,
+		const char *, const char *);
+
+/* pkgdb_cache.c */
+struct xbps_pkgdb_stamp {
+	uint64_t size;
+	uint64_t ino;
+	int64_t mtime;
+	int64_t mtime_nsec;
+	unsigned char sha256[XBPS_SHA256_DIGEST_SIZE];
+};
+struct xbps_pkgdb_state {
+	/* set if the pkgdb in memory was loaded from the binary snapshot */
+	bool snapshot;
+	/* set if stamp identifies the plist the pkgdb in memory was read from */
+	bool stamped;
+	struct xbps_pkgdb_stamp stamp;
+	/* generation and packages of the pkgdb in sync with the storage */
+	uint64_t gen;
+	xbps_array_t keys;
+	/* end of the last valid journal record, 0 if there is no journal */
+	uint64_t journal_end;
+	/* identifies the journal in the snapshots that include its records */
+	uint64_t journal_id;
+	/* lib/files_index.c */
+	struct xbps_files_index *files_index;
+	/* lib/pkgdb_files.c */
+	struct xbps_staged_files *staged_files;
+	/* lib/package_triggers.c */
+	struct xbps_trigger *triggers;
+	/* lib/pkgdb_shlibs.c */
+	struct xbps_pkgdb_shlibs *shlibs;
+};
+int HIDDEN xbps_pkgdb_cache_load(struct xbps_handle *, uint64_t *);
+int HIDDEN xbps_pkgdb_cache_stamp(struct xbps_handle *, struct xbps_pkgdb_stamp *);
+int HIDDEN xbps_pkgdb_cache_write(struct xbps_handle *,
+		const struct xbps_pkgdb_stamp *);
+
+uint64_t HIDDEN xbps_pkgdb_journal_open(struct xbps_handle *);
+int HIDDEN xbps_pkgdb_journal_replay(struct xbps_handle *, uint64_t);
+uint64_t HIDDEN xbps_pkgdb_journal_size(struct xbps_handle *, uint64_t *);
+int HIDDEN xbps_pkgdb_journal_append(struct xbps_handle *, xbps_dictionary_t);
+void HIDDEN xbps_pkgdb_journal_remove(struct xbps_handle *);
+uint64_t HIDDEN xbps_generation(void);
+uint64_t HIDDEN xbps_object_generation(xbps_object_t);
+void HIDDEN xbps_files_index_invalidate(struct xbps_handle *);
+int HIDDEN xbps_files_index_flush(struct xbps_handle *);
+void HIDDEN xbps_files_index_stamp_pkgdb(struct xbps_handle *);
+int HIDDEN xbps_files_index_get_pkg_files(struct xbps_handle *, const char *,
+		xbps_dictionary_t, xbps_dictionary_t *);
+void HIDDEN xbps_files_index_release(struct xbps_handle *);
+int HIDDEN xbps_pkgdb_files_stage(struct xbps_handle *, const char *,
+		xbps_dictionary_t);
+int HIDDEN xbps_pkgdb_files_staged(struct xbps_handle *, const char *,
+		xbps_dictionary_t *);
+bool HIDDEN xbps_pkgdb_files_sha256(struct xbps_handle *, const char *,
+		char *, size_t);
+int HIDDEN xbps_pkgdb_files_flush(struct xbps_handle *);
+void HIDDEN xbps_pkgdb_files_unlink(struct xbps_handle *);
+void HIDDEN xbps_pkgdb_files_release(struct xbps_handle *);
+bool HIDDEN xbps_buffer_sha256(char *, size_t, const void *, size_t);
+struct xbps_sha256 HIDDEN *xbps_sha256_new(void);
+bool HIDDEN xbps_sha256_update(struct xbps_sha256 *, const void *, size_t);
+bool HIDDEN xbps_sha256_final(struct xbps_sha256 *, unsigned char *);
+void HIDDEN xbps_sha256_free(struct xbps_sha256 *);
+int HIDDEN xbps_pkgdb_shlibs_attach(struct xbps_handle *, void *, size_t,
+		const char *, size_t);
+int HIDDEN xbps_pkgdb_shlibs_write(struct xbps_handle *, FILE *);
+void HIDDEN xbps_pkgdb_shlibs_release(struct xbps_handle *);
+int HIDDEN xbps_pkgdb_shlibs_update(struct xbps_handle *, const char *,
+		xbps_dictionary_t, xbps_dictionary_t);
+int HIDDEN xbps_pkgdb_shlib_providers(struct xbps_handle *, const char *,
+		unsigned int *);
+int HIDDEN xbps_pkgdb_shlib_foreach_requirer(struct xbps_handle *,
+		const char *, int (*)(const char *, void *), void *);
+int HIDDEN xbps_pkgdb_shlibs_foreach_unresolved(struct xbps_handle *,
+		int (*)(const char *, void *), void *);
+int HIDDEN xbps_triggers_add(struct xbps_handle *, xbps_dictionary_t);
+int HIDDEN xbps_configure_pkg_batch(struct xbps_handle *, const char *, bool,
+		bool);
+int HIDDEN xbps_configure_pkgs(struct xbps_handle *, xbps_array_t, bool, bool);
+void HIDDEN xbps_triggers_release(struct xbps_handle *);
 
 #endif /* !_XBPS_API_IMPL_H_ */
@@ -0,0 +1,328 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "xbps_api_impl.h"
+
+/*
+ * Binary packages start with their metadata entries:
+ *
+ * 	- INSTALL	<optional>
+ * 	- REMOVE 	<optional>
+ * 	- props.plist	<required>
+ * 	- files.plist	<required>
+ *
+ * followed by the payload. A struct xbps_binpkg is an open package whose
+ * metadata has been decoded, positioned at the first payload entry.
+ *
+ * The transaction opens every binary package once to internalize its
+ * metadata. The handles of the biggest packages, for which reading the
+ * metadata again is the most expensive, are kept in a cache until the
+ * files of the transaction are collected and the package is unpacked
+ * from the same stream. Every other handle is closed and its package
+ * opened again when needed. xbps_binpkg_cache_get() returns a handle
+ * with a reference, dropped by xbps_binpkg_close(), so that it is not
+ * freed when evicted while still in use.
+ */
+#define BINPKG_CACHE_MAX	8
+
+static struct xbps_binpkg *cache[BINPKG_CACHE_MAX];
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+binpkg_get_data(struct archive *ar, struct archive_entry *entry,
+		xbps_data_t *datap)
+{
+	char *buf;
+	int64_t entry_size = archive_entry_size(entry);
+
+	/* empty scripts are ignored */
+	if (entry_size == 0)
+		return 0;
+	if ((buf = xbps_archive_get_file(ar, entry)) == NULL)
+		return -errno;
+	*datap = xbps_data_create_data(buf, entry_size);
+	free(buf);
+	if (*datap == NULL)
+		return -errno;
+	return 0;
+}
+
+int HIDDEN
+xbps_binpkg_open(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
+		xbps_state_t failstate, struct xbps_binpkg **bpp)
+{
+	char path[PATH_MAX];
+	struct xbps_binpkg *bp;
+	struct archive_entry *entry;
+	struct stat st;
+	const char *pkgver;
+	ssize_t l;
+	int rv = 0;
+
+	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
+	assert(pkgver);
+
+	l = xbps_pkg_path(xhp, path, sizeof(path), pkg_repod);
+	if (l < 0) {
+		xbps_set_cb_state(xhp, failstate, -l, pkgver,
+		    "%s: cannot determine binary package file: %s",
+		    pkgver, strerror(-l));
+		return l;
+	}
+
+	if ((bp = calloc(1, sizeof(*bp))) == NULL)
+		return -errno;
+	bp->fd = -1;
+	bp->refs = 1;
+	if ((bp->pkgver = strdup(pkgver)) == NULL ||
+	    (bp->path = strdup(path)) == NULL) {
+		rv = -errno;
+		goto out;
+	}
+	if ((bp->ar = xbps_archive_read_new()) == NULL) {
+		rv = -errno;
+		goto out;
+	}
+
+	bp->fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (bp->fd == -1) {
+		rv = -errno;
+		xbps_set_cb_state(xhp, failstate, -rv, pkgver,
+		    "%s: failed to open binary package `%s': %s",
+		    pkgver, path, strerror(-rv));
+		goto out;
+	}
+	if (fstat(bp->fd, &st) == -1) {
+		rv = -errno;
+		xbps_set_cb_state(xhp, failstate, -rv, pkgver,
+		    "%s: failed to fstat binary package `%s': %s",
+		    pkgver, path, strerror(-rv));
+		goto out;
+	}
+	bp->size = st.st_size;
+	if (archive_read_open_fd(bp->ar, bp->fd, st.st_blksize) == ARCHIVE_FATAL) {
+		rv = -xbps_archive_errno(bp->ar);
+		xbps_set_cb_state(xhp, failstate, -rv, pkgver,
+		    "%s: failed to read binary package `%s': %s",
+		    pkgver, path, strerror(-rv));
+		goto out;
+	}
+
+	for (uint8_t i = 0; i < 4; i++) {
+		const char *entry_pname;
+		int ar_rv = archive_read_next_header(bp->ar, &entry);
+		if (ar_rv == ARCHIVE_EOF) {
+			bp->eof = true;
+			break;
+		} else if (ar_rv == ARCHIVE_FATAL) {
+			rv = -xbps_archive_errno(bp->ar);
+			xbps_set_cb_state(xhp, failstate, -rv, pkgver,
+			    "%s: failed to read binary package `%s': %s",
+			    pkgver, path, archive_error_string(bp->ar));
+			goto out;
+		} else if (ar_rv == ARCHIVE_RETRY) {
+			continue;
+		}
+
+		entry_pname = archive_entry_pathname(entry);
+		if (!entry_pname)
+			xbps_unreachable();
+
+		if (strcmp("./INSTALL", entry_pname) == 0) {
+			rv = binpkg_get_data(bp->ar, entry, &bp->install);
+			if (rv < 0)
+				goto out;
+		} else if (strcmp("./REMOVE", entry_pname) == 0) {
+			rv = binpkg_get_data(bp->ar, entry, &bp->remove);
+			if (rv < 0)
+				goto out;
+		} else if (strcmp("./props.plist", entry_pname) == 0) {
+			bp->propsd = xbps_archive_get_dictionary(bp->ar, entry);
+			if (bp->propsd == NULL) {
+				rv = -EINVAL;
+				goto out;
+			}
+		} else if (strcmp("./files.plist", entry_pname) == 0) {
+			bp->filesd = xbps_archive_get_dictionary(bp->ar, entry);
+			if (bp->filesd == NULL) {
+				rv = -EINVAL;
+				goto out;
+			}
+		} else {
+			bp->entry = entry;
+			break;
+		}
+	}
+
+	/*
+	 * Bail out if required metadata files are not in archive.
+	 */
+	if (bp->propsd == NULL || bp->filesd == NULL) {
+		rv = -ENODEV;
+		xbps_set_cb_state(xhp, failstate, -rv, pkgver,
+		    "%s: invalid binary package `%s'.", pkgver, path);
+		goto out;
+	}
+
+out:
+	if (rv < 0) {
+		xbps_binpkg_close(bp);
+		return rv;
+	}
+	*bpp = bp;
+	return 0;
+}
+
+int HIDDEN
+xbps_binpkg_next_entry(struct xbps_binpkg *bp, struct archive_entry **entry)
+{
+	if (bp->entry != NULL) {
+		*entry = bp->entry;
+		bp->entry = NULL;
+		return ARCHIVE_OK;
+	}
+	if (bp->eof)
+		return ARCHIVE_EOF;
+	return archive_read_next_header(bp->ar, entry);
+}
+
+void HIDDEN
+xbps_binpkg_close(struct xbps_binpkg *bp)
+{
+	unsigned int refs;
+
+	if (bp == NULL)
+		return;
+	pthread_mutex_lock(&cache_lock);
+	refs = --bp->refs;
+	pthread_mutex_unlock(&cache_lock);
+	if (refs > 0)
+		return;
+	if (bp->ar != NULL)
+		archive_read_free(bp->ar);
+	if (bp->fd != -1)
+		close(bp->fd);
+	if (bp->install != NULL)
+		xbps_object_release(bp->install);
+	if (bp->remove != NULL)
+		xbps_object_release(bp->remove);
+	if (bp->propsd != NULL)
+		xbps_object_release(bp->propsd);
+	if (bp->filesd != NULL)
+		xbps_object_release(bp->filesd);
+	free(bp->pkgver);
+	free(bp->path);
+	free(bp);
+}
+
+void HIDDEN
+xbps_binpkg_cache_put(struct xbps_binpkg *bp)
+{
+	struct xbps_binpkg *evict = bp;
+	unsigned int i, slot = BINPKG_CACHE_MAX;
+
+	pthread_mutex_lock(&cache_lock);
+	for (i = 0; i < BINPKG_CACHE_MAX; i++) {
+		if (cache[i] == NULL) {
+			slot = i;
+			evict = NULL;
+			break;
+		}
+		/* replace the smallest package if this one is bigger */
+		if (cache[i]->size < evict->size) {
+			slot = i;
+			evict = cache[i];
+		}
+	}
+	if (slot < BINPKG_CACHE_MAX)
+		cache[slot] = bp;
+	pthread_mutex_unlock(&cache_lock);
+
+	xbps_binpkg_close(evict);
+}
+
+static struct xbps_binpkg *
+cache_lookup(xbps_dictionary_t pkg_repod, bool take)
+{
+	struct xbps_binpkg *bp = NULL;
+	const char *pkgver = NULL;
+
+	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
+	assert(pkgver);
+
+	pthread_mutex_lock(&cache_lock);
+	for (unsigned int i = 0; i < BINPKG_CACHE_MAX; i++) {
+		if (cache[i] == NULL || strcmp(cache[i]->pkgver, pkgver))
+			continue;
+		bp = cache[i];
+		if (take)
+			cache[i] = NULL;
+		else
+			bp->refs++;
+		break;
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return bp;
+}
+
+struct xbps_binpkg HIDDEN *
+xbps_binpkg_cache_get(xbps_dictionary_t pkg_repod)
+{
+	return cache_lookup(pkg_repod, false);
+}
+
+struct xbps_binpkg HIDDEN *
+xbps_binpkg_cache_take(xbps_dictionary_t pkg_repod)
+{
+	return cache_lookup(pkg_repod, true);
+}
+
+void HIDDEN
+xbps_binpkg_cache_clear(void)
+{
+	struct xbps_binpkg *evict[BINPKG_CACHE_MAX];
+
+	pthread_mutex_lock(&cache_lock);
+	for (unsigned int i = 0; i < BINPKG_CACHE_MAX; i++) {
+		evict[i] = cache[i];
+		cache[i] = NULL;
+	}
+	pthread_mutex_unlock(&cache_lock);
+	for (unsigned int i = 0; i < BINPKG_CACHE_MAX; i++)
+		xbps_binpkg_close(evict[i]);
+}
@@ -28,9 +28,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
 
+/*
+ * Callbacks may be triggered from concurrent workers (i.e parallel
+ * downloads), serialize them so that clients don't have to.
+ */
+static pthread_mutex_t fetch_cb_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t state_cb_mtx = PTHREAD_MUTEX_INITIALIZER;
+
 void HIDDEN
 xbps_set_cb_fetch(struct xbps_handle *xhp,
 		  off_t file_size,
@@ -54,7 +62,9 @@ xbps_set_cb_fetch(struct xbps_handle *xhp,
 	xfcd.cb_start = cb_start;
 	xfcd.cb_update = cb_update;
 	xfcd.cb_end = cb_end;
+	pthread_mutex_lock(&fetch_cb_mtx);
 	(*xhp->fetch_cb)(&xfcd, xhp->fetch_cb_data);
+	pthread_mutex_unlock(&fetch_cb_mtx);
 }
 
 int HIDDEN PRINTF_LIKE(5, 6)
@@ -86,7 +96,9 @@ xbps_set_cb_state(struct xbps_handle *xhp,
 		else
 			xscd.desc = buf;
 	}
+	pthread_mutex_lock(&state_cb_mtx);
 	retval = (*xhp->state_cb)(&xscd, xhp->state_cb_data);
+	pthread_mutex_unlock(&state_cb_mtx);
 	if (buf != NULL)
 		free(buf);
 
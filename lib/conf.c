@@ -199,11 +199,28 @@ store_noextract(struct xbps_handle *xhp, const char *value)
 	xbps_dbg_printf("Added noextract pattern: %s\n", value);
 }
 
+static int
+parse_jobs(const char *val, unsigned int *jobs)
+{
+	unsigned long n;
+	char *end;
+
+	errno = 0;
+	n = strtoul(val, &end, 10);
+	if (errno != 0 || end == val || *end != '\0' || n == 0 || n > UINT_MAX)
+		return -1;
+	*jobs = (unsigned int)n;
+	return 0;
+}
+
 enum {
 	KEY_ERROR = 0,
 	KEY_ARCHITECTURE,
 	KEY_BESTMATCHING,
 	KEY_CACHEDIR,
+	KEY_CONFIGUREJOBS,
+	KEY_FETCHHOSTJOBS,
+	KEY_FETCHJOBS,
 	KEY_IGNOREPKG,
 	KEY_INCLUDE,
 	KEY_NOEXTRACT,
@@ -214,6 +231,7 @@ enum {
 	KEY_SYSLOG,
 	KEY_VIRTUALPKG,
 	KEY_KEEPCONF,
+	KEY_PKGDBJOURNAL,
 };
 
 static const struct key {
@@ -224,10 +242,14 @@ static const struct key {
 	{ "architecture", 12, KEY_ARCHITECTURE },
 	{ "bestmatching", 12, KEY_BESTMATCHING },
 	{ "cachedir",      8, KEY_CACHEDIR },
+	{ "configurejobs",13, KEY_CONFIGUREJOBS },
+	{ "fetchhostjobs",13, KEY_FETCHHOSTJOBS },
+	{ "fetchjobs",     9, KEY_FETCHJOBS },
 	{ "ignorepkg",     9, KEY_IGNOREPKG },
 	{ "include",       7, KEY_INCLUDE },
 	{ "keepconf",      8, KEY_KEEPCONF },
 	{ "noextract",     9, KEY_NOEXTRACT },
+	{ "pkgdbjournal", 12, KEY_PKGDBJOURNAL },
 	{ "preserve",      8, KEY_PRESERVE },
 	{ "repository",   10, KEY_REPOSITORY },
 	{ "rootdir",       7, KEY_ROOTDIR },
@@ -436,6 +458,15 @@ parse_file(struct xbps_handle *xhp, const char *path, bool nested)
 				xbps_dbg_printf("%s: config preservation disabled\n", path);
 			}
 			break;
+		case KEY_PKGDBJOURNAL:
+			if (strcasecmp(val, "true") == 0) {
+				xhp->flags |= XBPS_FLAG_PKGDB_JOURNAL;
+				xbps_dbg_printf("%s: pkgdb journal enabled\n", path);
+			} else {
+				xhp->flags &= ~XBPS_FLAG_PKGDB_JOURNAL;
+				xbps_dbg_printf("%s: pkgdb journal disabled\n", path);
+			}
+			break;
 		case KEY_BESTMATCHING:
 			if (strcasecmp(val, "true") == 0) {
 				xhp->flags |= XBPS_FLAG_BESTMATCH;
@@ -445,6 +476,33 @@ parse_file(struct xbps_handle *xhp, const char *path, bool nested)
 				xbps_dbg_printf("%s: pkg best matching disabled\n", path);
 			}
 			break;
+		case KEY_FETCHJOBS:
+			if (parse_jobs(val, &xhp->fetch_jobs) == -1) {
+				xbps_dbg_printf("%s: ignoring invalid fetchjobs "
+				    "at line %zu\n", path, nlines);
+				continue;
+			}
+			xbps_dbg_printf("%s: fetchjobs set to %u\n", path,
+			    xhp->fetch_jobs);
+			break;
+		case KEY_CONFIGUREJOBS:
+			if (parse_jobs(val, &xhp->configure_jobs) == -1) {
+				xbps_dbg_printf("%s: ignoring invalid configurejobs "
+				    "at line %zu\n", path, nlines);
+				continue;
+			}
+			xbps_dbg_printf("%s: configurejobs set to %u\n", path,
+			    xhp->configure_jobs);
+			break;
+		case KEY_FETCHHOSTJOBS:
+			if (parse_jobs(val, &xhp->fetch_host_jobs) == -1) {
+				xbps_dbg_printf("%s: ignoring invalid fetchhostjobs "
+				    "at line %zu\n", path, nlines);
+				continue;
+			}
+			xbps_dbg_printf("%s: fetchhostjobs set to %u\n", path,
+			    xhp->fetch_host_jobs);
+			break;
 		case KEY_IGNOREPKG:
 			store_ignored_pkg(xhp, val);
 			break;
@@ -44,8 +44,6 @@
 #include <time.h>
 #include <unistd.h>
 
-#include <openssl/sha.h>
-
 #include "xbps_api_impl.h"
 #include "fetch.h"
 #include "compat.h"
@@ -58,13 +56,12 @@
  * XBPS download related functions, frontend for NetBSD's libfetch.
  */
 static const char *
-print_time(time_t *t)
+print_time(time_t *t, char *buf, size_t len)
 {
 	struct tm tm;
-	static char buf[255];
 
 	gmtime_r(t, &tm);
-	strftime(buf, sizeof(buf), "%d %b %Y %H:%M", &tm);
+	strftime(buf, len, "%d %b %Y %H:%M", &tm);
 	return buf;
 }
 
@@ -85,6 +82,18 @@ xbps_fetch_unset_cache_connection(void)
 	fetchConnectionCacheClose();
 }
 
+/*
+ * Transfers start with FETCH_BUFSIZ_MIN bytes buffers, doubled while
+ * every read fills the buffer up to FETCH_BUFSIZ_MAX, so that fast links
+ * and local mirrors need few syscalls while small files and slow links
+ * don't allocate more than needed. The digest is computed on the same
+ * buffers.
+ */
+#define FETCH_BUFSIZ_MIN	(64 * 1024)
+#define FETCH_BUFSIZ_MAX	(1024 * 1024)
+/* bytes copied between progress callbacks on the zero-copy path */
+#define FETCH_COPY_CHUNK	(8 * 1024 * 1024)
+
 const char *
 xbps_fetch_error_string(void)
 {
@@ -94,6 +103,81 @@ xbps_fetch_error_string(void)
 	return fetchLastErrString;
 }
 
+static int
+fetch_write(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Copies a file:// source in the kernel, without reading it into
+ * userspace. Returns 1 if the file systems don't support it and nothing
+ * was copied, the transfer must then be done through libfetch.
+ */
+static int
+fetch_copy_file(struct xbps_handle *xhp, struct url *url,
+		struct url_stat *url_st, int fd, const char *filename,
+		off_t *bytes_dload)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+	char *path;
+	off_t off = url->offset;
+	ssize_t n;
+	int sfd, rv = 0;
+
+	if ((path = fetchUnquotePath(url)) == NULL)
+		return 1;
+	sfd = open(path, O_RDONLY|O_CLOEXEC);
+	free(path);
+	if (sfd == -1)
+		return 1;
+
+	while ((n = copy_file_range(sfd, &off, fd, NULL,
+	    FETCH_COPY_CHUNK, 0)) != 0) {
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (*bytes_dload == 0 && (errno == EXDEV ||
+			    errno == ENOSYS || errno == EINVAL ||
+			    errno == EOPNOTSUPP)) {
+				xbps_dbg_printf("copy_file_range: %s, "
+				    "falling back to read/write\n",
+				    strerror(errno));
+				rv = 1;
+			} else {
+				rv = -1;
+			}
+			break;
+		}
+		*bytes_dload += n;
+		xbps_set_cb_fetch(xhp, url_st->size, url->offset,
+		    url->offset + *bytes_dload,
+		    filename, false, true, false);
+	}
+	(void)close(sfd);
+	return rv;
+#else
+	(void)xhp;
+	(void)url;
+	(void)url_st;
+	(void)fd;
+	(void)filename;
+	(void)bytes_dload;
+	return 1;
+#endif
+}
+
 int
 xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char *filename, const char *flags, unsigned char *digest, size_t digestlen)
 {
@@ -103,12 +187,13 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	struct fetchIO *fio = NULL;
 	struct timespec ts[2];
 	off_t bytes_dload = 0;
-	ssize_t bytes_read = 0, bytes_written = 0;
-	char buf[4096], *tempfile = NULL;
-	char fetch_flags[8];
-	int fd = -1, rv = 0;
+	ssize_t bytes_read = 0;
+	size_t bufsz = FETCH_BUFSIZ_MIN;
+	char *buf = NULL, *tempfile = NULL;
+	char fetch_flags[8], tbuf[64];
+	int fd = -1, rv = 0, r;
 	bool refetch = false, restart = false;
-	SHA256_CTX sha256;
+	struct xbps_sha256 *sha256 = NULL;
 
 	assert(xhp);
 	assert(uri);
@@ -119,7 +204,6 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 			errno = ENOBUFS;
 			return -1;
 		}
-		SHA256_Init(&sha256);
 	}
 
 	/* Extern vars declared in libfetch */
@@ -128,6 +212,15 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	if (!filename || (url = fetchParseURL(uri)) == NULL)
 		return -1;
 
+	if ((buf = malloc(bufsz)) == NULL) {
+		rv = -1;
+		goto fetch_file_out;
+	}
+	if (digest != NULL && (sha256 = xbps_sha256_new()) == NULL) {
+		rv = -1;
+		goto fetch_file_out;
+	}
+
 	memset(&fetch_flags, 0, sizeof(fetch_flags));
 	if (flags != NULL)
 		xbps_strlcpy(fetch_flags, flags, 7);
@@ -175,11 +268,15 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 
 	/* debug stuff */
 	xbps_dbg_printf("st.st_size: %zd\n", (ssize_t)stp->st_size);
-	xbps_dbg_printf("st.st_atime: %s\n", print_time(&stp->st_atime));
-	xbps_dbg_printf("st.st_mtime: %s\n", print_time(&stp->st_mtime));
+	xbps_dbg_printf("st.st_atime: %s\n",
+	    print_time(&stp->st_atime, tbuf, sizeof(tbuf)));
+	xbps_dbg_printf("st.st_mtime: %s\n",
+	    print_time(&stp->st_mtime, tbuf, sizeof(tbuf)));
 	xbps_dbg_printf("url_stat.size: %zd\n", (ssize_t)url_st.size);
-	xbps_dbg_printf("url_stat.atime: %s\n", print_time(&url_st.atime));
-	xbps_dbg_printf("url_stat.mtime: %s\n", print_time(&url_st.mtime));
+	xbps_dbg_printf("url_stat.atime: %s\n",
+	    print_time(&url_st.atime, tbuf, sizeof(tbuf)));
+	xbps_dbg_printf("url_stat.mtime: %s\n",
+	    print_time(&url_st.mtime, tbuf, sizeof(tbuf)));
 
 	if (fio == NULL) {
 		if (fetchLastErrCode == FETCH_UNCHANGED) {
@@ -213,7 +310,7 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	xbps_dbg_printf("url->offset: %zd\n", (ssize_t)url->offset);
 	xbps_dbg_printf("url->length: %zu\n", url->length);
 	xbps_dbg_printf("url->last_modified: %s\n",
-	    print_time(&url->last_modified));
+	    print_time(&url->last_modified, tbuf, sizeof(tbuf)));
 	/*
 	 * If restarting, open the file for appending otherwise create it.
 	 */
@@ -233,8 +330,8 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	 */
 	if (restart) {
 		if (digest) {
-			while ((bytes_read = read(fd, buf, sizeof(buf))) > 0) {
-				SHA256_Update(&sha256, buf, bytes_read);
+			while ((bytes_read = read(fd, buf, bufsz)) > 0) {
+				xbps_sha256_update(sha256, buf, bytes_read);
 			}
 			if (bytes_read == -1) {
 				xbps_dbg_printf("IO error while reading %s: %s\n",
@@ -246,6 +343,15 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 		}
 		lseek(fd, 0, SEEK_END);
 	}
+#ifdef __linux__
+	/*
+	 * Reserve the remaining blocks at once. The file size is kept
+	 * so that an interrupted transfer can still be resumed.
+	 */
+	if (url_st.size > url->offset)
+		(void)fallocate(fd, FALLOC_FL_KEEP_SIZE, url->offset,
+		    url_st.size - url->offset);
+#endif
 
 	/*
 	 * Initialize data for the fetch progress function callback
@@ -254,14 +360,30 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 	 */
 	xbps_set_cb_fetch(xhp, url_st.size, url->offset, url->offset,
 	    filename, true, false, false);
+	/*
+	 * Local files that don't need to be hashed are copied by the kernel.
+	 */
+	r = 1;
+	if (digest == NULL && strcmp(url->scheme, SCHEME_FILE) == 0) {
+		r = fetch_copy_file(xhp, url, &url_st, fd, filename,
+		    &bytes_dload);
+		if (r == -1) {
+			xbps_dbg_printf("Couldn't copy to %s: %s\n",
+			    tempfile, strerror(errno));
+			rv = -1;
+			goto fetch_file_out;
+		}
+	}
 	/*
 	 * Start fetching requested file.
 	 */
-	while ((bytes_read = fetchIO_read(fio, buf, sizeof(buf))) > 0) {
-		if (digest)
-			SHA256_Update(&sha256, buf, bytes_read);
-		bytes_written = write(fd, buf, (size_t)bytes_read);
-		if (bytes_written != bytes_read) {
+	while (r == 1 && (bytes_read = fetchIO_read(fio, buf, bufsz)) > 0) {
+		if (digest && !xbps_sha256_update(sha256, buf, bytes_read)) {
+			errno = EINVAL;
+			rv = -1;
+			goto fetch_file_out;
+		}
+		if (fetch_write(fd, buf, (size_t)bytes_read) == -1) {
 			xbps_dbg_printf("Couldn't write to %s!\n", tempfile);
 			rv = -1;
 			goto fetch_file_out;
@@ -274,6 +396,15 @@ xbps_fetch_file_dest_sha256(struct xbps_handle *xhp, const char *uri, const char
 		xbps_set_cb_fetch(xhp, url_st.size, url->offset,
 		    url->offset + bytes_dload,
 		    filename, false, true, false);
+		/* the source fills the buffer, read more at once */
+		if ((size_t)bytes_read == bufsz && bufsz < FETCH_BUFSIZ_MAX) {
+			char *nbuf = realloc(buf, bufsz * 2);
+
+			if (nbuf != NULL) {
+				buf = nbuf;
+				bufsz *= 2;
+			}
+		}
 	}
 	if (bytes_read == -1) {
 		xbps_dbg_printf("IO error while fetching %s: %s\n",
@@ -319,10 +450,14 @@ rename_file:
 	}
 	rv = 1;
 
-	if (digest)
-		SHA256_Final(digest, &sha256);
+	if (digest && !xbps_sha256_final(sha256, digest)) {
+		errno = EINVAL;
+		rv = -1;
+	}
 
 fetch_file_out:
+	xbps_sha256_free(sha256);
+	free(buf);
 	if (fio != NULL)
 		fetchIO_close(fio);
 	if (fd != -1)
@@ -134,3 +134,9 @@ xbps_file_exec(struct xbps_handle *xhp, const char *arg, ...)
 
 	return result;
 }
+
+int HIDDEN
+xbps_file_execv(struct xbps_handle *xhp, const char **argv)
+{
+	return pfcexec(xhp, argv[0], argv);
+}
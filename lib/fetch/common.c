@@ -1880,7 +1880,7 @@ fetchFreeURLList(struct url_list *ue)
 static const char *
 fetch_read_word(FILE *f)
 {
-	static char word[1024];
+	static __thread char word[1024];
 
 	if (fscanf(f, " %1023s ", word) != 1)
 		return (NULL);
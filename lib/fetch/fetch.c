@@ -42,8 +42,8 @@
 #include "common.h"
 
 auth_t	 fetchAuthMethod;
-int	 fetchLastErrCode;
-char	 fetchLastErrString[MAXERRSTRING];
+__thread int	 fetchLastErrCode;
+__thread char	 fetchLastErrString[MAXERRSTRING];
 int	 fetchTimeout;
 int	 fetchConnTimeout = 300 * 1000;
 int	 fetchConnDelay = 250;
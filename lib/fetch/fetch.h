@@ -163,10 +163,10 @@ void		 fetchConnectionCacheClose(void);
 typedef int (*auth_t)(struct url *);
 extern auth_t		 fetchAuthMethod;
 
-/* Last error code */
-extern int		 fetchLastErrCode;
+/* Last error code (per thread, transfers may run concurrently) */
+extern __thread int	 fetchLastErrCode;
 #define MAXERRSTRING 256
-extern char		 fetchLastErrString[MAXERRSTRING];
+extern __thread char	 fetchLastErrString[MAXERRSTRING];
 
 /* I/O timeout */
 extern int		 fetchTimeout;
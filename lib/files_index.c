@@ -0,0 +1,1192 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/**
+ * @file lib/files_index.c
+ * @brief Installed files index
+ *
+ * The files index maps every path registered by an installed package
+ * to its owner. It contains a table of packages sorted by pkgname, the
+ * files of each package in the same order as its files plist, and a
+ * table of all files sorted by path, so that exact lookups are a binary
+ * search and pattern lookups a linear scan of a single file.
+ *
+ * Every package records the "metafile-sha256" of the files plist it was
+ * generated from. Packages whose plist changed since are read from the
+ * plist instead, the index is rewritten by xbps_pkgdb_update() after
+ * xbps_register_pkg() or xbps_remove_pkg() modified the pkgdb, or on the
+ * first lookup that found it stale if the metadir is writable.
+ *
+ * The index also records the size, inode and mtime of the pkgdb plist
+ * and journal it was generated from. While they match the pkgdb in
+ * memory, the index has every installed package and exact lookups only
+ * check the packages owning the matched files instead of the whole pkgdb.
+ *
+ * Files also record their "sha256", "size" and "mutable" objects, so
+ * that xbps_pkgdb_get_pkg_files() rebuilds the files dictionary of an
+ * up to date package from the index rather than parsing its plist.
+ * Packages whose plist has any other object are flagged and always read
+ * from the plist.
+ */
+
+#define FILES_INDEX		"files.idx"
+#define FILES_INDEX_MAGIC	"XBPSFIDX"
+#define FILES_INDEX_VERSION	3
+#define FILES_INDEX_NOSTR	UINT32_MAX
+
+/* package flags */
+#define FILES_INDEX_PKG_NOPLIST		0x1
+#define FILES_INDEX_PKG_PARTIAL		0x2
+
+/* file flags */
+#define FILES_INDEX_FILE_SIZE		0x1
+#define FILES_INDEX_FILE_HAS_MUTABLE	0x2
+#define FILES_INDEX_FILE_MUTABLE	0x4
+
+static const char *const types[] = {
+	/* in the same order as the keys of the files plist */
+	"conf_files", "dirs", "files", "links",
+};
+
+struct files_index_stamp {
+	uint64_t plist_size;
+	uint64_t plist_ino;
+	int64_t plist_mtime;
+	int64_t plist_mtime_nsec;
+	uint64_t journal_size;
+	uint64_t journal_ino;
+	int64_t journal_mtime;
+	int64_t journal_mtime_nsec;
+};
+
+struct files_index_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t npkgs;
+	uint32_t nfiles;
+	uint32_t strsz;
+	/* zero if unknown */
+	struct files_index_stamp stamp;
+};
+
+struct files_index_pkg {
+	uint32_t pkgname;
+	uint32_t pkgver;
+	uint32_t sha256;
+	uint32_t first;
+	uint32_t count;
+	uint32_t flags;
+};
+
+struct files_index_file {
+	uint32_t file;
+	uint32_t target;
+	uint32_t pkg;
+	uint32_t type;
+	uint32_t sha256;
+	uint32_t flags;
+	uint64_t size;
+};
+
+struct files_index {
+	void *mf;
+	size_t mflen;
+	struct files_index_hdr hdr;
+	const struct files_index_pkg *pkgs;
+	const struct files_index_file *files;
+	const uint32_t *sorted;
+	const char *strtab;
+};
+
+/* stored in xhp->pkgdb_state */
+struct xbps_files_index {
+	/* set if the files of a package in the pkgdb changed */
+	bool dirty;
+	/* the pkgdb storage the pkgdb in memory was read from */
+	struct files_index_stamp stamp;
+	bool stamped;
+	/* index mapped by xbps_files_index_get_pkg_files() */
+	struct files_index cached;
+	bool cached_open;
+	pthread_mutex_t lock;
+};
+
+static struct xbps_files_index *
+files_index(struct xbps_handle *xhp)
+{
+	return xhp->pkgdb_state ? xhp->pkgdb_state->files_index : NULL;
+}
+
+static char *
+index_path(struct xbps_handle *xhp)
+{
+	return xbps_xasprintf("%s/%s", xhp->metadir, FILES_INDEX);
+}
+
+static int
+index_stamp(struct xbps_handle *xhp, struct files_index_stamp *stamp)
+{
+	struct stat st;
+	char *path;
+
+	memset(stamp, 0, sizeof(*stamp));
+	if (stat(xhp->pkgdb_plist, &st) == -1)
+		return -errno;
+	stamp->plist_size = (uint64_t)st.st_size;
+	stamp->plist_ino = (uint64_t)st.st_ino;
+	stamp->plist_mtime = st.st_mtim.tv_sec;
+	stamp->plist_mtime_nsec = st.st_mtim.tv_nsec;
+	path = xbps_xasprintf("%s.journal", xhp->pkgdb_plist);
+	if (stat(path, &st) == 0) {
+		stamp->journal_size = (uint64_t)st.st_size;
+		stamp->journal_ino = (uint64_t)st.st_ino;
+		stamp->journal_mtime = st.st_mtim.tv_sec;
+		stamp->journal_mtime_nsec = st.st_mtim.tv_nsec;
+	} else if (errno != ENOENT) {
+		free(path);
+		return -errno;
+	}
+	free(path);
+	return 0;
+}
+
+/*
+ * Reader
+ */
+static void
+index_close(struct files_index *ix)
+{
+	if (ix->mf)
+		(void)munmap(ix->mf, ix->mflen);
+	memset(ix, 0, sizeof(*ix));
+}
+
+static int
+index_open(struct xbps_handle *xhp, struct files_index *ix)
+{
+	const char *p;
+	char *path;
+	size_t flen = 0, need;
+	int r = 0;
+
+	memset(ix, 0, sizeof(*ix));
+	path = index_path(xhp);
+	if (!xbps_mmap_file(path, &ix->mf, &ix->mflen, &flen)) {
+		r = -errno;
+		ix->mf = NULL;
+		goto out;
+	}
+	if (flen < sizeof(ix->hdr)) {
+		r = -EINVAL;
+		goto out;
+	}
+	memcpy(&ix->hdr, ix->mf, sizeof(ix->hdr));
+	if (memcmp(ix->hdr.magic, FILES_INDEX_MAGIC, sizeof(ix->hdr.magic)) != 0 ||
+	    ix->hdr.version != FILES_INDEX_VERSION) {
+		r = -ESTALE;
+		goto out;
+	}
+	need = sizeof(ix->hdr) +
+	    (size_t)ix->hdr.npkgs * sizeof(struct files_index_pkg) +
+	    (size_t)ix->hdr.nfiles * (sizeof(struct files_index_file) + sizeof(uint32_t)) +
+	    ix->hdr.strsz;
+	if (need != flen || ix->hdr.strsz == 0) {
+		r = -EINVAL;
+		goto out;
+	}
+	p = (const char *)ix->mf + sizeof(ix->hdr);
+	ix->pkgs = (const void *)p;
+	p += (size_t)ix->hdr.npkgs * sizeof(struct files_index_pkg);
+	ix->files = (const void *)p;
+	p += (size_t)ix->hdr.nfiles * sizeof(struct files_index_file);
+	ix->sorted = (const void *)p;
+	p += (size_t)ix->hdr.nfiles * sizeof(uint32_t);
+	ix->strtab = p;
+	if (ix->strtab[ix->hdr.strsz - 1] != '\0')
+		r = -EINVAL;
+out:
+	if (r < 0) {
+		if (r != -ENOENT)
+			xbps_dbg_printf("[files] ignoring index %s: %s\n",
+			    path, strerror(-r));
+		index_close(ix);
+	}
+	free(path);
+	return r;
+}
+
+static const char *
+index_str(const struct files_index *ix, uint32_t off)
+{
+	/* the string table is nul terminated, any offset in it is valid */
+	if (off >= ix->hdr.strsz)
+		return NULL;
+	return ix->strtab + off;
+}
+
+static const struct files_index_pkg *
+index_find_pkg(const struct files_index *ix, const char *pkgname)
+{
+	uint32_t lo = 0, hi = ix->hdr.npkgs;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const char *s = index_str(ix, ix->pkgs[mid].pkgname);
+		int cmp;
+
+		if (s == NULL)
+			return NULL;
+		cmp = strcmp(pkgname, s);
+		if (cmp == 0)
+			return &ix->pkgs[mid];
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+/*
+ * Returns the index entry of the installed package \a pkgname if it is
+ * up to date with the pkgdb.
+ */
+static const struct files_index_pkg *
+index_pkg_valid(const struct files_index *ix, const char *pkgname,
+		xbps_dictionary_t pkgd)
+{
+	const struct files_index_pkg *ipkg;
+	const char *pkgver = NULL, *sha256 = NULL, *s;
+
+	if (ix->mf == NULL || (ipkg = index_find_pkg(ix, pkgname)) == NULL)
+		return NULL;
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	/* packages without files plist have no hash */
+	if (!xbps_dictionary_get_cstring_nocopy(pkgd, "metafile-sha256", &sha256))
+		sha256 = "";
+	if (pkgver == NULL)
+		return NULL;
+	if ((s = index_str(ix, ipkg->pkgver)) == NULL || strcmp(s, pkgver) != 0)
+		return NULL;
+	if ((s = index_str(ix, ipkg->sha256)) == NULL || strcmp(s, sha256) != 0)
+		return NULL;
+	if (ipkg->first > ix->hdr.nfiles ||
+	    ipkg->count > ix->hdr.nfiles - ipkg->first)
+		return NULL;
+	return ipkg;
+}
+
+static bool
+index_get_file(const struct files_index *ix, uint32_t idx,
+		struct xbps_pkg_file *f)
+{
+	const struct files_index_file *ifile = &ix->files[idx];
+
+	if (ifile->type >= __arraycount(types) ||
+	    (f->file = index_str(ix, ifile->file)) == NULL)
+		return false;
+	f->type = types[ifile->type];
+	f->target = NULL;
+	if (ifile->target != FILES_INDEX_NOSTR &&
+	    (f->target = index_str(ix, ifile->target)) == NULL)
+		return false;
+	return true;
+}
+
+/*
+ * Returns true if the index was generated from the pkgdb in memory.
+ */
+static bool
+index_complete(const struct xbps_files_index *fi, const struct files_index *ix)
+{
+	return ix->mf && fi && fi->stamped && !fi->dirty &&
+	    memcmp(&ix->hdr.stamp, &fi->stamp, sizeof(fi->stamp)) == 0;
+}
+
+/*
+ * Returns the stamp of the pkgdb in memory if it is the one on storage.
+ */
+static const struct files_index_stamp *
+pkgdb_stamp(const struct xbps_files_index *fi)
+{
+	return fi && fi->stamped && !fi->dirty ? &fi->stamp : NULL;
+}
+
+static void
+cached_release(struct xbps_files_index *fi)
+{
+	if (fi == NULL)
+		return;
+	pthread_mutex_lock(&fi->lock);
+	index_close(&fi->cached);
+	fi->cached_open = false;
+	pthread_mutex_unlock(&fi->lock);
+}
+
+/*
+ * Writer
+ */
+struct builder {
+	char *strtab;
+	size_t strsz, strcap;
+	struct files_index_pkg *pkgs;
+	size_t npkgs, pkgscap;
+	struct files_index_file *files;
+	size_t nfiles, filescap;
+};
+
+struct sort_entry {
+	const char *path;
+	uint32_t idx;
+};
+
+static bool
+grow(void **ptr, size_t *cap, size_t need, size_t elemsz)
+{
+	size_t ncap = *cap ? *cap : 64;
+	void *p;
+
+	if (need <= *cap)
+		return true;
+	while (ncap < need)
+		ncap *= 2;
+	if ((p = realloc(*ptr, ncap * elemsz)) == NULL)
+		return false;
+	*ptr = p;
+	*cap = ncap;
+	return true;
+}
+
+static bool
+add_str(struct builder *b, const char *s, uint32_t *off)
+{
+	size_t len = strlen(s) + 1;
+
+	if (b->strsz + len >= FILES_INDEX_NOSTR)
+		return false;
+	if (!grow((void **)&b->strtab, &b->strcap, b->strsz + len, 1))
+		return false;
+	memcpy(b->strtab + b->strsz, s, len);
+	*off = (uint32_t)b->strsz;
+	b->strsz += len;
+	return true;
+}
+
+static bool
+add_file(struct builder *b, uint32_t type, const char *file,
+		const char *target, const char *sha256, uint64_t size,
+		uint32_t flags)
+{
+	struct files_index_file *ifile;
+
+	if (b->nfiles >= FILES_INDEX_NOSTR ||
+	    !grow((void **)&b->files, &b->filescap, b->nfiles + 1, sizeof(*ifile)))
+		return false;
+	ifile = &b->files[b->nfiles];
+	memset(ifile, 0, sizeof(*ifile));
+	ifile->pkg = (uint32_t)b->npkgs - 1;
+	ifile->type = type;
+	ifile->target = ifile->sha256 = FILES_INDEX_NOSTR;
+	ifile->flags = flags;
+	ifile->size = size;
+	if (!add_str(b, file, &ifile->file) ||
+	    (target && !add_str(b, target, &ifile->target)) ||
+	    (sha256 && !add_str(b, sha256, &ifile->sha256)))
+		return false;
+	b->nfiles++;
+	return true;
+}
+
+static bool
+add_plist_file(struct builder *b, uint32_t type, xbps_dictionary_t obj,
+		bool *partial)
+{
+	const char *file = NULL, *target = NULL, *sha256 = NULL;
+	uint64_t size = 0;
+	uint32_t flags = 0;
+	unsigned int known = 1;
+	bool mutable;
+
+	if (!xbps_dictionary_get_cstring_nocopy(obj, "file", &file)) {
+		*partial = true;
+		return true;
+	}
+	if (xbps_dictionary_get_cstring_nocopy(obj, "target", &target))
+		known++;
+	if (xbps_dictionary_get_cstring_nocopy(obj, "sha256", &sha256))
+		known++;
+	if (xbps_dictionary_get_uint64(obj, "size", &size)) {
+		flags |= FILES_INDEX_FILE_SIZE;
+		known++;
+	}
+	if (xbps_dictionary_get_bool(obj, "mutable", &mutable)) {
+		flags |= FILES_INDEX_FILE_HAS_MUTABLE;
+		if (mutable)
+			flags |= FILES_INDEX_FILE_MUTABLE;
+		known++;
+	}
+	if (xbps_dictionary_count(obj) != known)
+		*partial = true;
+	return add_file(b, type, file, target, sha256, size, flags);
+}
+
+static bool
+add_pkg_plist(struct xbps_handle *xhp, struct builder *b, const char *pkgname)
+{
+	xbps_dictionary_t filesd;
+	char *plist;
+	unsigned int ntypes = 0;
+	bool ok = true, partial = false;
+
+	plist = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
+	filesd = xbps_plist_dictionary_from_file(plist);
+	if (filesd == NULL) {
+		/* unreadable plists are read again by the readers */
+		if (access(plist, F_OK) == -1 && errno == ENOENT)
+			b->pkgs[b->npkgs - 1].flags |= FILES_INDEX_PKG_NOPLIST;
+		else
+			b->pkgs[b->npkgs - 1].flags |= FILES_INDEX_PKG_PARTIAL;
+		free(plist);
+		return true;
+	}
+	free(plist);
+
+	for (uint32_t t = 0; ok && t < __arraycount(types); t++) {
+		xbps_object_t array = xbps_dictionary_get(filesd, types[t]);
+
+		if (array == NULL)
+			continue;
+		ntypes++;
+		if (xbps_object_type(array) != XBPS_TYPE_ARRAY) {
+			partial = true;
+			continue;
+		}
+		for (unsigned int i = 0; ok && i < xbps_array_count(array); i++)
+			ok = add_plist_file(b, t, xbps_array_get(array, i), &partial);
+	}
+	if (xbps_dictionary_count(filesd) != ntypes)
+		partial = true;
+	if (partial)
+		b->pkgs[b->npkgs - 1].flags |= FILES_INDEX_PKG_PARTIAL;
+	xbps_object_release(filesd);
+	return ok;
+}
+
+static bool
+add_pkg(struct xbps_handle *xhp, struct builder *b,
+		const struct files_index *old, const char *pkgname,
+		xbps_dictionary_t pkgd)
+{
+	const struct files_index_pkg *opkg;
+	struct files_index_pkg *ipkg;
+	struct xbps_pkg_file f;
+	const char *pkgver = NULL, *sha256 = NULL;
+
+	if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+		return true;
+	xbps_dictionary_get_cstring_nocopy(pkgd, "metafile-sha256", &sha256);
+
+	if (!grow((void **)&b->pkgs, &b->pkgscap, b->npkgs + 1, sizeof(*ipkg)))
+		return false;
+	ipkg = &b->pkgs[b->npkgs++];
+	memset(ipkg, 0, sizeof(*ipkg));
+	ipkg->first = (uint32_t)b->nfiles;
+	if (!add_str(b, pkgname, &ipkg->pkgname) ||
+	    !add_str(b, pkgver, &ipkg->pkgver) ||
+	    !add_str(b, sha256 ? sha256 : "", &ipkg->sha256))
+		return false;
+
+	if ((opkg = index_pkg_valid(old, pkgname, pkgd)) == NULL) {
+		if (!add_pkg_plist(xhp, b, pkgname))
+			return false;
+	} else {
+		b->pkgs[b->npkgs - 1].flags = opkg->flags;
+		for (uint32_t i = opkg->first; i < opkg->first + opkg->count; i++) {
+			const struct files_index_file *ofile = &old->files[i];
+			const char *osha256 = NULL;
+
+			if (!index_get_file(old, i, &f) ||
+			    (ofile->sha256 != FILES_INDEX_NOSTR &&
+			    (osha256 = index_str(old, ofile->sha256)) == NULL) ||
+			    !add_file(b, ofile->type, f.file, f.target, osha256,
+			    ofile->size, ofile->flags))
+				return false;
+		}
+	}
+	/* add_str() may have moved the table */
+	ipkg = &b->pkgs[b->npkgs - 1];
+	ipkg->count = (uint32_t)b->nfiles - ipkg->first;
+	return true;
+}
+
+static int
+sort_cmp(const void *a, const void *b)
+{
+	const struct sort_entry *sa = a, *sb = b;
+	int cmp = strcmp(sa->path, sb->path);
+
+	if (cmp != 0)
+		return cmp;
+	return sa->idx < sb->idx ? -1 : sa->idx > sb->idx;
+}
+
+static bool
+put(FILE *fp, const void *data, size_t len)
+{
+	return fwrite(data, 1, len, fp) == len;
+}
+
+static int
+write_index(const char *path, struct builder *b,
+		const struct files_index_stamp *stamp)
+{
+	struct files_index_hdr hdr;
+	struct sort_entry *sorted;
+	char *tmp;
+	FILE *fp = NULL;
+	int fd, r = 0;
+
+	sorted = calloc(b->nfiles ? b->nfiles : 1, sizeof(*sorted));
+	if (sorted == NULL)
+		return -ENOMEM;
+	for (size_t i = 0; i < b->nfiles; i++) {
+		sorted[i].path = b->strtab + b->files[i].file;
+		sorted[i].idx = (uint32_t)i;
+	}
+	qsort(sorted, b->nfiles, sizeof(*sorted), sort_cmp);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, FILES_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = FILES_INDEX_VERSION;
+	hdr.npkgs = (uint32_t)b->npkgs;
+	hdr.nfiles = (uint32_t)b->nfiles;
+	hdr.strsz = (uint32_t)b->strsz;
+	if (stamp)
+		hdr.stamp = *stamp;
+
+	tmp = xbps_xasprintf("%s.XXXXXXXXXX", path);
+	if ((fd = mkstemp(tmp)) == -1) {
+		r = -errno;
+		goto out;
+	}
+	if (fchmod(fd, 0644) == -1 || !(fp = fdopen(fd, "w"))) {
+		r = -errno;
+		close(fd);
+		goto out;
+	}
+	if (!put(fp, &hdr, sizeof(hdr)) ||
+	    !put(fp, b->pkgs, b->npkgs * sizeof(*b->pkgs)) ||
+	    !put(fp, b->files, b->nfiles * sizeof(*b->files))) {
+		r = errno ? -errno : -EIO;
+		goto out;
+	}
+	for (size_t i = 0; i < b->nfiles; i++) {
+		if (!put(fp, &sorted[i].idx, sizeof(sorted[i].idx))) {
+			r = errno ? -errno : -EIO;
+			goto out;
+		}
+	}
+	if (!put(fp, b->strtab, b->strsz) || fflush(fp) == EOF ||
+	    fsync(fileno(fp)) == -1) {
+		r = errno ? -errno : -EIO;
+		goto out;
+	}
+	r = fclose(fp) == EOF ? -errno : 0;
+	fp = NULL;
+	if (r == 0 && rename(tmp, path) == -1)
+		r = -errno;
+out:
+	if (fp)
+		fclose(fp);
+	if (r < 0)
+		unlink(tmp);
+	free(tmp);
+	free(sorted);
+	return r;
+}
+
+static int
+index_write(struct xbps_handle *xhp, const struct files_index *old,
+		const struct files_index_stamp *stamp)
+{
+	struct builder b;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	char *path;
+	uint32_t off;
+	int r = 0;
+
+	memset(&b, 0, sizeof(b));
+	/* the string table is never empty */
+	if (!add_str(&b, "", &off))
+		return -ENOMEM;
+
+	iter = xbps_dictionary_iterator(xhp->pkgdb);
+	if (iter == NULL) {
+		free(b.strtab);
+		return -ENOMEM;
+	}
+	while ((obj = xbps_object_iterator_next(iter))) {
+		const char *pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
+		xbps_dictionary_t pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
+
+		if (!add_pkg(xhp, &b, old, pkgname, pkgd)) {
+			r = errno ? -errno : -ENOMEM;
+			break;
+		}
+	}
+	xbps_object_iterator_release(iter);
+
+	path = index_path(xhp);
+	if (r == 0)
+		r = write_index(path, &b, stamp);
+	if (r < 0) {
+		xbps_dbg_printf("[files] failed to write index %s: %s\n",
+		    path, strerror(-r));
+	} else {
+		xbps_dbg_printf("[files] wrote index %s (%zu files)\n",
+		    path, b.nfiles);
+	}
+	free(path);
+	free(b.strtab);
+	free(b.pkgs);
+	free(b.files);
+	/* map the new index on the next lookup */
+	if (r == 0)
+		cached_release(files_index(xhp));
+	return r;
+}
+
+void HIDDEN
+xbps_files_index_invalidate(struct xbps_handle *xhp)
+{
+	struct xbps_files_index *fi = files_index(xhp);
+
+	if (fi)
+		fi->dirty = true;
+}
+
+void HIDDEN
+xbps_files_index_release(struct xbps_handle *xhp)
+{
+	struct xbps_files_index *fi = files_index(xhp);
+
+	if (fi == NULL)
+		return;
+	index_close(&fi->cached);
+	pthread_mutex_destroy(&fi->lock);
+	free(fi);
+	xhp->pkgdb_state->files_index = NULL;
+}
+
+void HIDDEN
+xbps_files_index_stamp_pkgdb(struct xbps_handle *xhp)
+{
+	struct xbps_files_index *fi = files_index(xhp);
+
+	if (fi == NULL) {
+		/* before the pkgdb is used by more threads */
+		if ((fi = calloc(1, sizeof(*fi))) == NULL)
+			return;
+		pthread_mutex_init(&fi->lock, NULL);
+		xhp->pkgdb_state->files_index = fi;
+	}
+	/* taken before the pkgdb is read, a newer pkgdb never matches */
+	fi->stamped = index_stamp(xhp, &fi->stamp) == 0;
+	fi->dirty = false;
+}
+
+/*
+ * Returns true if the index was generated from the pkgdb in memory,
+ * updating its stamp if it was generated from the pkgdb identified by
+ * \a prev, which was written again without changing the files of any
+ * package.
+ */
+static bool
+index_restamp(struct xbps_handle *xhp, const struct files_index_stamp *prev,
+		const struct files_index_stamp *stamp)
+{
+	struct files_index_hdr hdr;
+	char *path;
+	bool rv = false;
+	int fd;
+
+	path = index_path(xhp);
+	if ((fd = open(path, O_RDWR|O_CLOEXEC)) == -1) {
+		free(path);
+		return false;
+	}
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    memcmp(hdr.magic, FILES_INDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != FILES_INDEX_VERSION) {
+		/* rewritten */
+	} else if (memcmp(&hdr.stamp, stamp, sizeof(*stamp)) == 0) {
+		rv = true;
+	} else if (prev && memcmp(&hdr.stamp, prev, sizeof(*prev)) == 0) {
+		hdr.stamp = *stamp;
+		if (pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr))
+			rv = true;
+		else
+			xbps_dbg_printf("[files] failed to update %s: %s\n",
+			    path, strerror(errno));
+	}
+	(void)close(fd);
+	free(path);
+	return rv;
+}
+
+/*
+ * Called with the pkgdb locked right after it was written: regenerates
+ * the index if the files of a package changed, or if it is missing or
+ * stale.
+ */
+int HIDDEN
+xbps_files_index_flush(struct xbps_handle *xhp)
+{
+	struct xbps_files_index *fi = files_index(xhp);
+	struct files_index old;
+	struct files_index_stamp prev;
+	bool prev_stamped;
+	int r;
+
+	if (fi == NULL)
+		return -ENOMEM;
+	prev = fi->stamp;
+	prev_stamped = fi->stamped;
+	fi->stamped = index_stamp(xhp, &fi->stamp) == 0;
+	if (!fi->dirty && fi->stamped &&
+	    index_restamp(xhp, prev_stamped ? &prev : NULL, &fi->stamp))
+		return 0;
+
+	(void)index_open(xhp, &old);
+	r = index_write(xhp, &old, fi->stamped ? &fi->stamp : NULL);
+	index_close(&old);
+	if (r == 0)
+		fi->dirty = false;
+	return r;
+}
+
+/*
+ * Lookup
+ */
+static int
+index_pkg_files(const struct files_index *ix, const struct files_index_pkg *ipkg,
+		xbps_dictionary_t *filesdp)
+{
+	xbps_array_t arrays[__arraycount(types)] = { NULL };
+	xbps_dictionary_t filesd, d;
+	struct xbps_pkg_file f;
+	const char *sha256;
+	int r = 0;
+
+	if ((filesd = xbps_dictionary_create()) == NULL)
+		return xbps_error_oom();
+	for (uint32_t i = ipkg->first; i < ipkg->first + ipkg->count; i++) {
+		const struct files_index_file *ifile = &ix->files[i];
+
+		if (!index_get_file(ix, i, &f)) {
+			r = -EINVAL;
+			break;
+		}
+		sha256 = NULL;
+		if (ifile->sha256 != FILES_INDEX_NOSTR &&
+		    (sha256 = index_str(ix, ifile->sha256)) == NULL) {
+			r = -EINVAL;
+			break;
+		}
+		if (arrays[ifile->type] == NULL &&
+		    (arrays[ifile->type] = xbps_array_create()) == NULL) {
+			r = xbps_error_oom();
+			break;
+		}
+		if ((d = xbps_dictionary_create()) == NULL) {
+			r = xbps_error_oom();
+			break;
+		}
+		if (!xbps_dictionary_set_cstring(d, "file", f.file) ||
+		    (f.target && !xbps_dictionary_set_cstring(d, "target", f.target)) ||
+		    (sha256 && !xbps_dictionary_set_cstring(d, "sha256", sha256)) ||
+		    ((ifile->flags & FILES_INDEX_FILE_SIZE) &&
+		    !xbps_dictionary_set_uint64(d, "size", ifile->size)) ||
+		    ((ifile->flags & FILES_INDEX_FILE_HAS_MUTABLE) &&
+		    !xbps_dictionary_set_bool(d, "mutable",
+		    ifile->flags & FILES_INDEX_FILE_MUTABLE)) ||
+		    !xbps_array_add(arrays[ifile->type], d)) {
+			xbps_object_release(d);
+			r = xbps_error_oom();
+			break;
+		}
+		xbps_object_release(d);
+	}
+	for (uint32_t t = 0; t < __arraycount(types); t++) {
+		if (arrays[t] == NULL)
+			continue;
+		if (r == 0 && !xbps_dictionary_set(filesd, types[t], arrays[t]))
+			r = xbps_error_oom();
+		xbps_object_release(arrays[t]);
+	}
+	if (r < 0) {
+		xbps_object_release(filesd);
+		return r;
+	}
+	*filesdp = filesd;
+	return 0;
+}
+
+int HIDDEN
+xbps_files_index_get_pkg_files(struct xbps_handle *xhp, const char *pkgname,
+		xbps_dictionary_t pkgd, xbps_dictionary_t *filesdp)
+{
+	struct xbps_files_index *fi = files_index(xhp);
+	const struct files_index_pkg *ipkg;
+	int r = -ENOENT;
+
+	if (fi == NULL)
+		return -ESTALE;
+	pthread_mutex_lock(&fi->lock);
+	if (!fi->cached_open) {
+		(void)index_open(xhp, &fi->cached);
+		fi->cached_open = true;
+	}
+	ipkg = index_pkg_valid(&fi->cached, pkgname, pkgd);
+	if (ipkg == NULL || (ipkg->flags & FILES_INDEX_PKG_PARTIAL)) {
+		r = -ESTALE;
+	} else if (ipkg->flags & FILES_INDEX_PKG_NOPLIST) {
+		*filesdp = NULL;
+		r = 0;
+	} else {
+		r = index_pkg_files(&fi->cached, ipkg, filesdp);
+	}
+	pthread_mutex_unlock(&fi->lock);
+	return r;
+}
+
+/*
+ * Returns the files dictionary of \a pkgname, or NULL if it has no files
+ * plist or the plist doesn't match the "metafile-sha256" of \a pkgd.
+ */
+static xbps_dictionary_t
+pkg_plist(struct xbps_handle *xhp, const char *pkgname, xbps_dictionary_t pkgd)
+{
+	xbps_dictionary_t filesd = NULL;
+	const char *sha256 = NULL;
+	char digest[XBPS_SHA256_SIZE];
+	char *plist;
+
+	/* not written yet */
+	if (xbps_pkgdb_files_staged(xhp, pkgname, &filesd) == 0)
+		return filesd;
+
+	plist = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
+	if (xbps_dictionary_get_cstring_nocopy(pkgd, "metafile-sha256", &sha256) &&
+	    (!xbps_file_sha256(digest, sizeof(digest), plist) ||
+	    strcmp(digest, sha256) != 0)) {
+		if (errno != ENOENT)
+			xbps_dbg_printf("[files] ignoring %s: sha256 mismatch\n",
+			    plist);
+		free(plist);
+		return NULL;
+	}
+	filesd = xbps_plist_dictionary_from_file(plist);
+	free(plist);
+	return filesd;
+}
+
+static int
+foreach_plist(struct xbps_handle *xhp, const char *pkgname,
+		xbps_dictionary_t pkgd, const char *pkgver, const char *path,
+		int (*fn)(struct xbps_handle *, const struct xbps_pkg_file *, void *, bool *),
+		void *arg, bool *done)
+{
+	xbps_dictionary_t filesd;
+	struct xbps_pkg_file f;
+	int r = 0;
+
+	if ((filesd = pkg_plist(xhp, pkgname, pkgd)) == NULL)
+		return 0;
+
+	f.pkgver = pkgver;
+	for (unsigned int t = 0; !r && !*done && t < __arraycount(types); t++) {
+		xbps_array_t array = xbps_dictionary_get(filesd, types[t]);
+
+		f.type = types[t];
+		for (unsigned int i = 0; !r && !*done && i < xbps_array_count(array); i++) {
+			xbps_dictionary_t obj = xbps_array_get(array, i);
+
+			f.file = f.target = NULL;
+			if (!xbps_dictionary_get_cstring_nocopy(obj, "file", &f.file))
+				continue;
+			if (path && strcmp(path, f.file) != 0)
+				continue;
+			xbps_dictionary_get_cstring_nocopy(obj, "target", &f.target);
+			r = (*fn)(xhp, &f, arg, done);
+		}
+	}
+	xbps_object_release(filesd);
+	return r;
+}
+
+/*
+ * Collects the files in the index matching \a path, sorted by their
+ * position in the index which is the pkgdb order.
+ */
+static int
+index_lookup(const struct files_index *ix, const char *path,
+		uint32_t **matchesp, size_t *nmatchesp)
+{
+	uint32_t lo = 0, hi = ix->hdr.nfiles, *matches = NULL;
+	size_t nmatches = 0, cap = 0;
+	const char *s;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if (ix->sorted[mid] >= ix->hdr.nfiles ||
+		    (s = index_str(ix, ix->files[ix->sorted[mid]].file)) == NULL)
+			return -EINVAL;
+		if (strcmp(s, path) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < ix->hdr.nfiles; lo++) {
+		if (ix->sorted[lo] >= ix->hdr.nfiles ||
+		    (s = index_str(ix, ix->files[ix->sorted[lo]].file)) == NULL)
+			return -EINVAL;
+		if (strcmp(s, path) != 0)
+			break;
+		if (!grow((void **)&matches, &cap, nmatches + 1, sizeof(*matches))) {
+			free(matches);
+			return -ENOMEM;
+		}
+		matches[nmatches++] = ix->sorted[lo];
+	}
+	*matchesp = matches;
+	*nmatchesp = nmatches;
+	return 0;
+}
+
+static unsigned int
+index_stale_pkgs(struct xbps_handle *xhp, const struct files_index *ix)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	unsigned int stale = 0;
+
+	iter = xbps_dictionary_iterator(xhp->pkgdb);
+	assert(iter);
+	while ((obj = xbps_object_iterator_next(iter))) {
+		xbps_dictionary_t pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
+
+		if (!xbps_dictionary_get(pkgd, "pkgver"))
+			continue;
+		if (!index_pkg_valid(ix, xbps_dictionary_keysym_cstring_nocopy(obj), pkgd))
+			stale++;
+	}
+	xbps_object_iterator_release(iter);
+	return stale;
+}
+
+/*
+ * Returns the package owning every file in \a matches, or NULL if the
+ * index is corrupted.
+ */
+static const struct files_index_pkg **
+index_match_pkgs(const struct files_index *ix, const uint32_t *matches,
+		size_t nmatches)
+{
+	const struct files_index_pkg **owners;
+
+	if ((owners = calloc(nmatches ? nmatches : 1, sizeof(*owners))) == NULL)
+		return NULL;
+	for (size_t i = 0; i < nmatches; i++) {
+		uint32_t pkg = ix->files[matches[i]].pkg;
+
+		if (pkg >= ix->hdr.npkgs ||
+		    matches[i] < ix->pkgs[pkg].first ||
+		    matches[i] - ix->pkgs[pkg].first >= ix->pkgs[pkg].count ||
+		    index_str(ix, ix->pkgs[pkg].pkgname) == NULL) {
+			free(owners);
+			return NULL;
+		}
+		owners[i] = &ix->pkgs[pkg];
+	}
+	return owners;
+}
+
+/*
+ * Runs \a fn for the files in \a matches, sorted by their position in the
+ * index, with an index generated from the pkgdb in memory: only the
+ * packages owning them are checked.
+ */
+static int
+foreach_match(struct xbps_handle *xhp, const struct files_index *ix,
+		const char *path, const uint32_t *matches, size_t nmatches,
+		const struct files_index_pkg **owners,
+		int (*fn)(struct xbps_handle *, const struct xbps_pkg_file *, void *, bool *),
+		void *arg)
+{
+	const struct files_index_pkg *ipkg = NULL;
+	const char *pkgver = NULL;
+	bool done = false, valid = false;
+	int r = 0;
+
+	for (size_t i = 0; !r && !done && i < nmatches; i++) {
+		struct xbps_pkg_file f;
+
+		/* the matches of a package are adjacent */
+		if (owners[i] != ipkg) {
+			const char *pkgname;
+			xbps_dictionary_t pkgd;
+
+			ipkg = owners[i];
+			pkgname = index_str(ix, ipkg->pkgname);
+			pkgd = xbps_dictionary_get(xhp->pkgdb, pkgname);
+			pkgver = NULL;
+			valid = false;
+			if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+				continue;
+			if (index_pkg_valid(ix, pkgname, pkgd) == ipkg) {
+				valid = true;
+			} else {
+				r = foreach_plist(xhp, pkgname, pkgd, pkgver, path,
+				    fn, arg, &done);
+			}
+		}
+		if (!valid)
+			continue;
+		f.pkgver = pkgver;
+		if (index_get_file(ix, matches[i], &f))
+			r = (*fn)(xhp, &f, arg, &done);
+	}
+	return r;
+}
+
+int
+xbps_pkgdb_foreach_file(struct xbps_handle *xhp, const char *path,
+		int (*fn)(struct xbps_handle *, const struct xbps_pkg_file *, void *, bool *),
+		void *arg)
+{
+	struct files_index ix;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	uint32_t *matches = NULL;
+	size_t nmatches = 0;
+	bool done = false;
+	int r;
+
+	if ((r = xbps_pkgdb_init(xhp)) != 0)
+		return r > 0 ? -r : r;
+
+	(void)index_open(xhp, &ix);
+	if (path && index_complete(files_index(xhp), &ix)) {
+		const struct files_index_pkg **owners = NULL;
+
+		if (index_lookup(&ix, path, &matches, &nmatches) == 0 &&
+		    (owners = index_match_pkgs(&ix, matches, nmatches))) {
+			xbps_dbg_printf("[files] %s: %zu matches in the index\n",
+			    path, nmatches);
+			r = foreach_match(xhp, &ix, path, matches, nmatches,
+			    owners, fn, arg);
+			free(owners);
+			free(matches);
+			index_close(&ix);
+			return r;
+		}
+		/* corrupted index, ignore it */
+		free(matches);
+		matches = NULL;
+		nmatches = 0;
+		index_close(&ix);
+	}
+	if (xhp->lock_fd != -1 && index_stale_pkgs(xhp, &ix)) {
+		/*
+		 * Regenerate a missing or stale index only with the pkgdb
+		 * locked, a transaction may be writing it otherwise.
+		 */
+		if (index_write(xhp, &ix, pkgdb_stamp(files_index(xhp))) == 0) {
+			index_close(&ix);
+			(void)index_open(xhp, &ix);
+		}
+	}
+	if (ix.mf && path && (r = index_lookup(&ix, path, &matches, &nmatches)) < 0) {
+		/* corrupted index, ignore it */
+		index_close(&ix);
+		r = 0;
+	}
+
+	iter = xbps_dictionary_iterator(xhp->pkgdb);
+	if (iter == NULL) {
+		free(matches);
+		index_close(&ix);
+		return xbps_error_oom();
+	}
+	while (!r && !done && (obj = xbps_object_iterator_next(iter))) {
+		const struct files_index_pkg *ipkg;
+		const char *pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
+		xbps_dictionary_t pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
+		struct xbps_pkg_file f;
+
+		if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &f.pkgver))
+			continue;
+		if ((ipkg = index_pkg_valid(&ix, pkgname, pkgd)) == NULL) {
+			r = foreach_plist(xhp, pkgname, pkgd, f.pkgver, path,
+			    fn, arg, &done);
+			continue;
+		}
+		if (path) {
+			for (size_t i = 0; !r && !done && i < nmatches; i++) {
+				if (matches[i] < ipkg->first ||
+				    matches[i] >= ipkg->first + ipkg->count)
+					continue;
+				if (index_get_file(&ix, matches[i], &f))
+					r = (*fn)(xhp, &f, arg, &done);
+			}
+			continue;
+		}
+		for (uint32_t i = ipkg->first; !r && !done && i < ipkg->first + ipkg->count; i++) {
+			if (index_get_file(&ix, i, &f))
+				r = (*fn)(xhp, &f, arg, &done);
+		}
+	}
+	xbps_object_iterator_release(iter);
+	free(matches);
+	index_close(&ix);
+	return r;
+}
@@ -49,6 +49,9 @@ xbps_init(struct xbps_handle *xhp)
 
 	assert(xhp != NULL);
 
+	/* the pkgdb is not locked until xbps_pkgdb_lock() */
+	xhp->lock_fd = -1;
+
 	if (xhp->flags & XBPS_FLAG_DEBUG)
 		xbps_debug_level = 1;
 
@@ -158,6 +161,19 @@ xbps_init(struct xbps_handle *xhp)
 	if (xbps_path_clean(xhp->metadir) == -1)
 		return ENOTSUP;
 
+	/*
+	 * Parallel downloads are bounded by the libfetch connection
+	 * cache limits, so that every transfer reuses its connection.
+	 */
+	if (xhp->fetch_jobs == 0)
+		xhp->fetch_jobs = XBPS_FETCH_JOBS;
+	else if (xhp->fetch_jobs > XBPS_FETCH_CACHECONN)
+		xhp->fetch_jobs = XBPS_FETCH_CACHECONN;
+	if (xhp->fetch_host_jobs == 0)
+		xhp->fetch_host_jobs = XBPS_FETCH_JOBS_HOST;
+	else if (xhp->fetch_host_jobs > XBPS_FETCH_CACHECONN_HOST)
+		xhp->fetch_host_jobs = XBPS_FETCH_CACHECONN_HOST;
+
 	p = getenv("XBPS_SYSLOG");
 	if (p) {
 		if (strcasecmp(p, "true") == 0)
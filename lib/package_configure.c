@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
 
@@ -40,9 +41,15 @@
  * Configure a package or all packages. Only packages in XBPS_PKG_STATE_UNPACKED
  * state will be processed (unless overriden). Package configuration steps:
  *  - Its <b>post-install</b> target in the INSTALL script will be executed.
+ *  - Its declared triggers are collected, to be run once for all
+ *    configured packages by xbps_configure_triggers(). xbps_configure_pkg()
+ *    runs them itself unless XBPS_FLAG_BATCH_TRIGGERS is set.
  *  - Its state will be changed to XBPS_PKG_STATE_INSTALLED if previous step
  *    ran successful.
  *
+ * With xbps_handle::configure_jobs set to more than 1, packages are
+ * configured in parallel, but never before their dependencies.
+ *
  * @note
  * If the \a XBPS_FLAG_FORCE_CONFIGURE is set through xbps_init() in the flags
   member, the package (or packages) will be reconfigured even if its
@@ -55,12 +62,16 @@ xbps_configure_packages(struct xbps_handle *xhp, xbps_array_t ignpkgs)
 	xbps_dictionary_t pkgd;
 	xbps_object_t obj;
 	xbps_object_iterator_t iter;
+	xbps_array_t pkgs = NULL;
 	const char *pkgver;
 	int rv;
 
 	if ((rv = xbps_pkgdb_init(xhp)) != 0)
 		return rv;
 
+	if (xhp->configure_jobs > 1 && (pkgs = xbps_array_create()) == NULL)
+		return ENOMEM;
+
 	iter = xbps_dictionary_iterator(xhp->pkgdb);
 	assert(iter);
 	while ((obj = xbps_object_iterator_next(iter))) {
@@ -75,7 +86,14 @@ xbps_configure_packages(struct xbps_handle *xhp, xbps_array_t ignpkgs)
 				continue;
 			}
 		}
-		rv = xbps_configure_pkg(xhp, pkgver, true, false);
+		if (pkgs) {
+			if (!xbps_array_add(pkgs, pkgd)) {
+				rv = ENOMEM;
+				break;
+			}
+			continue;
+		}
+		rv = xbps_configure_pkg_batch(xhp, pkgver, true, false);
 		if (rv != 0) {
 			xbps_dbg_printf("%s: failed to configure %s: %s\n",
 			    __func__, pkgver, strerror(rv));
@@ -84,23 +102,35 @@ xbps_configure_packages(struct xbps_handle *xhp, xbps_array_t ignpkgs)
 	}
 	xbps_object_iterator_release(iter);
 
+	if (pkgs) {
+		if (rv == 0)
+			rv = xbps_configure_pkgs(xhp, pkgs, true, false);
+		xbps_object_release(pkgs);
+	}
+
+	if (rv == 0)
+		rv = xbps_configure_triggers(xhp);
+	else
+		xbps_triggers_release(xhp);
+
 	return rv;
 }
 
-int
-xbps_configure_pkg(struct xbps_handle *xhp,
-		   const char *pkgver,
-		   bool check_state,
-		   bool update)
+/*
+ * Returns the package dictionary from pkgdb to configure, or NULL
+ * with 0 if the package does not need to be configured.
+ */
+static int
+configure_pkg_check(struct xbps_handle *xhp, const char *pkgver,
+		bool check_state, xbps_dictionary_t *pkgdp)
 {
 	xbps_dictionary_t pkgd;
 	const char *p;
 	char pkgname[XBPS_NAME_SIZE];
 	int rv = 0;
 	pkg_state_t state = 0;
-	mode_t myumask;
 
-	assert(pkgver != NULL);
+	*pkgdp = NULL;
 
 	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
 		p = pkgver;
@@ -132,8 +162,20 @@ xbps_configure_pkg(struct xbps_handle *xhp,
 			return EINVAL;
 		}
 	}
+	*pkgdp = pkgd;
+	return 0;
+}
 
-	myumask = umask(022);
+/*
+ * Runs the post-install action of the package. If \a lock is set, the
+ * package is configured concurrently with others and the lock is held
+ * while updating its state and the triggers.
+ */
+static int
+configure_pkg_run(struct xbps_handle *xhp, const char *pkgver,
+		xbps_dictionary_t pkgd, bool update, pthread_mutex_t *lock)
+{
+	int rv;
 
 	xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE, 0, pkgver, NULL);
 
@@ -143,19 +185,343 @@ xbps_configure_pkg(struct xbps_handle *xhp,
 		    errno, pkgver,
 		    "%s: [configure] INSTALL script failed to execute "
 		    "the post ACTION: %s", pkgver, strerror(rv));
-		umask(myumask);
 		return rv;
 	}
+	if (lock)
+		pthread_mutex_lock(lock);
+	if ((rv = xbps_triggers_add(xhp, pkgd)) < 0) {
+		rv = -rv;
+		xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE_FAIL, rv,
+		    pkgver, "%s: [configure] failed to collect triggers: %s",
+		    pkgver, strerror(rv));
+		goto out;
+	}
 	rv = xbps_set_pkg_state_dictionary(pkgd, XBPS_PKG_STATE_INSTALLED);
 	if (rv != 0) {
 		xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE_FAIL, rv,
 		    pkgver, "%s: [configure] failed to set state to installed: %s",
 		    pkgver, strerror(rv));
-		umask(myumask);
-		return rv;
+		goto out;
 	}
 	xbps_set_cb_state(xhp, XBPS_STATE_CONFIGURE_DONE, 0, pkgver, NULL);
+out:
+	if (lock)
+		pthread_mutex_unlock(lock);
+	return rv;
+}
+
+/*
+ * Configures the package, its triggers are collected to be run by
+ * xbps_configure_triggers().
+ */
+int HIDDEN
+xbps_configure_pkg_batch(struct xbps_handle *xhp, const char *pkgver,
+		bool check_state, bool update)
+{
+	xbps_dictionary_t pkgd;
+	int rv;
+	mode_t myumask;
 
+	assert(pkgver != NULL);
+
+	rv = configure_pkg_check(xhp, pkgver, check_state, &pkgd);
+	if (rv != 0 || pkgd == NULL)
+		return rv;
+
+	myumask = umask(022);
+	rv = configure_pkg_run(xhp, pkgver, pkgd, update, NULL);
 	umask(myumask);
+	return rv;
+}
+
+int
+xbps_configure_pkg(struct xbps_handle *xhp,
+		   const char *pkgver,
+		   bool check_state,
+		   bool update)
+{
+	int rv;
+
+	rv = xbps_configure_pkg_batch(xhp, pkgver, check_state, update);
+	if (xhp->flags & XBPS_FLAG_BATCH_TRIGGERS)
+		return rv;
+	if (rv == 0)
+		rv = xbps_configure_triggers(xhp);
+	else
+		xbps_triggers_release(xhp);
+	return rv;
+}
+
+/*
+ * Parallel configuration.
+ *
+ * The packages to configure are the nodes of a graph whose edges are
+ * their run_depends between them; up to xbps_handle::configure_jobs
+ * workers configure the packages whose dependencies have been
+ * configured, in the given order. Cyclic dependencies are configured in
+ * the given order too, once nothing else can be configured.
+ *
+ * A failure does not stop the packages that don't depend on the failed
+ * one, the packages depending on it are not configured and reported as
+ * failed too.
+ */
+struct configure_job {
+	const char *pkgver;
+	xbps_dictionary_t pkgd;
+	/* jobs depending on this one */
+	unsigned int *rdeps;
+	unsigned int nrdeps;
+	/* dependencies not configured yet */
+	unsigned int ndeps;
+	bool update;
+	bool started;
+};
+
+struct configure_pool {
+	struct xbps_handle *xhp;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct configure_job *jobs;
+	unsigned int njobs;
+	unsigned int ndone;
+	unsigned int running;
+	bool trans;
+	int rv;
+};
+
+static struct configure_job *
+configure_pool_next(struct configure_pool *pool)
+{
+	struct configure_job *cycle = NULL;
+
+	for (unsigned int i = 0; i < pool->njobs; i++) {
+		struct configure_job *job = &pool->jobs[i];
+
+		if (job->started)
+			continue;
+		if (job->ndeps == 0)
+			return job;
+		if (cycle == NULL)
+			cycle = job;
+	}
+	/* nothing is running that could satisfy a dependency */
+	return pool->running == 0 ? cycle : NULL;
+}
+
+static void
+configure_pool_skip(struct configure_pool *pool, struct configure_job *job,
+		const char *dep)
+{
+	for (unsigned int i = 0; i < job->nrdeps; i++) {
+		struct configure_job *rdep = &pool->jobs[job->rdeps[i]];
+
+		if (rdep->started)
+			continue;
+		rdep->started = true;
+		pool->ndone++;
+		xbps_set_cb_state(pool->xhp, XBPS_STATE_CONFIGURE_FAIL,
+		    ECANCELED, rdep->pkgver,
+		    "%s: [configure] not configured, dependency %s failed",
+		    rdep->pkgver, dep);
+		configure_pool_skip(pool, rdep, dep);
+	}
+}
+
+static void *
+configure_pool_worker(void *arg)
+{
+	struct configure_pool *pool = arg;
+	struct configure_job *job;
+	int rv;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->ndone < pool->njobs) {
+		if ((job = configure_pool_next(pool)) == NULL) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		job->started = true;
+		pool->running++;
+		pthread_mutex_unlock(&pool->lock);
+
+		rv = configure_pkg_run(pool->xhp, job->pkgver, job->pkgd,
+		    job->update, &pool->lock);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->running--;
+		pool->ndone++;
+		if (rv != 0) {
+			xbps_dbg_printf("%s: configure failed for "
+			    "%s: %s\n", __func__, job->pkgver, strerror(rv));
+			if (pool->rv == 0)
+				pool->rv = rv;
+			configure_pool_skip(pool, job, job->pkgver);
+		} else {
+			for (unsigned int i = 0; i < job->nrdeps; i++)
+				pool->jobs[job->rdeps[i]].ndeps--;
+			if (pool->trans) {
+				xbps_set_cb_state(pool->xhp, job->update ?
+				    XBPS_STATE_UPDATE_DONE : XBPS_STATE_INSTALL_DONE,
+				    0, job->pkgver, NULL);
+			}
+		}
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static int
+configure_pool_add_dep(struct configure_pool *pool, xbps_dictionary_t idx,
+		unsigned int i, const char *pattern)
+{
+	struct configure_job *dep;
+	xbps_dictionary_t pkgd;
+	const char *pkgver = NULL;
+	char pkgname[XBPS_NAME_SIZE];
+	unsigned int *rdeps;
+	uint32_t j;
+
+	pkgd = xbps_pkgdb_get_pkg(pool->xhp, pattern);
+	if (pkgd == NULL)
+		pkgd = xbps_pkgdb_get_virtualpkg(pool->xhp, pattern);
+	if (pkgd == NULL ||
+	    !xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver) ||
+	    !xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+		return 0;
+	/* not configured with this package */
+	if (!xbps_dictionary_get_uint32(idx, pkgname, &j) || j == i)
+		return 0;
+
+	dep = &pool->jobs[j];
+	rdeps = realloc(dep->rdeps, (dep->nrdeps + 1) * sizeof(*rdeps));
+	if (rdeps == NULL)
+		return ENOMEM;
+	dep->rdeps = rdeps;
+	dep->rdeps[dep->nrdeps++] = i;
+	pool->jobs[i].ndeps++;
 	return 0;
 }
+
+static int
+configure_pool_init(struct configure_pool *pool, xbps_array_t pkgs,
+		bool check_state)
+{
+	xbps_dictionary_t idx;
+	char pkgname[XBPS_NAME_SIZE];
+	int rv = 0;
+
+	if ((pool->jobs = calloc(xbps_array_count(pkgs) + 1,
+	    sizeof(*pool->jobs))) == NULL)
+		return ENOMEM;
+	if ((idx = xbps_dictionary_create()) == NULL)
+		return ENOMEM;
+
+	for (unsigned int i = 0; i < xbps_array_count(pkgs); i++) {
+		xbps_dictionary_t obj = xbps_array_get(pkgs, i);
+		struct configure_job *job = &pool->jobs[pool->njobs];
+		const char *pkgver = NULL;
+
+		if (pool->trans) {
+			xbps_trans_type_t ttype = xbps_transaction_pkg_type(obj);
+
+			if (ttype == XBPS_TRANS_REMOVE ||
+			    ttype == XBPS_TRANS_HOLD)
+				continue;
+			job->update = ttype == XBPS_TRANS_UPDATE;
+		}
+		if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver) ||
+		    !xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
+			rv = EINVAL;
+			goto out;
+		}
+		rv = configure_pkg_check(pool->xhp, pkgver, check_state,
+		    &job->pkgd);
+		if (rv != 0)
+			goto out;
+		if (job->pkgd == NULL)
+			continue;
+		job->pkgver = pkgver;
+		if (!xbps_dictionary_set_uint32(idx, pkgname, pool->njobs)) {
+			rv = ENOMEM;
+			goto out;
+		}
+		pool->njobs++;
+	}
+
+	for (unsigned int i = 0; i < pool->njobs; i++) {
+		xbps_array_t rundeps;
+
+		rundeps = xbps_dictionary_get(pool->jobs[i].pkgd, "run_depends");
+		for (unsigned int j = 0; j < xbps_array_count(rundeps); j++) {
+			const char *pattern = NULL;
+
+			xbps_array_get_cstring_nocopy(rundeps, j, &pattern);
+			if ((rv = configure_pool_add_dep(pool, idx, i, pattern)) != 0)
+				goto out;
+		}
+	}
+out:
+	xbps_object_release(idx);
+	return rv;
+}
+
+int HIDDEN
+xbps_configure_pkgs(struct xbps_handle *xhp, xbps_array_t pkgs,
+		bool check_state, bool trans)
+{
+	struct configure_pool pool = { .xhp = xhp, .trans = trans };
+	pthread_t *thds = NULL;
+	unsigned int i, nthreads;
+	mode_t myumask;
+	int r, rv;
+
+	if ((rv = configure_pool_init(&pool, pkgs, check_state)) != 0)
+		goto out;
+	if (pool.njobs == 0)
+		goto out;
+
+	nthreads = xhp->configure_jobs < pool.njobs ?
+	    xhp->configure_jobs : pool.njobs;
+	if ((thds = calloc(nthreads, sizeof(*thds))) == NULL) {
+		rv = ENOMEM;
+		goto out;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	xbps_dbg_printf("[configure] configuring %u packages with %u jobs.\n",
+	    pool.njobs, nthreads);
+
+	myumask = umask(022);
+	for (i = 0; i < nthreads; i++) {
+		r = pthread_create(&thds[i], NULL, configure_pool_worker, &pool);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to create thread: %s\n", strerror(r));
+			break;
+		}
+	}
+	/* if we are unable to create any threads, just do single threaded. */
+	if (i == 0)
+		configure_pool_worker(&pool);
+	while (i > 0) {
+		r = pthread_join(thds[--i], NULL);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to wait on thread: %s\n", strerror(r));
+		}
+	}
+	umask(myumask);
+	rv = pool.rv;
+
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.lock);
+out:
+	for (i = 0; pool.jobs && i < pool.njobs; i++)
+		free(pool.jobs[i].rdeps);
+	free(pool.jobs);
+	free(thds);
+	return rv;
+}
@@ -30,6 +30,7 @@
 #include <errno.h>
 
 #include "xbps_api_impl.h"
+#include "uthash.h"
 
 /**
  * @file lib/package_orphans.c
@@ -57,90 +58,205 @@
  * Text inside of white boxes are the key associated with the object, its
  * data type is specified on its edge, i.e array, bool, integer, string,
  * dictionary.
+ *
+ * Orphans are found in a single pass over the reverse dependencies: every
+ * candidate counts its revdeps that are not orphans yet, and is queued
+ * once the count drops to zero. Removing a queued package decrements the
+ * count of the packages it depends on.
  */
 
+struct orphan {
+	char *pkgname;		/* hash key */
+	xbps_dictionary_t pkgd;
+	/* revdeps that are not orphans yet */
+	unsigned int pending;
+	bool candidate;
+	bool queued;
+	/* candidates depending on this package */
+	struct orphan **deps;
+	unsigned int ndeps, depscap;
+	UT_hash_handle hh;
+};
+
+struct orphans {
+	struct orphan *nodes;
+	struct orphan **queue;
+	unsigned int head, tail, cap;
+};
+
+static struct orphan *
+orphan_get(struct orphans *o, const char *pkgver)
+{
+	struct orphan *node;
+	char pkgname[XBPS_NAME_SIZE];
+
+	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+		xbps_strlcpy(pkgname, pkgver, sizeof(pkgname));
+
+	HASH_FIND_STR(o->nodes, pkgname, node);
+	if (node)
+		return node;
+	if ((node = calloc(1, sizeof(*node))) == NULL)
+		return NULL;
+	if ((node->pkgname = strdup(pkgname)) == NULL) {
+		free(node);
+		return NULL;
+	}
+	HASH_ADD_KEYPTR(hh, o->nodes, node->pkgname, strlen(node->pkgname), node);
+	return node;
+}
+
+static bool
+orphan_queue(struct orphans *o, struct orphan *node)
+{
+	if (o->tail == o->cap) {
+		unsigned int cap = o->cap ? o->cap * 2 : 64;
+		struct orphan **queue = realloc(o->queue, cap * sizeof(*queue));
+
+		if (queue == NULL)
+			return false;
+		o->queue = queue;
+		o->cap = cap;
+	}
+	node->queued = true;
+	o->queue[o->tail++] = node;
+	return true;
+}
+
+/*
+ * Makes the automatic package \a pkgd a candidate, waiting for all its
+ * revdeps to be queued.
+ */
+static bool
+orphan_candidate(struct xbps_handle *xhp, struct orphans *o,
+		xbps_dictionary_t pkgd, struct orphan **nodep)
+{
+	struct orphan *node, *rnode;
+	xbps_array_t revdeps;
+	const char *pkgver = NULL;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	if ((node = orphan_get(o, pkgver)) == NULL)
+		return false;
+	*nodep = node;
+	if (node->candidate || node->queued)
+		return true;
+	node->candidate = true;
+	node->pkgd = pkgd;
+
+	revdeps = xbps_pkgdb_get_pkg_revdeps(xhp, pkgver);
+	for (unsigned int i = 0; i < xbps_array_count(revdeps); i++) {
+		const char *revdepver = NULL;
+
+		xbps_array_get_cstring_nocopy(revdeps, i, &revdepver);
+		if ((rnode = orphan_get(o, revdepver)) == NULL)
+			return false;
+		if (rnode->ndeps == rnode->depscap) {
+			unsigned int cap = rnode->depscap ? rnode->depscap * 2 : 4;
+			struct orphan **deps = realloc(rnode->deps, cap * sizeof(*deps));
+
+			if (deps == NULL)
+				return false;
+			rnode->deps = deps;
+			rnode->depscap = cap;
+		}
+		rnode->deps[rnode->ndeps++] = node;
+		node->pending++;
+	}
+	return true;
+}
+
+/*
+ * Adds the queued packages to \a array, queueing the candidates whose
+ * revdeps have all been queued.
+ */
+static bool
+orphans_drain(struct orphans *o, xbps_array_t array)
+{
+	while (o->head < o->tail) {
+		struct orphan *node = o->queue[o->head++];
+		const char *pkgver = NULL;
+
+		xbps_dictionary_get_cstring_nocopy(node->pkgd, "pkgver", &pkgver);
+		xbps_dbg_printf(" %s orphan\n", pkgver);
+		if (!xbps_array_add(array, node->pkgd))
+			return false;
+		for (unsigned int i = 0; i < node->ndeps; i++) {
+			struct orphan *dep = node->deps[i];
+
+			if (--dep->pending == 0 && dep->candidate && !dep->queued &&
+			    !orphan_queue(o, dep))
+				return false;
+		}
+	}
+	return true;
+}
+
+static void
+orphans_free(struct orphans *o)
+{
+	struct orphan *node, *tmp;
+
+	HASH_ITER(hh, o->nodes, node, tmp) {
+		HASH_DEL(o->nodes, node);
+		free(node->pkgname);
+		free(node->deps);
+		free(node);
+	}
+	free(o->queue);
+}
+
 xbps_array_t
 xbps_find_pkg_orphans(struct xbps_handle *xhp, xbps_array_t orphans_user)
 {
+	struct orphans o;
+	struct orphan *node;
 	xbps_array_t array = NULL;
 	xbps_object_t obj;
 	xbps_object_iterator_t iter;
+	xbps_array_t candidates;
+	bool ok = true;
 
 	if (xbps_pkgdb_init(xhp) != 0)
 		return NULL;
 
 	if ((array = xbps_array_create()) == NULL)
 		return NULL;
+	if ((candidates = xbps_array_create()) == NULL) {
+		xbps_object_release(array);
+		return NULL;
+	}
 
+	memset(&o, 0, sizeof(o));
 	if (!orphans_user) {
 		/* automatic mode (xbps-query -O, xbps-remove -o) */
 		iter = xbps_dictionary_iterator(xhp->pkgdb);
 		assert(iter);
-		/*
-		 * Iterate on pkgdb until no more orphans are found.
-		 */
-		for (;;) {
-			bool added = false;
-			while ((obj = xbps_object_iterator_next(iter))) {
-				xbps_array_t revdeps;
-				xbps_dictionary_t pkgd;
-				unsigned int cnt = 0, revdepscnt = 0;
-				const char *pkgver = NULL;
-				bool automatic = false;
-
-				pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
-				if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver)) {
-					/* _XBPS_ALTERNATIVES_ */
-					continue;
-				}
-				xbps_dbg_printf(" %s checking %s\n", __func__, pkgver);
-				xbps_dictionary_get_bool(pkgd, "automatic-install", &automatic);
-				if (!automatic) {
-					xbps_dbg_printf(" %s skipped (!automatic)\n", pkgver);
-					continue;
-				}
-				if (xbps_find_pkg_in_array(array, pkgver, 0)) {
-					xbps_dbg_printf(" %s orphan (queued)\n", pkgver);
-					continue;
-				}
-				revdeps = xbps_pkgdb_get_pkg_revdeps(xhp, pkgver);
-				revdepscnt = xbps_array_count(revdeps);
-
-				if (revdepscnt == 0) {
-					added = true;
-					xbps_array_add(array, pkgd);
-					xbps_dbg_printf(" %s orphan (automatic and !revdeps)\n", pkgver);
-					continue;
-				}
-				/* verify all revdeps are seen */
-				for (unsigned int i = 0; i < revdepscnt; i++) {
-					const char *revdepver = NULL;
-
-					xbps_array_get_cstring_nocopy(revdeps, i, &revdepver);
-					if (xbps_find_pkg_in_array(array, revdepver, 0))
-						cnt++;
-				}
-				if (cnt == revdepscnt) {
-					added = true;
-					xbps_array_add(array, pkgd);
-					xbps_dbg_printf(" %s orphan (automatic and all revdeps)\n", pkgver);
-				}
+		while (ok && (obj = xbps_object_iterator_next(iter))) {
+			xbps_dictionary_t pkgd;
+			bool automatic = false;
 
+			pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
+			if (!xbps_dictionary_get(pkgd, "pkgver")) {
+				/* _XBPS_ALTERNATIVES_ */
+				continue;
 			}
-			xbps_dbg_printf("orphans pkgdb iter: added %s\n", added ? "true" : "false");
-			xbps_object_iterator_reset(iter);
-			if (!added)
-				break;
+			xbps_dictionary_get_bool(pkgd, "automatic-install", &automatic);
+			if (!automatic)
+				continue;
+			ok = orphan_candidate(xhp, &o, pkgd, &node) &&
+			    xbps_array_add(candidates, pkgd);
 		}
 		xbps_object_iterator_release(iter);
-
-		return array;
+		goto queue;
 	}
 
 	/*
-	 * Recursive removal mode (xbps-remove -R).
+	 * Recursive removal mode (xbps-remove -R): the packages to remove
+	 * are queued, the candidates are the automatic packages of their
+	 * dependency trees.
 	 */
-	for (unsigned int i = 0; i < xbps_array_count(orphans_user); i++) {
+	for (unsigned int i = 0; ok && i < xbps_array_count(orphans_user); i++) {
 		xbps_dictionary_t pkgd;
 		const char *pkgver = NULL;
 
@@ -148,58 +264,56 @@ xbps_find_pkg_orphans(struct xbps_handle *xhp, xbps_array_t orphans_user)
 		pkgd = xbps_pkgdb_get_pkg(xhp, pkgver);
 		if (pkgd == NULL)
 			continue;
-		xbps_array_add(array, pkgd);
+		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+		if ((node = orphan_get(&o, pkgver)) == NULL) {
+			ok = false;
+			break;
+		}
+		if (node->queued)
+			continue;
+		node->pkgd = pkgd;
+		ok = orphan_queue(&o, node);
 	}
-
-	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+	for (unsigned int i = 0; ok && i < o.tail; i++) {
 		xbps_array_t rdeps;
-		xbps_dictionary_t pkgd;
 		const char *pkgver = NULL;
-		unsigned int cnt = 0, reqbycnt = 0;
 
-		pkgd = xbps_array_get(array, i);
-		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+		xbps_dictionary_get_cstring_nocopy(o.queue[i]->pkgd, "pkgver", &pkgver);
 		rdeps = xbps_pkgdb_get_pkg_fulldeptree(xhp, pkgver);
-		if (xbps_array_count(rdeps) == 0) {
-			continue;
-		}
-
 		xbps_dbg_printf(" processing rdeps for %s\n", pkgver);
-		for (unsigned int x = 0; x < xbps_array_count(rdeps); x++) {
-			xbps_array_t reqby;
+		for (unsigned int x = 0; ok && x < xbps_array_count(rdeps); x++) {
 			xbps_dictionary_t deppkgd;
 			const char *deppkgver = NULL;
 			bool automatic = false;
 
-			cnt = 0;
 			xbps_array_get_cstring_nocopy(rdeps, x, &deppkgver);
-			if (xbps_find_pkg_in_array(array, deppkgver, 0)) {
-				xbps_dbg_printf(" rdep %s already queued\n", deppkgver);
-				continue;
-			}
 			deppkgd = xbps_pkgdb_get_pkg(xhp, deppkgver);
 			xbps_dictionary_get_bool(deppkgd, "automatic-install", &automatic);
 			if (!automatic) {
 				xbps_dbg_printf(" rdep %s skipped (!automatic)\n", deppkgver);
 				continue;
 			}
-
-			reqby = xbps_pkgdb_get_pkg_revdeps(xhp, deppkgver);
-			reqbycnt = xbps_array_count(reqby);
-			for (unsigned int j = 0; j < reqbycnt; j++) {
-				const char *reqbydep = NULL;
-
-				xbps_array_get_cstring_nocopy(reqby, j, &reqbydep);
-				xbps_dbg_printf(" %s processing revdep %s\n", pkgver, reqbydep);
-				if (xbps_find_pkg_in_array(array, reqbydep, 0))
-					cnt++;
-			}
-			if (cnt == reqbycnt) {
-				xbps_array_add(array, deppkgd);
-				xbps_dbg_printf(" added %s orphan\n", deppkgver);
-			}
+			ok = orphan_candidate(xhp, &o, deppkgd, &node) &&
+			    xbps_array_add(candidates, deppkgd);
 		}
 	}
+queue:
+	/* candidates without revdeps, in the order they were found */
+	for (unsigned int i = 0; ok && i < xbps_array_count(candidates); i++) {
+		const char *pkgver = NULL;
 
+		xbps_dictionary_get_cstring_nocopy(xbps_array_get(candidates, i),
+		    "pkgver", &pkgver);
+		node = orphan_get(&o, pkgver);
+		if (node->pending == 0 && node->candidate && !node->queued)
+			ok = orphan_queue(&o, node);
+	}
+	ok = ok && orphans_drain(&o, array);
+	xbps_object_release(candidates);
+	orphans_free(&o);
+	if (!ok) {
+		xbps_object_release(array);
+		return NULL;
+	}
 	return array;
 }
@@ -85,11 +85,9 @@ xbps_register_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkgrd)
 	/*
 	 * Create a hash for the pkg's metafile if it exists.
 	 */
-	buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
-	if (xbps_file_sha256(sha256, sizeof sha256, buf)) {
+	if (xbps_pkgdb_files_sha256(xhp, pkgname, sha256, sizeof sha256)) {
 		xbps_dictionary_set_cstring(pkgd, "metafile-sha256", sha256);
 	}
-	free(buf);
 	/*
 	 * Remove self replacement when applicable.
 	 */
@@ -110,9 +108,12 @@ xbps_register_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkgrd)
 	xbps_dictionary_remove(pkgd, "pkgname");
 	xbps_dictionary_remove(pkgd, "version");
 
+	(void)xbps_pkgdb_shlibs_update(xhp, pkgname,
+	    xbps_dictionary_get(xhp->pkgdb, pkgname), pkgd);
 	if (!xbps_dictionary_set(xhp->pkgdb, pkgname, pkgd)) {
 		xbps_dbg_printf("%s: failed to set pkgd for %s\n", __func__, pkgver);
 	}
+	xbps_files_index_invalidate(xhp);
 out:
 	xbps_object_release(pkgd);
 
@@ -110,8 +110,8 @@ xbps_remove_pkg(struct xbps_handle *xhp, const char *pkgver, bool update)
 {
 	xbps_dictionary_t pkgd = NULL, obsd = NULL;
 	xbps_array_t obsoletes = NULL;
-	char pkgname[XBPS_NAME_SIZE], metafile[PATH_MAX];
-	int rv = 0;
+	char pkgname[XBPS_NAME_SIZE];
+	int r, rv = 0;
 	pkg_state_t state = 0;
 	uid_t euid;
 
@@ -202,23 +202,22 @@ xbps_remove_pkg(struct xbps_handle *xhp, const char *pkgver, bool update)
 
 purge:
 	/*
-	 * Remove package metadata plist.
+	 * Remove package metadata plist along with the pkgdb.
 	 */
-	snprintf(metafile, sizeof(metafile), "%s/.%s-files.plist", xhp->metadir, pkgname);
-	if (remove(metafile) == -1) {
-		if (errno != ENOENT) {
-			xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FAIL,
-			    rv, pkgver,
-			    "%s: failed to remove metadata file: %s",
-			    pkgver, strerror(errno));
-		}
+	if ((r = xbps_pkgdb_files_stage(xhp, pkgname, NULL)) < 0) {
+		xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FAIL,
+		    rv, pkgver,
+		    "%s: failed to remove metadata file: %s",
+		    pkgver, strerror(-r));
 	}
 	/*
 	 * Unregister package from pkgdb.
 	 */
 	xbps_dbg_printf("[remove] unregister %s returned %d\n", pkgver, rv);
 	xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_DONE, 0, pkgver, NULL);
+	(void)xbps_pkgdb_shlibs_update(xhp, pkgname, pkgd, NULL);
 	xbps_dictionary_remove(xhp->pkgdb, pkgname);
+	xbps_files_index_invalidate(xhp);
 out:
 	if (rv != 0) {
 		xbps_set_cb_state(xhp, XBPS_STATE_REMOVE_FAIL, rv, pkgver,
@@ -0,0 +1,240 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+#include "uthash.h"
+
+/**
+ * @file lib/package_triggers.c
+ * @brief Package triggers
+ *
+ * Packages can declare triggers in the "triggers" array of their metadata.
+ * Each trigger is an executable in XBPS_TRIGGERS_DIR (relative to rootdir)
+ * that updates some state shared by all packages.
+ *
+ * Instead of running the triggers once per configured package, the
+ * triggers of every configured package are collected in the handle's
+ * pkgdb state and each one is run once by xbps_configure_triggers() with
+ * the following arguments:
+ *
+ * 	<trigger> run-batch post-install <pkgname> [<pkgname> ...]
+ *
+ * These are not the per-package triggers of usr/libexec/xbps-triggers run
+ * by the INSTALL scripts, which take different arguments and read the
+ * variables exported by the script.
+ */
+
+#define XBPS_TRIGGERS_DIR	"usr/libexec/xbps-batch-triggers"
+
+struct xbps_trigger {
+	char *name;
+	char **pkgnames;
+	unsigned int npkgnames;
+	UT_hash_handle hh;
+};
+
+static void
+trigger_free(struct xbps_trigger *t)
+{
+	for (unsigned int i = 0; i < t->npkgnames; i++)
+		free(t->pkgnames[i]);
+	free(t->pkgnames);
+	free(t->name);
+	free(t);
+}
+
+static int
+trigger_add(struct xbps_trigger **triggers, const char *name,
+		const char *pkgname)
+{
+	struct xbps_trigger *t;
+	char **pkgnames;
+
+	HASH_FIND_STR(*triggers, name, t);
+	if (t == NULL) {
+		if ((t = calloc(1, sizeof(*t))) == NULL)
+			return -errno;
+		if ((t->name = strdup(name)) == NULL) {
+			free(t);
+			return -errno;
+		}
+		HASH_ADD_KEYPTR(hh, *triggers, t->name, strlen(t->name), t);
+	}
+	for (unsigned int i = 0; i < t->npkgnames; i++) {
+		if (strcmp(t->pkgnames[i], pkgname) == 0)
+			return 0;
+	}
+	pkgnames = realloc(t->pkgnames, (t->npkgnames + 1) * sizeof(*pkgnames));
+	if (pkgnames == NULL)
+		return -errno;
+	t->pkgnames = pkgnames;
+	if ((t->pkgnames[t->npkgnames] = strdup(pkgname)) == NULL)
+		return -errno;
+	t->npkgnames++;
+	return 0;
+}
+
+int HIDDEN
+xbps_triggers_add(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
+{
+	xbps_array_t array;
+	const char *pkgver = NULL;
+	char pkgname[XBPS_NAME_SIZE];
+	int r;
+
+	assert(xhp->pkgdb_state);
+
+	array = xbps_dictionary_get(pkgd, "triggers");
+	if (xbps_array_count(array) == 0)
+		return 0;
+	if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver) ||
+	    !xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
+		return -EINVAL;
+
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		const char *name = NULL;
+
+		if (!xbps_array_get_cstring_nocopy(array, i, &name))
+			return -EINVAL;
+		if (*name == '\0' || *name == '.' || strchr(name, '/')) {
+			xbps_dbg_printf("%s: ignoring invalid trigger `%s'\n",
+			    pkgver, name);
+			continue;
+		}
+		xbps_dbg_printf("%s: deferring trigger `%s'\n", pkgver, name);
+		if ((r = trigger_add(&xhp->pkgdb_state->triggers, name,
+		    pkgname)) < 0)
+			return r;
+	}
+	return 0;
+}
+
+void HIDDEN
+xbps_triggers_release(struct xbps_handle *xhp)
+{
+	struct xbps_trigger *t, *tmp;
+
+	if (xhp->pkgdb_state == NULL)
+		return;
+	HASH_ITER(hh, xhp->pkgdb_state->triggers, t, tmp) {
+		HASH_DEL(xhp->pkgdb_state->triggers, t);
+		trigger_free(t);
+	}
+}
+
+static int
+trigger_run(struct xbps_handle *xhp, struct xbps_trigger *t, bool *ran)
+{
+	const char **argv;
+	char *path;
+	int rv;
+
+	path = xbps_xasprintf("%s/%s", XBPS_TRIGGERS_DIR, t->name);
+	/* triggers are optional, like in the INSTALL scripts */
+	if (access(path, X_OK) == -1) {
+		xbps_dbg_printf("[triggers] skipping `%s': %s\n", t->name,
+		    strerror(errno));
+		free(path);
+		return 0;
+	}
+	if ((argv = calloc(t->npkgnames + 4, sizeof(*argv))) == NULL) {
+		free(path);
+		return errno;
+	}
+	*ran = true;
+	argv[0] = path;
+	argv[1] = "run-batch";
+	argv[2] = "post-install";
+	for (unsigned int i = 0; i < t->npkgnames; i++)
+		argv[i + 3] = t->pkgnames[i];
+
+	xbps_set_cb_state(xhp, XBPS_STATE_TRIGGER, 0, t->name,
+	    "Running trigger `%s' for %u package%s ...", t->name,
+	    t->npkgnames, t->npkgnames == 1 ? "" : "s");
+	rv = xbps_file_execv(xhp, argv);
+	if (rv != 0) {
+		if (rv == -1)
+			rv = errno ? errno : EINVAL;
+		xbps_set_cb_state(xhp, XBPS_STATE_TRIGGER_FAIL, rv, t->name,
+		    "[configure] trigger `%s' failed: %s", t->name,
+		    strerror(rv));
+	}
+	free(argv);
+	free(path);
+	return rv;
+}
+
+int
+xbps_configure_triggers(struct xbps_handle *xhp)
+{
+	struct xbps_trigger *t, *tmp;
+	unsigned int ntriggers = 0, nruns = 0;
+	int rv = 0, r;
+
+	assert(xhp);
+
+	if (xhp->pkgdb_state == NULL || xhp->pkgdb_state->triggers == NULL)
+		return 0;
+
+	if (xhp->target_arch) {
+		xbps_dbg_printf("[triggers] not running triggers for "
+		    "target architecture.\n");
+		xbps_triggers_release(xhp);
+		return 0;
+	}
+	/* triggers are executed relative to rootdir, like the scripts */
+	if (chdir(xhp->rootdir) == -1) {
+		rv = errno;
+		xbps_triggers_release(xhp);
+		return rv;
+	}
+	HASH_ITER(hh, xhp->pkgdb_state->triggers, t, tmp) {
+		bool ran = false;
+
+		if ((r = trigger_run(xhp, t, &ran)) != 0 && rv == 0)
+			rv = r;
+		if (ran) {
+			ntriggers++;
+			nruns += t->npkgnames;
+		}
+	}
+	if (ntriggers == 0) {
+		xbps_triggers_release(xhp);
+		return rv;
+	}
+	xbps_set_cb_state(xhp, XBPS_STATE_TRIGGERS_DONE, 0, NULL,
+	    "%u trigger%s run for %u package%s, %u run%s saved.",
+	    ntriggers, ntriggers == 1 ? "" : "s",
+	    nruns, nruns == 1 ? "" : "s",
+	    nruns - ntriggers, nruns - ntriggers == 1 ? "" : "s");
+	xbps_triggers_release(xhp);
+	return rv;
+}
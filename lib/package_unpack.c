@@ -82,9 +82,9 @@ static int
 unpack_archive(struct xbps_handle *xhp,
 	       xbps_dictionary_t pkg_repod,
 	       const char *pkgver,
-	       const char *fname,
-	       struct archive *ar)
+	       struct xbps_binpkg *bp)
 {
+	struct archive *ar = bp->ar;
 	xbps_dictionary_t binpkg_filesd, pkg_filesd, obsd;
 	xbps_array_t array, obsoletes;
 	const struct stat *entry_statp;
@@ -99,7 +99,8 @@ unpack_archive(struct xbps_handle *xhp,
 	bool skip_extract, force, xucd_stats;
 	uid_t euid;
 
-	binpkg_filesd = pkg_filesd = NULL;
+	binpkg_filesd = bp->filesd;
+	pkg_filesd = NULL;
 	force = preserve = false;
 	xucd_stats = false;
 	ar_rv = rv = error = 0;
@@ -146,60 +147,6 @@ unpack_archive(struct xbps_handle *xhp,
 	 */
 	flags = set_extract_flags(euid);
 
-	/*
-	 * First get all metadata files on archive in this order:
-	 * 	- INSTALL	<optional>
-	 * 	- REMOVE 	<optional>
-	 * 	- props.plist	<required> but currently ignored
-	 * 	- files.plist	<required>
-	 *
-	 * The XBPS package must contain props and files plists, otherwise
-	 * it's not a valid package.
-	 */
-	for (uint8_t i = 0; i < 4; i++) {
-		ar_rv = archive_read_next_header(ar, &entry);
-		if (ar_rv == ARCHIVE_EOF || ar_rv == ARCHIVE_FATAL)
-			break;
-
-		entry_pname = archive_entry_pathname(entry);
-		if (!entry_pname)
-			xbps_unreachable();
-
-		if (strcmp("./INSTALL", entry_pname) == 0 ||
-		    strcmp("./REMOVE", entry_pname) == 0 ||
-		    strcmp("./props.plist", entry_pname) == 0) {
-			archive_read_data_skip(ar);
-		} else if (strcmp("./files.plist", entry_pname) == 0) {
-			binpkg_filesd = xbps_archive_get_dictionary(ar, entry);
-			if (binpkg_filesd == NULL) {
-				rv = EINVAL;
-				goto out;
-			}
-			break;
-		} else {
-			break;
-		}
-	}
-	/*
-	 * If there was any error extracting files from archive, error out.
-	 */
-	if (ar_rv == ARCHIVE_FATAL) {
-		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv, pkgver,
-		    "%s: [unpack] 1: failed to extract files: %s",
-		    pkgver, archive_error_string(ar));
-		rv = EINVAL;
-		goto out;
-	}
-	/*
-	 * Bail out if required metadata files are not in archive.
-	 */
-	if (binpkg_filesd == NULL) {
-		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, ENODEV, pkgver,
-		    "%s: [unpack] invalid binary package `%s'.", pkgver, fname);
-		rv = ENODEV;
-		goto out;
-	}
-
 	/*
 	 * Internalize current pkg metadata files plist.
 	 */
@@ -209,7 +156,7 @@ unpack_archive(struct xbps_handle *xhp,
 	 * Unpack all files on archive now.
 	 */
 	for (;;) {
-		ar_rv = archive_read_next_header(ar, &entry);
+		ar_rv = xbps_binpkg_next_entry(bp, &entry);
 		if (ar_rv == ARCHIVE_EOF || ar_rv == ARCHIVE_FATAL)
 			break;
 		else if (ar_rv == ARCHIVE_RETRY)
@@ -455,35 +402,24 @@ unpack_archive(struct xbps_handle *xhp,
 		goto out;
 	}
 	/*
-	 * Externalize binpkg files.plist to disk, if not empty.
+	 * Stage binpkg files.plist, if not empty; it is written along
+	 * with the pkgdb.
 	 */
 	if (xbps_dictionary_count(binpkg_filesd)) {
-		char *buf;
-		mode_t prev_umask;
-		prev_umask = umask(022);
-		buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
-		if (!xbps_dictionary_externalize_to_file(binpkg_filesd, buf)) {
-			rv = errno;
-			umask(prev_umask);
-			free(buf);
+		if ((rv = xbps_pkgdb_files_stage(xhp, pkgname, binpkg_filesd)) < 0) {
+			rv = -rv;
 			xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
 			    rv, pkgver, "%s: [unpack] failed to externalize pkg "
 			    "pkg metadata files: %s", pkgver, strerror(rv));
 			goto out;
 		}
-		umask(prev_umask);
-		free(buf);
 	}
 out:
 	/*
 	 * If unpacked pkg has no files, remove its files metadata plist.
 	 */
-	if (!xbps_dictionary_count(binpkg_filesd)) {
-		char *buf = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
-		unlink(buf);
-		free(buf);
-	}
-	xbps_object_release(binpkg_filesd);
+	if (!xbps_dictionary_count(binpkg_filesd))
+		(void)xbps_pkgdb_files_stage(xhp, pkgname, NULL);
 
 	return rv;
 }
@@ -491,12 +427,9 @@ out:
 int HIDDEN
 xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 {
-	char bpkg[PATH_MAX];
-	struct archive *ar = NULL;
-	struct stat st;
+	struct xbps_binpkg *bp;
 	const char *pkgver;
-	ssize_t l;
-	int pkg_fd = -1, rv = 0;
+	int rv = 0;
 	mode_t myumask;
 
 	assert(xbps_object_type(pkg_repod) == XBPS_TYPE_DICTIONARY);
@@ -504,54 +437,18 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
 	xbps_set_cb_state(xhp, XBPS_STATE_UNPACK, 0, pkgver, NULL);
 
-	l = xbps_pkg_path(xhp, bpkg, sizeof(bpkg), pkg_repod);
-	if (l < 0) {
-		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
-		    errno, pkgver,
-		    "%s: [unpack] cannot determine binary package "
-		    "file: %s", pkgver, strerror(errno));
-		return -l;
-	}
-
-	if ((ar = archive_read_new()) == NULL)
-		return ENOMEM;
 	/*
-	 * Enable support for tar format and some compression methods.
+	 * Continue from the payload of the package if it was kept open
+	 * when its metadata was internalized, otherwise open it again.
 	 */
-	archive_read_support_filter_gzip(ar);
-	archive_read_support_filter_bzip2(ar);
-	archive_read_support_filter_xz(ar);
-	archive_read_support_filter_lz4(ar);
-	archive_read_support_filter_zstd(ar);
-	archive_read_support_format_tar(ar);
+	if ((bp = xbps_binpkg_cache_take(pkg_repod)) == NULL) {
+		rv = xbps_binpkg_open(xhp, pkg_repod, XBPS_STATE_UNPACK_FAIL, &bp);
+		if (rv < 0)
+			return -rv;
+	}
 
 	myumask = umask(022);
 
-	pkg_fd = open(bpkg, O_RDONLY|O_CLOEXEC);
-	if (pkg_fd == -1) {
-		rv = errno;
-		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
-		    rv, pkgver,
-		    "%s: [unpack] failed to open binary package `%s': %s",
-		    pkgver, bpkg, strerror(rv));
-		goto out;
-	}
-	if (fstat(pkg_fd, &st) == -1) {
-		rv = errno;
-		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
-		    rv, pkgver,
-		    "%s: [unpack] failed to fstat binary package `%s': %s",
-		    pkgver, bpkg, strerror(rv));
-		goto out;
-	}
-	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
-		rv = xbps_archive_errno(ar);
-		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL,
-		    rv, pkgver,
-		    "%s: [unpack] failed to read binary package `%s': %s",
-		    pkgver, bpkg, strerror(rv));
-		goto out;
-	}
 	/*
 	 * Externalize pkg files dictionary to metadir.
 	 */
@@ -568,7 +465,7 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	/*
 	 * Extract archive files.
 	 */
-	if ((rv = unpack_archive(xhp, pkg_repod, pkgver, bpkg, ar)) != 0) {
+	if ((rv = unpack_archive(xhp, pkg_repod, pkgver, bp)) != 0) {
 		xbps_set_cb_state(xhp, XBPS_STATE_UNPACK_FAIL, rv, pkgver,
 		    "%s: [unpack] failed to unpack files from archive: %s",
 		    pkgver, strerror(rv));
@@ -593,10 +490,7 @@ xbps_unpack_binary_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 	}
 
 out:
-	if (pkg_fd != -1)
-		close(pkg_fd);
-	if (ar != NULL)
-		archive_read_free(ar);
+	xbps_binpkg_close(bp);
 
 	/* restore */
 	umask(myumask);
@@ -63,6 +63,12 @@
  * dictionary.
  */
 
+/*
+ * The proplib generation when the pkgdb in memory was last in sync
+ * with the storage, and its packages at that time. Objects modified
+ * afterwards have a greater generation.
+ */
+
 int
 xbps_pkgdb_lock(struct xbps_handle *xhp)
 {
@@ -115,16 +121,14 @@ xbps_pkgdb_unlock(struct xbps_handle *xhp)
 	xhp->lock_fd = -1;
 }
 
-static int
-pkgdb_map_vpkgs(struct xbps_handle *xhp)
+int HIDDEN
+xbps_pkgdb_map_vpkg(struct xbps_handle *xhp, const char *vpkgname,
+		const char *vpkg, const char *pkgname)
 {
-	xbps_object_iterator_t iter;
-	xbps_object_t obj;
+	xbps_dictionary_t providers;
+	bool alloc = false;
 	int r = 0;
 
-	if (!xbps_dictionary_count(xhp->pkgdb))
-		return 0;
-
 	if (xhp->vpkgd == NULL) {
 		xhp->vpkgd = xbps_dictionary_create();
 		if (!xhp->vpkgd) {
@@ -134,6 +138,46 @@ pkgdb_map_vpkgs(struct xbps_handle *xhp)
 		}
 	}
 
+	providers = xbps_dictionary_get(xhp->vpkgd, vpkgname);
+	if (!providers) {
+		providers = xbps_dictionary_create();
+		if (!providers) {
+			r = -errno;
+			xbps_error_printf("failed to create dictionary\n");
+			return r;
+		}
+		if (!xbps_dictionary_set(xhp->vpkgd, vpkgname, providers)) {
+			r = -errno;
+			xbps_error_printf("failed to set dictionary entry\n");
+			xbps_object_release(providers);
+			return r;
+		}
+		alloc = true;
+	}
+
+	if (!xbps_dictionary_set_cstring(providers, vpkg, pkgname)) {
+		r = -errno;
+		xbps_error_printf("failed to set dictionary entry\n");
+		if (alloc)
+			xbps_object_release(providers);
+		return r;
+	}
+	if (alloc)
+		xbps_object_release(providers);
+	xbps_dbg_printf("[pkgdb] added vpkg %s for %s\n", vpkg, pkgname);
+	return 0;
+}
+
+static int
+pkgdb_map_vpkgs(struct xbps_handle *xhp)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	int r = 0;
+
+	if (!xbps_dictionary_count(xhp->pkgdb))
+		return 0;
+
 	/*
 	 * This maps all pkgs that have virtualpkgs in pkgdb.
 	 */
@@ -164,42 +208,15 @@ pkgdb_map_vpkgs(struct xbps_handle *xhp)
 		for (unsigned int i = 0; i < cnt; i++) {
 			char vpkgname[XBPS_NAME_SIZE];
 			const char *vpkg = NULL;
-			xbps_dictionary_t providers;
-			bool alloc = false;
 
 			xbps_array_get_cstring_nocopy(provides, i, &vpkg);
 			if (!xbps_pkg_name(vpkgname, sizeof(vpkgname), vpkg)) {
 				xbps_warn_printf("%s: invalid provides: %s\n", pkgver, vpkg);
 				continue;
 			}
-
-			providers = xbps_dictionary_get(xhp->vpkgd, vpkgname);
-			if (!providers) {
-				providers = xbps_dictionary_create();
-				if (!providers) {
-					r = -errno;
-					xbps_error_printf("failed to create dictionary\n");
-					goto out;
-				}
-				if (!xbps_dictionary_set(xhp->vpkgd, vpkgname, providers)) {
-					r = -errno;
-					xbps_error_printf("failed to set dictionary entry\n");
-					xbps_object_release(providers);
-					goto out;
-				}
-				alloc = true;
-			}
-
-			if (!xbps_dictionary_set_cstring(providers, vpkg, pkgname)) {
-				r = -errno;
-				xbps_error_printf("failed to set dictionary entry\n");
-				if (alloc)
-					xbps_object_release(providers);
+			r = xbps_pkgdb_map_vpkg(xhp, vpkgname, vpkg, pkgname);
+			if (r < 0)
 				goto out;
-			}
-			if (alloc)
-				xbps_object_release(providers);
-			xbps_dbg_printf("[pkgdb] added vpkg %s for %s\n", vpkg, pkgname);
 		}
 	}
 out:
@@ -233,6 +250,9 @@ pkgdb_map_names(struct xbps_handle *xhp)
 		if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver)) {
 			continue;
 		}
+		/* don't modify the packages that were already mapped */
+		if (xbps_dictionary_get(pkgd, "pkgname"))
+			continue;
 		if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver)) {
 			rv = EINVAL;
 			break;
@@ -246,6 +266,159 @@ pkgdb_map_names(struct xbps_handle *xhp)
 	return rv;
 }
 
+/*
+ * Records the pkgdb in memory as being in sync with the storage.
+ */
+static void
+pkgdb_synced(struct xbps_handle *xhp)
+{
+	struct xbps_pkgdb_state *state = xhp->pkgdb_state;
+
+	if (state->keys)
+		xbps_object_release(state->keys);
+	state->keys = NULL;
+	if (xhp->pkgdb)
+		state->keys = xbps_dictionary_all_keys(xhp->pkgdb);
+	state->gen = xbps_generation();
+}
+
+static bool
+pkgdb_obj_changed(xbps_object_t obj, uint64_t gen)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t o;
+	bool changed = false;
+
+	switch (xbps_object_type(obj)) {
+	case XBPS_TYPE_DICTIONARY:
+		if (xbps_object_generation(obj) > gen)
+			return true;
+		if ((iter = xbps_dictionary_iterator(obj)) == NULL)
+			return true;
+		while (!changed && (o = xbps_object_iterator_next(iter)))
+			changed = pkgdb_obj_changed(xbps_dictionary_get_keysym(obj, o), gen);
+		xbps_object_iterator_release(iter);
+		return changed;
+	case XBPS_TYPE_ARRAY:
+		if (xbps_object_generation(obj) > gen)
+			return true;
+		for (unsigned int i = 0; !changed && i < xbps_array_count(obj); i++)
+			changed = pkgdb_obj_changed(xbps_array_get(obj, i), gen);
+		return changed;
+	default:
+		/* strings, numbers, booleans and data are immutable */
+		return false;
+	}
+}
+
+/*
+ * Returns the changes to the pkgdb since it was in sync with the storage:
+ * the "set" dictionary with the added or modified packages, and the
+ * "remove" array with the names of the removed packages. Returns NULL if
+ * they are unknown.
+ */
+static xbps_dictionary_t
+pkgdb_changes(struct xbps_handle *xhp)
+{
+	struct xbps_pkgdb_state *state = xhp->pkgdb_state;
+	xbps_dictionary_t changes = NULL, set = NULL;
+	xbps_array_t remove = NULL;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	bool ok = true;
+
+	if (state->keys == NULL)
+		return NULL;
+
+	if ((changes = xbps_dictionary_create()) == NULL ||
+	    (set = xbps_dictionary_create()) == NULL ||
+	    (remove = xbps_array_create()) == NULL ||
+	    !xbps_dictionary_set(changes, "set", set) ||
+	    !xbps_dictionary_set(changes, "remove", remove) ||
+	    (iter = xbps_dictionary_iterator(xhp->pkgdb)) == NULL) {
+		ok = false;
+		goto out;
+	}
+	while (ok && (obj = xbps_object_iterator_next(iter))) {
+		xbps_object_t pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
+
+		if (pkgdb_obj_changed(pkgd, state->gen))
+			ok = xbps_dictionary_set_keysym(set, obj, pkgd);
+	}
+	xbps_object_iterator_release(iter);
+	for (unsigned int i = 0; ok && i < xbps_array_count(state->keys); i++) {
+		const char *pkgname;
+
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(
+		    xbps_array_get(state->keys, i));
+		if (!xbps_dictionary_get(xhp->pkgdb, pkgname))
+			ok = xbps_array_add_cstring(remove, pkgname);
+	}
+out:
+	if (set)
+		xbps_object_release(set);
+	if (remove)
+		xbps_object_release(remove);
+	if (!ok && changes) {
+		xbps_object_release(changes);
+		changes = NULL;
+	}
+	return changes;
+}
+
+static int
+pkgdb_write(struct xbps_handle *xhp)
+{
+	struct xbps_pkgdb_stamp stamp;
+	mode_t prev_umask;
+	int rv;
+
+	prev_umask = umask(022);
+	if (!xbps_dictionary_externalize_to_file(xhp->pkgdb, xhp->pkgdb_plist)) {
+		rv = errno;
+		umask(prev_umask);
+		return rv;
+	}
+	umask(prev_umask);
+	/* the plist includes the journal records now */
+	xbps_pkgdb_journal_remove(xhp);
+	if (xbps_pkgdb_cache_stamp(xhp, &stamp) == 0)
+		(void)xbps_pkgdb_cache_write(xhp, &stamp);
+	return 0;
+}
+
+/*
+ * Only the packages changed since the pkgdb was in sync with the storage
+ * are written, to the journal if it's enabled. The whole plist is written
+ * if the changes are unknown, or the journal must be compacted.
+ */
+static int
+pkgdb_flush(struct xbps_handle *xhp)
+{
+	xbps_dictionary_t changes;
+	unsigned int nset, nremove;
+	int r = -ENOTSUP;
+
+	if ((changes = pkgdb_changes(xhp)) == NULL)
+		return pkgdb_write(xhp);
+
+	nset = xbps_dictionary_count(xbps_dictionary_get(changes, "set"));
+	nremove = xbps_array_count(xbps_dictionary_get(changes, "remove"));
+	if (nset == 0 && nremove == 0 && access(xhp->pkgdb_plist, F_OK) == 0) {
+		xbps_object_release(changes);
+		xbps_dbg_printf("[pkgdb] unchanged, nothing to flush\n");
+		return 0;
+	}
+	xbps_dbg_printf("[pkgdb] flushing %u changed and %u removed packages\n",
+	    nset, nremove);
+	if (xhp->flags & XBPS_FLAG_PKGDB_JOURNAL)
+		r = xbps_pkgdb_journal_append(xhp, changes);
+	xbps_object_release(changes);
+	if (r == 0)
+		return 0;
+	return pkgdb_write(xhp);
+}
+
 int HIDDEN
 xbps_pkgdb_init(struct xbps_handle *xhp)
 {
@@ -270,6 +443,11 @@ xbps_pkgdb_init(struct xbps_handle *xhp)
 			xbps_error_printf("failed to initialize pkgdb: %s\n", strerror(rv));
 		return rv;
 	}
+	/* the snapshot has the pkgname and vpkg maps already applied */
+	if (xhp->pkgdb_state->snapshot) {
+		xbps_dbg_printf("[pkgdb] initialized ok.\n");
+		return 0;
+	}
 	if ((rv = pkgdb_map_names(xhp)) != 0) {
 		xbps_dbg_printf("[pkgdb] pkgdb_map_names %s\n", strerror(rv));
 		return rv;
@@ -279,6 +457,14 @@ xbps_pkgdb_init(struct xbps_handle *xhp)
 		return rv;
 	}
 	assert(xhp->pkgdb);
+	/* "pkgname" is derived from "pkgver", it doesn't need to be written */
+	pkgdb_synced(xhp);
+	/*
+	 * Regenerate a missing or stale snapshot, only with the pkgdb
+	 * locked: the plist must not change after it was read.
+	 */
+	if (xhp->pkgdb_state->stamped && xbps_dictionary_count(xhp->pkgdb))
+		(void)xbps_pkgdb_cache_write(xhp, &xhp->pkgdb_state->stamp);
 	xbps_dbg_printf("[pkgdb] initialized ok.\n");
 
 	return 0;
@@ -287,49 +473,80 @@ xbps_pkgdb_init(struct xbps_handle *xhp)
 int
 xbps_pkgdb_update(struct xbps_handle *xhp, bool flush, bool update)
 {
-	xbps_dictionary_t pkgdb_storage;
-	mode_t prev_umask;
 	static int cached_rv;
-	int rv = 0;
+	struct xbps_pkgdb_state *state;
+	uint64_t journal_off = 0, journal_end;
+	int r, rv = 0;
 
 	if (cached_rv && !flush)
 		return cached_rv;
 
 	if (xhp->pkgdb && flush) {
-		pkgdb_storage = xbps_dictionary_internalize_from_file(xhp->pkgdb_plist);
-		if (pkgdb_storage == NULL ||
-		    !xbps_dictionary_equals(xhp->pkgdb, pkgdb_storage)) {
-			/* flush dictionary to storage */
-			prev_umask = umask(022);
-			if (!xbps_dictionary_externalize_to_file(xhp->pkgdb, xhp->pkgdb_plist)) {
-				umask(prev_umask);
-				return errno;
-			}
-			umask(prev_umask);
+		/*
+		 * Packages registered by this transaction lack "pkgname",
+		 * map them before writing them.
+		 */
+		(void)pkgdb_map_names(xhp);
+		/* the plists must be on disk before the pkgdb refers to them */
+		if ((r = xbps_pkgdb_files_flush(xhp)) < 0)
+			return -r;
+		if ((rv = pkgdb_flush(xhp)) != 0)
+			return rv;
+		xbps_pkgdb_files_unlink(xhp);
+		(void)xbps_files_index_flush(xhp);
+		cached_rv = 0;
+		/* the copy in memory is what was just written, keep it */
+		if (update) {
+			pkgdb_synced(xhp);
+			return 0;
 		}
-		if (pkgdb_storage)
-			xbps_object_release(pkgdb_storage);
-
 		xbps_object_release(xhp->pkgdb);
 		xhp->pkgdb = NULL;
-		cached_rv = 0;
+		pkgdb_synced(xhp);
 	}
 	if (!update)
 		return rv;
 
 	/* update copy in memory */
-	if ((xhp->pkgdb = xbps_dictionary_internalize_from_file(xhp->pkgdb_plist)) == NULL) {
-		rv = errno;
-		if (!rv)
-			rv = EINVAL;
-
-		if (rv == ENOENT)
-			xhp->pkgdb = xbps_dictionary_create();
-		else
-			xbps_error_printf("cannot access to pkgdb: %s\n", strerror(rv));
-
-		cached_rv = rv = errno;
+	if (xhp->pkgdb_state == NULL &&
+	    (xhp->pkgdb_state = calloc(1, sizeof(*xhp->pkgdb_state))) == NULL)
+		return ENOMEM;
+	state = xhp->pkgdb_state;
+	state->snapshot = state->stamped = false;
+	xbps_pkgdb_shlibs_release(xhp);
+	xbps_files_index_stamp_pkgdb(xhp);
+	journal_end = xbps_pkgdb_journal_open(xhp);
+	if (xbps_pkgdb_cache_load(xhp, &journal_off) == 0) {
+		/* journal records not in the snapshot need to be mapped */
+		state->snapshot = journal_off == journal_end;
+	} else {
+		/*
+		 * Identify the plist before reading it, to regenerate the
+		 * snapshot. Only with the pkgdb locked it can't change.
+		 */
+		if (xhp->lock_fd != -1)
+			state->stamped = xbps_pkgdb_cache_stamp(xhp, &state->stamp) == 0;
+		if ((xhp->pkgdb = xbps_dictionary_internalize_from_file(xhp->pkgdb_plist)) == NULL) {
+			rv = errno;
+			if (!rv)
+				rv = EINVAL;
+			state->stamped = false;
+
+			if (rv == ENOENT)
+				xhp->pkgdb = xbps_dictionary_create();
+			else
+				xbps_error_printf("cannot access to pkgdb: %s\n", strerror(rv));
+
+			cached_rv = rv = errno;
+		}
 	}
+	if (xhp->pkgdb && (r = xbps_pkgdb_journal_replay(xhp, journal_off)) < 0) {
+		xbps_error_printf("cannot replay pkgdb journal: %s\n", strerror(-r));
+		xbps_object_release(xhp->pkgdb);
+		xhp->pkgdb = NULL;
+		cached_rv = rv = -r;
+	}
+	pkgdb_synced(xhp);
 
 	return rv;
 }
@@ -342,6 +559,14 @@ xbps_pkgdb_release(struct xbps_handle *xhp)
 	xbps_pkgdb_unlock(xhp);
 	if (xhp->pkgdb)
 		xbps_object_release(xhp->pkgdb);
+	if (xhp->pkgdb_state && xhp->pkgdb_state->keys)
+		xbps_object_release(xhp->pkgdb_state->keys);
+	xbps_pkgdb_files_release(xhp);
+	xbps_triggers_release(xhp);
+	xbps_files_index_release(xhp);
+	xbps_pkgdb_shlibs_release(xhp);
+	free(xhp->pkgdb_state);
+	xhp->pkgdb_state = NULL;
 	xbps_dbg_printf("[pkgdb] released ok.\n");
 }
 
@@ -513,7 +738,7 @@ xbps_pkgdb_get_pkg_fulldeptree(struct xbps_handle *xhp, const char *pkg)
 xbps_dictionary_t
 xbps_pkgdb_get_pkg_files(struct xbps_handle *xhp, const char *pkg)
 {
-	xbps_dictionary_t pkgd;
+	xbps_dictionary_t pkgd, filesd;
 	const char *pkgver = NULL;
 	char pkgname[XBPS_NAME_SIZE], plist[PATH_MAX];
 
@@ -528,6 +753,11 @@ xbps_pkgdb_get_pkg_files(struct xbps_handle *xhp, const char *pkg)
 	if (!xbps_pkg_name(pkgname, sizeof(pkgname), pkgver))
 		return NULL;
 
+	/* not written yet, or up to date in the files index */
+	if (xbps_pkgdb_files_staged(xhp, pkgname, &filesd) == 0 ||
+	    xbps_files_index_get_pkg_files(xhp, pkgname, pkgd, &filesd) == 0)
+		return filesd;
+
 	snprintf(plist, sizeof(plist)-1, "%s/.%s-files.plist", xhp->metadir, pkgname);
 	return xbps_plist_dictionary_from_file(plist);
 }
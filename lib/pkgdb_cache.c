@@ -0,0 +1,535 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+
+/**
+ * @file lib/pkgdb_cache.c
+ * @brief Binary pkgdb snapshot
+ *
+ * The snapshot is a pre-parsed copy of the pkgdb plist with the
+ * "pkgname" objects already mapped, followed by the virtual packages
+ * provided by installed packages. Loading it avoids parsing the XML
+ * plist and the passes over the pkgdb done by xbps_pkgdb_init().
+ *
+ * The snapshot records the size, mtime, inode and SHA256 of the plist it
+ * was generated from and is only used while they still match, the hash
+ * is only checked on file systems without sub-second timestamps. It also
+ * records the size of the pkgdb journal it includes, the records appended
+ * to the journal afterwards are replayed on top of it.
+ *
+ * The snapshot ends with the shlibs index of lib/pkgdb_shlibs.c, which
+ * keeps it mapped.
+ */
+
+#define PKGDB_CACHE_MAGIC	"XBPSPKDB"
+#define PKGDB_CACHE_VERSION	3
+#define PKGDB_CACHE_MAXDEPTH	32
+
+enum {
+	TAG_DICT = 'd',
+	TAG_ARRAY = 'a',
+	TAG_STRING = 's',
+	TAG_INT = 'i',
+	TAG_UINT = 'u',
+	TAG_TRUE = 't',
+	TAG_FALSE = 'f',
+	TAG_DATA = 'x',
+};
+
+struct pkgdb_cache_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t plist_size;
+	uint64_t plist_ino;
+	int64_t plist_mtime;
+	int64_t plist_mtime_nsec;
+	unsigned char plist_sha256[XBPS_SHA256_DIGEST_SIZE];
+	uint64_t journal_id;
+	uint64_t journal_size;
+};
+
+struct cursor {
+	const char *p;
+	const char *end;
+};
+
+static char *
+cache_path(struct xbps_handle *xhp)
+{
+	return xbps_xasprintf("%s.cache", xhp->pkgdb_plist);
+}
+
+/*
+ * Writer
+ */
+static bool
+put(FILE *fp, const void *data, size_t len)
+{
+	return fwrite(data, 1, len, fp) == len;
+}
+
+static bool
+put_tag(FILE *fp, char tag)
+{
+	return fputc(tag, fp) != EOF;
+}
+
+static bool
+put_u32(FILE *fp, uint32_t v)
+{
+	return put(fp, &v, sizeof(v));
+}
+
+static bool
+put_str(FILE *fp, const char *s)
+{
+	size_t len = strlen(s);
+
+	if (len >= UINT32_MAX)
+		return false;
+	return put_u32(fp, (uint32_t)len) && put(fp, s, len + 1);
+}
+
+static bool
+put_obj(FILE *fp, xbps_object_t obj, unsigned int depth)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t o;
+	bool ok = true;
+
+	if (depth > PKGDB_CACHE_MAXDEPTH)
+		return false;
+
+	switch (xbps_object_type(obj)) {
+	case XBPS_TYPE_DICTIONARY:
+		if (!put_tag(fp, TAG_DICT) ||
+		    !put_u32(fp, xbps_dictionary_count(obj)))
+			return false;
+		iter = xbps_dictionary_iterator(obj);
+		if (!iter)
+			return false;
+		while (ok && (o = xbps_object_iterator_next(iter))) {
+			ok = put_str(fp, xbps_dictionary_keysym_cstring_nocopy(o)) &&
+			    put_obj(fp, xbps_dictionary_get_keysym(obj, o), depth + 1);
+		}
+		xbps_object_iterator_release(iter);
+		return ok;
+	case XBPS_TYPE_ARRAY:
+		if (!put_tag(fp, TAG_ARRAY) ||
+		    !put_u32(fp, xbps_array_count(obj)))
+			return false;
+		for (unsigned int i = 0; ok && i < xbps_array_count(obj); i++)
+			ok = put_obj(fp, xbps_array_get(obj, i), depth + 1);
+		return ok;
+	case XBPS_TYPE_STRING:
+		return put_tag(fp, TAG_STRING) &&
+		    put_str(fp, xbps_string_cstring_nocopy(obj));
+	case XBPS_TYPE_NUMBER:
+		if (xbps_number_unsigned(obj)) {
+			uint64_t v = xbps_number_unsigned_integer_value(obj);
+			return put_tag(fp, TAG_UINT) && put(fp, &v, sizeof(v));
+		} else {
+			int64_t v = xbps_number_integer_value(obj);
+			return put_tag(fp, TAG_INT) && put(fp, &v, sizeof(v));
+		}
+	case XBPS_TYPE_BOOL:
+		return put_tag(fp, xbps_bool_true(obj) ? TAG_TRUE : TAG_FALSE);
+	case XBPS_TYPE_DATA:
+		if (xbps_data_size(obj) >= UINT32_MAX)
+			return false;
+		return put_tag(fp, TAG_DATA) &&
+		    put_u32(fp, (uint32_t)xbps_data_size(obj)) &&
+		    put(fp, xbps_data_data_nocopy(obj), xbps_data_size(obj));
+	default:
+		return false;
+	}
+}
+
+static bool
+put_vpkgs(FILE *fp, xbps_dictionary_t pkgdb)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	uint32_t cnt = 0;
+	bool ok = true;
+
+	for (int pass = 0; ok && pass < 2; pass++) {
+		if (pass == 1 && !put_u32(fp, cnt))
+			return false;
+		iter = xbps_dictionary_iterator(pkgdb);
+		if (!iter)
+			return false;
+		while (ok && (obj = xbps_object_iterator_next(iter))) {
+			xbps_dictionary_t pkgd = xbps_dictionary_get_keysym(pkgdb, obj);
+			xbps_array_t provides = xbps_dictionary_get(pkgd, "provides");
+			const char *pkgname = NULL;
+
+			if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgname", &pkgname))
+				continue;
+			for (unsigned int i = 0; ok && i < xbps_array_count(provides); i++) {
+				char vpkgname[XBPS_NAME_SIZE];
+				const char *vpkg = NULL;
+
+				xbps_array_get_cstring_nocopy(provides, i, &vpkg);
+				if (!vpkg || !xbps_pkg_name(vpkgname, sizeof(vpkgname), vpkg))
+					continue;
+				if (pass == 0) {
+					cnt++;
+					continue;
+				}
+				ok = put_str(fp, vpkgname) && put_str(fp, vpkg) &&
+				    put_str(fp, pkgname);
+			}
+		}
+		xbps_object_iterator_release(iter);
+	}
+	return ok;
+}
+
+/*
+ * Identifies the current pkgdb plist. Called before the plist is read, the
+ * snapshot of what was read must not be stamped with a newer plist.
+ */
+int HIDDEN
+xbps_pkgdb_cache_stamp(struct xbps_handle *xhp, struct xbps_pkgdb_stamp *stamp)
+{
+	struct stat st;
+
+	if (stat(xhp->pkgdb_plist, &st) == -1)
+		return -errno;
+	stamp->size = (uint64_t)st.st_size;
+	stamp->ino = (uint64_t)st.st_ino;
+	stamp->mtime = st.st_mtim.tv_sec;
+	stamp->mtime_nsec = st.st_mtim.tv_nsec;
+	if (!xbps_file_sha256_raw(stamp->sha256, sizeof(stamp->sha256),
+	    xhp->pkgdb_plist))
+		return errno ? -errno : -EIO;
+	return 0;
+}
+
+/*
+ * Writes the snapshot of the pkgdb in memory, read from the plist
+ * identified by \a stamp. The caller must hold the pkgdb lock.
+ */
+int HIDDEN
+xbps_pkgdb_cache_write(struct xbps_handle *xhp,
+		const struct xbps_pkgdb_stamp *stamp)
+{
+	struct pkgdb_cache_hdr hdr;
+	char *path, *tmp = NULL;
+	FILE *fp = NULL;
+	int fd, r = 0;
+
+	if (!xhp->pkgdb)
+		return -EINVAL;
+
+	path = cache_path(xhp);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PKGDB_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = PKGDB_CACHE_VERSION;
+	hdr.plist_size = stamp->size;
+	hdr.plist_ino = stamp->ino;
+	hdr.plist_mtime = stamp->mtime;
+	hdr.plist_mtime_nsec = stamp->mtime_nsec;
+	memcpy(hdr.plist_sha256, stamp->sha256, sizeof(hdr.plist_sha256));
+	hdr.journal_size = xbps_pkgdb_journal_size(xhp, &hdr.journal_id);
+
+	tmp = xbps_xasprintf("%s.XXXXXXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		r = -errno;
+		free(tmp);
+		tmp = NULL;
+		goto out;
+	}
+	if (fchmod(fd, 0644) == -1 || !(fp = fdopen(fd, "w"))) {
+		r = -errno;
+		close(fd);
+		goto out;
+	}
+	if (!put(fp, &hdr, sizeof(hdr)) ||
+	    !put_obj(fp, xhp->pkgdb, 0) ||
+	    !put_vpkgs(fp, xhp->pkgdb)) {
+		r = errno ? -errno : -EINVAL;
+		goto out;
+	}
+	if ((r = xbps_pkgdb_shlibs_write(xhp, fp)) < 0)
+		goto out;
+	if (fflush(fp) == EOF || fsync(fileno(fp)) == -1) {
+		r = -errno;
+		goto out;
+	}
+	if (fclose(fp) == EOF) {
+		fp = NULL;
+		r = -errno;
+		goto out;
+	}
+	fp = NULL;
+	if (rename(tmp, path) == -1) {
+		r = -errno;
+		goto out;
+	}
+	free(tmp);
+	tmp = NULL;
+	xbps_dbg_printf("[pkgdb] wrote snapshot %s\n", path);
+out:
+	if (fp)
+		fclose(fp);
+	if (tmp) {
+		unlink(tmp);
+		free(tmp);
+	}
+	if (r < 0) {
+		xbps_dbg_printf("[pkgdb] failed to write snapshot %s: %s\n",
+		    path, strerror(-r));
+	}
+	free(path);
+	return r;
+}
+
+/*
+ * Reader
+ */
+static bool
+get(struct cursor *c, void *dst, size_t len)
+{
+	if ((size_t)(c->end - c->p) < len)
+		return false;
+	memcpy(dst, c->p, len);
+	c->p += len;
+	return true;
+}
+
+static const char *
+get_str(struct cursor *c)
+{
+	const char *s;
+	uint32_t len;
+
+	if (!get(c, &len, sizeof(len)) || (size_t)(c->end - c->p) <= len ||
+	    c->p[len] != '\0')
+		return NULL;
+	s = c->p;
+	c->p += len + 1;
+	return s;
+}
+
+static xbps_object_t
+get_obj(struct cursor *c, unsigned int depth)
+{
+	xbps_object_t obj = NULL, o;
+	const char *s;
+	uint32_t cnt;
+	uint64_t u;
+	int64_t i;
+	char tag;
+
+	if (depth > PKGDB_CACHE_MAXDEPTH || !get(c, &tag, sizeof(tag)))
+		return NULL;
+
+	switch (tag) {
+	case TAG_DICT:
+		/* every entry is at least a key and a tag */
+		if (!get(c, &cnt, sizeof(cnt)) || cnt > (size_t)(c->end - c->p) / 6)
+			return NULL;
+		obj = xbps_dictionary_create_with_capacity(cnt);
+		for (uint32_t n = 0; obj && n < cnt; n++) {
+			if (!(s = get_str(c)) || !(o = get_obj(c, depth + 1))) {
+				xbps_object_release(obj);
+				return NULL;
+			}
+			if (!xbps_dictionary_set(obj, s, o)) {
+				xbps_object_release(o);
+				xbps_object_release(obj);
+				return NULL;
+			}
+			xbps_object_release(o);
+		}
+		return obj;
+	case TAG_ARRAY:
+		if (!get(c, &cnt, sizeof(cnt)) || cnt > (size_t)(c->end - c->p))
+			return NULL;
+		obj = xbps_array_create_with_capacity(cnt);
+		for (uint32_t n = 0; obj && n < cnt; n++) {
+			if (!(o = get_obj(c, depth + 1))) {
+				xbps_object_release(obj);
+				return NULL;
+			}
+			if (!xbps_array_add(obj, o)) {
+				xbps_object_release(o);
+				xbps_object_release(obj);
+				return NULL;
+			}
+			xbps_object_release(o);
+		}
+		return obj;
+	case TAG_STRING:
+		if (!(s = get_str(c)))
+			return NULL;
+		return xbps_string_create_cstring(s);
+	case TAG_INT:
+		if (!get(c, &i, sizeof(i)))
+			return NULL;
+		return xbps_number_create_integer(i);
+	case TAG_UINT:
+		if (!get(c, &u, sizeof(u)))
+			return NULL;
+		return xbps_number_create_unsigned_integer(u);
+	case TAG_TRUE:
+	case TAG_FALSE:
+		return xbps_bool_create(tag == TAG_TRUE);
+	case TAG_DATA:
+		if (!get(c, &cnt, sizeof(cnt)) || (size_t)(c->end - c->p) < cnt)
+			return NULL;
+		obj = xbps_data_create_data(c->p, cnt);
+		c->p += cnt;
+		return obj;
+	default:
+		return NULL;
+	}
+}
+
+static bool
+cache_valid(struct xbps_handle *xhp, const struct pkgdb_cache_hdr *hdr,
+		const char *path)
+{
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	struct stat st, cst;
+	uint64_t journal_id;
+
+	if (memcmp(hdr->magic, PKGDB_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != PKGDB_CACHE_VERSION)
+		return false;
+	/* the records it includes must still be in the journal */
+	if (hdr->journal_size != 0 &&
+	    (hdr->journal_size > xbps_pkgdb_journal_size(xhp, &journal_id) ||
+	    hdr->journal_id != journal_id))
+		return false;
+	if (stat(xhp->pkgdb_plist, &st) == -1)
+		return false;
+	if (hdr->plist_size != (uint64_t)st.st_size ||
+	    hdr->plist_ino != (uint64_t)st.st_ino ||
+	    hdr->plist_mtime != st.st_mtim.tv_sec ||
+	    hdr->plist_mtime_nsec != st.st_mtim.tv_nsec)
+		return false;
+	/*
+	 * Without sub-second timestamps the mtime can't tell apart writes
+	 * within the same second, which only matters if the plist could
+	 * have been written again after the snapshot in that second.
+	 */
+	if (st.st_mtim.tv_nsec == 0 &&
+	    (stat(path, &cst) == -1 || cst.st_mtim.tv_sec <= st.st_mtim.tv_sec)) {
+		if (!xbps_file_sha256_raw(digest, sizeof(digest), xhp->pkgdb_plist))
+			return false;
+		if (memcmp(digest, hdr->plist_sha256, sizeof(digest)) != 0)
+			return false;
+	}
+	return true;
+}
+
+int HIDDEN
+xbps_pkgdb_cache_load(struct xbps_handle *xhp, uint64_t *journal_offp)
+{
+	struct pkgdb_cache_hdr hdr;
+	struct cursor c;
+	xbps_dictionary_t pkgdb = NULL;
+	char *path;
+	void *mf = NULL;
+	size_t mflen = 0, flen = 0;
+	uint64_t journal_id;
+	uint32_t nvpkgs;
+	bool replay;
+	int r = 0;
+
+	path = cache_path(xhp);
+	if (!xbps_mmap_file(path, &mf, &mflen, &flen)) {
+		r = -errno;
+		goto out;
+	}
+	c.p = mf;
+	c.end = c.p + flen;
+	if (!get(&c, &hdr, sizeof(hdr)) || !cache_valid(xhp, &hdr, path)) {
+		r = -ESTALE;
+		goto out;
+	}
+	pkgdb = get_obj(&c, 0);
+	if (xbps_object_type(pkgdb) != XBPS_TYPE_DICTIONARY ||
+	    !get(&c, &nvpkgs, sizeof(nvpkgs))) {
+		r = -EINVAL;
+		goto out;
+	}
+	/*
+	 * The packages changed by the journal records that are not in the
+	 * snapshot can provide other virtual packages, they are mapped
+	 * again by xbps_pkgdb_init() after the records are replayed.
+	 */
+	replay = hdr.journal_size != xbps_pkgdb_journal_size(xhp, &journal_id);
+	for (uint32_t i = 0; !replay && i < nvpkgs; i++) {
+		const char *vpkgname, *vpkg, *pkgname;
+
+		if (!(vpkgname = get_str(&c)) || !(vpkg = get_str(&c)) ||
+		    !(pkgname = get_str(&c))) {
+			r = -EINVAL;
+			goto out;
+		}
+		r = xbps_pkgdb_map_vpkg(xhp, vpkgname, vpkg, pkgname);
+		if (r < 0)
+			goto out;
+	}
+	/* and can change the shlibs they provide and require */
+	if (!replay &&
+	    xbps_pkgdb_shlibs_attach(xhp, mf, mflen, c.p, (size_t)(c.end - c.p)) == 0)
+		mf = NULL;
+	xhp->pkgdb = pkgdb;
+	pkgdb = NULL;
+	*journal_offp = hdr.journal_size;
+	xbps_dbg_printf("[pkgdb] loaded snapshot %s\n", path);
+out:
+	if (pkgdb)
+		xbps_object_release(pkgdb);
+	if (mf)
+		(void)munmap(mf, mflen);
+	if (r < 0 && r != -ENOENT) {
+		xbps_dbg_printf("[pkgdb] ignoring snapshot %s: %s\n",
+		    path, strerror(-r));
+	}
+	free(path);
+	return r;
+}
@@ -0,0 +1,314 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+#include "uthash.h"
+
+/**
+ * @file lib/pkgdb_files.c
+ * @brief Deferred writes of package files plists
+ *
+ * The files plist of every unpacked package, and the removal of the
+ * plist of every removed package, are staged in memory and applied by
+ * xbps_pkgdb_update() right before the pkgdb is written. The plists are
+ * written to temporary files in batches of FLUSH_BATCH, every batch is
+ * synced and closed before the next one is written, so a transaction never
+ * holds more than FLUSH_BATCH descriptors. The temporary files are renamed
+ * once all are written and the metadir is synced once, instead of syncing
+ * every plist while the packages are unpacked. The plists of removed
+ * packages are only unlinked after the pkgdb was written.
+ *
+ * Staged plists are hashed in memory for their "metafile-sha256" and
+ * returned by xbps_pkgdb_get_pkg_files() until they are written.
+ */
+
+#define FLUSH_BATCH	64
+
+/* hashed in xhp->pkgdb_state */
+struct xbps_staged_files {
+	char *pkgname;
+	/* NULL if the plist is removed */
+	char *xml;
+	size_t len;
+	char sha256[XBPS_SHA256_SIZE];
+	char *tmp;
+	int fd;
+	UT_hash_handle hh;
+};
+
+static void
+staged_free(struct xbps_staged_files *sf)
+{
+	if (sf->fd != -1)
+		(void)close(sf->fd);
+	if (sf->tmp) {
+		(void)unlink(sf->tmp);
+		free(sf->tmp);
+	}
+	free(sf->pkgname);
+	free(sf->xml);
+	free(sf);
+}
+
+int HIDDEN
+xbps_pkgdb_files_stage(struct xbps_handle *xhp, const char *pkgname,
+		xbps_dictionary_t filesd)
+{
+	struct xbps_staged_files *sf, *old = NULL;
+
+	if ((sf = calloc(1, sizeof(*sf))) == NULL)
+		return -errno;
+	sf->fd = -1;
+	if ((sf->pkgname = strdup(pkgname)) == NULL)
+		goto err;
+	if (xbps_dictionary_count(filesd)) {
+		/* the same bytes xbps_dictionary_externalize_to_file() writes */
+		if ((sf->xml = xbps_dictionary_externalize(filesd)) == NULL)
+			goto err;
+		sf->len = strlen(sf->xml);
+		if (!xbps_buffer_sha256(sf->sha256, sizeof(sf->sha256),
+		    sf->xml, sf->len))
+			goto err;
+	}
+	HASH_REPLACE_STR(xhp->pkgdb_state->staged_files, pkgname, sf, old);
+	if (old)
+		staged_free(old);
+	return 0;
+err:
+	if (!errno)
+		errno = ENOMEM;
+	staged_free(sf);
+	return -errno;
+}
+
+int HIDDEN
+xbps_pkgdb_files_staged(struct xbps_handle *xhp, const char *pkgname,
+		xbps_dictionary_t *filesdp)
+{
+	struct xbps_staged_files *sf;
+
+	if (xhp->pkgdb_state == NULL)
+		return -ENOENT;
+	HASH_FIND_STR(xhp->pkgdb_state->staged_files, pkgname, sf);
+	if (sf == NULL)
+		return -ENOENT;
+	*filesdp = NULL;
+	if (sf->xml && (*filesdp = xbps_dictionary_internalize(sf->xml)) == NULL)
+		return -EINVAL;
+	return 0;
+}
+
+bool HIDDEN
+xbps_pkgdb_files_sha256(struct xbps_handle *xhp, const char *pkgname,
+		char *dst, size_t len)
+{
+	struct xbps_staged_files *sf;
+	char *plist;
+	bool rv;
+
+	HASH_FIND_STR(xhp->pkgdb_state->staged_files, pkgname, sf);
+	if (sf) {
+		if (sf->xml == NULL)
+			return false;
+		return xbps_strlcpy(dst, sf->sha256, len) < len;
+	}
+	plist = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir, pkgname);
+	rv = xbps_file_sha256(dst, len, plist);
+	free(plist);
+	return rv;
+}
+
+static int
+staged_write(struct xbps_handle *xhp, struct xbps_staged_files *sf)
+{
+	const char *p = sf->xml;
+	size_t left = sf->len;
+
+	sf->tmp = xbps_xasprintf("%s/.%s-files.plist.XXXXXX", xhp->metadir,
+	    sf->pkgname);
+	if ((sf->fd = mkstemp(sf->tmp)) == -1) {
+		free(sf->tmp);
+		sf->tmp = NULL;
+		return -errno;
+	}
+	if (fchmod(sf->fd, 0644) == -1)
+		return -errno;
+	while (left > 0) {
+		ssize_t n = write(sf->fd, p, left);
+
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += n;
+		left -= n;
+	}
+#ifdef __linux__
+	/* start the writeback now, the batch is synced together later */
+	(void)sync_file_range(sf->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+	return 0;
+}
+
+static int
+staged_sync(struct xbps_staged_files **batch, size_t n)
+{
+	int r = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		struct xbps_staged_files *sf = batch[i];
+
+#ifdef HAVE_FDATASYNC
+		if (r == 0 && fdatasync(sf->fd) == -1)
+#else
+		if (r == 0 && fsync(sf->fd) == -1)
+#endif
+			r = -errno;
+		if (close(sf->fd) == -1 && r == 0)
+			r = -errno;
+		sf->fd = -1;
+	}
+	return r;
+}
+
+/*
+ * Writes and renames the staged plists, called before the pkgdb is
+ * written. The plists of removed packages are kept staged until
+ * xbps_pkgdb_files_unlink() is called.
+ */
+int HIDDEN
+xbps_pkgdb_files_flush(struct xbps_handle *xhp)
+{
+	struct xbps_staged_files **staged = &xhp->pkgdb_state->staged_files;
+	struct xbps_staged_files *sf, *tmp, *batch[FLUSH_BATCH];
+	char *plist;
+	size_t n = 0;
+	int dfd, r = 0;
+
+	if (*staged == NULL)
+		return 0;
+
+	HASH_ITER(hh, *staged, sf, tmp) {
+		if (sf->xml == NULL)
+			continue;
+		if ((r = staged_write(xhp, sf)) < 0)
+			goto err;
+		batch[n++] = sf;
+		if (n == FLUSH_BATCH) {
+			r = staged_sync(batch, n);
+			n = 0;
+			if (r < 0)
+				goto err;
+		}
+	}
+	if ((r = staged_sync(batch, n)) < 0)
+		goto err;
+	HASH_ITER(hh, *staged, sf, tmp) {
+		if (sf->tmp == NULL)
+			continue;
+		plist = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir,
+		    sf->pkgname);
+		if (rename(sf->tmp, plist) == -1) {
+			r = -errno;
+			free(plist);
+			goto err;
+		}
+		free(plist);
+		free(sf->tmp);
+		sf->tmp = NULL;
+		HASH_DEL(*staged, sf);
+		staged_free(sf);
+	}
+	/* make the renames durable before the pkgdb refers to the plists */
+	if ((dfd = open(xhp->metadir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) != -1) {
+		(void)fsync(dfd);
+		(void)close(dfd);
+	}
+	return 0;
+err:
+	xbps_error_printf("failed to write package files plists to %s: %s\n",
+	    xhp->metadir, strerror(-r));
+	/* keep the plists staged, but drop the temporary files */
+	HASH_ITER(hh, *staged, sf, tmp) {
+		if (sf->fd != -1)
+			(void)close(sf->fd);
+		sf->fd = -1;
+		if (sf->tmp) {
+			(void)unlink(sf->tmp);
+			free(sf->tmp);
+			sf->tmp = NULL;
+		}
+	}
+	return r;
+}
+
+/*
+ * Removes the plists of removed packages, called once the pkgdb without
+ * them was written.
+ */
+void HIDDEN
+xbps_pkgdb_files_unlink(struct xbps_handle *xhp)
+{
+	struct xbps_staged_files **staged = &xhp->pkgdb_state->staged_files;
+	struct xbps_staged_files *sf, *tmp;
+	char *plist;
+
+	HASH_ITER(hh, *staged, sf, tmp) {
+		if (sf->xml)
+			continue;
+		plist = xbps_xasprintf("%s/.%s-files.plist", xhp->metadir,
+		    sf->pkgname);
+		if (unlink(plist) == -1 && errno != ENOENT) {
+			xbps_dbg_printf("[pkgdb] failed to remove %s: %s\n",
+			    plist, strerror(errno));
+		}
+		free(plist);
+		HASH_DEL(*staged, sf);
+		staged_free(sf);
+	}
+}
+
+void HIDDEN
+xbps_pkgdb_files_release(struct xbps_handle *xhp)
+{
+	struct xbps_staged_files *sf, *tmp;
+
+	if (xhp->pkgdb_state == NULL)
+		return;
+	HASH_ITER(hh, xhp->pkgdb_state->staged_files, sf, tmp) {
+		HASH_DEL(xhp->pkgdb_state->staged_files, sf);
+		staged_free(sf);
+	}
+}
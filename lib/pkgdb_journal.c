@@ -0,0 +1,355 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "xbps_api_impl.h"
+
+/**
+ * @file lib/pkgdb_journal.c
+ * @brief pkgdb journal
+ *
+ * With the \a pkgdbjournal option, the packages changed since the pkgdb
+ * plist was written are appended to a journal instead of writing the
+ * whole plist again. Each record is a plist dictionary with the
+ * "set" dictionary of the changed objects keyed by package name, and
+ * the "remove" array of the removed package names, followed by its
+ * length and CRC32.
+ *
+ * The journal records the size, mtime, inode and SHA256 of the plist it
+ * applies to, and is ignored once it does not match. Records are only
+ * appended at the end of the last valid record, a torn record left by
+ * a crash is ignored and overwritten. The journal is compacted into the
+ * plist once it grows over a quarter of the plist.
+ */
+
+#define PKGDB_JOURNAL_MAGIC	"XBPSJRNL"
+#define PKGDB_JOURNAL_VERSION	1
+#define PKGDB_JOURNAL_MINSIZE	(64 * 1024)
+
+struct pkgdb_journal_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t id;
+	uint64_t plist_size;
+	uint64_t plist_ino;
+	int64_t plist_mtime;
+	int64_t plist_mtime_nsec;
+	unsigned char plist_sha256[XBPS_SHA256_DIGEST_SIZE];
+};
+
+struct pkgdb_journal_rec {
+	uint32_t len;
+	uint32_t crc;
+};
+
+static char *
+journal_path(struct xbps_handle *xhp)
+{
+	return xbps_xasprintf("%s.journal", xhp->pkgdb_plist);
+}
+
+static int
+journal_hdr_init(struct xbps_handle *xhp, struct pkgdb_journal_hdr *hdr,
+		const struct stat *st)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, PKGDB_JOURNAL_MAGIC, sizeof(hdr->magic));
+	hdr->version = PKGDB_JOURNAL_VERSION;
+	hdr->plist_size = (uint64_t)st->st_size;
+	hdr->plist_ino = (uint64_t)st->st_ino;
+	hdr->plist_mtime = st->st_mtim.tv_sec;
+	hdr->plist_mtime_nsec = st->st_mtim.tv_nsec;
+	/* the mtime can't tell apart writes within the same second */
+	if (st->st_mtim.tv_nsec == 0 &&
+	    !xbps_file_sha256_raw(hdr->plist_sha256, sizeof(hdr->plist_sha256),
+	    xhp->pkgdb_plist))
+		return errno ? -errno : -EIO;
+	return 0;
+}
+
+static bool
+journal_valid(struct xbps_handle *xhp, const struct pkgdb_journal_hdr *hdr)
+{
+	struct pkgdb_journal_hdr cur;
+	struct stat st;
+
+	if (stat(xhp->pkgdb_plist, &st) == -1 ||
+	    journal_hdr_init(xhp, &cur, &st) < 0)
+		return false;
+	cur.id = hdr->id;
+	return memcmp(hdr, &cur, sizeof(cur)) == 0;
+}
+
+/*
+ * Calls fn for every valid record from offset `from' and returns the
+ * end of the last valid record.
+ */
+static int
+journal_walk(const char *p, size_t len, uint64_t from,
+		int (*fn)(const char *, void *), void *arg, uint64_t *endp)
+{
+	uint64_t off = sizeof(struct pkgdb_journal_hdr);
+	int r = 0;
+
+	while (len - off >= sizeof(struct pkgdb_journal_rec)) {
+		struct pkgdb_journal_rec rec;
+		const char *xml;
+
+		memcpy(&rec, p + off, sizeof(rec));
+		xml = p + off + sizeof(rec);
+		if (rec.len == 0 || len - off - sizeof(rec) < rec.len ||
+		    xml[rec.len - 1] != '\0' ||
+		    crc32(0, (const unsigned char *)xml, rec.len) != rec.crc)
+			break;
+		if (off >= from && fn != NULL && (r = fn(xml, arg)) < 0)
+			break;
+		off += sizeof(rec) + rec.len;
+	}
+	*endp = off;
+	return r;
+}
+
+static int
+journal_apply(const char *xml, void *arg)
+{
+	struct xbps_handle *xhp = arg;
+	xbps_dictionary_t d, set;
+	xbps_array_t remove, keys;
+	int r = 0;
+
+	if ((d = xbps_dictionary_internalize(xml)) == NULL)
+		return -EINVAL;
+	set = xbps_dictionary_get(d, "set");
+	keys = xbps_dictionary_all_keys(set);
+	for (unsigned int i = 0; i < xbps_array_count(keys); i++) {
+		xbps_dictionary_keysym_t ksym = xbps_array_get(keys, i);
+
+		if (!xbps_dictionary_set(xhp->pkgdb,
+		    xbps_dictionary_keysym_cstring_nocopy(ksym),
+		    xbps_dictionary_get_keysym(set, ksym))) {
+			r = -ENOMEM;
+			goto out;
+		}
+	}
+	remove = xbps_dictionary_get(d, "remove");
+	for (unsigned int i = 0; i < xbps_array_count(remove); i++) {
+		const char *pkgname = NULL;
+
+		if (xbps_array_get_cstring_nocopy(remove, i, &pkgname))
+			xbps_dictionary_remove(xhp->pkgdb, pkgname);
+	}
+out:
+	if (keys)
+		xbps_object_release(keys);
+	xbps_object_release(d);
+	return r;
+}
+
+static int
+journal_read(struct xbps_handle *xhp, uint64_t from, bool apply)
+{
+	struct pkgdb_journal_hdr hdr;
+	char *path;
+	void *mf = NULL;
+	size_t mflen = 0, flen = 0;
+	uint64_t end = 0;
+	int r = 0;
+
+	xhp->pkgdb_state->journal_end = 0;
+	path = journal_path(xhp);
+	if (!xbps_mmap_file(path, &mf, &mflen, &flen)) {
+		r = -errno;
+		mf = NULL;
+		goto out;
+	}
+	if (flen < sizeof(hdr)) {
+		r = -EINVAL;
+		goto out;
+	}
+	memcpy(&hdr, mf, sizeof(hdr));
+	/* records are only applied after the journal was opened */
+	if (!apply && !journal_valid(xhp, &hdr)) {
+		r = -ESTALE;
+		goto out;
+	}
+	r = journal_walk(mf, flen, from, apply ? journal_apply : NULL, xhp, &end);
+	if (r < 0)
+		goto out;
+	xhp->pkgdb_state->journal_end = end;
+	xhp->pkgdb_state->journal_id = hdr.id;
+	if (end != flen)
+		xbps_dbg_printf("[pkgdb] ignoring torn journal record at %ju\n",
+		    (uintmax_t)end);
+out:
+	if (mf)
+		(void)munmap(mf, mflen);
+	if (r < 0 && r != -ENOENT)
+		xbps_dbg_printf("[pkgdb] ignoring journal %s: %s\n", path,
+		    strerror(-r));
+	free(path);
+	return r;
+}
+
+uint64_t HIDDEN
+xbps_pkgdb_journal_open(struct xbps_handle *xhp)
+{
+	(void)journal_read(xhp, 0, false);
+	return xhp->pkgdb_state->journal_end;
+}
+
+int HIDDEN
+xbps_pkgdb_journal_replay(struct xbps_handle *xhp, uint64_t from)
+{
+	uint64_t end = xhp->pkgdb_state->journal_end;
+	int r;
+
+	if (end == 0 || from >= end)
+		return 0;
+	r = journal_read(xhp, from, true);
+	if (r == 0)
+		xbps_dbg_printf("[pkgdb] replayed journal from %ju to %ju\n",
+		    (uintmax_t)from, (uintmax_t)xhp->pkgdb_state->journal_end);
+	return r;
+}
+
+uint64_t HIDDEN
+xbps_pkgdb_journal_size(struct xbps_handle *xhp, uint64_t *idp)
+{
+	struct xbps_pkgdb_state *state = xhp->pkgdb_state;
+
+	*idp = state->journal_end ? state->journal_id : 0;
+	return state->journal_end;
+}
+
+int HIDDEN
+xbps_pkgdb_journal_append(struct xbps_handle *xhp, xbps_dictionary_t changes)
+{
+	struct xbps_pkgdb_state *state = xhp->pkgdb_state;
+	struct pkgdb_journal_hdr hdr;
+	struct pkgdb_journal_rec rec;
+	struct stat st;
+	struct timespec ts;
+	char *path, *xml = NULL;
+	uint64_t off = state->journal_end, limit;
+	size_t len;
+	int fd = -1, dfd, r = 0;
+	bool created = false;
+
+	if (stat(xhp->pkgdb_plist, &st) == -1)
+		return -errno;
+	limit = (uint64_t)st.st_size / 4;
+	if (limit < PKGDB_JOURNAL_MINSIZE)
+		limit = PKGDB_JOURNAL_MINSIZE;
+
+	if ((xml = xbps_dictionary_externalize(changes)) == NULL)
+		return errno ? -errno : -ENOMEM;
+	len = strlen(xml) + 1;
+	if (len >= UINT32_MAX ||
+	    (off ? off : sizeof(hdr)) + sizeof(rec) + len > limit) {
+		free(xml);
+		return -EFBIG;
+	}
+	rec.len = (uint32_t)len;
+	rec.crc = crc32(0, (const unsigned char *)xml, rec.len);
+
+	path = journal_path(xhp);
+	if (off == 0) {
+		/* no valid journal, start a new one */
+		if ((r = journal_hdr_init(xhp, &hdr, &st)) < 0)
+			goto out;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		hdr.id = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+		hdr.id ^= (uint64_t)getpid() << 48;
+		fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+		if (fd == -1 || fchmod(fd, 0644) == -1 ||
+		    pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+			r = errno ? -errno : -EIO;
+			goto out;
+		}
+		off = sizeof(hdr);
+		state->journal_id = hdr.id;
+		created = true;
+	} else if ((fd = open(path, O_WRONLY|O_CLOEXEC)) == -1) {
+		r = -errno;
+		goto out;
+	}
+	if (pwrite(fd, &rec, sizeof(rec), off) != (ssize_t)sizeof(rec) ||
+	    pwrite(fd, xml, len, off + sizeof(rec)) != (ssize_t)len ||
+	    ftruncate(fd, off + sizeof(rec) + len) == -1 ||
+	    fsync(fd) == -1) {
+		r = errno ? -errno : -EIO;
+		goto out;
+	}
+	/* a new journal must not be lost along with its directory entry */
+	if (created) {
+		if ((dfd = open(xhp->metadir, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) == -1) {
+			r = -errno;
+			goto out;
+		}
+		if (fsync(dfd) == -1)
+			r = -errno;
+		(void)close(dfd);
+		if (r < 0)
+			goto out;
+	}
+	state->journal_end = off + sizeof(rec) + len;
+	xbps_dbg_printf("[pkgdb] appended %zu bytes to journal %s\n", len, path);
+out:
+	if (fd != -1)
+		close(fd);
+	if (r < 0)
+		xbps_dbg_printf("[pkgdb] failed to append to journal %s: %s\n",
+		    path, strerror(-r));
+	free(xml);
+	free(path);
+	return r;
+}
+
+void HIDDEN
+xbps_pkgdb_journal_remove(struct xbps_handle *xhp)
+{
+	char *path;
+
+	path = journal_path(xhp);
+	if (unlink(path) == -1 && errno != ENOENT)
+		xbps_dbg_printf("[pkgdb] failed to remove journal %s: %s\n",
+		    path, strerror(errno));
+	xhp->pkgdb_state->journal_end = 0;
+	free(path);
+}
@@ -0,0 +1,634 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xbps_api_impl.h"
+#include "uthash.h"
+
+/**
+ * @file lib/pkgdb_shlibs.c
+ * @brief Installed shared libraries index
+ *
+ * The index maps every soname in the "shlib-provides" and
+ * "shlib-requires" arrays of the installed packages to the number of
+ * packages providing it and to the names of the packages requiring it.
+ *
+ * It is stored in the pkgdb snapshot as a table of sonames sorted for a
+ * binary search, and the list of sonames that are required but not
+ * provided. The snapshot stays mapped, xbps_register_pkg() and
+ * xbps_remove_pkg() copy the sonames they change to a hash table that
+ * takes precedence over it. Without a usable snapshot the hash table is
+ * filled from the pkgdb the first time the index is used.
+ *
+ * Section layout, the integers are not aligned:
+ *
+ * 	- uint32_t number of sonames, unresolved sonames and data bytes.
+ * 	- uint32_t offset of every soname record in the data, by soname.
+ * 	- uint32_t index of every unresolved soname in the offsets.
+ * 	- records: soname, uint32_t providers, uint32_t requirers and
+ * 	  the requirers names; strings are a uint32_t length followed by
+ * 	  the nul terminated string.
+ */
+
+struct shlib {
+	char *soname;		/* hash key */
+	unsigned int nprovides;
+	char **requires;
+	unsigned int nrequires, cap;
+	UT_hash_handle hh;
+};
+
+struct shlib_rec {
+	const char *soname;
+	uint32_t nprovides;
+	uint32_t nrequires;
+	/* first requirer */
+	const char *p;
+	const char *end;
+};
+
+struct shlibs_base {
+	void *mf;
+	size_t mflen;
+	uint32_t nsonames;
+	uint32_t nunresolved;
+	const char *offs;
+	const char *unresolved;
+	const char *data;
+	uint32_t datalen;
+};
+
+/* stored in xhp->pkgdb_state */
+struct xbps_pkgdb_shlibs {
+	struct shlibs_base base;
+	struct shlib *hash;
+	bool ready;
+};
+
+static uint32_t
+get_u32(const char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static const char *
+rec_str(struct shlib_rec *rec)
+{
+	const char *s;
+	uint32_t len;
+
+	if ((size_t)(rec->end - rec->p) < sizeof(len))
+		return NULL;
+	len = get_u32(rec->p);
+	rec->p += sizeof(len);
+	if ((size_t)(rec->end - rec->p) <= len || rec->p[len] != '\0')
+		return NULL;
+	s = rec->p;
+	rec->p += len + 1;
+	return s;
+}
+
+static bool
+base_rec(const struct shlibs_base *base, uint32_t idx, struct shlib_rec *rec)
+{
+	uint32_t off;
+
+	if (idx >= base->nsonames)
+		return false;
+	off = get_u32(base->offs + idx * sizeof(uint32_t));
+	if (off >= base->datalen)
+		return false;
+	rec->p = base->data + off;
+	rec->end = base->data + base->datalen;
+	if ((rec->soname = rec_str(rec)) == NULL ||
+	    (size_t)(rec->end - rec->p) < 2 * sizeof(uint32_t))
+		return false;
+	rec->nprovides = get_u32(rec->p);
+	rec->nrequires = get_u32(rec->p + sizeof(uint32_t));
+	rec->p += 2 * sizeof(uint32_t);
+	return true;
+}
+
+static bool
+base_find(const struct shlibs_base *base, const char *soname,
+		struct shlib_rec *rec)
+{
+	uint32_t lo = 0, hi = base->nsonames;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp;
+
+		if (!base_rec(base, mid, rec))
+			return false;
+		cmp = strcmp(soname, rec->soname);
+		if (cmp == 0)
+			return true;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return false;
+}
+
+static void
+base_release(struct shlibs_base *base)
+{
+	if (base->mf)
+		(void)munmap(base->mf, base->mflen);
+	memset(base, 0, sizeof(*base));
+}
+
+static struct xbps_pkgdb_shlibs *
+shlibs_get(struct xbps_handle *xhp)
+{
+	assert(xhp->pkgdb_state);
+	if (xhp->pkgdb_state->shlibs == NULL)
+		xhp->pkgdb_state->shlibs = calloc(1, sizeof(struct xbps_pkgdb_shlibs));
+	return xhp->pkgdb_state->shlibs;
+}
+
+static void
+shlibs_clear(struct xbps_pkgdb_shlibs *sl)
+{
+	struct shlib *sh, *tmp;
+
+	HASH_ITER(hh, sl->hash, sh, tmp) {
+		HASH_DEL(sl->hash, sh);
+		for (unsigned int i = 0; i < sh->nrequires; i++)
+			free(sh->requires[i]);
+		free(sh->requires);
+		free(sh->soname);
+		free(sh);
+	}
+	base_release(&sl->base);
+	sl->ready = false;
+}
+
+void HIDDEN
+xbps_pkgdb_shlibs_release(struct xbps_handle *xhp)
+{
+	if (xhp->pkgdb_state == NULL || xhp->pkgdb_state->shlibs == NULL)
+		return;
+	shlibs_clear(xhp->pkgdb_state->shlibs);
+	free(xhp->pkgdb_state->shlibs);
+	xhp->pkgdb_state->shlibs = NULL;
+}
+
+int HIDDEN
+xbps_pkgdb_shlibs_attach(struct xbps_handle *xhp, void *mf, size_t mflen,
+		const char *p, size_t len)
+{
+	struct xbps_pkgdb_shlibs *sl;
+	const char *end = p + len;
+	uint32_t hdr[3];
+
+	if ((sl = shlibs_get(xhp)) == NULL)
+		return -ENOMEM;
+	shlibs_clear(sl);
+	if (len < sizeof(hdr))
+		return -EINVAL;
+	memcpy(hdr, p, sizeof(hdr));
+	p += sizeof(hdr);
+	if ((size_t)(end - p) / sizeof(uint32_t) < (size_t)hdr[0] + hdr[1] ||
+	    (size_t)(end - p) - ((size_t)hdr[0] + hdr[1]) * sizeof(uint32_t) != hdr[2])
+		return -EINVAL;
+	sl->base.nsonames = hdr[0];
+	sl->base.nunresolved = hdr[1];
+	sl->base.datalen = hdr[2];
+	sl->base.offs = p;
+	sl->base.unresolved = p + (size_t)hdr[0] * sizeof(uint32_t);
+	sl->base.data = sl->base.unresolved + (size_t)hdr[1] * sizeof(uint32_t);
+	sl->base.mf = mf;
+	sl->base.mflen = mflen;
+	sl->ready = true;
+	return 0;
+}
+
+static struct shlib *
+shlib_get(struct xbps_pkgdb_shlibs *sl, const char *soname)
+{
+	struct shlib_rec rec;
+	struct shlib *sh;
+	const char *s;
+
+	HASH_FIND_STR(sl->hash, soname, sh);
+	if (sh)
+		return sh;
+	if ((sh = calloc(1, sizeof(*sh))) == NULL)
+		return NULL;
+	if ((sh->soname = strdup(soname)) == NULL)
+		goto err;
+	HASH_ADD_KEYPTR(hh, sl->hash, sh->soname, strlen(sh->soname), sh);
+	/* copy it from the snapshot before it is changed */
+	if (!base_find(&sl->base, soname, &rec))
+		return sh;
+	sh->nprovides = rec.nprovides;
+	if (rec.nrequires > (size_t)(rec.end - rec.p) / 5)
+		return sh;
+	if ((sh->requires = calloc(rec.nrequires ? rec.nrequires : 1, sizeof(char *))) == NULL)
+		return NULL;
+	sh->cap = rec.nrequires;
+	for (uint32_t i = 0; i < rec.nrequires; i++) {
+		if ((s = rec_str(&rec)) == NULL)
+			break;
+		if ((sh->requires[sh->nrequires] = strdup(s)) == NULL)
+			return NULL;
+		sh->nrequires++;
+	}
+	return sh;
+err:
+	free(sh);
+	return NULL;
+}
+
+static bool
+shlib_require(struct shlib *sh, const char *pkgname)
+{
+	if (sh->nrequires == sh->cap) {
+		unsigned int cap = sh->cap ? sh->cap * 2 : 4;
+		char **requires = realloc(sh->requires, cap * sizeof(char *));
+
+		if (requires == NULL)
+			return false;
+		sh->requires = requires;
+		sh->cap = cap;
+	}
+	if ((sh->requires[sh->nrequires] = strdup(pkgname)) == NULL)
+		return false;
+	sh->nrequires++;
+	return true;
+}
+
+static void
+shlib_unrequire(struct shlib *sh, const char *pkgname)
+{
+	for (unsigned int i = 0; i < sh->nrequires; i++) {
+		if (strcmp(sh->requires[i], pkgname) != 0)
+			continue;
+		free(sh->requires[i]);
+		memmove(&sh->requires[i], &sh->requires[i + 1],
+		    (sh->nrequires - i - 1) * sizeof(char *));
+		sh->nrequires--;
+		return;
+	}
+}
+
+static int
+shlibs_pkg(struct xbps_pkgdb_shlibs *sl, const char *pkgname,
+		xbps_dictionary_t pkgd, bool add)
+{
+	xbps_array_t array;
+	struct shlib *sh;
+	const char *soname;
+
+	array = xbps_dictionary_get(pkgd, "shlib-provides");
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		if (!xbps_array_get_cstring_nocopy(array, i, &soname))
+			continue;
+		if ((sh = shlib_get(sl, soname)) == NULL)
+			return xbps_error_oom();
+		if (add)
+			sh->nprovides++;
+		else if (sh->nprovides > 0)
+			sh->nprovides--;
+	}
+	array = xbps_dictionary_get(pkgd, "shlib-requires");
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		if (!xbps_array_get_cstring_nocopy(array, i, &soname))
+			continue;
+		if ((sh = shlib_get(sl, soname)) == NULL)
+			return xbps_error_oom();
+		if (!add)
+			shlib_unrequire(sh, pkgname);
+		else if (!shlib_require(sh, pkgname))
+			return xbps_error_oom();
+	}
+	return 0;
+}
+
+static struct xbps_pkgdb_shlibs *
+shlibs_init(struct xbps_handle *xhp, int *rp)
+{
+	struct xbps_pkgdb_shlibs *sl;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	int r = 0;
+
+	if (xhp->pkgdb == NULL) {
+		*rp = -EINVAL;
+		return NULL;
+	}
+	if ((sl = shlibs_get(xhp)) == NULL) {
+		*rp = xbps_error_oom();
+		return NULL;
+	}
+	if (sl->ready)
+		return sl;
+
+	iter = xbps_dictionary_iterator(xhp->pkgdb);
+	if (iter == NULL) {
+		*rp = xbps_error_oom();
+		return NULL;
+	}
+	while (r == 0 && (obj = xbps_object_iterator_next(iter))) {
+		const char *pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
+		xbps_dictionary_t pkgd = xbps_dictionary_get_keysym(xhp->pkgdb, obj);
+
+		/* ignore internal objs */
+		if (strncmp(pkgname, "_XBPS_", 6) == 0)
+			continue;
+		r = shlibs_pkg(sl, pkgname, pkgd, true);
+	}
+	xbps_object_iterator_release(iter);
+	if (r < 0) {
+		shlibs_clear(sl);
+		*rp = r;
+		return NULL;
+	}
+	xbps_dbg_printf("[pkgdb] indexed %u shlibs\n", HASH_COUNT(sl->hash));
+	sl->ready = true;
+	return sl;
+}
+
+int HIDDEN
+xbps_pkgdb_shlibs_update(struct xbps_handle *xhp, const char *pkgname,
+		xbps_dictionary_t opkgd, xbps_dictionary_t pkgd)
+{
+	struct xbps_pkgdb_shlibs *sl;
+	int r;
+
+	/* nothing to update until the index is used */
+	if (xhp->pkgdb_state == NULL || (sl = xhp->pkgdb_state->shlibs) == NULL ||
+	    !sl->ready)
+		return 0;
+	if (opkgd && (r = shlibs_pkg(sl, pkgname, opkgd, false)) < 0)
+		goto err;
+	if (pkgd && (r = shlibs_pkg(sl, pkgname, pkgd, true)) < 0)
+		goto err;
+	return 0;
+err:
+	/* rebuilt from the pkgdb when used again */
+	shlibs_clear(sl);
+	return r;
+}
+
+int HIDDEN
+xbps_pkgdb_shlib_providers(struct xbps_handle *xhp, const char *soname,
+		unsigned int *nprovides)
+{
+	struct xbps_pkgdb_shlibs *sl;
+	struct shlib_rec rec;
+	struct shlib *sh;
+	int r;
+
+	if ((sl = shlibs_init(xhp, &r)) == NULL)
+		return r;
+	*nprovides = 0;
+	HASH_FIND_STR(sl->hash, soname, sh);
+	if (sh)
+		*nprovides = sh->nprovides;
+	else if (base_find(&sl->base, soname, &rec))
+		*nprovides = rec.nprovides;
+	return 0;
+}
+
+int HIDDEN
+xbps_pkgdb_shlib_foreach_requirer(struct xbps_handle *xhp, const char *soname,
+		int (*fn)(const char *, void *), void *arg)
+{
+	struct xbps_pkgdb_shlibs *sl;
+	struct shlib_rec rec;
+	struct shlib *sh;
+	const char *s;
+	int r = 0;
+
+	if ((sl = shlibs_init(xhp, &r)) == NULL)
+		return r;
+	HASH_FIND_STR(sl->hash, soname, sh);
+	if (sh) {
+		for (unsigned int i = 0; r == 0 && i < sh->nrequires; i++)
+			r = (*fn)(sh->requires[i], arg);
+		return r;
+	}
+	if (!base_find(&sl->base, soname, &rec))
+		return 0;
+	for (uint32_t i = 0; r == 0 && i < rec.nrequires; i++) {
+		if ((s = rec_str(&rec)) == NULL)
+			return -EINVAL;
+		r = (*fn)(s, arg);
+	}
+	return r;
+}
+
+int HIDDEN
+xbps_pkgdb_shlibs_foreach_unresolved(struct xbps_handle *xhp,
+		int (*fn)(const char *, void *), void *arg)
+{
+	struct xbps_pkgdb_shlibs *sl;
+	struct shlib_rec rec;
+	struct shlib *sh, *tmp;
+	int r = 0;
+
+	if ((sl = shlibs_init(xhp, &r)) == NULL)
+		return r;
+	for (uint32_t i = 0; r == 0 && i < sl->base.nunresolved; i++) {
+		if (!base_rec(&sl->base,
+		    get_u32(sl->base.unresolved + i * sizeof(uint32_t)), &rec))
+			return -EINVAL;
+		HASH_FIND_STR(sl->hash, rec.soname, sh);
+		if (sh == NULL)
+			r = (*fn)(rec.soname, arg);
+	}
+	HASH_ITER(hh, sl->hash, sh, tmp) {
+		if (r != 0)
+			break;
+		if (sh->nprovides == 0 && sh->nrequires > 0)
+			r = (*fn)(sh->soname, arg);
+	}
+	return r;
+}
+
+/*
+ * Writer
+ */
+struct section {
+	char *data;
+	size_t len, cap;
+	uint32_t *offs;
+	uint32_t *unresolved;
+	uint32_t nsonames, nunresolved;
+};
+
+static bool
+section_put(struct section *s, const void *data, size_t len)
+{
+	if (s->len + len > UINT32_MAX)
+		return false;
+	if (s->len + len > s->cap) {
+		size_t cap = s->cap ? s->cap : 4096;
+		char *p;
+
+		while (cap < s->len + len)
+			cap *= 2;
+		if ((p = realloc(s->data, cap)) == NULL)
+			return false;
+		s->data = p;
+		s->cap = cap;
+	}
+	memcpy(s->data + s->len, data, len);
+	s->len += len;
+	return true;
+}
+
+static bool
+section_put_str(struct section *s, const char *str)
+{
+	uint32_t len = (uint32_t)strlen(str);
+
+	return section_put(s, &len, sizeof(len)) && section_put(s, str, len + 1);
+}
+
+static bool
+section_rec_start(struct section *s, const char *soname, uint32_t nprovides,
+		uint32_t nrequires)
+{
+	if (nprovides == 0 && nrequires == 0)
+		return true;
+	if (nprovides == 0)
+		s->unresolved[s->nunresolved++] = s->nsonames;
+	s->offs[s->nsonames++] = (uint32_t)s->len;
+	return section_put_str(s, soname) &&
+	    section_put(s, &nprovides, sizeof(nprovides)) &&
+	    section_put(s, &nrequires, sizeof(nrequires));
+}
+
+static int
+shlib_cmp(const void *a, const void *b)
+{
+	const struct shlib *sa = *(struct shlib * const *)a;
+	const struct shlib *sb = *(struct shlib * const *)b;
+
+	return strcmp(sa->soname, sb->soname);
+}
+
+int HIDDEN
+xbps_pkgdb_shlibs_write(struct xbps_handle *xhp, FILE *fp)
+{
+	struct xbps_pkgdb_shlibs *sl;
+	struct shlibs_base *base;
+	struct section s;
+	struct shlib **sorted = NULL, *sh, *tmp;
+	struct shlib_rec rec;
+	uint32_t hdr[3], n = 0, b = 0, max;
+	const char *str;
+	int r = 0;
+
+	if ((sl = shlibs_init(xhp, &r)) == NULL)
+		return r;
+	base = &sl->base;
+
+	memset(&s, 0, sizeof(s));
+	max = HASH_COUNT(sl->hash) + base->nsonames;
+	if ((sorted = calloc(HASH_COUNT(sl->hash) + 1, sizeof(*sorted))) == NULL ||
+	    (s.offs = calloc(max + 1, sizeof(uint32_t))) == NULL ||
+	    (s.unresolved = calloc(max + 1, sizeof(uint32_t))) == NULL) {
+		r = xbps_error_oom();
+		goto out;
+	}
+	HASH_ITER(hh, sl->hash, sh, tmp)
+		sorted[n++] = sh;
+	qsort(sorted, n, sizeof(*sorted), shlib_cmp);
+
+	/* merge the changed sonames with the snapshot */
+	for (uint32_t i = 0; i < n || b < base->nsonames;) {
+		int cmp;
+
+		if (b < base->nsonames && !base_rec(base, b, &rec)) {
+			r = -EINVAL;
+			goto out;
+		}
+		if (i == n)
+			cmp = 1;
+		else if (b == base->nsonames)
+			cmp = -1;
+		else
+			cmp = strcmp(sorted[i]->soname, rec.soname);
+		if (cmp <= 0) {
+			sh = sorted[i++];
+			if (cmp == 0)
+				b++;
+			if (!section_rec_start(&s, sh->soname, sh->nprovides,
+			    sh->nrequires))
+				goto oom;
+			for (unsigned int j = 0; j < sh->nrequires; j++) {
+				if (!section_put_str(&s, sh->requires[j]))
+					goto oom;
+			}
+			continue;
+		}
+		b++;
+		if (!section_rec_start(&s, rec.soname, rec.nprovides,
+		    rec.nrequires))
+			goto oom;
+		for (uint32_t j = 0; j < rec.nrequires; j++) {
+			if ((str = rec_str(&rec)) == NULL) {
+				r = -EINVAL;
+				goto out;
+			}
+			if (!section_put_str(&s, str))
+				goto oom;
+		}
+	}
+	hdr[0] = s.nsonames;
+	hdr[1] = s.nunresolved;
+	hdr[2] = (uint32_t)s.len;
+	if (fwrite(hdr, sizeof(hdr), 1, fp) != 1 ||
+	    fwrite(s.offs, sizeof(uint32_t), s.nsonames, fp) != s.nsonames ||
+	    fwrite(s.unresolved, sizeof(uint32_t), s.nunresolved, fp) != s.nunresolved ||
+	    fwrite(s.data, 1, s.len, fp) != s.len)
+		r = errno ? -errno : -EIO;
+	goto out;
+oom:
+	r = xbps_error_oom();
+out:
+	free(sorted);
+	free(s.offs);
+	free(s.unresolved);
+	free(s.data);
+	return r;
+}
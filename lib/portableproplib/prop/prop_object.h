@@ -60,6 +60,9 @@ prop_type_t	prop_object_type(prop_object_t);
 bool		prop_object_equals(prop_object_t, prop_object_t);
 bool		prop_object_equals_with_error(prop_object_t, prop_object_t, bool *);
 
+uint64_t	prop_generation(void);
+uint64_t	prop_object_generation(prop_object_t);
+
 typedef struct _prop_object_iterator *prop_object_iterator_t;
 
 prop_object_t	prop_object_iterator_next(prop_object_iterator_t);
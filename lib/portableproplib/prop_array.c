@@ -43,6 +43,7 @@ struct _prop_array {
 	int			pa_flags;
 
 	uint32_t		pa_version;
+	uint64_t		pa_gen;		/* last modification */
 };
 
 #define PA_F_IMMUTABLE		0x01	/* array is immutable */
@@ -277,6 +278,7 @@ _prop_array_alloc(unsigned int capacity)
 		pa->pa_flags = 0;
 
 		pa->pa_version = 0;
+		pa->pa_gen = _prop_generation_next();
 	} else if (array != NULL)
 		_PROP_FREE(array, M_PROP_ARRAY);
 
@@ -462,6 +464,23 @@ prop_array_capacity(prop_array_t pa)
 	return (rv);
 }
 
+/*
+ * _prop_array_generation --
+ *	Return the generation of the last modification of the array.
+ */
+uint64_t
+_prop_array_generation(prop_object_t obj)
+{
+	prop_array_t pa = obj;
+	uint64_t rv;
+
+	_PROP_RWLOCK_RDLOCK(pa->pa_rwlock);
+	rv = pa->pa_gen;
+	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
+
+	return (rv);
+}
+
 /*
  * prop_array_count --
  *	Return the number of objects stored in the array.
@@ -611,6 +630,7 @@ _prop_array_add(prop_array_t pa, prop_object_t po)
 	prop_object_retain(po);
 	pa->pa_array[pa->pa_count++] = po;
 	pa->pa_version++;
+	pa->pa_gen = _prop_generation_next();
 
 	return (true);
 }
@@ -644,10 +664,12 @@ _prop_array_add_first(prop_array_t pa, prop_object_t po)
 		/* passed in object is now the first element */
 		pa->pa_array[0] = po;
 		pa->pa_version++;
+		pa->pa_gen = _prop_generation_next();
 		pa->pa_count++;
 	} else {
 		pa->pa_array[pa->pa_count++] = po;
 		pa->pa_version++;
+		pa->pa_gen = _prop_generation_next();
 	}
 	return true;
 }
@@ -686,6 +708,7 @@ prop_array_set(prop_array_t pa, unsigned int idx, prop_object_t po)
 	prop_object_retain(po);
 	pa->pa_array[idx] = po;
 	pa->pa_version++;
+	pa->pa_gen = _prop_generation_next();
 
 	prop_object_release(opo);
 
@@ -766,6 +789,7 @@ prop_array_remove(prop_array_t pa, unsigned int idx)
 		pa->pa_array[idx - 1] = pa->pa_array[idx];
 	pa->pa_count--;
 	pa->pa_version++;
+	pa->pa_gen = _prop_generation_next();
 
 	_PROP_RWLOCK_UNLOCK(pa->pa_rwlock);
 
@@ -41,9 +41,16 @@
  * We implement these like arrays, but we keep them sorted by key.
  * This allows us to binary-search as well as keep externalized output
  * sane-looking for human eyes.
+ *
+ * Dictionaries holding PD_HASH_THRESHOLD or more objects also get an
+ * open-addressing hash table mirroring the entries of the sorted array,
+ * so that lookups in big dictionaries (the pkgdb, repository indexes)
+ * do not have to binary-search.  Keys set in sorted order, as when
+ * internalizing, are appended without searching or moving the array.
  */
 
 #define	EXPAND_STEP		16
+#define	PD_HASH_THRESHOLD	64
 
 /*
  * prop_dictionary_keysym_t is allocated with space at the end to hold the
@@ -59,6 +66,7 @@
 struct _prop_dictionary_keysym {
 	struct _prop_object		pdk_obj;
 	size_t				pdk_size;
+	uint32_t			pdk_hash;
 	struct rb_node			pdk_link;
 	char 				pdk_key[1];
 	/* actually variable length */
@@ -88,7 +96,11 @@ struct _prop_dictionary {
 	unsigned int		pd_count;
 	int			pd_flags;
 
+	struct _prop_dict_entry	*pd_hash;	/* NULL pde_key: free slot */
+	unsigned int		pd_hashsize;	/* power of two */
+
 	uint32_t		pd_version;
+	uint64_t		pd_gen;		/* last modification */
 };
 
 #define	PD_F_IMMUTABLE		0x01	/* dictionary is immutable */
@@ -275,6 +287,22 @@ _prop_dict_keysym_equals(prop_object_t v1, prop_object_t v2,
 		return _PROP_OBJECT_EQUALS_FALSE;
 }
 
+/*
+ * FNV-1a, cached in the keysym so that rebuilding a hash table does not
+ * need to hash the keys again.
+ */
+static uint32_t
+_prop_dict_hash(const char *key)
+{
+	uint32_t h = 2166136261U;
+
+	for (; *key != '\0'; key++) {
+		h ^= (unsigned char)*key;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
 static prop_dictionary_keysym_t
 _prop_dict_keysym_alloc(const char *key)
 {
@@ -318,6 +346,7 @@ _prop_dict_keysym_alloc(const char *key)
 
 	strcpy(pdk->pdk_key, key);
 	pdk->pdk_size = size;
+	pdk->pdk_hash = _prop_dict_hash(key);
 
 	/*
 	 * We dropped the mutex when we allocated the new object, so
@@ -352,6 +381,8 @@ _prop_dictionary_free(prop_stack_t stack, prop_object_t *obj)
 	if (pd->pd_count == 0) {
 		if (pd->pd_array != NULL)
 			_PROP_FREE(pd->pd_array, M_PROP_DICT);
+		if (pd->pd_hash != NULL)
+			_PROP_FREE(pd->pd_hash, M_PROP_DICT);
 
 		_PROP_RWLOCK_DESTROY(pd->pd_rwlock);
 
@@ -563,8 +594,11 @@ _prop_dictionary_alloc(unsigned int capacity)
 		pd->pd_capacity = capacity;
 		pd->pd_count = 0;
 		pd->pd_flags = 0;
+		pd->pd_hash = NULL;
+		pd->pd_hashsize = 0;
 
 		pd->pd_version = 0;
+		pd->pd_gen = _prop_generation_next();
 	} else if (array != NULL)
 		_PROP_FREE(array, M_PROP_DICT);
 
@@ -596,6 +630,105 @@ _prop_dictionary_expand(prop_dictionary_t pd, unsigned int capacity)
 	return (true);
 }
 
+static void
+_prop_dict_hash_insert(prop_dictionary_t pd, prop_dictionary_keysym_t pdk,
+    prop_object_t po)
+{
+	unsigned int mask = pd->pd_hashsize - 1;
+	unsigned int i;
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	i = pdk->pdk_hash & mask;
+	while (pd->pd_hash[i].pde_key != NULL)
+		i = (i + 1) & mask;
+	pd->pd_hash[i].pde_key = pdk;
+	pd->pd_hash[i].pde_objref = po;
+}
+
+static struct _prop_dict_entry *
+_prop_dict_hash_find(prop_dictionary_t pd, prop_dictionary_keysym_t pdk)
+{
+	unsigned int mask = pd->pd_hashsize - 1;
+	unsigned int i;
+
+	/*
+	 * Dictionary must be READ-LOCKED or WRITE-LOCKED.
+	 */
+
+	for (i = pdk->pdk_hash & mask; pd->pd_hash[i].pde_key != pdk;
+	     i = (i + 1) & mask)
+		_PROP_ASSERT(pd->pd_hash[i].pde_key != NULL);
+	return (&pd->pd_hash[i]);
+}
+
+/*
+ * _prop_dict_hash_delete --
+ *	Remove the slot of a key.  Following slots of the probe sequence
+ *	are moved back so that no tombstones are needed.
+ */
+static void
+_prop_dict_hash_delete(prop_dictionary_t pd, prop_dictionary_keysym_t pdk)
+{
+	unsigned int mask = pd->pd_hashsize - 1;
+	unsigned int i, j, home;
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	i = (unsigned int)(_prop_dict_hash_find(pd, pdk) - pd->pd_hash);
+	for (j = (i + 1) & mask; pd->pd_hash[j].pde_key != NULL;
+	     j = (j + 1) & mask) {
+		home = pd->pd_hash[j].pde_key->pdk_hash & mask;
+		/* Move the slot back unless its home lies in (i, j]. */
+		if (i <= j ? (home > i && home <= j) : (home > i || home <= j))
+			continue;
+		pd->pd_hash[i] = pd->pd_hash[j];
+		i = j;
+	}
+	pd->pd_hash[i].pde_key = NULL;
+	pd->pd_hash[i].pde_objref = NULL;
+}
+
+/*
+ * _prop_dict_hash_rebuild --
+ *	Build the hash table of a dictionary that became big enough, or
+ *	resize it.  If memory cannot be allocated the dictionary falls
+ *	back to the binary search.
+ */
+static void
+_prop_dict_hash_rebuild(prop_dictionary_t pd)
+{
+	unsigned int size, idx;
+
+	/*
+	 * Dictionary must be WRITE-LOCKED.
+	 */
+
+	/* Keep the load factor at or below 1/2. */
+	for (size = PD_HASH_THRESHOLD * 2; size < pd->pd_count * 2; size <<= 1)
+		;
+	if (size != pd->pd_hashsize) {
+		if (pd->pd_hash != NULL)
+			_PROP_FREE(pd->pd_hash, M_PROP_DICT);
+		pd->pd_hash = _PROP_CALLOC(size * sizeof(*pd->pd_hash),
+		    M_PROP_DICT);
+		if (pd->pd_hash == NULL) {
+			pd->pd_hashsize = 0;
+			return;
+		}
+		pd->pd_hashsize = size;
+	} else
+		memset(pd->pd_hash, 0, size * sizeof(*pd->pd_hash));
+
+	for (idx = 0; idx < pd->pd_count; idx++)
+		_prop_dict_hash_insert(pd, pd->pd_array[idx].pde_key,
+		    pd->pd_array[idx].pde_objref);
+}
+
 static prop_object_t
 _prop_dictionary_iterator_next_object_locked(void *v)
 {
@@ -714,6 +847,8 @@ prop_dictionary_copy(prop_dictionary_t opd)
 		}
 		pd->pd_count = opd->pd_count;
 		pd->pd_flags = opd->pd_flags;
+		if (pd->pd_count >= PD_HASH_THRESHOLD)
+			_prop_dict_hash_rebuild(pd);
 	}
 	_PROP_RWLOCK_UNLOCK(opd->pd_rwlock);
 	return (pd);
@@ -753,6 +888,23 @@ prop_dictionary_make_immutable(prop_dictionary_t pd)
 	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
 }
 
+/*
+ * _prop_dictionary_generation --
+ *	Return the generation of the last modification of the dictionary.
+ */
+uint64_t
+_prop_dictionary_generation(prop_object_t obj)
+{
+	prop_dictionary_t pd = obj;
+	uint64_t rv;
+
+	_PROP_RWLOCK_RDLOCK(pd->pd_rwlock);
+	rv = pd->pd_gen;
+	_PROP_RWLOCK_UNLOCK(pd->pd_rwlock);
+
+	return (rv);
+}
+
 /*
  * prop_dictionary_count --
  *	Return the number of objects stored in the dictionary.
@@ -871,13 +1023,40 @@ _prop_dict_lookup(prop_dictionary_t pd, const char *key,
 		  unsigned int *idxp)
 {
 	struct _prop_dict_entry *pde;
-	unsigned int base, idx, distance;
+	unsigned int base, idx, distance, mask;
+	uint32_t h;
 	int res;
 
 	/*
 	 * Dictionary must be READ-LOCKED or WRITE-LOCKED.
 	 */
 
+	/*
+	 * Readers are served by the hash table.  The returned entry is
+	 * then a copy of the one in the array and must not be modified.
+	 */
+	if (idxp == NULL && pd->pd_hash != NULL) {
+		h = _prop_dict_hash(key);
+		mask = pd->pd_hashsize - 1;
+		for (idx = h & mask; (pde = &pd->pd_hash[idx])->pde_key != NULL;
+		     idx = (idx + 1) & mask) {
+			if (pde->pde_key->pdk_hash == h &&
+			    strcmp(key, pde->pde_key->pdk_key) == 0)
+				return (pde);
+		}
+		return (NULL);
+	}
+
+	/*
+	 * Callers that want the index insert the key if it is not found:
+	 * catch the common case of keys set in sorted order early.
+	 */
+	if (idxp != NULL && (pd->pd_count == 0 ||
+	    strcmp(key, pd->pd_array[pd->pd_count - 1].pde_key->pdk_key) > 0)) {
+		*idxp = pd->pd_count;
+		return (NULL);
+	}
+
 	for (idx = 0, base = 0, distance = pd->pd_count; distance != 0;
 	     distance >>= 1) {
 		idx = base + (distance >> 1);
@@ -895,9 +1074,9 @@ _prop_dict_lookup(prop_dictionary_t pd, const char *key,
 		}		/* else move left */
 	}
 
-	/* idx points to the slot we looked at last. */
+	/* base is where the key would be inserted. */
 	if (idxp != NULL)
-		*idxp = idx;
+		*idxp = base;
 	return (NULL);
 }
 
@@ -990,7 +1169,10 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 		prop_object_t opo = pde->pde_objref;
 		prop_object_retain(po);
 		pde->pde_objref = po;
+		if (pd->pd_hash != NULL)
+			_prop_dict_hash_find(pd, pde->pde_key)->pde_objref = po;
 		prop_object_release(opo);
+		pd->pd_gen = _prop_generation_next();
 		rv = true;
 		goto out;
 	}
@@ -999,9 +1181,11 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 	if (pdk == NULL)
 		goto out;
 
+	/* Grow big dictionaries geometrically. */
 	if (pd->pd_count == pd->pd_capacity &&
-	    _prop_dictionary_expand(pd,
-	    			    pd->pd_capacity + EXPAND_STEP) == false) {
+	    _prop_dictionary_expand(pd, pd->pd_capacity +
+	    (pd->pd_capacity / 2 > EXPAND_STEP ?
+	    pd->pd_capacity / 2 : EXPAND_STEP)) == false) {
 		prop_object_release(pdk);
 	    	goto out;
 	}
@@ -1009,47 +1193,21 @@ prop_dictionary_set(prop_dictionary_t pd, const char *key, prop_object_t po)
 	/* At this point, the store will succeed. */
 	prop_object_retain(po);
 
-	if (pd->pd_count == 0) {
-		pd->pd_array[0].pde_key = pdk;
-		pd->pd_array[0].pde_objref = po;
-		pd->pd_count++;
-		pd->pd_version++;
-		rv = true;
-		goto out;
-	}
-
-	pde = &pd->pd_array[idx];
-	_PROP_ASSERT(pde->pde_key != NULL);
-
-	if (strcmp(key, pde->pde_key->pdk_key) < 0) {
-		/*
-		 * key < pdk_key: insert to the left.  This is the same as
-		 * inserting to the right, except we decrement the current
-		 * index first.
-		 *
-		 * Because we're unsigned, we have to special case 0
-		 * (grumble).
-		 */
-		if (idx == 0) {
-			memmove(&pd->pd_array[1], &pd->pd_array[0],
-				pd->pd_count * sizeof(*pde));
-			pd->pd_array[0].pde_key = pdk;
-			pd->pd_array[0].pde_objref = po;
-			pd->pd_count++;
-			pd->pd_version++;
-			rv = true;
-			goto out;
-		}
-		idx--;
-	}
-
-	memmove(&pd->pd_array[idx + 2], &pd->pd_array[idx + 1],
-		(pd->pd_count - (idx + 1)) * sizeof(*pde));
-	pd->pd_array[idx + 1].pde_key = pdk;
-	pd->pd_array[idx + 1].pde_objref = po;
+	_PROP_ASSERT(idx <= pd->pd_count);
+	if (idx < pd->pd_count)
+		memmove(&pd->pd_array[idx + 1], &pd->pd_array[idx],
+			(pd->pd_count - idx) * sizeof(*pde));
+	pd->pd_array[idx].pde_key = pdk;
+	pd->pd_array[idx].pde_objref = po;
 	pd->pd_count++;
 
 	pd->pd_version++;
+	pd->pd_gen = _prop_generation_next();
+
+	if (pd->pd_hash != NULL && pd->pd_count * 2 <= pd->pd_hashsize)
+		_prop_dict_hash_insert(pd, pdk, po);
+	else if (pd->pd_count >= PD_HASH_THRESHOLD)
+		_prop_dict_hash_rebuild(pd);
 
 	rv = true;
 
@@ -1090,12 +1248,15 @@ _prop_dictionary_remove(prop_dictionary_t pd, struct _prop_dict_entry *pde,
 	_PROP_ASSERT(idx < pd->pd_count);
 	_PROP_ASSERT(pde == &pd->pd_array[idx]);
 
+	if (pd->pd_hash != NULL)
+		_prop_dict_hash_delete(pd, pdk);
+
 	idx++;
 	memmove(&pd->pd_array[idx - 1], &pd->pd_array[idx],
 		(pd->pd_count - idx) * sizeof(*pde));
 	pd->pd_count--;
 	pd->pd_version++;
-
+	pd->pd_gen = _prop_generation_next();
 
 	prop_object_release(pdk);
 
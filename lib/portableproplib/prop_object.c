@@ -46,6 +46,9 @@ static pthread_mutex_t _prop_refcnt_mtx = PTHREAD_MUTEX_INITIALIZER;
 #include <unistd.h>
 #include <zlib.h>
 
+/* last generation given to a created or modified container */
+static uint64_t _prop_generation;
+
 /*
  * _prop_object_init --
  *	Initialize an object.  Called when sub-classes create
@@ -1086,9 +1089,21 @@ prop_object_release(prop_object_t obj)
 
 	do {
 		do {
+			bool dropped;
+
 			po = obj;
 			_PROP_ASSERT(obj);
 
+			/*
+			 * Only the last reference needs the type lock, which
+			 * serializes against lookups of shared objects.
+			 */
+			_PROP_ATOMIC_DEC32_IF_GT1(&po->po_refcnt, dropped);
+			if (dropped) {
+				ret = 0;
+				break;
+			}
+
 			if (po->po_type->pot_lock != NULL)
 				po->po_type->pot_lock();
 
@@ -1121,6 +1136,54 @@ prop_object_release(prop_object_t obj)
 	} while (_prop_stack_pop(&stack, &obj, NULL, NULL, NULL));
 }
 
+/*
+ * _prop_generation_next --
+ *	Return a new generation, greater than any generation returned
+ *	before.  Containers record it when they are created or modified.
+ */
+uint64_t
+_prop_generation_next(void)
+{
+	uint64_t gen;
+
+	_PROP_ATOMIC_INC64_NV(&_prop_generation, gen);
+	return (gen);
+}
+
+/*
+ * prop_generation --
+ *	Return the last generation given to a container.  Containers
+ *	with a greater generation were created or modified afterwards.
+ */
+uint64_t
+prop_generation(void)
+{
+	uint64_t gen;
+
+	_PROP_ATOMIC_LOAD64(&_prop_generation, gen);
+	return (gen);
+}
+
+/*
+ * prop_object_generation --
+ *	Return the generation of a dictionary or array: the one it
+ *	got when it was last modified.  Other objects are immutable
+ *	and return 0.
+ */
+uint64_t
+prop_object_generation(prop_object_t obj)
+{
+
+	switch (prop_object_type(obj)) {
+	case PROP_TYPE_DICTIONARY:
+		return (_prop_dictionary_generation(obj));
+	case PROP_TYPE_ARRAY:
+		return (_prop_array_generation(obj));
+	default:
+		return (0);
+	}
+}
+
 /*
  * prop_object_type --
  *	Return the type of an object.
@@ -175,6 +175,9 @@ bool		_prop_number_internalize(prop_stack_t, prop_object_t *,
 bool		_prop_string_internalize(prop_stack_t, prop_object_t *,
 				struct _prop_object_internalize_context *);
 
+uint64_t	_prop_array_generation(prop_object_t);
+uint64_t	_prop_dictionary_generation(prop_object_t);
+
 struct _prop_object_type {
 	/* type indicator */
 	uint32_t	pot_type;
@@ -216,6 +219,8 @@ void		_prop_object_init(struct _prop_object *,
 				  const struct _prop_object_type *);
 void		_prop_object_fini(struct _prop_object *);
 
+uint64_t	_prop_generation_next(void);
+
 struct _prop_object_iterator {
 	prop_object_t	(*pi_next_object)(void *);
 	void		(*pi_reset)(void *);
@@ -303,27 +308,77 @@ struct _prop_object_iterator {
 		v = --(*(x)); \
 		pthread_mutex_unlock(&_prop_refcnt_mtx); \
 	} while (/*CONSTCOND*/0)
+#define _PROP_ATOMIC_DEC32_IF_GT1(x, ok) \
+	do { \
+		pthread_mutex_lock(&_prop_refcnt_mtx); \
+		if ((ok = (*(x) > 1))) \
+			(*(x))--; \
+		pthread_mutex_unlock(&_prop_refcnt_mtx); \
+	} while (/*CONSTCOND*/0)
+#define _PROP_ATOMIC_INC64_NV(x, v) \
+	do { \
+		pthread_mutex_lock(&_prop_refcnt_mtx); \
+		v = ++(*(x)); \
+		pthread_mutex_unlock(&_prop_refcnt_mtx); \
+	} while (/*CONSTCOND*/0)
+#define _PROP_ATOMIC_LOAD64(x, v) \
+	do { \
+		pthread_mutex_lock(&_prop_refcnt_mtx); \
+		v = *(x); \
+		pthread_mutex_unlock(&_prop_refcnt_mtx); \
+	} while (/*CONSTCOND*/0)
 
 #else /* GCC ATOMIC BUILTINS */
 
+/*
+ * Taking a reference needs no ordering, dropping one must make the
+ * writes to the object visible to the thread that frees it.
+ */
 #define _PROP_ATOMIC_INC32(x)						\
 do {									\
-	(void)__sync_fetch_and_add(x, 1);				\
+	(void)__atomic_add_fetch(x, 1, __ATOMIC_RELAXED);		\
 } while (/*CONSTCOND*/0)
 
 #define _PROP_ATOMIC_DEC32(x)						\
 do {									\
-	(void)__sync_fetch_and_sub(x, 1);				\
+	(void)__atomic_sub_fetch(x, 1, __ATOMIC_ACQ_REL);		\
 } while (/*CONSTCOND*/0)
 
 #define _PROP_ATOMIC_INC32_NV(x, v)					\
 do {									\
-	v = __sync_add_and_fetch(x, 1);					\
+	v = __atomic_add_fetch(x, 1, __ATOMIC_RELAXED);			\
 } while (/*CONSTCOND*/0)
 
 #define _PROP_ATOMIC_DEC32_NV(x, v)					\
 do {									\
-	v = __sync_sub_and_fetch(x, 1);					\
+	v = __atomic_sub_fetch(x, 1, __ATOMIC_ACQ_REL);			\
+} while (/*CONSTCOND*/0)
+
+/*
+ * Drop a reference only if it is not the last one, which has to be
+ * dropped with the type lock held.
+ */
+#define _PROP_ATOMIC_DEC32_IF_GT1(x, ok)				\
+do {									\
+	uint32_t _ocnt = __atomic_load_n(x, __ATOMIC_RELAXED);		\
+	ok = false;							\
+	while (_ocnt > 1) {						\
+		if (__atomic_compare_exchange_n(x, &_ocnt, _ocnt - 1,	\
+		    true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {	\
+			ok = true;					\
+			break;						\
+		}							\
+	}								\
+} while (/*CONSTCOND*/0)
+
+#define _PROP_ATOMIC_INC64_NV(x, v)					\
+do {									\
+	v = __atomic_add_fetch(x, 1, __ATOMIC_RELAXED);			\
+} while (/*CONSTCOND*/0)
+
+#define _PROP_ATOMIC_LOAD64(x, v)					\
+do {									\
+	v = __atomic_load_n(x, __ATOMIC_RELAXED);			\
 } while (/*CONSTCOND*/0)
 
 #endif /* !HAVE_ATOMICS */
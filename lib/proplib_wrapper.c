@@ -834,6 +834,18 @@ xbps_object_equals_with_error(xbps_object_t o, xbps_object_t oo, bool *b)
 	return prop_object_equals_with_error(o, oo, b);
 }
 
+uint64_t HIDDEN
+xbps_generation(void)
+{
+	return prop_generation();
+}
+
+uint64_t HIDDEN
+xbps_object_generation(xbps_object_t o)
+{
+	return prop_object_generation(o);
+}
+
 xbps_object_t
 xbps_object_iterator_next(xbps_object_iterator_t o)
 {
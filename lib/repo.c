@@ -25,6 +25,7 @@
  */
 
 #include <sys/file.h>
+#include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -33,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <archive.h>
 #include <archive_entry.h>
@@ -196,14 +198,17 @@ repo_read_meta(struct xbps_repo *repo, struct archive *ar)
 		r = -EINVAL;
 		return r;
 	}
-	if (archive_entry_size(entry) == 0) {
+	/*
+	 * Repositories loaded after being opened from the binary index keep
+	 * its metadata, it's the same and may be in use by other threads.
+	 */
+	if (archive_entry_size(entry) == 0 || repo->idxmeta) {
 		r = archive_read_data_skip(ar);
 		if (r == ARCHIVE_FATAL) {
 			xbps_error_printf("failed to read repository: %s: archive error: %s\n",
 			    repo->uri, archive_error_string(ar));
 			return -xbps_archive_errno(ar);
 		}
-		repo->idxmeta = NULL;
 		return 0;
 	}
 
@@ -301,32 +306,41 @@ repo_read(struct xbps_repo *repo, struct archive *ar)
 }
 
 static int
-repo_open_local(struct xbps_repo *repo, struct archive *ar)
+repo_path(struct xbps_repo *repo, char *path, size_t pathsz, const char *name)
 {
-	char path[PATH_MAX];
 	int r;
 
 	if (repo->is_remote) {
 		char *cachedir;
 		cachedir = xbps_get_remote_repo_string(repo->uri);
 		if (!cachedir) {
-			r = -EINVAL;
 			xbps_error_printf("failed to open repository: %s: invalid repository url\n",
 			    repo->uri);
-			goto err;
+			return -EINVAL;
 		}
-		r = snprintf(path, sizeof(path), "%s/%s/%s-repodata",
-		    repo->xhp->metadir, cachedir, repo->arch);
+		r = snprintf(path, pathsz, "%s/%s/%s-%s",
+		    repo->xhp->metadir, cachedir, repo->arch, name);
 		free(cachedir);
 	} else {
-		r = snprintf(path, sizeof(path), "%s/%s-repodata", repo->uri, repo->arch);
+		r = snprintf(path, pathsz, "%s/%s-%s", repo->uri, repo->arch, name);
 	}
-	if (r < 0 || (size_t)r >= sizeof(path)) {
-		r = -ENAMETOOLONG;
+	if (r < 0 || (size_t)r >= pathsz) {
 		xbps_error_printf("failed to open repository: %s: repository path too long\n",
 		    repo->uri);
-		goto err;
+		return -ENAMETOOLONG;
 	}
+	return 0;
+}
+
+static int
+repo_open_local(struct xbps_repo *repo, struct archive *ar)
+{
+	char path[PATH_MAX];
+	int r;
+
+	r = repo_path(repo, path, sizeof(path), "repodata");
+	if (r < 0)
+		goto err;
 
 	r = xbps_archive_read_open(ar, path);
 	if (r < 0) {
@@ -501,8 +515,8 @@ err1:
 	return r;
 }
 
-struct xbps_repo *
-xbps_repo_open(struct xbps_handle *xhp, const char *url)
+static struct xbps_repo *
+repo_alloc(struct xbps_handle *xhp, const char *url)
 {
 	struct xbps_repo *repo;
 	int r;
@@ -518,26 +532,94 @@ xbps_repo_open(struct xbps_handle *xhp, const char *url)
 	repo->uri = url;
 	repo->arch = xhp->target_arch ? xhp->target_arch : xhp->native_arch;
 	repo->is_remote = xbps_repository_is_remote(url);
+	return repo;
+}
 
-	r = repo_open(xhp, repo);
-	if (r < 0) {
-		free(repo);
-		errno = -r;
-		return NULL;
-	}
+static bool
+repo_use_stage(struct xbps_repo *repo)
+{
+	return !repo->is_remote || (repo->xhp->flags & XBPS_FLAG_USE_STAGE);
+}
 
-	if (xbps_dictionary_count(repo->stage) == 0 ||
-	    (repo->is_remote && !(xhp->flags & XBPS_FLAG_USE_STAGE))) {
+static int
+repo_load(struct xbps_repo *repo)
+{
+	int r;
+
+	r = repo_open(repo->xhp, repo);
+	if (r < 0)
+		return r;
+
+	if (xbps_dictionary_count(repo->stage) == 0 || !repo_use_stage(repo)) {
 		repo->idx = repo->index;
 		xbps_object_retain(repo->idx);
-		return repo;
+		return 0;
 	}
 
 	r = repo_merge_stage(repo);
 	if (r < 0) {
 		xbps_error_printf(
 		    "failed to open repository: %s: could not merge stage: %s\n",
-		    url, strerror(-r));
+		    repo->uri, strerror(-r));
+		return r;
+	}
+	return 0;
+}
+
+struct xbps_repo *
+xbps_repo_open(struct xbps_handle *xhp, const char *url)
+{
+	struct xbps_repo *repo;
+	int r;
+
+	repo = repo_alloc(xhp, url);
+	if (!repo)
+		return NULL;
+
+	r = repo_load(repo);
+	if (r < 0) {
+		xbps_repo_release(repo);
+		errno = -r;
+		return NULL;
+	}
+
+	return repo;
+}
+
+struct xbps_repo HIDDEN *
+xbps_repo_open_lazy(struct xbps_handle *xhp, const char *url)
+{
+	struct xbps_repo *repo;
+	char path[PATH_MAX];
+	int r;
+
+	if (xbps_repository_is_remote(url) && (xhp->flags & XBPS_FLAG_REPOS_MEMSYNC))
+		return xbps_repo_open(xhp, url);
+
+	repo = repo_alloc(xhp, url);
+	if (!repo)
+		return NULL;
+
+	r = repo_path(repo, path, sizeof(path), "repodata");
+	if (r < 0) {
+		xbps_repo_release(repo);
+		errno = -r;
+		return NULL;
+	}
+
+	repo->binidx = xbps_repo_index_open(path, url, repo_use_stage(repo));
+	if (repo->binidx) {
+		r = xbps_repo_index_meta(repo->binidx, &repo->idxmeta);
+		if (r == 0) {
+			repo->is_signed = repo->idxmeta != NULL;
+			return repo;
+		}
+		xbps_repo_index_close(repo->binidx);
+		repo->binidx = NULL;
+	}
+
+	r = repo_load(repo);
+	if (r < 0) {
 		xbps_repo_release(repo);
 		errno = -r;
 		return NULL;
@@ -546,6 +628,47 @@ xbps_repo_open(struct xbps_handle *xhp, const char *url)
 	return repo;
 }
 
+int HIDDEN
+xbps_repo_load(struct xbps_repo *repo)
+{
+	if (repo->idx)
+		return 0;
+	return repo_load(repo);
+}
+
+int HIDDEN
+xbps_repo_index_update(struct xbps_handle *xhp, const char *url)
+{
+	struct xbps_repo *repo;
+	char path[PATH_MAX];
+	int r;
+
+	repo = repo_alloc(xhp, url);
+	if (!repo)
+		return -errno;
+
+	r = repo_path(repo, path, sizeof(path), "repodata");
+	if (r < 0)
+		goto out;
+
+	/* binary index is up to date */
+	repo->binidx = xbps_repo_index_open(path, url, false);
+	if (repo->binidx)
+		goto out;
+
+	r = repo_open(xhp, repo);
+	if (r < 0)
+		goto out;
+
+	r = xbps_repo_index_write(path, repo->index, repo->stage, repo->idxmeta);
+	if (r < 0) {
+		xbps_dbg_printf("[repo] `%s' failed to write binary index: %s\n",
+		    url, strerror(-r));
+	}
+out:
+	xbps_repo_release(repo);
+	return r;
+}
 
 void
 xbps_repo_release(struct xbps_repo *repo)
@@ -553,6 +676,10 @@ xbps_repo_release(struct xbps_repo *repo)
 	if (!repo)
 		return;
 
+	if (repo->revdeps) {
+		xbps_object_release(repo->revdeps);
+		repo->revdeps = NULL;
+	}
 	if (repo->idx) {
 		xbps_object_release(repo->idx);
 		repo->idx = NULL;
@@ -569,6 +696,10 @@ xbps_repo_release(struct xbps_repo *repo)
 		xbps_object_release(repo->idxmeta);
 		repo->idxmeta = NULL;
 	}
+	if (repo->binidx) {
+		xbps_repo_index_close(repo->binidx);
+		repo->binidx = NULL;
+	}
 	free(repo);
 }
 
@@ -579,9 +710,14 @@ xbps_repo_get_virtualpkg(struct xbps_repo *repo, const char *pkg)
 	const char *pkgver;
 	char pkgname[XBPS_NAME_SIZE] = {0};
 
-	if (!repo || !repo->idx || !pkg) {
+	if (!repo || !pkg) {
 		return NULL;
 	}
+	if (!repo->idx) {
+		if (!repo->binidx)
+			return NULL;
+		return xbps_repo_index_get_virtualpkg(repo->xhp, repo->binidx, pkg);
+	}
 	pkgd = xbps_find_virtualpkg_in_dict(repo->xhp, repo->idx, pkg);
 	if (!pkgd) {
 		return NULL;
@@ -613,9 +749,14 @@ xbps_repo_get_pkg(struct xbps_repo *repo, const char *pkg)
 	const char *pkgver;
 	char pkgname[XBPS_NAME_SIZE] = {0};
 
-	if (!repo || !repo->idx || !pkg) {
+	if (!repo || !pkg) {
 		return NULL;
 	}
+	if (!repo->idx) {
+		if (!repo->binidx)
+			return NULL;
+		return xbps_repo_index_get_pkg(repo->xhp, repo->binidx, pkg);
+	}
 	/* Try matching vpkg from configuration files */
 	if ((pkgd = xbps_find_virtualpkg_in_conf(repo->xhp, repo->idx, pkg))) {
 		goto add;
@@ -645,81 +786,182 @@ add:
 	return pkgd;
 }
 
-static xbps_array_t
-revdeps_match(struct xbps_repo *repo, xbps_dictionary_t tpkgd, const char *str)
+/*
+ * Reverse dependencies index, built once per repository on the first
+ * query: maps the pkgname of every run-time dependency to the index keys
+ * of the packages depending on it. Dependencies with glob patterns are
+ * stored with an empty key and are candidates for every query.
+ */
+static const char *
+revdeps_key(const char *dep, char *name, size_t namesz)
 {
-	xbps_dictionary_t pkgd;
-	xbps_array_t revdeps = NULL, pkgdeps, provides;
+	if (strpbrk(dep, "*?[]") != NULL)
+		return "";
+	if (xbps_pkgpattern_version(dep)) {
+		if (xbps_pkgpattern_name(name, namesz, dep))
+			return name;
+	} else if (xbps_pkg_name(name, namesz, dep)) {
+		return name;
+	}
+	return dep;
+}
+
+static xbps_dictionary_t
+revdeps_index(struct xbps_repo *repo)
+{
+	xbps_dictionary_t index, pkgd;
+	xbps_array_t pkgdeps, array;
 	xbps_object_iterator_t iter;
 	xbps_object_t obj;
-	const char *pkgver = NULL, *tpkgver = NULL, *arch = NULL, *vpkg = NULL;
+	const char *pkgname, *dep, *key;
+	char name[XBPS_NAME_SIZE];
+
+	if (repo->revdeps != NULL)
+		return repo->revdeps;
 
+	if ((index = xbps_dictionary_create()) == NULL)
+		return NULL;
 	iter = xbps_dictionary_iterator(repo->idx);
 	assert(iter);
 
 	while ((obj = xbps_object_iterator_next(iter))) {
+		pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
 		pkgd = xbps_dictionary_get_keysym(repo->idx, obj);
-		if (xbps_dictionary_equals(pkgd, tpkgd))
-			continue;
-
 		pkgdeps = xbps_dictionary_get(pkgd, "run_depends");
-		if (!xbps_array_count(pkgdeps))
-			continue;
-		/*
-		 * Try to match passed in string.
-		 */
-		if (str) {
-			if (!xbps_match_pkgdep_in_array(pkgdeps, str))
-				continue;
-			xbps_dictionary_get_cstring_nocopy(pkgd,
-			    "architecture", &arch);
-			if (!xbps_pkg_arch_match(repo->xhp, arch, NULL))
+		for (unsigned int i = 0; i < xbps_array_count(pkgdeps); i++) {
+			if (!xbps_array_get_cstring_nocopy(pkgdeps, i, &dep))
 				continue;
+			key = revdeps_key(dep, name, sizeof(name));
+			if ((array = xbps_dictionary_get(index, key)) == NULL) {
+				if ((array = xbps_array_create()) == NULL ||
+				    !xbps_dictionary_set(index, key, array)) {
+					xbps_object_release(array);
+					goto err;
+				}
+				xbps_object_release(array);
+			}
+			if (!xbps_array_add_cstring_nocopy(array, pkgname))
+				goto err;
+		}
+	}
+	xbps_object_iterator_release(iter);
+	repo->revdeps = index;
+	return index;
+err:
+	xbps_object_iterator_release(iter);
+	xbps_object_release(index);
+	return NULL;
+}
 
-			xbps_dictionary_get_cstring_nocopy(pkgd,
-			    "pkgver", &tpkgver);
-			/* match */
-			if (revdeps == NULL)
-				revdeps = xbps_array_create();
-
-			if (!xbps_match_string_in_array(revdeps, tpkgver))
-				xbps_array_add_cstring_nocopy(revdeps, tpkgver);
+static void
+revdeps_candidates(xbps_dictionary_t index, xbps_dictionary_t cands,
+		const char *str)
+{
+	char name[XBPS_NAME_SIZE];
+	xbps_array_t array;
+	const char *pkgname;
 
-			continue;
+	/*
+	 * A dependency on `foo>=1' also matches `foo-bar-1_1' in
+	 * dewey_match(), look up every prefix ending at a dash.
+	 */
+	for (const char *p = str; (p = strchr(p, '-')) != NULL; p++) {
+		if ((size_t)(p - str) >= sizeof(name))
+			break;
+		memcpy(name, str, p - str);
+		name[p - str] = '\0';
+		array = xbps_dictionary_get(index, name);
+		for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+			xbps_array_get_cstring_nocopy(array, i, &pkgname);
+			xbps_dictionary_set_bool(cands, pkgname, true);
 		}
+	}
+	array = xbps_dictionary_get(index, str);
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		xbps_array_get_cstring_nocopy(array, i, &pkgname);
+		xbps_dictionary_set_bool(cands, pkgname, true);
+	}
+}
+
+static bool
+revdeps_pkg_match(struct xbps_repo *repo, xbps_dictionary_t pkgd,
+		xbps_dictionary_t tpkgd, const char *str)
+{
+	xbps_array_t pkgdeps, provides;
+	const char *pkgver = NULL, *arch = NULL, *vpkg = NULL;
+	bool match = false;
+
+	pkgdeps = xbps_dictionary_get(pkgd, "run_depends");
+	if (str) {
+		/*
+		 * Try to match passed in string.
+		 */
+		match = xbps_match_pkgdep_in_array(pkgdeps, str);
+	} else {
 		/*
 		 * Try to match any virtual package.
 		 */
 		provides = xbps_dictionary_get(tpkgd, "provides");
-		for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+		for (unsigned int i = 0; !match && i < xbps_array_count(provides); i++) {
 			xbps_array_get_cstring_nocopy(provides, i, &vpkg);
-			if (!xbps_match_pkgdep_in_array(pkgdeps, vpkg))
-				continue;
-
-			xbps_dictionary_get_cstring_nocopy(pkgd,
-			    "architecture", &arch);
-			if (!xbps_pkg_arch_match(repo->xhp, arch, NULL))
-				continue;
-
-			xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver",
-			    &tpkgver);
-			/* match */
-			if (revdeps == NULL)
-				revdeps = xbps_array_create();
-
-			if (!xbps_match_string_in_array(revdeps, tpkgver))
-				xbps_array_add_cstring_nocopy(revdeps, tpkgver);
+			match = xbps_match_pkgdep_in_array(pkgdeps, vpkg);
 		}
 		/*
 		 * Try to match by pkgver.
 		 */
+		if (!match) {
+			xbps_dictionary_get_cstring_nocopy(tpkgd, "pkgver", &pkgver);
+			match = xbps_match_pkgdep_in_array(pkgdeps, pkgver);
+		}
+	}
+	if (!match)
+		return false;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "architecture", &arch);
+	return xbps_pkg_arch_match(repo->xhp, arch, NULL);
+}
+
+static xbps_array_t
+revdeps_match(struct xbps_repo *repo, xbps_dictionary_t tpkgd, const char *str)
+{
+	xbps_dictionary_t index, cands, pkgd;
+	xbps_array_t revdeps = NULL, provides, wild;
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	const char *pkgver = NULL, *tpkgver = NULL, *vpkg = NULL;
+
+	if ((index = revdeps_index(repo)) == NULL)
+		return NULL;
+	if ((cands = xbps_dictionary_create()) == NULL)
+		return NULL;
+
+	if (str) {
+		revdeps_candidates(index, cands, str);
+	} else {
+		provides = xbps_dictionary_get(tpkgd, "provides");
+		for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+			xbps_array_get_cstring_nocopy(provides, i, &vpkg);
+			revdeps_candidates(index, cands, vpkg);
+		}
 		xbps_dictionary_get_cstring_nocopy(tpkgd, "pkgver", &pkgver);
-		if (!xbps_match_pkgdep_in_array(pkgdeps, pkgver))
-			continue;
+		revdeps_candidates(index, cands, pkgver);
+	}
+	wild = xbps_dictionary_get(index, "");
+	for (unsigned int i = 0; i < xbps_array_count(wild); i++) {
+		xbps_array_get_cstring_nocopy(wild, i, &vpkg);
+		xbps_dictionary_set_bool(cands, vpkg, true);
+	}
+
+	/* candidates are iterated in the same order as the index */
+	iter = xbps_dictionary_iterator(cands);
+	assert(iter);
 
-		xbps_dictionary_get_cstring_nocopy(pkgd,
-		    "architecture", &arch);
-		if (!xbps_pkg_arch_match(repo->xhp, arch, NULL))
+	while ((obj = xbps_object_iterator_next(iter))) {
+		pkgd = xbps_dictionary_get(repo->idx,
+		    xbps_dictionary_keysym_cstring_nocopy(obj));
+		if (pkgd == NULL || xbps_dictionary_equals(pkgd, tpkgd))
+			continue;
+		if (!revdeps_pkg_match(repo, pkgd, tpkgd, str))
 			continue;
 
 		xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &tpkgver);
@@ -727,10 +969,10 @@ revdeps_match(struct xbps_repo *repo, xbps_dictionary_t tpkgd, const char *str)
 		if (revdeps == NULL)
 			revdeps = xbps_array_create();
 
-		if (!xbps_match_string_in_array(revdeps, tpkgver))
-			xbps_array_add_cstring_nocopy(revdeps, tpkgver);
+		xbps_array_add_cstring_nocopy(revdeps, tpkgver);
 	}
 	xbps_object_iterator_release(iter);
+	xbps_object_release(cands);
 	return revdeps;
 }
 
@@ -742,8 +984,10 @@ xbps_repo_get_pkg_revdeps(struct xbps_repo *repo, const char *pkg)
 	const char *vpkg;
 	bool match = false;
 
-	if (repo->idx == NULL)
-		return NULL;
+	if (repo->idx == NULL) {
+		if (repo->binidx == NULL || xbps_repo_load(repo) < 0)
+			return NULL;
+	}
 
 	if (((pkgd = xbps_repo_get_pkg(repo, pkg)) == NULL) &&
 	    ((pkgd = xbps_repo_get_virtualpkg(repo, pkg)) == NULL)) {
@@ -776,6 +1020,32 @@ xbps_repo_get_pkg_revdeps(struct xbps_repo *repo, const char *pkg)
 	return revdeps;
 }
 
+xbps_dictionary_t
+xbps_repo_get_files(struct xbps_repo *repo)
+{
+	struct stat st, rst;
+	char path[PATH_MAX], rpath[PATH_MAX], nopath[PATH_MAX];
+
+	if (repo_path(repo, path, sizeof(path), "files") < 0)
+		return NULL;
+	if (repo->is_remote) {
+		if (repo_path(repo, rpath, sizeof(rpath), "repodata") < 0 ||
+		    repo_path(repo, nopath, sizeof(nopath), "files.none") < 0)
+			return NULL;
+		/*
+		 * Fetch the files index on first use and whenever the
+		 * repodata has been synced after it, unless the repository
+		 * did not provide one since the last sync.
+		 */
+		if (access(nopath, F_OK) == -1 && (stat(path, &st) == -1 ||
+		    (stat(rpath, &rst) == 0 && st.st_mtime < rst.st_mtime)))
+			(void)xbps_repo_sync_files(repo->xhp, repo->uri, path);
+	}
+	if (access(path, R_OK) == -1)
+		return NULL;
+	return xbps_archive_fetch_plist(path, XBPS_REPODATA_FILES);
+}
+
 int
 xbps_repo_key_import(struct xbps_repo *repo)
 {
@@ -0,0 +1,822 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xbps_api_impl.h"
+#include "uthash.h"
+
+/**
+ * @file lib/repo_index.c
+ * @brief Binary repository index
+ *
+ * The binary index is an uncompressed sidecar of the `<arch>-repodata`
+ * archive that is mmap(2)ed and searched in place, so that looking up
+ * a handful of packages does not require decompressing and internalizing
+ * the whole XML index.
+ *
+ * Layout (native byte order, all offsets relative to the start of file):
+ *
+ *  - header: magic, version and the size and mtime of the repodata
+ *    archive it was generated from.
+ *  - string table: NUL terminated package names, pkgvers and
+ *    virtual package names.
+ *  - index and stage sections: package records sorted by package name,
+ *    followed by virtual package records sorted by virtual package name.
+ *  - blob area: the externalized package dictionaries and the index-meta.
+ *
+ * The version field doubles as byte order mark, an index written on a
+ * machine with different endianness is rejected and the repodata is read
+ * instead.
+ */
+
+#define BINIDX_MAGIC	"XBPSRIDX"
+#define BINIDX_VERSION	1
+
+enum {
+	SECTION_INDEX = 0,
+	SECTION_STAGE,
+	SECTION_MAX,
+};
+
+struct binidx_pkg {
+	uint32_t name;
+	uint32_t pkgver;
+	uint32_t blob;
+	uint32_t bloblen;
+};
+
+struct binidx_vpkg {
+	uint32_t name;
+	uint32_t pkg;
+};
+
+struct binidx_section {
+	uint32_t pkgs;
+	uint32_t npkgs;
+	uint32_t vpkgs;
+	uint32_t nvpkgs;
+};
+
+struct binidx_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t repodata_size;
+	int64_t repodata_mtime;
+	int64_t repodata_mtime_nsec;
+	uint32_t strtab;
+	uint32_t strtabsz;
+	uint32_t blob;
+	uint32_t blobsz;
+	uint32_t meta;
+	uint32_t metasz;
+	struct binidx_section sections[SECTION_MAX];
+};
+
+struct xbps_repo_index {
+	pthread_mutex_t lock;
+	void *map;
+	size_t mapsz;
+	const char *strtab;
+	const char *blob;
+	const struct binidx_hdr *hdr;
+	const struct binidx_pkg *pkgs[SECTION_MAX];
+	const struct binidx_vpkg *vpkgs[SECTION_MAX];
+	uint32_t npkgs[SECTION_MAX];
+	uint32_t nvpkgs[SECTION_MAX];
+	const char *uri;
+	bool use_stage;
+	/* package dictionaries internalized so far, keyed by pkgname */
+	xbps_dictionary_t cache;
+};
+
+/*
+ * Writer
+ */
+struct buf {
+	char *data;
+	size_t len;
+	size_t sz;
+};
+
+struct strent {
+	uint32_t off;
+	UT_hash_handle hh;
+	char str[];
+};
+
+struct vpkgent {
+	const char *name;
+	uint32_t nameoff;
+	uint32_t pkg;
+};
+
+struct writer {
+	struct buf strtab;
+	struct buf blob;
+	struct buf recs;
+	struct strent *strings;
+};
+
+static int
+buf_reserve(struct buf *b, size_t len)
+{
+	char *p;
+	size_t sz;
+
+	if (b->len + len <= b->sz)
+		return 0;
+	sz = b->sz ? b->sz : 4096;
+	while (sz < b->len + len)
+		sz *= 2;
+	p = realloc(b->data, sz);
+	if (!p)
+		return -errno;
+	b->data = p;
+	b->sz = sz;
+	return 0;
+}
+
+static int
+buf_append(struct buf *b, const void *data, size_t len, uint32_t *offp)
+{
+	int r;
+
+	if (b->len + len > UINT32_MAX)
+		return -EFBIG;
+	r = buf_reserve(b, len);
+	if (r < 0)
+		return r;
+	if (offp)
+		*offp = (uint32_t)b->len;
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	return 0;
+}
+
+static int
+buf_align(struct buf *b)
+{
+	static const char zero[8];
+
+	return buf_append(b, zero, (8 - b->len % 8) % 8, NULL);
+}
+
+static int
+intern(struct writer *w, const char *str, struct strent **entp)
+{
+	struct strent *ent = NULL;
+	size_t len = strlen(str);
+	int r;
+
+	HASH_FIND(hh, w->strings, str, len, ent);
+	if (ent) {
+		*entp = ent;
+		return 0;
+	}
+	ent = malloc(sizeof(*ent) + len + 1);
+	if (!ent)
+		return -errno;
+	memcpy(ent->str, str, len + 1);
+	r = buf_append(&w->strtab, str, len + 1, &ent->off);
+	if (r < 0) {
+		free(ent);
+		return r;
+	}
+	HASH_ADD_KEYPTR(hh, w->strings, ent->str, len, ent);
+	*entp = ent;
+	return 0;
+}
+
+static int
+vpkgent_cmp(const void *a, const void *b)
+{
+	const struct vpkgent *va = a, *vb = b;
+	int r;
+
+	r = strcmp(va->name, vb->name);
+	if (r != 0)
+		return r;
+	return va->pkg < vb->pkg ? -1 : va->pkg > vb->pkg;
+}
+
+static int
+write_section(struct writer *w, xbps_dictionary_t d, struct binidx_section *sec,
+		struct binidx_pkg **pkgsp, struct vpkgent **vpkgsp)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	struct binidx_pkg *pkgs = NULL;
+	struct vpkgent *vpkgs = NULL;
+	const char *prev = NULL;
+	unsigned int npkgs, nvpkgs = 0, vpkgssz = 0, i = 0;
+	int r = 0;
+
+	*pkgsp = NULL;
+	*vpkgsp = NULL;
+	memset(sec, 0, sizeof(*sec));
+
+	npkgs = xbps_dictionary_count(d);
+	if (npkgs == 0)
+		return 0;
+
+	pkgs = calloc(npkgs, sizeof(*pkgs));
+	if (!pkgs)
+		return -errno;
+
+	iter = xbps_dictionary_iterator(d);
+	if (!iter) {
+		r = -errno;
+		goto err;
+	}
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		const char *pkgname = xbps_dictionary_keysym_cstring_nocopy(keysym);
+		xbps_dictionary_t pkgd = xbps_dictionary_get_keysym(d, keysym);
+		xbps_array_t provides;
+		struct strent *ent;
+		const char *pkgver = NULL;
+		char *xml;
+
+		/* records are looked up with bsearch */
+		if (prev && strcmp(prev, pkgname) >= 0) {
+			r = -EINVAL;
+			break;
+		}
+		prev = pkgname;
+
+		if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver)) {
+			r = -EINVAL;
+			break;
+		}
+		if ((r = intern(w, pkgname, &ent)) < 0)
+			break;
+		pkgs[i].name = ent->off;
+		if ((r = intern(w, pkgver, &ent)) < 0)
+			break;
+		pkgs[i].pkgver = ent->off;
+
+		xml = xbps_dictionary_externalize(pkgd);
+		if (!xml) {
+			r = errno ? -errno : -EINVAL;
+			break;
+		}
+		pkgs[i].bloblen = (uint32_t)strlen(xml) + 1;
+		r = buf_append(&w->blob, xml, pkgs[i].bloblen, &pkgs[i].blob);
+		free(xml);
+		if (r < 0)
+			break;
+
+		provides = xbps_dictionary_get(pkgd, "provides");
+		for (unsigned int j = 0; j < xbps_array_count(provides); j++) {
+			char vpkgname[XBPS_NAME_SIZE];
+			const char *vpkg = NULL;
+
+			if (!xbps_array_get_cstring_nocopy(provides, j, &vpkg))
+				continue;
+			if (xbps_pkg_name(vpkgname, sizeof(vpkgname), vpkg))
+				vpkg = vpkgname;
+			if ((r = intern(w, vpkg, &ent)) < 0)
+				break;
+			if (nvpkgs == vpkgssz) {
+				struct vpkgent *tmp;
+				vpkgssz = vpkgssz ? vpkgssz * 2 : 64;
+				tmp = realloc(vpkgs, vpkgssz * sizeof(*vpkgs));
+				if (!tmp) {
+					r = -errno;
+					break;
+				}
+				vpkgs = tmp;
+			}
+			vpkgs[nvpkgs].name = ent->str;
+			vpkgs[nvpkgs].nameoff = ent->off;
+			vpkgs[nvpkgs].pkg = i;
+			nvpkgs++;
+		}
+		if (r < 0)
+			break;
+		i++;
+	}
+	xbps_object_iterator_release(iter);
+	if (r < 0)
+		goto err;
+
+	if (nvpkgs > 0)
+		qsort(vpkgs, nvpkgs, sizeof(*vpkgs), vpkgent_cmp);
+
+	sec->npkgs = npkgs;
+	sec->nvpkgs = nvpkgs;
+	*pkgsp = pkgs;
+	*vpkgsp = vpkgs;
+	return 0;
+err:
+	free(pkgs);
+	free(vpkgs);
+	return r;
+}
+
+static int
+write_records(struct writer *w, struct binidx_section *sec,
+		const struct binidx_pkg *pkgs, const struct vpkgent *vpkgs,
+		size_t base)
+{
+	uint32_t nvpkgs = sec->nvpkgs;
+	int r;
+
+	if ((r = buf_align(&w->recs)) < 0)
+		return r;
+	sec->pkgs = (uint32_t)(base + w->recs.len);
+	r = buf_append(&w->recs, pkgs, sec->npkgs * sizeof(*pkgs), NULL);
+	if (r < 0)
+		return r;
+	sec->nvpkgs = 0;
+	sec->vpkgs = (uint32_t)(base + w->recs.len);
+	for (uint32_t i = 0; i < nvpkgs; i++) {
+		struct binidx_vpkg rec;
+
+		/* a package providing the same vpkg more than once */
+		if (i > 0 && vpkgs[i].nameoff == vpkgs[i-1].nameoff &&
+		    vpkgs[i].pkg == vpkgs[i-1].pkg)
+			continue;
+		rec.name = vpkgs[i].nameoff;
+		rec.pkg = vpkgs[i].pkg;
+		if ((r = buf_append(&w->recs, &rec, sizeof(rec), NULL)) < 0)
+			return r;
+		sec->nvpkgs++;
+	}
+	return 0;
+}
+
+static int
+write_all(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+int
+xbps_repo_index_write(const char *repodata, xbps_dictionary_t index,
+		xbps_dictionary_t stage, xbps_dictionary_t meta)
+{
+	struct writer w = {0};
+	struct binidx_hdr hdr;
+	struct binidx_pkg *pkgs[SECTION_MAX] = {0};
+	struct vpkgent *vpkgs[SECTION_MAX] = {0};
+	xbps_dictionary_t dicts[SECTION_MAX] = { index, stage };
+	struct strent *ent, *tmp;
+	struct stat st;
+	char path[PATH_MAX], tmppath[PATH_MAX];
+	size_t off;
+	int fd = -1, r;
+
+	if (stat(repodata, &st) == -1)
+		return -errno;
+
+	r = snprintf(path, sizeof(path), "%s.idx", repodata);
+	if (r < 0 || (size_t)r >= sizeof(path))
+		return -ENAMETOOLONG;
+	r = snprintf(tmppath, sizeof(tmppath), "%s.idx.XXXXXXXXXX", repodata);
+	if (r < 0 || (size_t)r >= sizeof(tmppath))
+		return -ENAMETOOLONG;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BINIDX_MAGIC, sizeof(hdr.magic));
+	hdr.version = BINIDX_VERSION;
+	hdr.repodata_size = (uint64_t)st.st_size;
+	hdr.repodata_mtime = st.st_mtim.tv_sec;
+	hdr.repodata_mtime_nsec = st.st_mtim.tv_nsec;
+
+	for (int i = 0; i < SECTION_MAX; i++) {
+		r = write_section(&w, dicts[i], &hdr.sections[i], &pkgs[i], &vpkgs[i]);
+		if (r < 0)
+			goto out;
+	}
+	if (xbps_dictionary_count(meta)) {
+		char *xml = xbps_dictionary_externalize(meta);
+		if (!xml) {
+			r = errno ? -errno : -EINVAL;
+			goto out;
+		}
+		hdr.metasz = (uint32_t)strlen(xml) + 1;
+		r = buf_append(&w.blob, xml, hdr.metasz, &hdr.meta);
+		free(xml);
+		if (r < 0)
+			goto out;
+	}
+
+	off = sizeof(hdr);
+	hdr.strtab = (uint32_t)off;
+	hdr.strtabsz = (uint32_t)w.strtab.len;
+	if ((r = buf_align(&w.strtab)) < 0)
+		goto out;
+	off += w.strtab.len;
+	for (int i = 0; i < SECTION_MAX; i++) {
+		r = write_records(&w, &hdr.sections[i], pkgs[i], vpkgs[i], off);
+		if (r < 0)
+			goto out;
+	}
+	if ((r = buf_align(&w.recs)) < 0)
+		goto out;
+	off += w.recs.len;
+	if (off + w.blob.len > UINT32_MAX) {
+		r = -EFBIG;
+		goto out;
+	}
+	hdr.blob = (uint32_t)off;
+	hdr.blobsz = (uint32_t)w.blob.len;
+
+	fd = mkstemp(tmppath);
+	if (fd == -1) {
+		r = -errno;
+		goto out;
+	}
+	if ((r = write_all(fd, &hdr, sizeof(hdr))) < 0 ||
+	    (r = write_all(fd, w.strtab.data, w.strtab.len)) < 0 ||
+	    (r = write_all(fd, w.recs.data, w.recs.len)) < 0 ||
+	    (r = write_all(fd, w.blob.data, w.blob.len)) < 0)
+		goto out;
+	if (fchmod(fd, 0644) == -1 || fsync(fd) == -1) {
+		r = -errno;
+		goto out;
+	}
+	close(fd);
+	fd = -1;
+	if (rename(tmppath, path) == -1) {
+		r = -errno;
+		goto out;
+	}
+	r = 0;
+out:
+	if (fd != -1) {
+		close(fd);
+		unlink(tmppath);
+	}
+	HASH_ITER(hh, w.strings, ent, tmp) {
+		HASH_DEL(w.strings, ent);
+		free(ent);
+	}
+	for (int i = 0; i < SECTION_MAX; i++) {
+		free(pkgs[i]);
+		free(vpkgs[i]);
+	}
+	free(w.strtab.data);
+	free(w.recs.data);
+	free(w.blob.data);
+	return r;
+}
+
+/*
+ * Reader
+ */
+static bool
+valid_str(const struct xbps_repo_index *idx, uint32_t off)
+{
+	return off < idx->hdr->strtabsz;
+}
+
+static bool
+valid_blob(const struct xbps_repo_index *idx, uint32_t off, uint32_t len)
+{
+	if (len == 0 || off > idx->hdr->blobsz || len > idx->hdr->blobsz - off)
+		return false;
+	return idx->blob[off + len - 1] == '\0';
+}
+
+static bool
+valid_range(size_t mapsz, uint64_t off, uint64_t len)
+{
+	return off <= mapsz && len <= mapsz - off;
+}
+
+static int
+index_validate(struct xbps_repo_index *idx)
+{
+	const struct binidx_hdr *hdr = idx->hdr;
+
+	if (memcmp(hdr->magic, BINIDX_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != BINIDX_VERSION)
+		return -EINVAL;
+	if (!valid_range(idx->mapsz, hdr->strtab, hdr->strtabsz) ||
+	    !valid_range(idx->mapsz, hdr->blob, hdr->blobsz))
+		return -EINVAL;
+	idx->strtab = (const char *)idx->map + hdr->strtab;
+	idx->blob = (const char *)idx->map + hdr->blob;
+	if (hdr->strtabsz > 0 && idx->strtab[hdr->strtabsz - 1] != '\0')
+		return -EINVAL;
+	if (hdr->metasz > 0 && !valid_blob(idx, hdr->meta, hdr->metasz))
+		return -EINVAL;
+
+	for (int i = 0; i < SECTION_MAX; i++) {
+		const struct binidx_section *sec = &hdr->sections[i];
+
+		if (sec->pkgs % sizeof(uint32_t) || sec->vpkgs % sizeof(uint32_t))
+			return -EINVAL;
+		if (!valid_range(idx->mapsz, sec->pkgs,
+		    (uint64_t)sec->npkgs * sizeof(struct binidx_pkg)) ||
+		    !valid_range(idx->mapsz, sec->vpkgs,
+		    (uint64_t)sec->nvpkgs * sizeof(struct binidx_vpkg)))
+			return -EINVAL;
+		idx->pkgs[i] = (const void *)((const char *)idx->map + sec->pkgs);
+		idx->vpkgs[i] = (const void *)((const char *)idx->map + sec->vpkgs);
+		idx->npkgs[i] = sec->npkgs;
+		idx->nvpkgs[i] = sec->nvpkgs;
+
+		for (uint32_t j = 0; j < sec->npkgs; j++) {
+			const struct binidx_pkg *rec = &idx->pkgs[i][j];
+			if (!valid_str(idx, rec->name) || !valid_str(idx, rec->pkgver) ||
+			    !valid_blob(idx, rec->blob, rec->bloblen))
+				return -EINVAL;
+		}
+		for (uint32_t j = 0; j < sec->nvpkgs; j++) {
+			const struct binidx_vpkg *rec = &idx->vpkgs[i][j];
+			if (!valid_str(idx, rec->name) || rec->pkg >= sec->npkgs)
+				return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+struct xbps_repo_index HIDDEN *
+xbps_repo_index_open(const char *repodata, const char *uri, bool use_stage)
+{
+	struct xbps_repo_index *idx;
+	struct stat st, idxst;
+	char path[PATH_MAX];
+	int fd, r;
+
+	r = snprintf(path, sizeof(path), "%s.idx", repodata);
+	if (r < 0 || (size_t)r >= sizeof(path)) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	if (stat(repodata, &st) == -1)
+		return NULL;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+	if (fstat(fd, &idxst) == -1) {
+		r = errno;
+		close(fd);
+		errno = r;
+		return NULL;
+	}
+	if ((size_t)idxst.st_size < sizeof(struct binidx_hdr) ||
+	    (uint64_t)idxst.st_size > UINT32_MAX) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx) {
+		r = errno;
+		close(fd);
+		errno = r;
+		return NULL;
+	}
+	idx->mapsz = (size_t)idxst.st_size;
+	idx->map = mmap(NULL, idx->mapsz, PROT_READ, MAP_PRIVATE, fd, 0);
+	r = errno;
+	close(fd);
+	if (idx->map == MAP_FAILED) {
+		free(idx);
+		errno = r;
+		return NULL;
+	}
+	idx->hdr = idx->map;
+
+	r = -index_validate(idx);
+	if (r == 0 &&
+	    (idx->hdr->repodata_size != (uint64_t)st.st_size ||
+	     idx->hdr->repodata_mtime != st.st_mtim.tv_sec ||
+	     idx->hdr->repodata_mtime_nsec != st.st_mtim.tv_nsec))
+		r = ESTALE;
+	if (r == 0 && !(idx->cache = xbps_dictionary_create()))
+		r = errno ? errno : ENOMEM;
+	if (r != 0) {
+		xbps_dbg_printf("[repo] %s: ignoring binary index: %s\n",
+		    path, strerror(r));
+		munmap(idx->map, idx->mapsz);
+		free(idx);
+		errno = r;
+		return NULL;
+	}
+
+	pthread_mutex_init(&idx->lock, NULL);
+	idx->uri = uri;
+	idx->use_stage = use_stage && idx->npkgs[SECTION_STAGE] > 0;
+	return idx;
+}
+
+void HIDDEN
+xbps_repo_index_close(struct xbps_repo_index *idx)
+{
+	if (!idx)
+		return;
+	xbps_object_release(idx->cache);
+	munmap(idx->map, idx->mapsz);
+	pthread_mutex_destroy(&idx->lock);
+	free(idx);
+}
+
+int HIDDEN
+xbps_repo_index_meta(struct xbps_repo_index *idx, xbps_dictionary_t *metap)
+{
+	*metap = NULL;
+	if (idx->hdr->metasz == 0)
+		return 0;
+	*metap = xbps_dictionary_internalize(idx->blob + idx->hdr->meta);
+	if (!*metap)
+		return errno ? -errno : -EINVAL;
+	xbps_dictionary_make_immutable(*metap);
+	return 0;
+}
+
+static const struct binidx_pkg *
+index_find(struct xbps_repo_index *idx, int sec, const char *pkgname)
+{
+	const struct binidx_pkg *pkgs = idx->pkgs[sec];
+	uint32_t lo = 0, hi = idx->npkgs[sec];
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int r = strcmp(pkgname, idx->strtab + pkgs[mid].name);
+		if (r == 0)
+			return &pkgs[mid];
+		if (r < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+/*
+ * Internalizes the package dictionary for pkgname into the cache,
+ * the staged package takes precedence if the stage is in use.
+ */
+static xbps_dictionary_t
+index_fill(struct xbps_repo_index *idx, const char *pkgname)
+{
+	const struct binidx_pkg *rec = NULL;
+	xbps_dictionary_t pkgd;
+
+	if ((pkgd = xbps_dictionary_get(idx->cache, pkgname)))
+		return pkgd;
+	if (idx->use_stage)
+		rec = index_find(idx, SECTION_STAGE, pkgname);
+	if (!rec)
+		rec = index_find(idx, SECTION_INDEX, pkgname);
+	if (!rec)
+		return NULL;
+
+	pkgd = xbps_dictionary_internalize(idx->blob + rec->blob);
+	if (!pkgd)
+		return NULL;
+	if (!xbps_dictionary_set_cstring_nocopy(pkgd, "repository", idx->uri) ||
+	    !xbps_dictionary_set_cstring(pkgd, "pkgname", pkgname) ||
+	    !xbps_dictionary_set(idx->cache, pkgname, pkgd)) {
+		xbps_object_release(pkgd);
+		return NULL;
+	}
+	xbps_object_release(pkgd);
+	return pkgd;
+}
+
+static void
+index_fill_pattern(struct xbps_repo_index *idx, const char *pkg)
+{
+	char pkgname[XBPS_NAME_SIZE];
+
+	if (xbps_pkgpattern_name(pkgname, sizeof(pkgname), pkg) ||
+	    xbps_pkg_name(pkgname, sizeof(pkgname), pkg))
+		index_fill(idx, pkgname);
+	else
+		index_fill(idx, pkg);
+}
+
+static void
+index_fill_providers(struct xbps_repo_index *idx, int sec, const char *vpkgname)
+{
+	const struct binidx_vpkg *vpkgs = idx->vpkgs[sec];
+	uint32_t lo = 0, hi = idx->nvpkgs[sec];
+
+	/* lower bound */
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (strcmp(idx->strtab + vpkgs[mid].name, vpkgname) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < idx->nvpkgs[sec]; lo++) {
+		if (strcmp(idx->strtab + vpkgs[lo].name, vpkgname) != 0)
+			break;
+		index_fill(idx, idx->strtab + idx->pkgs[sec][vpkgs[lo].pkg].name);
+	}
+}
+
+xbps_dictionary_t HIDDEN
+xbps_repo_index_get_pkg(struct xbps_handle *xhp, struct xbps_repo_index *idx,
+		const char *pkg)
+{
+	xbps_dictionary_t providers, pkgd = NULL;
+
+	pthread_mutex_lock(&idx->lock);
+	/*
+	 * Make the packages that xbps_find_virtualpkg_in_conf() and
+	 * xbps_find_pkg_in_dict() could match available in the cache.
+	 */
+	if (xhp->vpkgd_conf &&
+	    (providers = xbps_dictionary_get(xhp->vpkgd_conf, pkg))) {
+		xbps_object_iterator_t iter;
+		xbps_object_t obj;
+
+		iter = xbps_dictionary_iterator(providers);
+		assert(iter);
+		while ((obj = xbps_object_iterator_next(iter))) {
+			xbps_string_t rpkg = xbps_dictionary_get_keysym(providers, obj);
+			index_fill_pattern(idx, xbps_string_cstring_nocopy(rpkg));
+		}
+		xbps_object_iterator_release(iter);
+		pkgd = xbps_find_virtualpkg_in_conf(xhp, idx->cache, pkg);
+	}
+	if (!pkgd) {
+		index_fill_pattern(idx, pkg);
+		pkgd = xbps_find_pkg_in_dict(idx->cache, pkg);
+	}
+	pthread_mutex_unlock(&idx->lock);
+	return pkgd;
+}
+
+xbps_dictionary_t HIDDEN
+xbps_repo_index_get_virtualpkg(struct xbps_handle *xhp, struct xbps_repo_index *idx,
+		const char *pkg)
+{
+	char vpkgname[XBPS_NAME_SIZE];
+	xbps_dictionary_t pkgd;
+	const char *vpkg;
+
+	pthread_mutex_lock(&idx->lock);
+	if ((vpkg = vpkg_user_conf(xhp, pkg)))
+		index_fill_pattern(idx, vpkg);
+	if (!xbps_pkgpattern_name(vpkgname, sizeof(vpkgname), pkg) &&
+	    !xbps_pkg_name(vpkgname, sizeof(vpkgname), pkg))
+		xbps_strlcpy(vpkgname, pkg, sizeof(vpkgname));
+	/*
+	 * The cache is iterated in pkgname order just like the full
+	 * index, filling every provider of vpkgname from both sections
+	 * makes the first match the same one.
+	 */
+	index_fill_providers(idx, SECTION_INDEX, vpkgname);
+	if (idx->use_stage)
+		index_fill_providers(idx, SECTION_STAGE, vpkgname);
+	pkgd = xbps_find_virtualpkg_in_dict(xhp, idx->cache, pkg);
+	pthread_mutex_unlock(&idx->lock);
+	return pkgd;
+}
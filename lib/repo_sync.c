@@ -26,11 +26,16 @@
 #include <sys/stat.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <archive.h>
+#include <archive_entry.h>
+
 #include "xbps_api_impl.h"
 #include "fetch.h"
 
@@ -70,16 +75,398 @@ xbps_get_remote_repo_string(const char *uri)
 	return p;
 }
 
+/*
+ * Repositories can publish the changes made to their repodata as
+ * deltas, listed in `<arch>-repodata.deltas' with the SHA256 and
+ * mtime of the current repodata (the head). A delta archive holds the
+ * packages added or changed in the index, the packages removed from
+ * it and the whole stage and index metadata.
+ *
+ * The repodata in metadir is rebuilt from the deltas, so its SHA256
+ * no longer matches the one published by the repository; the SHA256
+ * it corresponds to is stored in `<arch>-repodata.state', along with
+ * the size and mtime of the local repodata to detect a stale state.
+ */
+static int
+repodata_read(const char *path, xbps_dictionary_t *indexp,
+		xbps_dictionary_t *metap, xbps_dictionary_t *stagep)
+{
+	struct archive *ar;
+	struct archive_entry *entry;
+	int r;
+
+	if ((ar = xbps_archive_read_new()) == NULL)
+		return -errno;
+	if ((r = xbps_archive_read_open(ar, path)) < 0) {
+		archive_read_free(ar);
+		return r;
+	}
+	while ((r = archive_read_next_header(ar, &entry)) == ARCHIVE_OK) {
+		const char *pname = archive_entry_pathname(entry);
+		xbps_dictionary_t *dp, d;
+		char *buf;
+
+		if (pname == NULL)
+			xbps_unreachable();
+		if (strcmp(pname, XBPS_REPODATA_INDEX) == 0)
+			dp = indexp;
+		else if (strcmp(pname, XBPS_REPODATA_META) == 0)
+			dp = metap;
+		else if (strcmp(pname, XBPS_REPODATA_STAGE) == 0)
+			dp = stagep;
+		else
+			continue;
+		if ((buf = xbps_archive_get_file(ar, entry)) == NULL) {
+			r = ARCHIVE_FATAL;
+			break;
+		}
+		d = *buf ? xbps_dictionary_internalize(buf) : xbps_dictionary_create();
+		free(buf);
+		if (d == NULL) {
+			r = ARCHIVE_FATAL;
+			break;
+		}
+		if (*dp)
+			xbps_object_release(*dp);
+		*dp = d;
+	}
+	archive_read_free(ar);
+	if (r != ARCHIVE_EOF || !*indexp || !*metap || !*stagep)
+		return -EINVAL;
+	return 0;
+}
+
+static int
+repodata_write(const char *path, xbps_dictionary_t index,
+		xbps_dictionary_t meta, xbps_dictionary_t stage, time_t mtime)
+{
+	const char *const names[] = {
+		XBPS_REPODATA_INDEX, XBPS_REPODATA_META, XBPS_REPODATA_STAGE,
+	};
+	xbps_dictionary_t dicts[] = { index, meta, stage };
+	struct archive *ar = NULL;
+	struct timespec ts[2];
+	char tmp[PATH_MAX];
+	int fd, r = 0;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+		return -ENAMETOOLONG;
+	if ((fd = mkstemp(tmp)) == -1)
+		return -errno;
+	if ((ar = archive_write_new()) == NULL) {
+		r = -errno;
+		goto err;
+	}
+	archive_write_set_format_pax_restricted(ar);
+	if (archive_write_open_fd(ar, fd) != ARCHIVE_OK) {
+		r = -xbps_archive_errno(ar);
+		goto err;
+	}
+	for (size_t i = 0; i < __arraycount(names); i++) {
+		char *buf = NULL;
+
+		if (xbps_dictionary_count(dicts[i]) > 0 &&
+		    (buf = xbps_dictionary_externalize(dicts[i])) == NULL) {
+			r = -EINVAL;
+			goto err;
+		}
+		r = xbps_archive_append_buf(ar, buf ? buf : "", buf ? strlen(buf) : 0,
+		    names[i], 0644, "root", "root");
+		free(buf);
+		if (r < 0)
+			goto err;
+	}
+	if (archive_write_close(ar) != ARCHIVE_OK) {
+		r = -xbps_archive_errno(ar);
+		goto err;
+	}
+	archive_write_free(ar);
+	ar = NULL;
+
+	/* keep the mtime of the repository, used to fetch it if needed */
+	ts[0].tv_sec = ts[1].tv_sec = mtime;
+	ts[0].tv_nsec = ts[1].tv_nsec = 0;
+	if (fchmod(fd, 0644) == -1 || futimens(fd, ts) == -1) {
+		r = -errno;
+		goto err;
+	}
+	close(fd);
+	fd = -1;
+	if (rename(tmp, path) == -1) {
+		r = -errno;
+		goto err;
+	}
+	return 0;
+err:
+	if (ar)
+		archive_write_free(ar);
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	return r;
+}
+
+/*
+ * Gets the SHA256 of the published repodata the local repodata
+ * corresponds to.
+ */
+static bool
+repodata_state(const char *path, const char *statepath, char *sha256, size_t len)
+{
+	xbps_dictionary_t state;
+	struct stat st;
+	const char *s = NULL;
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	bool found = false;
+
+	if (stat(path, &st) == -1)
+		return false;
+	if (access(statepath, F_OK) == 0 &&
+	    (state = xbps_plist_dictionary_from_file(statepath)) != NULL) {
+		xbps_dictionary_get_cstring_nocopy(state, "sha256", &s);
+		xbps_dictionary_get_uint64(state, "size", &size);
+		xbps_dictionary_get_int64(state, "mtime", &mtime);
+		if (s && size == (uint64_t)st.st_size && mtime == (int64_t)st.st_mtime) {
+			xbps_strlcpy(sha256, s, len);
+			found = true;
+		}
+		xbps_object_release(state);
+		if (found)
+			return true;
+	}
+	/* the repodata was fetched as is */
+	return xbps_file_sha256(sha256, len, path);
+}
+
+static void
+repodata_state_write(const char *path, const char *statepath, const char *sha256)
+{
+	xbps_dictionary_t state;
+	struct stat st;
+
+	if (stat(path, &st) == -1 || (state = xbps_dictionary_create()) == NULL)
+		return;
+	if (xbps_dictionary_set_cstring(state, "sha256", sha256) &&
+	    xbps_dictionary_set_uint64(state, "size", (uint64_t)st.st_size) &&
+	    xbps_dictionary_set_int64(state, "mtime", (int64_t)st.st_mtime))
+		xbps_dictionary_externalize_to_file(state, statepath);
+	xbps_object_release(state);
+}
+
+static int
+delta_apply(xbps_dictionary_t delta, const char *from, const char *to,
+		xbps_dictionary_t index, xbps_dictionary_t *metap,
+		xbps_dictionary_t *stagep)
+{
+	xbps_dictionary_t changed, meta, stage;
+	xbps_array_t removed;
+	xbps_object_iterator_t iter;
+	xbps_object_t keysym;
+	const char *dfrom = NULL, *dto = NULL;
+	uint32_t count = 0;
+
+	xbps_dictionary_get_cstring_nocopy(delta, "from", &dfrom);
+	xbps_dictionary_get_cstring_nocopy(delta, "to", &dto);
+	if (!dfrom || !dto || strcmp(dfrom, from) || strcmp(dto, to))
+		return -EINVAL;
+
+	removed = xbps_dictionary_get(delta, "index-removed");
+	for (unsigned int i = 0; i < xbps_array_count(removed); i++) {
+		const char *pkgname = NULL;
+
+		xbps_array_get_cstring_nocopy(removed, i, &pkgname);
+		if (pkgname)
+			xbps_dictionary_remove(index, pkgname);
+	}
+	changed = xbps_dictionary_get(delta, "index");
+	iter = xbps_dictionary_iterator(changed);
+	if (iter == NULL)
+		return -EINVAL;
+	while ((keysym = xbps_object_iterator_next(iter))) {
+		if (!xbps_dictionary_set_keysym(index, keysym,
+		    xbps_dictionary_get_keysym(changed, keysym))) {
+			xbps_object_iterator_release(iter);
+			return -ENOMEM;
+		}
+	}
+	xbps_object_iterator_release(iter);
+
+	if (!xbps_dictionary_get_uint32(delta, "index-count", &count) ||
+	    count != xbps_dictionary_count(index))
+		return -EINVAL;
+
+	if ((stage = xbps_dictionary_get(delta, "stage")) != NULL)
+		xbps_object_retain(stage);
+	else if ((stage = xbps_dictionary_create()) == NULL)
+		return -ENOMEM;
+	xbps_object_release(*stagep);
+	*stagep = stage;
+	if ((meta = xbps_dictionary_get(delta, "index-meta")) != NULL)
+		xbps_object_retain(meta);
+	else if ((meta = xbps_dictionary_create()) == NULL)
+		return -ENOMEM;
+	xbps_object_release(*metap);
+	*metap = meta;
+	return 0;
+}
+
+/*
+ * Brings the repodata in `lrepodir' up to date with the deltas published
+ * by the repository. Returns 0 if it is up to date, a negative errno if
+ * the whole repodata has to be fetched.
+ */
+static int
+repo_sync_delta(struct xbps_handle *xhp, const char *uri,
+		const char *lrepodir, const char *arch)
+{
+	char path[PATH_MAX], statepath[PATH_MAX], dpath[PATH_MAX];
+	char nopath[PATH_MAX], state[XBPS_SHA256_SIZE];
+	xbps_dictionary_t deltas = NULL, index = NULL, meta = NULL, stage = NULL;
+	xbps_array_t list, chain = NULL;
+	const char *head = NULL, *cur;
+	uint64_t size = 0, dsize = 0;
+	int64_t mtime = 0;
+	char *url;
+	int r;
+
+	if (snprintf(path, sizeof(path), "%s/%s-repodata", lrepodir, arch) >= (int)sizeof(path) ||
+	    snprintf(statepath, sizeof(statepath), "%s.state", path) >= (int)sizeof(statepath) ||
+	    snprintf(dpath, sizeof(dpath), "%s.deltas", path) >= (int)sizeof(dpath) ||
+	    snprintf(nopath, sizeof(nopath), "%s.nodeltas", path) >= (int)sizeof(nopath))
+		return -ENAMETOOLONG;
+	if (access(path, F_OK) == -1)
+		return -errno;
+	/*
+	 * The repository had no deltas when the local repodata was fetched,
+	 * do not ask again until it changes.
+	 */
+	if (access(nopath, F_OK) == 0)
+		return -ENOENT;
+
+	url = xbps_xasprintf("%s/%s-repodata.deltas", uri, arch);
+	r = xbps_fetch_file_dest(xhp, url, dpath, NULL);
+	free(url);
+	if (r == -1) {
+		xbps_dbg_printf("[reposync] %s: no repodata deltas: %s\n", uri,
+		    xbps_fetch_error_string() ? xbps_fetch_error_string() :
+		    strerror(errno));
+		/* never use an outdated list */
+		unlink(dpath);
+		if (fetchLastErrCode == FETCH_UNAVAIL) {
+			int fd = open(nopath, O_WRONLY|O_CREAT|O_CLOEXEC, 0644);
+			if (fd != -1)
+				close(fd);
+		}
+		return -ENOENT;
+	}
+	if ((deltas = xbps_archive_fetch_plist(dpath, XBPS_REPODATA_DELTAS)) == NULL)
+		return -EINVAL;
+	xbps_dictionary_get_cstring_nocopy(deltas, "head", &head);
+	xbps_dictionary_get_uint64(deltas, "size", &size);
+	xbps_dictionary_get_int64(deltas, "mtime", &mtime);
+	list = xbps_dictionary_get(deltas, "deltas");
+	if (head == NULL || !repodata_state(path, statepath, state, sizeof(state))) {
+		r = -EINVAL;
+		goto out;
+	}
+	if (strcmp(state, head) == 0) {
+		xbps_dbg_printf("[reposync] %s: repodata is up to date\n", uri);
+		r = 0;
+		goto out;
+	}
+
+	/* find the chain of deltas from the local repodata to the head */
+	if ((chain = xbps_array_create()) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+	cur = state;
+	for (unsigned int i = 0; i < xbps_array_count(list) && strcmp(cur, head); i++) {
+		xbps_dictionary_t d = xbps_array_get(list, i);
+		const char *from = NULL, *to = NULL;
+		uint64_t s = 0;
+
+		xbps_dictionary_get_cstring_nocopy(d, "from", &from);
+		xbps_dictionary_get_cstring_nocopy(d, "to", &to);
+		xbps_dictionary_get_uint64(d, "size", &s);
+		if (!from || !to || strcmp(from, cur) != 0)
+			continue;
+		xbps_array_add(chain, d);
+		dsize += s;
+		cur = to;
+	}
+	if (strcmp(cur, head) != 0 || dsize >= size) {
+		xbps_dbg_printf("[reposync] %s: no usable repodata deltas\n", uri);
+		r = -ENOENT;
+		goto out;
+	}
+
+	if ((r = repodata_read(path, &index, &meta, &stage)) < 0)
+		goto out;
+	for (unsigned int i = 0; i < xbps_array_count(chain); i++) {
+		xbps_dictionary_t d = xbps_array_get(chain, i), delta;
+		const char *file = NULL, *from = NULL, *to = NULL;
+		char fpath[PATH_MAX];
+
+		xbps_dictionary_get_cstring_nocopy(d, "file", &file);
+		xbps_dictionary_get_cstring_nocopy(d, "from", &from);
+		xbps_dictionary_get_cstring_nocopy(d, "to", &to);
+		if (file == NULL || strchr(file, '/') ||
+		    snprintf(fpath, sizeof(fpath), "%s/%s", lrepodir, file) >= (int)sizeof(fpath)) {
+			r = -EINVAL;
+			goto out;
+		}
+		url = xbps_xasprintf("%s/%s", uri, file);
+		r = xbps_fetch_file_dest(xhp, url, fpath, NULL);
+		free(url);
+		if (r == -1) {
+			r = -EIO;
+			goto out;
+		}
+		delta = xbps_archive_fetch_plist(fpath, XBPS_REPODATA_DELTA);
+		unlink(fpath);
+		if (delta == NULL) {
+			r = -EINVAL;
+			goto out;
+		}
+		r = delta_apply(delta, from, to, index, &meta, &stage);
+		xbps_object_release(delta);
+		if (r < 0)
+			goto out;
+	}
+	if ((r = repodata_write(path, index, meta, stage, (time_t)mtime)) < 0)
+		goto out;
+	repodata_state_write(path, statepath, head);
+	xbps_dbg_printf("[reposync] %s: applied %u repodata deltas (%ju bytes)\n",
+	    uri, xbps_array_count(chain), (uintmax_t)dsize);
+out:
+	if (r < 0)
+		xbps_dbg_printf("[reposync] %s: repodata deltas: %s\n", uri, strerror(-r));
+	if (chain)
+		xbps_object_release(chain);
+	if (index)
+		xbps_object_release(index);
+	if (meta)
+		xbps_object_release(meta);
+	if (stage)
+		xbps_object_release(stage);
+	xbps_object_release(deltas);
+	return r;
+}
+
 /*
  * Returns -1 on error, 0 if transfer was not necessary (local/remote
  * size and/or mtime match) and 1 if downloaded successfully.
+ *
+ * Repositories can be synced concurrently: files are fetched to full
+ * paths in metadir and the umask is set by the caller.
  */
 int HIDDEN
 xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 {
-	mode_t prev_umask;
 	const char *arch, *fetchstr = NULL;
-	char *repodata, *lrepodir, *uri_fixedp;
+	char *repodata, *lrepodir, *uri_fixedp, *path;
 	int rv = 0;
 
 	assert(uri != NULL);
@@ -106,49 +493,101 @@ xbps_repo_sync(struct xbps_handle *xhp, const char *uri)
 	/*
 	 * Create repodir in metadir.
 	 */
-	prev_umask = umask(022);
 	if ((rv = xbps_mkpath(lrepodir, 0755)) == -1) {
 		if (errno != EEXIST) {
 			xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC_FAIL,
 			    errno, NULL, "[reposync] failed "
 			    "to create repodir `%s': %s", lrepodir,
 			strerror(errno));
-			umask(prev_umask);
 			free(lrepodir);
 			return rv;
 		}
 	}
-	if (chdir(lrepodir) == -1) {
-		xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC_FAIL, errno, NULL,
-		    "[reposync] failed to change dir to repodir `%s': %s",
-		    lrepodir, strerror(errno));
-		umask(prev_umask);
-		free(lrepodir);
-		return -1;
-	}
-	free(lrepodir);
 	/*
 	 * Remote repository plist index full URL.
 	 */
 	repodata = xbps_xasprintf("%s/%s-repodata", uri, arch);
+	path = xbps_xasprintf("%s/%s-repodata", lrepodir, arch);
 
 	/* reposync start cb */
 	xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC, 0, repodata, NULL);
 	/*
-	 * Download plist index file from repository.
+	 * Apply the repodata deltas if available, otherwise
+	 * download plist index file from repository.
 	 */
-	if ((rv = xbps_fetch_file(xhp, repodata, NULL)) == -1) {
+	if (repo_sync_delta(xhp, uri, lrepodir, arch) == 0) {
+		rv = 0;
+	} else if ((rv = xbps_fetch_file_dest(xhp, repodata, path, NULL)) == -1) {
 		/* reposync error cb */
 		fetchstr = xbps_fetch_error_string();
 		xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC_FAIL,
 		    fetchLastErrCode != 0 ? fetchLastErrCode : errno, NULL,
 		    "[reposync] failed to fetch file `%s': %s",
 		    repodata, fetchstr ? fetchstr : strerror(errno));
-	} else if (rv == 1)
+	} else if (rv == 1) {
+		char *nopath = xbps_xasprintf("%s.nodeltas", path);
+
+		/* the repository may publish deltas now */
+		unlink(nopath);
+		free(nopath);
 		rv = 0;
-	umask(prev_umask);
+	}
+	/*
+	 * The binary index is generated locally rather than fetched,
+	 * it only has to match the repodata file in metadir.
+	 */
+	if (rv == 0) {
+		char *nopath = xbps_xasprintf("%s/%s-files.none", lrepodir, arch);
+
+		xbps_repo_index_update(xhp, uri);
+		/* the repository may provide a files index now */
+		unlink(nopath);
+		free(nopath);
+	}
 
 	free(repodata);
+	free(path);
+	free(lrepodir);
 
 	return rv;
 }
+
+/*
+ * Fetches the optional files index of the remote repository \a uri into
+ * \a path. Returns -1 on error, 0 otherwise.
+ */
+int HIDDEN
+xbps_repo_sync_files(struct xbps_handle *xhp, const char *uri, const char *path)
+{
+	mode_t prev_umask;
+	const char *arch;
+	char *url;
+	int rv;
+
+	if (xhp->target_arch)
+		arch = xhp->target_arch;
+	else
+		arch = xhp->native_arch;
+
+	url = xbps_xasprintf("%s/%s-files", uri, arch);
+	xbps_set_cb_state(xhp, XBPS_STATE_REPOSYNC, 0, url, NULL);
+	prev_umask = umask(022);
+	rv = xbps_fetch_file_dest(xhp, url, path, NULL);
+	umask(prev_umask);
+	if (rv == -1) {
+		/* repositories are not required to provide it */
+		xbps_dbg_printf("[reposync] failed to fetch `%s': %s\n", url,
+		    xbps_fetch_error_string() ? xbps_fetch_error_string() :
+		    strerror(errno));
+		/* do not ask again until the next sync */
+		if (fetchLastErrCode == FETCH_UNAVAIL) {
+			char *nopath = xbps_xasprintf("%s.none", path);
+			int fd = open(nopath, O_WRONLY|O_CREAT|O_CLOEXEC, 0644);
+			if (fd != -1)
+				close(fd);
+			free(nopath);
+		}
+	}
+	free(url);
+	return rv == -1 ? -1 : 0;
+}
@@ -23,6 +23,7 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <sys/stat.h>
 #include <sys/utsname.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -30,6 +31,7 @@
 #include <libgen.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "xbps_api_impl.h"
 #include "fetch.h"
@@ -51,6 +53,8 @@ typedef enum {
 
 static SIMPLEQ_HEAD(rpool_head, xbps_repo) rpool_queue =
     SIMPLEQ_HEAD_INITIALIZER(rpool_queue);
+/* serializes registering and loading repositories looked up by threads */
+static pthread_mutex_t rpool_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * @file lib/rpool.c
@@ -58,34 +62,122 @@ static SIMPLEQ_HEAD(rpool_head, xbps_repo) rpool_queue =
  * @defgroup repopool Repository pool functions
  */
 
+struct rpool_sync {
+	struct xbps_handle *xhp;
+	pthread_mutex_t lock;
+	const char **uris;
+	unsigned int nuris;
+	unsigned int next;
+};
+
+static void *
+rpool_sync_worker(void *arg)
+{
+	struct rpool_sync *rs = arg;
+	const char *repouri;
+
+	for (;;) {
+		pthread_mutex_lock(&rs->lock);
+		if (rs->next == rs->nuris) {
+			pthread_mutex_unlock(&rs->lock);
+			break;
+		}
+		repouri = rs->uris[rs->next++];
+		pthread_mutex_unlock(&rs->lock);
+
+		if (xbps_repo_sync(rs->xhp, repouri) == -1) {
+			xbps_dbg_printf(
+			    "[rpool] `%s' failed to fetch repository data: %s\n",
+			    repouri, fetchLastErrCode == 0 ? strerror(errno) :
+			    xbps_fetch_error_string());
+		}
+	}
+	return NULL;
+}
+
 int
 xbps_rpool_sync(struct xbps_handle *xhp, const char *uri)
 {
+	struct rpool_sync rs = { 0 };
 	const char *repouri = NULL;
-
-	for (unsigned int i = 0; i < xbps_array_count(xhp->repositories); i++) {
+	pthread_t *thds = NULL;
+	unsigned int i, nthreads;
+	mode_t prev_umask;
+	int r;
+
+	rs.xhp = xhp;
+	rs.uris = calloc(xbps_array_count(xhp->repositories) + 1, sizeof(*rs.uris));
+	if (rs.uris == NULL)
+		return ENOMEM;
+	for (i = 0; i < xbps_array_count(xhp->repositories); i++) {
 		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
 		/* If argument was set just process that repository */
 		if (uri && strcmp(repouri, uri))
 			continue;
-
-		if (xbps_repo_sync(xhp, repouri) == -1) {
-			xbps_dbg_printf(
-			    "[rpool] `%s' failed to fetch repository data: %s\n",
-			    repouri, fetchLastErrCode == 0 ? strerror(errno) :
-			    xbps_fetch_error_string());
+		/* local repositories do not need to be synced */
+		if (!xbps_repository_is_remote(repouri))
 			continue;
+		rs.uris[rs.nuris++] = repouri;
+	}
+
+	/* repositories are synced in parallel, up to `fetchjobs' at once */
+	nthreads = xhp->fetch_jobs;
+	if (nthreads > rs.nuris)
+		nthreads = rs.nuris;
+	if (nthreads > 1 && (thds = calloc(nthreads, sizeof(*thds))) == NULL)
+		nthreads = 1;
+
+	prev_umask = umask(022);
+	pthread_mutex_init(&rs.lock, NULL);
+	for (i = 0; nthreads > 1 && i < nthreads; i++) {
+		r = pthread_create(&thds[i], NULL, rpool_sync_worker, &rs);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to create thread: %s\n", strerror(r));
+			break;
+		}
+	}
+	/* if we are unable to create any threads, just do single threaded. */
+	if (i == 0)
+		rpool_sync_worker(&rs);
+	while (i > 0) {
+		r = pthread_join(thds[--i], NULL);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to wait on thread: %s\n", strerror(r));
 		}
 	}
+	pthread_mutex_destroy(&rs.lock);
+	umask(prev_umask);
+
+	free(thds);
+	free(rs.uris);
 	return 0;
 }
 
+static struct xbps_repo *
+rpool_find(const char *url)
+{
+	struct xbps_repo *repo;
+
+	SIMPLEQ_FOREACH(repo, &rpool_queue, entries)
+		if (strcmp(url, repo->uri) == 0)
+			return repo;
+
+	return NULL;
+}
+
+/*
+ * Returns the registered repository without loading its index, the
+ * binary index provides its packages and metadata.
+ */
 struct xbps_repo HIDDEN *
 xbps_regget_repo(struct xbps_handle *xhp, const char *url)
 {
-	struct xbps_repo *repo;
+	struct xbps_repo *repo = NULL;
 	const char *repouri = NULL;
 
+	pthread_mutex_lock(&rpool_lock);
 	if (SIMPLEQ_EMPTY(&rpool_queue)) {
 		/* iterate until we have a match */
 		for (unsigned int i = 0; i < xbps_array_count(xhp->repositories); i++) {
@@ -93,31 +185,34 @@ xbps_regget_repo(struct xbps_handle *xhp, const char *url)
 			if (strcmp(repouri, url))
 				continue;
 
-			repo = xbps_repo_open(xhp, repouri);
+			repo = xbps_repo_open_lazy(xhp, repouri);
 			if (!repo)
-				return NULL;
+				goto out;
 
 			SIMPLEQ_INSERT_TAIL(&rpool_queue, repo, entries);
 			xbps_dbg_printf("[rpool] `%s' registered.\n", repouri);
 		}
 	}
-	SIMPLEQ_FOREACH(repo, &rpool_queue, entries)
-		if (strcmp(url, repo->uri) == 0)
-			return repo;
-
-	return NULL;
+	repo = rpool_find(url);
+out:
+	pthread_mutex_unlock(&rpool_lock);
+	return repo;
 }
 
 struct xbps_repo *
 xbps_rpool_get_repo(const char *url)
 {
 	struct xbps_repo *repo;
+	int r;
 
-	SIMPLEQ_FOREACH(repo, &rpool_queue, entries)
-		if (strcmp(url, repo->uri) == 0)
-			return repo;
-
-	return NULL;
+	/* callers may access the index dictionaries, load them */
+	pthread_mutex_lock(&rpool_lock);
+	if ((repo = rpool_find(url)) && (r = xbps_repo_load(repo)) < 0) {
+		errno = -r;
+		repo = NULL;
+	}
+	pthread_mutex_unlock(&rpool_lock);
+	return repo;
 }
 
 void
@@ -135,10 +230,15 @@ xbps_rpool_release(struct xbps_handle *xhp)
 	}
 }
 
-int
-xbps_rpool_foreach(struct xbps_handle *xhp,
+/*
+ * Repositories used only to look up packages are opened lazily from
+ * their binary index, those passed to xbps_rpool_foreach() callbacks
+ * are fully loaded as callers may access the index dictionaries.
+ */
+static int
+rpool_foreach(struct xbps_handle *xhp,
 	int (*fn)(struct xbps_repo *, void *, bool *),
-	void *arg)
+	void *arg, bool lazy)
 {
 	struct xbps_repo *repo = NULL;
 	const char *repouri = NULL;
@@ -152,13 +252,25 @@ again:
 	for (unsigned int i = n; i < xbps_array_count(xhp->repositories); i++, n++) {
 		xbps_array_get_cstring_nocopy(xhp->repositories, i, &repouri);
 		xbps_dbg_printf("[rpool] checking `%s' at index %u\n", repouri, n);
-		if ((repo = xbps_rpool_get_repo(repouri)) == NULL) {
-			repo = xbps_repo_open(xhp, repouri);
+		pthread_mutex_lock(&rpool_lock);
+		repo = rpool_find(repouri);
+		if (repo && !lazy)
+			rv = xbps_repo_load(repo);
+		pthread_mutex_unlock(&rpool_lock);
+		if (rv < 0)
+			return -rv;
+		if (repo == NULL) {
+			if (lazy)
+				repo = xbps_repo_open_lazy(xhp, repouri);
+			else
+				repo = xbps_repo_open(xhp, repouri);
 			if (!repo) {
 				xbps_repo_remove(xhp, repouri);
 				goto again;
 			}
+			pthread_mutex_lock(&rpool_lock);
 			SIMPLEQ_INSERT_TAIL(&rpool_queue, repo, entries);
+			pthread_mutex_unlock(&rpool_lock);
 			xbps_dbg_printf("[rpool] `%s' registered.\n", repouri);
 		}
 		foundrepo = true;
@@ -172,6 +284,14 @@ again:
 	return rv;
 }
 
+int
+xbps_rpool_foreach(struct xbps_handle *xhp,
+	int (*fn)(struct xbps_repo *, void *, bool *),
+	void *arg)
+{
+	return rpool_foreach(xhp, fn, arg, false);
+}
+
 static int
 find_virtualpkg_cb(struct xbps_repo *repo, void *arg, bool *done)
 {
@@ -282,25 +402,25 @@ repo_find_pkg(struct xbps_handle *xhp,
 		/*
 		 * Find best pkg version.
 		 */
-		rv = xbps_rpool_foreach(xhp, find_best_pkg_cb, &rpf);
+		rv = rpool_foreach(xhp, find_best_pkg_cb, &rpf, true);
 		break;
 	case VIRTUAL_PKG:
 		/*
 		 * Find virtual pkg.
 		 */
-		rv = xbps_rpool_foreach(xhp, find_virtualpkg_cb, &rpf);
+		rv = rpool_foreach(xhp, find_virtualpkg_cb, &rpf, true);
 		break;
 	case REAL_PKG:
 		/*
 		 * Find real pkg.
 		 */
-		rv = xbps_rpool_foreach(xhp, find_pkg_cb, &rpf);
+		rv = rpool_foreach(xhp, find_pkg_cb, &rpf, true);
 		break;
 	case REVDEPS_PKG:
 		/*
 		 * Find revdeps for pkg.
 		 */
-		rv = xbps_rpool_foreach(xhp, find_pkg_revdeps_cb, &rpf);
+		rv = rpool_foreach(xhp, find_pkg_revdeps_cb, &rpf, true);
 		break;
 	}
 	if (rv != 0) {
@@ -46,10 +46,17 @@
  * 	- foo is updated to 2.0, hence baz-1.0 is now broken.
  *
  * Abort transaction if such case is found.
+ *
+ * The sonames provided and required by the installed packages are looked
+ * up in the shlibs index of the pkgdb, only the sonames provided by the
+ * packages in the transaction and the sonames that were already missing
+ * are checked for installed packages.
  */
 
 struct shlib_entry {
 	const char *name;
+	/* providers added minus removed by the transaction */
+	int delta;
 	UT_hash_handle hh;
 };
 
@@ -57,6 +64,8 @@ struct shlib_ctx {
 	struct xbps_handle *xhp;
 	struct shlib_entry *entries;
 	xbps_dictionary_t seen;
+	xbps_dictionary_t broken;
+	xbps_bool_t placeholder;
 	xbps_array_t missing;
 };
 
@@ -85,7 +94,7 @@ shlib_entry_get(struct shlib_ctx *ctx, const char *name)
 }
 
 static int
-collect_shlib_array(struct shlib_ctx *ctx, xbps_array_t array)
+collect_shlib_array(struct shlib_ctx *ctx, xbps_array_t array, int delta)
 {
 	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
 		struct shlib_entry *entry;
@@ -95,6 +104,7 @@ collect_shlib_array(struct shlib_ctx *ctx, xbps_array_t array)
 		entry = shlib_entry_get(ctx, shlib);
 		if (!entry)
 			return -errno;
+		entry->delta += delta;
 	}
 	return 0;
 }
@@ -102,13 +112,9 @@ collect_shlib_array(struct shlib_ctx *ctx, xbps_array_t array)
 static int
 collect_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
 {
-	xbps_object_t obj;
-	xbps_object_iterator_t iter;
-	xbps_bool_t placeholder;
-
 	// can't set null values to xbps_dictionary so just use one boolean
-	placeholder = xbps_bool_create(true);
-	if (!placeholder)
+	ctx->placeholder = xbps_bool_create(true);
+	if (!ctx->placeholder)
 		return xbps_error_oom();
 
 	ctx->seen = xbps_dictionary_create();
@@ -118,7 +124,9 @@ collect_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
 	for (unsigned int i = 0; i < xbps_array_count(pkgs); i++) {
 		const char *pkgname;
 		xbps_dictionary_t pkgd = xbps_array_get(pkgs, i);
+		xbps_dictionary_t opkgd;
 		xbps_array_t array;
+		int r;
 
 		if (xbps_transaction_pkg_type(pkgd) == XBPS_TRANS_HOLD)
 			continue;
@@ -126,128 +134,162 @@ collect_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
 			xbps_error_printf("invalid package: missing `pkgname` property\n");
 			return -EINVAL;
 		}
-		if (!xbps_dictionary_set(ctx->seen, pkgname, placeholder))
+		if (!xbps_dictionary_set(ctx->seen, pkgname, ctx->placeholder))
 			return xbps_error_oom();
 
+		/* the installed package is replaced or removed */
+		opkgd = xbps_dictionary_get(ctx->xhp->pkgdb, pkgname);
+		array = xbps_dictionary_get(opkgd, "shlib-provides");
+		if (array && (r = collect_shlib_array(ctx, array, -1)) < 0)
+			return r;
+
 		if (xbps_transaction_pkg_type(pkgd) == XBPS_TRANS_REMOVE)
 			continue;
 
 		array = xbps_dictionary_get(pkgd, "shlib-provides");
-		if (array) {
-			int r = collect_shlib_array(ctx, array);
-			if (r < 0)
-				return r;
-		}
+		if (array && (r = collect_shlib_array(ctx, array, 1)) < 0)
+			return r;
 	}
+	return 0;
+}
 
-	iter = xbps_dictionary_iterator(ctx->xhp->pkgdb);
-	if (!iter)
-		return xbps_error_oom();
+static int
+shlib_provided(struct shlib_ctx *ctx, const char *shlib, bool *provided)
+{
+	struct shlib_entry *entry;
+	unsigned int nprovides = 0;
+	int r;
 
-	while ((obj = xbps_object_iterator_next(iter))) {
-		xbps_array_t array;
-		xbps_dictionary_t pkgd;
-		const char *pkgname = NULL;
+	if ((r = xbps_pkgdb_shlib_providers(ctx->xhp, shlib, &nprovides)) < 0)
+		return r;
+	if ((entry = shlib_entry_find(ctx->entries, shlib)))
+		*provided = (int)nprovides + entry->delta > 0;
+	else
+		*provided = nprovides > 0;
+	return 0;
+}
 
-		pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
-		/* ignore internal objs */
-		if (strncmp(pkgname, "_XBPS_", 6) == 0)
-			continue;
+static int
+check_pkg_shlibs(struct shlib_ctx *ctx, xbps_dictionary_t pkgd)
+{
+	xbps_array_t array;
+	int r;
 
-		pkgd = xbps_dictionary_get_keysym(ctx->xhp->pkgdb, obj);
+	array = xbps_dictionary_get(pkgd, "shlib-requires");
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		const char *pkgver = NULL;
+		const char *shlib = NULL;
+		char *missing;
+		bool provided;
 
-		if (xbps_dictionary_get(ctx->seen, pkgname))
+		if (!xbps_array_get_cstring_nocopy(array, i, &shlib))
+			return -EINVAL;
+		if ((r = shlib_provided(ctx, shlib, &provided)) < 0)
+			return r;
+		if (provided)
 			continue;
-
-		array = xbps_dictionary_get(pkgd, "shlib-provides");
-		if (array) {
-			int r = collect_shlib_array(ctx, array);
-			if (r < 0)
-				return r;
-		}
+		if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+			return -EINVAL;
+		missing = xbps_xasprintf(
+		    "%s: broken, unresolvable shlib `%s'",
+		    pkgver, shlib);
+		if (!xbps_array_add_cstring_nocopy(ctx->missing, missing))
+			return xbps_error_oom();
 	}
+	return 0;
+}
 
-	xbps_object_iterator_release(iter);
+static int
+broken_requirer_cb(const char *pkgname, void *arg)
+{
+	struct shlib_ctx *ctx = arg;
+
+	if (xbps_dictionary_get(ctx->seen, pkgname))
+		return 0;
+	if (!xbps_dictionary_set(ctx->broken, pkgname, ctx->placeholder))
+		return xbps_error_oom();
 	return 0;
 }
 
+/*
+ * Collects the installed packages requiring \a shlib if it is not
+ * provided anymore.
+ */
+static int
+broken_shlib_cb(const char *shlib, void *arg)
+{
+	struct shlib_ctx *ctx = arg;
+	bool provided;
+	int r;
+
+	if ((r = shlib_provided(ctx, shlib, &provided)) < 0 || provided)
+		return r;
+	return xbps_pkgdb_shlib_foreach_requirer(ctx->xhp, shlib,
+	    broken_requirer_cb, ctx);
+}
+
+static int
+pkgname_cmp(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
 static int
 check_shlibs(struct shlib_ctx *ctx, xbps_array_t pkgs)
 {
-	xbps_object_iterator_t iter;
-	xbps_object_t obj;
+	struct shlib_entry *entry, *tmp;
+	xbps_array_t keys;
+	const char **pkgnames;
+	unsigned int n;
+	int r;
 
 	for (unsigned int i = 0; i < xbps_array_count(pkgs); i++) {
-		xbps_array_t array;
 		xbps_dictionary_t pkgd = xbps_array_get(pkgs, i);
 		xbps_trans_type_t ttype = xbps_transaction_pkg_type(pkgd);
 
 		if (ttype == XBPS_TRANS_HOLD || ttype == XBPS_TRANS_REMOVE)
 			continue;
-
-		array = xbps_dictionary_get(pkgd, "shlib-requires");
-		if (!array)
-			continue;
-		for (unsigned int j = 0; j < xbps_array_count(array); j++) {
-			const char *pkgver = NULL;
-			const char *shlib = NULL;
-			char *missing;
-			if (!xbps_array_get_cstring_nocopy(array, j, &shlib))
-				return -EINVAL;
-			if (shlib_entry_find(ctx->entries, shlib))
-				continue;
-			if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
-				return -EINVAL;
-			missing = xbps_xasprintf(
-			    "%s: broken, unresolvable shlib `%s'",
-			    pkgver, shlib);
-			if (!xbps_array_add_cstring_nocopy(ctx->missing, missing))
-				return xbps_error_oom();
-		}
+		if ((r = check_pkg_shlibs(ctx, pkgd)) < 0)
+			return r;
 	}
 
-	iter = xbps_dictionary_iterator(ctx->xhp->pkgdb);
-	if (!iter)
+	/*
+	 * Installed packages can only be broken by the sonames whose
+	 * providers are replaced or removed, or were already broken.
+	 */
+	ctx->broken = xbps_dictionary_create();
+	if (!ctx->broken)
+		return xbps_error_oom();
+	HASH_ITER(hh, ctx->entries, entry, tmp) {
+		if (entry->delta < 0 && (r = broken_shlib_cb(entry->name, ctx)) < 0)
+			return r;
+	}
+	r = xbps_pkgdb_shlibs_foreach_unresolved(ctx->xhp, broken_shlib_cb, ctx);
+	if (r < 0)
+		return r;
+
+	/* in pkgdb order */
+	keys = xbps_dictionary_all_keys(ctx->broken);
+	n = xbps_array_count(keys);
+	if ((pkgnames = calloc(n + 1, sizeof(*pkgnames))) == NULL) {
+		if (keys)
+			xbps_object_release(keys);
 		return xbps_error_oom();
-
-	while ((obj = xbps_object_iterator_next(iter))) {
-		xbps_array_t array;
-		xbps_dictionary_t pkgd;
-		const char *pkgname = NULL;
-
-		pkgname = xbps_dictionary_keysym_cstring_nocopy(obj);
-		/* ignore internal objs */
-		if (strncmp(pkgname, "_XBPS_", 6) == 0)
-			continue;
-
-		pkgd  = xbps_dictionary_get_keysym(ctx->xhp->pkgdb, obj);
-
-		if (xbps_dictionary_get(ctx->seen, pkgname))
-			continue;
-
-		array = xbps_dictionary_get(pkgd, "shlib-requires");
-		if (!array)
-			continue;
-		for (unsigned int i = 0; i < xbps_array_count(array); i++) {
-			const char *pkgver = NULL;
-			const char *shlib = NULL;
-			char *missing;
-			if (!xbps_array_get_cstring_nocopy(array, i, &shlib))
-				return -EINVAL;
-			if (shlib_entry_find(ctx->entries, shlib))
-				continue;
-			if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
-				return -EINVAL;
-			missing = xbps_xasprintf(
-			    "%s: broken, unresolvable shlib `%s'", pkgver,
-			    shlib);
-			if (!xbps_array_add_cstring_nocopy(ctx->missing, missing))
-				return xbps_error_oom();
-		}
 	}
+	for (unsigned int i = 0; i < n; i++)
+		pkgnames[i] = xbps_dictionary_keysym_cstring_nocopy(xbps_array_get(keys, i));
+	qsort(pkgnames, n, sizeof(*pkgnames), pkgname_cmp);
+	r = 0;
+	for (unsigned int i = 0; r == 0 && i < n; i++) {
+		xbps_dictionary_t pkgd = xbps_dictionary_get(ctx->xhp->pkgdb, pkgnames[i]);
 
-	xbps_object_iterator_release(iter);
-	return 0;
+		if (pkgd)
+			r = check_pkg_shlibs(ctx, pkgd);
+	}
+	free(pkgnames);
+	if (keys)
+		xbps_object_release(keys);
+	return r;
 }
 
 bool HIDDEN
@@ -278,5 +320,9 @@ err:
 	}
 	if (ctx.seen)
 		xbps_object_release(ctx.seen);
+	if (ctx.broken)
+		xbps_object_release(ctx.broken);
+	if (ctx.placeholder)
+		xbps_object_release(ctx.placeholder);
 	return r == 0;
 }
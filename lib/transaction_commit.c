@@ -107,7 +107,7 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	xbps_object_iterator_t iter;
 	xbps_trans_type_t ttype;
 	const char *pkgver = NULL, *pkgname = NULL;
-	int rv = 0;
+	int rv = 0, trv = 0;
 
 	setlocale(LC_ALL, "");
 
@@ -145,7 +145,8 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 		return EINVAL;
 
 	/*
-	 * Download and verify binary packages.
+	 * Download and verify binary packages, and internalize their
+	 * metadata; pipelined per package if parallel jobs are enabled.
 	 */
 	if ((rv = xbps_transaction_fetch(xhp, iter)) != 0) {
 		xbps_dbg_printf("[trans] failed to fetch and verify binpkgs: "
@@ -162,15 +163,6 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	 */
 	xbps_fetch_unset_cache_connection();
 
-	/*
-	 * Internalize metadata of downloaded binary packages.
-	 */
-	if ((rv = xbps_transaction_internalize(xhp, iter)) < 0) {
-		xbps_dbg_printf("[trans] failed to internalize transaction binpkgs: "
-		    "%s\n", strerror(-rv));
-		goto out;
-	}
-
 	/*
 	 * Collect files in the transaction and find some issues
 	 * like multiple packages installing the same file.
@@ -408,43 +400,61 @@ xbps_transaction_commit(struct xbps_handle *xhp)
 	 */
 	xbps_set_cb_state(xhp, XBPS_STATE_TRANS_CONFIGURE, 0, NULL, NULL);
 
-	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
-		bool update;
-
-		xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
-		ttype = xbps_transaction_pkg_type(obj);
-		if (ttype == XBPS_TRANS_REMOVE || ttype == XBPS_TRANS_HOLD) {
-			xbps_dbg_printf("%s: skipping configuration for "
-			    "%s: %d\n", __func__, pkgver, ttype);
-			continue;
-		}
-		update = ttype == XBPS_TRANS_UPDATE;
-
-		rv = xbps_configure_pkg(xhp, pkgver, false, update);
-		if (rv != 0) {
-			xbps_dbg_printf("%s: configure failed for "
-			    "%s: %s\n", __func__, pkgver, strerror(rv));
+	if (xhp->configure_jobs > 1) {
+		/* packages not depending on each other are configured in parallel */
+		rv = xbps_configure_pkgs(xhp,
+		    xbps_dictionary_get(xhp->transd, "packages"), false, true);
+		if (rv != 0)
 			goto out;
-		}
-		/*
-		 * Notify client callback when a package has been
-		 * installed or updated.
-		 */
-		if (update) {
-			xbps_set_cb_state(xhp, XBPS_STATE_UPDATE_DONE, 0,
-			    pkgver, NULL);
-		} else {
-			xbps_set_cb_state(xhp, XBPS_STATE_INSTALL_DONE, 0,
-			    pkgver, NULL);
+	} else {
+		while ((obj = xbps_object_iterator_next(iter)) != NULL) {
+			bool update;
+
+			xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver);
+			ttype = xbps_transaction_pkg_type(obj);
+			if (ttype == XBPS_TRANS_REMOVE || ttype == XBPS_TRANS_HOLD) {
+				xbps_dbg_printf("%s: skipping configuration for "
+				    "%s: %d\n", __func__, pkgver, ttype);
+				continue;
+			}
+			update = ttype == XBPS_TRANS_UPDATE;
+
+			rv = xbps_configure_pkg_batch(xhp, pkgver, false, update);
+			if (rv != 0) {
+				xbps_dbg_printf("%s: configure failed for "
+				    "%s: %s\n", __func__, pkgver, strerror(rv));
+				goto out;
+			}
+			/*
+			 * Notify client callback when a package has been
+			 * installed or updated.
+			 */
+			if (update) {
+				xbps_set_cb_state(xhp, XBPS_STATE_UPDATE_DONE, 0,
+				    pkgver, NULL);
+			} else {
+				xbps_set_cb_state(xhp, XBPS_STATE_INSTALL_DONE, 0,
+				    pkgver, NULL);
+			}
 		}
 	}
+	/*
+	 * Run the triggers of all configured packages once. A failed
+	 * trigger is reported, but the packages are configured and
+	 * pkgdb must still be written.
+	 */
+	trv = xbps_configure_triggers(xhp);
 
 out:
+	xbps_triggers_release(xhp);
+	xbps_binpkg_cache_clear();
 	xbps_object_release(remove_scripts);
 	xbps_object_iterator_release(iter);
 	if (rv == 0) {
 		/* Force a pkgdb write for all unpacked pkgs in transaction */
 		rv = xbps_pkgdb_update(xhp, true, true);
+		if (rv == 0)
+			rv = trv;
 	}
 	return rv;
 }
@@ -26,6 +26,8 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -52,7 +54,7 @@ verify_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
 	 * For pkgs in local repos check the sha256 hash.
 	 * For pkgs in remote repos check the RSA signature.
 	 */
-	if ((repo = xbps_rpool_get_repo(repoloc)) == NULL) {
+	if ((repo = xbps_regget_repo(xhp, repoloc)) == NULL) {
 		rv = errno;
 		xbps_dbg_printf("%s: failed to get repository "
 			"%s: %s\n", pkgver, repoloc, strerror(errno));
@@ -150,7 +152,7 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 	snprintf(buf, sizeof buf, "%s/%s.%s.xbps.sig2", xhp->cachedir, pkgver, arch);
 	sigsuffix = buf+(strlen(buf)-sizeof (".sig2")+1);
 
-	if ((repo = xbps_rpool_get_repo(repoloc)) == NULL) {
+	if ((repo = xbps_regget_repo(xhp, repoloc)) == NULL) {
 		rv = errno;
 		xbps_dbg_printf("%s: failed to get repository "
 			"%s: %s\n", pkgver, repoloc, strerror(errno));
@@ -193,6 +195,212 @@ download_binpkg(struct xbps_handle *xhp, xbps_dictionary_t repo_pkgd)
 	return rv;
 }
 
+/*
+ * Parallel downloads: every package is a job, workers pick the
+ * first pending job whose repository host is below the per host
+ * limit, and the number of workers bounds the total of transfers.
+ * Both limits are capped by the libfetch connection cache limits,
+ * so that transfers reuse the cached connections.
+ *
+ * The pool also pipelines the transaction: packages already available
+ * (local repositories or cachedir) are verified while others are being
+ * downloaded, and every package is internalized as soon as it has been
+ * downloaded and verified.
+ */
+struct fetch_host {
+	char host[URL_HOSTLEN + 1];
+	int port;
+	unsigned int active;
+};
+
+struct fetch_job {
+	xbps_dictionary_t pkgd;
+	int host;	/* -1 if the package is not downloaded */
+	bool started;
+};
+
+struct fetch_pool {
+	struct xbps_handle *xhp;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct fetch_job *jobs;
+	unsigned int njobs;
+	unsigned int next;
+	struct fetch_host *hosts;
+	unsigned int nhosts;
+	bool internalize;
+	int rv;
+};
+
+static int
+fetch_pool_host(struct fetch_pool *pool, const char *repoloc)
+{
+	struct fetch_host *hosts;
+	struct url *url;
+	const char *host = "";
+	int port = 0;
+	unsigned int i;
+
+	if ((url = fetchParseURL(repoloc)) != NULL) {
+		host = url->host;
+		port = url->port;
+	}
+	for (i = 0; i < pool->nhosts; i++) {
+		if (pool->hosts[i].port == port &&
+		    strcmp(pool->hosts[i].host, host) == 0)
+			goto out;
+	}
+	hosts = realloc(pool->hosts, (pool->nhosts + 1) * sizeof(*hosts));
+	if (hosts == NULL) {
+		if (url != NULL)
+			fetchFreeURL(url);
+		return -1;
+	}
+	pool->hosts = hosts;
+	xbps_strlcpy(hosts[i].host, host, sizeof(hosts[i].host));
+	hosts[i].port = port;
+	hosts[i].active = 0;
+	pool->nhosts++;
+out:
+	if (url != NULL)
+		fetchFreeURL(url);
+	return (int)i;
+}
+
+static struct fetch_job *
+fetch_pool_next(struct fetch_pool *pool)
+{
+	struct fetch_job *job;
+
+	while (pool->next < pool->njobs && pool->jobs[pool->next].started)
+		pool->next++;
+	for (unsigned int i = pool->next; i < pool->njobs; i++) {
+		job = &pool->jobs[i];
+		if (job->started)
+			continue;
+		if (job->host < 0 ||
+		    pool->hosts[job->host].active < pool->xhp->fetch_host_jobs)
+			return job;
+	}
+	return NULL;
+}
+
+static void *
+fetch_pool_worker(void *arg)
+{
+	struct fetch_pool *pool = arg;
+	struct fetch_job *job;
+	int rv;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		/* stop picking up new jobs after the first failure */
+		if (pool->rv != 0)
+			break;
+		if ((job = fetch_pool_next(pool)) == NULL) {
+			if (pool->next == pool->njobs)
+				break;
+			/* all pending jobs wait for a busy host */
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		job->started = true;
+		if (job->host >= 0)
+			pool->hosts[job->host].active++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (job->host >= 0)
+			rv = download_binpkg(pool->xhp, job->pkgd);
+		else
+			rv = verify_binpkg(pool->xhp, job->pkgd);
+		if (rv == 0 && pool->internalize)
+			rv = -xbps_transaction_internalize_pkg(pool->xhp, job->pkgd);
+
+		pthread_mutex_lock(&pool->lock);
+		if (job->host >= 0)
+			pool->hosts[job->host].active--;
+		if (rv != 0 && pool->rv == 0)
+			pool->rv = rv;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static int
+fetch_pool_run(struct xbps_handle *xhp, xbps_array_t fetch,
+		xbps_array_t verify, unsigned int nthreads)
+{
+	struct fetch_pool pool = { 0 };
+	struct fetch_job *job;
+	pthread_t *thds;
+	const char *repoloc;
+	unsigned int i, nfetch;
+	int host, r, rv = 0;
+
+	nfetch = xbps_array_count(fetch);
+	pool.xhp = xhp;
+	pool.internalize = !(xhp->flags & XBPS_FLAG_DOWNLOAD_ONLY);
+	pool.njobs = nfetch + xbps_array_count(verify);
+	if ((pool.jobs = calloc(pool.njobs, sizeof(*pool.jobs))) == NULL)
+		return ENOMEM;
+	if ((thds = calloc(nthreads, sizeof(*thds))) == NULL) {
+		free(pool.jobs);
+		return ENOMEM;
+	}
+	/* downloads first, so that the network is busy as soon as possible */
+	for (i = 0; i < pool.njobs; i++) {
+		job = &pool.jobs[i];
+		if (i >= nfetch) {
+			job->pkgd = xbps_array_get(verify, i - nfetch);
+			job->host = -1;
+			continue;
+		}
+		job->pkgd = xbps_array_get(fetch, i);
+		xbps_dictionary_get_cstring_nocopy(job->pkgd,
+		    "repository", &repoloc);
+		if ((host = fetch_pool_host(&pool, repoloc)) < 0) {
+			rv = ENOMEM;
+			goto out;
+		}
+		job->host = host;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	xbps_dbg_printf("[trans] fetching with %u jobs (%u per host).\n",
+	    nthreads, xhp->fetch_host_jobs);
+
+	for (i = 0; i < nthreads; i++) {
+		r = pthread_create(&thds[i], NULL, fetch_pool_worker, &pool);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to create thread: %s\n", strerror(r));
+			break;
+		}
+	}
+	/* if we are unable to create any threads, just do single threaded. */
+	if (i == 0)
+		fetch_pool_worker(&pool);
+	while (i > 0) {
+		r = pthread_join(thds[--i], NULL);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to wait on thread: %s\n", strerror(r));
+		}
+	}
+	rv = pool.rv;
+
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.lock);
+out:
+	free(pool.hosts);
+	free(pool.jobs);
+	free(thds);
+	return rv;
+}
+
 int
 xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 {
@@ -201,7 +409,7 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 	xbps_trans_type_t ttype;
 	const char *repoloc;
 	int rv = 0;
-	unsigned int i, n;
+	unsigned int i, nfetch, nverify, nthreads;
 
 	xbps_object_iterator_reset(iter);
 
@@ -238,16 +446,36 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 	}
 	xbps_object_iterator_reset(iter);
 
+	nfetch = xbps_array_count(fetch);
+	nverify = xbps_array_count(verify);
+	if (nfetch) {
+		xbps_set_cb_state(xhp, XBPS_STATE_TRANS_DOWNLOAD, 0, NULL, NULL);
+		xbps_dbg_printf("[trans] downloading %d packages.\n", nfetch);
+	}
+
+	/*
+	 * Pipeline downloads, verification and internalization of
+	 * binary packages if more than one job is allowed.
+	 */
+	nthreads = xhp->fetch_jobs < nfetch + nverify ?
+	    xhp->fetch_jobs : nfetch + nverify;
+	if (nthreads > 1) {
+		if (nverify) {
+			xbps_set_cb_state(xhp, XBPS_STATE_TRANS_VERIFY, 0, NULL, NULL);
+			xbps_dbg_printf("[trans] verifying %d packages.\n", nverify);
+		}
+		if ((rv = fetch_pool_run(xhp, fetch, verify, nthreads)) != 0) {
+			xbps_dbg_printf("[trans] failed to fetch binpkgs: "
+				"%s\n", strerror(rv));
+		}
+		goto out;
+	}
+
 	/*
 	 * Download binary packages (if they come from a remote repository)
 	 * and don't exist already.
 	 */
-	n = xbps_array_count(fetch);
-	if (n) {
-		xbps_set_cb_state(xhp, XBPS_STATE_TRANS_DOWNLOAD, 0, NULL, NULL);
-		xbps_dbg_printf("[trans] downloading %d packages.\n", n);
-	}
-	for (i = 0; i < n; i++) {
+	for (i = 0; i < nfetch; i++) {
 		if ((rv = download_binpkg(xhp, xbps_array_get(fetch, i))) != 0) {
 			xbps_dbg_printf("[trans] failed to download binpkgs: "
 				"%s\n", strerror(rv));
@@ -258,18 +486,28 @@ xbps_transaction_fetch(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 	/*
 	 * Check binary package integrity.
 	 */
-	n = xbps_array_count(verify);
-	if (n) {
+	if (nverify) {
 		xbps_set_cb_state(xhp, XBPS_STATE_TRANS_VERIFY, 0, NULL, NULL);
-		xbps_dbg_printf("[trans] verifying %d packages.\n", n);
+		xbps_dbg_printf("[trans] verifying %d packages.\n", nverify);
 	}
-	for (i = 0; i < n; i++) {
+	for (i = 0; i < nverify; i++) {
 		if ((rv = verify_binpkg(xhp, xbps_array_get(verify, i))) != 0) {
 			xbps_dbg_printf("[trans] failed to check binpkgs: "
 				"%s\n", strerror(rv));
 			goto out;
 		}
 	}
+	if (xhp->flags & XBPS_FLAG_DOWNLOAD_ONLY)
+		goto out;
+
+	/*
+	 * Internalize metadata of downloaded binary packages.
+	 */
+	if ((rv = xbps_transaction_internalize(xhp, iter)) < 0) {
+		rv = -rv;
+		xbps_dbg_printf("[trans] failed to internalize transaction binpkgs: "
+		    "%s\n", strerror(rv));
+	}
 
 out:
 	if (fetch)
@@ -26,13 +26,11 @@
 
 #include <dirent.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
-
-#include <archive.h>
-#include <archive_entry.h>
+#include <unistd.h>
 
 #include "xbps_api_impl.h"
 #include "uthash.h"
@@ -62,6 +60,9 @@ struct item {
 		bool removepkg;
 	} old, new;
 	bool deleted;
+	/* number of tracked files below this directory and how many are deleted */
+	size_t nfiles;
+	size_t nremoved;
 	UT_hash_handle hh;
 };
 
@@ -73,6 +74,9 @@ static struct item **items = NULL;
 static size_t itemsidx = 0;
 static size_t itemssz = 0;
 
+/* files of the installed packages, referenced by the items */
+static xbps_array_t ofiles = NULL;
+
 static struct item *
 lookupItem(const char *file)
 {
@@ -141,44 +145,83 @@ match_preserved_file(struct xbps_handle *xhp, const char *file)
 	return xbps_match_string_in_array(xhp->preserved_files, file+1);
 }
 
-static bool
-has_dir_prefix(const char *dir, size_t dirlen, const char *file)
+/*
+ * Calls `cb` for every tracked directory containing `item`.
+ * Only whole path components are matched, the leading `.` (dot)
+ * is not a directory.
+ */
+static void
+foreach_parent_dir(const struct item *item, void (*cb)(struct item *))
+{
+	struct item *dir;
+
+	for (size_t n = item->len - 1; n > 1; n--) {
+		if (item->file[n] != '/')
+			continue;
+		HASH_FIND(hh, hashtab, item->file+1, n-1, dir);
+		if (dir != NULL)
+			(*cb)(dir);
+	}
+}
+
+static void
+count_file(struct item *dir)
+{
+	dir->nfiles++;
+}
+
+static void
+count_removed(struct item *dir)
+{
+	dir->nremoved++;
+}
+
+/*
+ * Count the tracked files below every directory once, instead of
+ * scanning all items for each directory that has to be deleted.
+ */
+static void
+index_directories(void)
 {
-	return strncmp(file, dir, dirlen) == 0 && file[dirlen] == '/';
+	for (size_t i = 0; i < itemsidx; i++)
+		foreach_parent_dir(items[i], count_file);
+}
+
+static void
+mark_deleted(struct item *item)
+{
+	if (item->deleted)
+		return;
+	item->deleted = true;
+	foreach_parent_dir(item, count_removed);
 }
 
 static bool
-can_delete_directory(const char *dir, size_t dirlen, size_t max)
+can_delete_directory(const struct item *item)
 {
-	struct item *item;
-	size_t rmcount = 0, fcount = 0;
+	size_t fcount = 0;
 	DIR *dp;
 
-	dp = opendir(dir);
+	dp = opendir(item->file);
 	if (dp == NULL) {
 		if (errno == ENOENT) {
 			return true;
 		} else {
 			xbps_dbg_printf("[files] %s: %s: %s\n",
-			    __func__, dir, strerror(errno));
+			    __func__, item->file, strerror(errno));
 			return false;
 		}
 	}
 
 	/*
-	 * 1. Check if there is tracked directory content,
-	 *    which can't be deleted.
-	 * 2. Count deletable directory content.
+	 * Check if there is tracked directory content,
+	 * which can't be deleted. Files are processed longest
+	 * paths first, all the directory content has been
+	 * processed by now.
 	 */
-	for (size_t i = 0; i < max; i++) {
-		item = items[i];
-		if (has_dir_prefix(dir, dirlen, item->file)) {
-			if (!item->deleted) {
-				closedir(dp);
-				return false;
-			}
-			rmcount++;
-		}
+	if (item->nremoved < item->nfiles) {
+		closedir(dp);
+		return false;
 	}
 
 	/*
@@ -191,13 +234,13 @@ can_delete_directory(const char *dir, size_t dirlen, size_t max)
 	/* ignore '.' and '..' */
 	fcount -= 2;
 
-	if (fcount <= rmcount) {
+	if (fcount <= item->nremoved) {
 		xbps_dbg_printf("[files] only removed %zu out of %zu files: %s\n",
-		    rmcount, fcount, dir);
+		    item->nremoved, fcount, item->file);
 	}
 	closedir(dp);
 
-	return fcount <= rmcount;
+	return fcount <= item->nremoved;
 }
 
 static int
@@ -287,7 +330,7 @@ collect_obsoletes(struct xbps_handle *xhp)
 			 */
 			xbps_dbg_printf("[files] %s: directory changed to %s: %s\n",
 			    item->new.pkgver, typestr(item->new.type), item->file);
-			if (!can_delete_directory(item->file, item->len, i)) {
+			if (!can_delete_directory(item)) {
 				xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
 				    ENOTEMPTY, item->old.pkgver,
 				    "%s: directory `%s' can not be deleted.",
@@ -326,7 +369,7 @@ collect_obsoletes(struct xbps_handle *xhp)
 			case ENOENT:
 				/* mark unexisting files as deleted and ignore ENOENT */
 				rv = 0;
-				item->deleted = true;
+				mark_deleted(item);
 				continue;
 			case ERANGE:
 				/* hash mismatch don't delete it */
@@ -406,7 +449,7 @@ collect_obsoletes(struct xbps_handle *xhp)
 		 * Mark file as being deleted, this is used when
 		 * checking if a directory can be deleted.
 		 */
-		item->deleted = true;
+		mark_deleted(item);
 
 		/*
 		 * Add file to the packages `obsolete_files` dict
@@ -662,102 +705,243 @@ out:
 	return rv;
 }
 
-static int
-collect_binpkg_files(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod,
-		unsigned int idx, bool update)
-{
+/*
+ * Reading the files lists of the packages dominates the collection of
+ * files, they are read by a pool of threads. The files are collected
+ * by the calling thread in transaction order, reading ahead at most
+ * `window` packages to bound memory usage.
+ */
+struct files_job {
+	xbps_dictionary_t obj;
+	/* the installed package, if any */
+	xbps_dictionary_t pkgd;
+	/* files of the binary package and the installed package */
 	xbps_dictionary_t filesd;
-	struct archive *ar = NULL;
-	struct archive_entry *entry;
-	struct stat st;
-	const char *pkgver, *pkgname;
-	char *bpkg;
-	/* size_t entry_size; */
-	int rv = 0, pkg_fd = -1;
+	xbps_dictionary_t ofilesd;
+	const char *pkgname;
+	const char *pkgver;
+	unsigned int idx;
+	xbps_trans_type_t ttype;
+	int rv;
+	bool done;
+};
 
-	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
-	assert(pkgver);
-	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgname", &pkgname);
-	assert(pkgname);
+struct files_pool {
+	struct xbps_handle *xhp;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct files_job *jobs;
+	unsigned int njobs;
+	unsigned int next;
+	unsigned int consumed;
+	unsigned int window;
+	bool stop;
+};
 
-	bpkg = xbps_repository_pkg_path(xhp, pkg_repod);
-	if (bpkg == NULL) {
-		rv = errno;
-		goto out;
+static int
+read_binpkg_files(struct xbps_handle *xhp, struct files_job *job)
+{
+	struct xbps_binpkg *bp;
+	int rv;
+
+	/* use the metadata internalized earlier if still cached */
+	if ((bp = xbps_binpkg_cache_get(job->obj)) != NULL) {
+		job->filesd = bp->filesd;
+		xbps_object_retain(job->filesd);
+		xbps_binpkg_close(bp);
+		return 0;
 	}
+	rv = xbps_binpkg_open(xhp, job->obj, XBPS_STATE_FILES_FAIL, &bp);
+	if (rv < 0)
+		return -rv;
+	job->filesd = bp->filesd;
+	xbps_object_retain(job->filesd);
+	xbps_binpkg_close(bp);
+	return 0;
+}
 
-	if ((ar = archive_read_new()) == NULL) {
-		rv = errno;
-		goto out;
+static void
+read_job_files(struct xbps_handle *xhp, struct files_job *job)
+{
+	if (job->ttype == XBPS_TRANS_INSTALL ||
+	    job->ttype == XBPS_TRANS_REINSTALL ||
+	    job->ttype == XBPS_TRANS_UPDATE) {
+		if ((job->rv = read_binpkg_files(xhp, job)) != 0)
+			return;
 	}
+	if (job->pkgd)
+		job->ofilesd = xbps_pkgdb_get_pkg_files(xhp, job->pkgname);
+}
 
-	/*
-	 * Enable support for tar format and gzip/bzip2/lzma compression methods.
-	 */
-	archive_read_support_filter_gzip(ar);
-	archive_read_support_filter_bzip2(ar);
-	archive_read_support_filter_xz(ar);
-	archive_read_support_filter_lz4(ar);
-	archive_read_support_filter_zstd(ar);
-	archive_read_support_format_tar(ar);
-
-	pkg_fd = open(bpkg, O_RDONLY|O_CLOEXEC);
-	if (pkg_fd == -1) {
-		rv = errno;
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
-		    rv, pkgver,
-		    "%s: failed to open binary package `%s': %s",
-		    pkgver, bpkg, strerror(rv));
-		goto out;
+static void *
+files_pool_worker(void *arg)
+{
+	struct files_pool *pool = arg;
+	struct files_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		if (pool->stop || pool->next == pool->njobs)
+			break;
+		if (pool->next >= pool->consumed + pool->window) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+		job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		read_job_files(pool->xhp, job);
+
+		pthread_mutex_lock(&pool->lock);
+		job->done = true;
+		pthread_cond_broadcast(&pool->cond);
 	}
-	if (fstat(pkg_fd, &st) == -1) {
-		rv = errno;
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
-		    rv, pkgver,
-		    "%s: failed to fstat binary package `%s': %s",
-		    pkgver, bpkg, strerror(rv));
-		goto out;
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/*
+ * Waits for the files of the next job in transaction order,
+ * reading them in the calling thread if no worker picked it up yet.
+ */
+static struct files_job *
+files_pool_wait(struct files_pool *pool, unsigned int i)
+{
+	struct files_job *job = &pool->jobs[i];
+
+	pthread_mutex_lock(&pool->lock);
+	while (!job->done) {
+		if (pool->next == i) {
+			pool->next++;
+			pthread_mutex_unlock(&pool->lock);
+			read_job_files(pool->xhp, job);
+			pthread_mutex_lock(&pool->lock);
+			job->done = true;
+			break;
+		}
+		pthread_cond_wait(&pool->cond, &pool->lock);
 	}
-	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
-		rv = xbps_archive_errno(ar);
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
-		    rv, pkgver,
-		    "%s: failed to read binary package `%s': %s",
-		    pkgver, bpkg, strerror(rv));
-		goto out;
+	pthread_mutex_unlock(&pool->lock);
+	return job;
+}
+
+static void
+files_pool_consumed(struct files_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->consumed++;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static int
+collect_job_files(struct xbps_handle *xhp, struct files_job *job)
+{
+	const char *oldpkgver = NULL;
+	bool preserve = false;
+	bool update = (job->ttype == XBPS_TRANS_UPDATE);
+	bool removepkg = (job->ttype == XBPS_TRANS_REMOVE);
+	int rv;
+
+	if (job->filesd) {
+		xbps_set_cb_state(xhp, XBPS_STATE_FILES, 0, job->pkgver,
+		    "%s: collecting files...", job->pkgver);
+		rv = collect_files(xhp, job->filesd, job->pkgname, job->pkgver,
+		    job->idx, update, false, false, false);
+		if (rv != 0)
+			return rv;
 	}
+	if (job->ofilesd == NULL)
+		return 0;
+
+	/* the items keep pointers to the installed files until cleanup */
+	if (!xbps_array_add(ofiles, job->ofilesd))
+		return ENOMEM;
+
+	xbps_dictionary_get_cstring_nocopy(job->pkgd, "pkgver", &oldpkgver);
+	if (!xbps_dictionary_get_bool(job->obj, "preserve", &preserve))
+		preserve = false;
+
+	assert(oldpkgver);
+	xbps_set_cb_state(xhp, XBPS_STATE_FILES, 0, oldpkgver,
+	    "%s: collecting files...", oldpkgver);
+	return collect_files(xhp, job->ofilesd, job->pkgname, job->pkgver,
+	    job->idx, update, removepkg, preserve, true);
+}
 
-	for (uint8_t i = 0; i < 4; i++) {
-		const char *entry_pname;
-		int ar_rv = archive_read_next_header(ar, &entry);
-		if (ar_rv == ARCHIVE_EOF || ar_rv == ARCHIVE_FATAL)
+static int
+collect_transaction_files(struct xbps_handle *xhp, struct files_job *jobs,
+		unsigned int njobs)
+{
+	struct files_pool pool = { 0 };
+	pthread_t *thds = NULL;
+	unsigned int i, nthreads = 0;
+	long ncpu;
+	int r, rv = 0;
+
+	pool.xhp = xhp;
+	pool.jobs = jobs;
+	pool.njobs = njobs;
+
+	/* the calling thread reads files lists too */
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu > 1 && njobs > 1) {
+		nthreads = (unsigned int)ncpu - 1;
+		if (nthreads > njobs - 1)
+			nthreads = njobs - 1;
+		pool.window = 2 * (unsigned int)ncpu;
+		thds = calloc(nthreads, sizeof(*thds));
+		if (thds == NULL)
+			nthreads = 0;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.cond, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		r = pthread_create(&thds[i], NULL, files_pool_worker, &pool);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to create thread: %s\n", strerror(r));
 			break;
-		else if (ar_rv == ARCHIVE_RETRY)
-			continue;
-
-		entry_pname = archive_entry_pathname(entry);
-		if (!entry_pname)
-			xbps_unreachable();
-		if ((strcmp("./files.plist", entry_pname)) == 0) {
-			filesd = xbps_archive_get_dictionary(ar, entry);
-			if (filesd == NULL) {
-				rv = EINVAL;
-				goto out;
-			}
-			rv = collect_files(xhp, filesd, pkgname, pkgver, idx,
-			    update, false, false, false);
-			xbps_object_release(filesd);
-			goto out;
 		}
-		archive_read_data_skip(ar);
+	}
+	nthreads = i;
+	if (nthreads > 0)
+		xbps_dbg_printf("[files] reading files with %u threads.\n",
+		    nthreads + 1);
+
+	for (i = 0; i < njobs; i++) {
+		struct files_job *job = files_pool_wait(&pool, i);
+
+		if ((rv = job->rv) == 0)
+			rv = collect_job_files(xhp, job);
+		files_pool_consumed(&pool);
+		if (rv != 0)
+			break;
 	}
 
-out:
-	if (pkg_fd != -1)
-		close(pkg_fd);
-	if (ar != NULL)
-		archive_read_free(ar);
-	free(bpkg);
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = true;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+	while (nthreads > 0) {
+		r = pthread_join(thds[--nthreads], NULL);
+		if (r != 0) {
+			xbps_error_printf(
+			    "failed to wait on thread: %s\n", strerror(r));
+		}
+	}
+	pthread_cond_destroy(&pool.cond);
+	pthread_mutex_destroy(&pool.lock);
+
+	for (i = 0; i < njobs; i++) {
+		if (jobs[i].filesd)
+			xbps_object_release(jobs[i].filesd);
+		if (jobs[i].ofilesd)
+			xbps_object_release(jobs[i].ofilesd);
+	}
+	free(thds);
 	return rv;
 }
 
@@ -782,6 +966,12 @@ cleanup(void)
 		free(item);
 	}
 	free(items);
+	items = NULL;
+	itemsidx = itemssz = 0;
+	if (ofiles) {
+		xbps_object_release(ofiles);
+		ofiles = NULL;
+	}
 }
 
 /*
@@ -807,19 +997,20 @@ cleanup(void)
 int HIDDEN
 xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 {
-	xbps_dictionary_t pkgd, filesd;
+	struct files_job *jobs = NULL, *job;
 	xbps_object_t obj;
 	xbps_trans_type_t ttype;
 	const char *pkgver, *pkgname;
 	int rv = 0;
-	unsigned int idx = 0;
+	unsigned int idx = 0, njobs = 0, jobssz = 0;
 
 	assert(xhp);
 	assert(iter);
 
-	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
-		bool update = false;
+	if ((ofiles = xbps_array_create()) == NULL)
+		return ENOMEM;
 
+	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
 		/* increment the index of the given package package in the transaction */
 		idx++;
 
@@ -830,22 +1021,30 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		}
 
 		if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgver", &pkgver)) {
-			return EINVAL;
+			rv = EINVAL;
+			goto out;
 		}
 		if (!xbps_dictionary_get_cstring_nocopy(obj, "pkgname", &pkgname)) {
-			return EINVAL;
+			rv = EINVAL;
+			goto out;
 		}
 
-		update = (ttype == XBPS_TRANS_UPDATE);
-
-		if (ttype == XBPS_TRANS_INSTALL || ttype == XBPS_TRANS_REINSTALL || ttype == XBPS_TRANS_UPDATE) {
-			xbps_set_cb_state(xhp, XBPS_STATE_FILES, 0, pkgver,
-			    "%s: collecting files...", pkgver);
-			rv = collect_binpkg_files(xhp, obj, idx, update);
-			if (rv != 0)
+		if (njobs == jobssz) {
+			jobssz = jobssz ? jobssz*2 : 64;
+			job = realloc(jobs, jobssz*sizeof (struct files_job));
+			if (job == NULL) {
+				rv = ENOMEM;
 				goto out;
+			}
+			jobs = job;
 		}
-
+		job = &jobs[njobs++];
+		memset(job, 0, sizeof(*job));
+		job->obj = obj;
+		job->pkgname = pkgname;
+		job->pkgver = pkgver;
+		job->idx = idx;
+		job->ttype = ttype;
 		/*
 		 * Always just try to get the package from the pkgdb:
 		 * update and remove always have a previous package,
@@ -854,37 +1053,19 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		 * a reinstallation, in which case the files list could
 		 * different between old and new "install".
 		 */
-		pkgd = xbps_pkgdb_get_pkg(xhp, pkgname);
-		if (pkgd) {
-			const char *oldpkgver;
-			bool preserve = false;
-			bool removepkg = (ttype == XBPS_TRANS_REMOVE);
-
-			xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &oldpkgver);
-			if (!xbps_dictionary_get_bool(obj, "preserve", &preserve))
-				preserve = false;
-
-			filesd = xbps_pkgdb_get_pkg_files(xhp, pkgname);
-			if (filesd == NULL) {
-				continue;
-			}
-
-			assert(oldpkgver);
-			xbps_set_cb_state(xhp, XBPS_STATE_FILES, 0, oldpkgver,
-			    "%s: collecting files...", oldpkgver);
-			rv = collect_files(xhp, filesd, pkgname, pkgver, idx,
-			    update, removepkg, preserve, true);
-			if (rv != 0)
-				goto out;
-		}
+		job->pkgd = xbps_pkgdb_get_pkg(xhp, pkgname);
 	}
 	xbps_object_iterator_reset(iter);
 
+	if ((rv = collect_transaction_files(xhp, jobs, njobs)) != 0)
+		goto out;
+
 	/*
 	 * Sort items by path length, to make it easier to find files in
 	 * directories.
 	 */
 	qsort(items, itemsidx, sizeof (struct item *), pathcmp);
+	index_directories();
 
 	if (chdir(xhp->rootdir) == -1) {
 		rv = errno;
@@ -893,11 +1074,10 @@ xbps_transaction_files(struct xbps_handle *xhp, xbps_object_iterator_t iter)
 		    xhp->rootdir, strerror(errno));
 	}
 
+	if (rv == 0)
+		rv = collect_obsoletes(xhp);
 out:
-	if (rv != 0)
-		return rv;
-
-	rv = collect_obsoletes(xhp);
+	free(jobs);
 	cleanup();
 	return rv;
 }
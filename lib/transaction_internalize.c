@@ -23,182 +23,62 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <errno.h>
-#include <fcntl.h>
-#include <limits.h>
-#include <stdlib.h>
 #include <string.h>
 
-#include <archive.h>
-#include <archive_entry.h>
-
 #include "xbps_api_impl.h"
 
-static int
-internalize_script(xbps_dictionary_t pkg_repod, const char *script,
-		struct archive *ar, struct archive_entry *entry)
-{
-	char buffer[BUFSIZ];
-	xbps_data_t data = NULL;
-	char *buf = NULL;
-	int64_t entry_size = archive_entry_size(entry);
-
-	if (entry_size == 0)
-		return 0;
-	if (entry_size < 0)
-		return -EINVAL;
-
-	if ((size_t)entry_size > sizeof buffer) {
-		buf = malloc(entry_size);
-		if (buf == NULL)
-			return -errno;
-	}
-
-	if (archive_read_data(ar, buf != NULL ? buf : buffer, entry_size) != entry_size) {
-		free(buf);
-		return -errno;
-	}
-
-	data = xbps_data_create_data(buf != NULL ? buf : buffer, entry_size);
-	if (data == NULL) {
-		free(buf);
-		return -errno;
-	}
-
-	free(buf);
-	xbps_dictionary_set(pkg_repod, script, data);
-	xbps_object_release(data);
-	return 0;
-}
-
 static int
 internalize_binpkg(struct xbps_handle *xhp, xbps_dictionary_t pkg_repod)
 {
-	char pkgfile[PATH_MAX];
-	xbps_dictionary_t filesd = NULL, propsd = NULL;
-	struct stat st;
-	struct archive *ar = NULL;
-	struct archive_entry *entry;
-	const char *pkgver, *pkgname, *binpkg_pkgver;
-	ssize_t l;
-	int pkg_fd = -1;
-	int rv = 0;
+	struct xbps_binpkg *bp;
+	const char *pkgver, *binpkg_pkgver = NULL;
+	int rv;
 
 	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver);
 	assert(pkgver);
-	xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgname", &pkgname);
-	assert(pkgname);
-
-	l = xbps_pkg_path(xhp, pkgfile, sizeof(pkgfile), pkg_repod);
-	if (l < 0)
-		return l;
-
-	if ((ar = archive_read_new()) == NULL)
-		return -errno;
-
-	/*
-	 * Enable support for tar format and gzip/bzip2/lzma compression methods.
-	 */
-	archive_read_support_filter_gzip(ar);
-	archive_read_support_filter_bzip2(ar);
-	archive_read_support_filter_xz(ar);
-	archive_read_support_filter_lz4(ar);
-	archive_read_support_filter_zstd(ar);
-	archive_read_support_format_tar(ar);
-
-	pkg_fd = open(pkgfile, O_RDONLY|O_CLOEXEC);
-	if (pkg_fd == -1) {
-		rv = -errno;
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
-		    -rv, pkgver,
-		    "%s: failed to open binary package `%s': %s",
-		    pkgver, pkgfile, strerror(rv));
-		goto out;
-	}
-	if (fstat(pkg_fd, &st) == -1) {
-		rv = -errno;
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
-		    -rv, pkgver,
-		    "%s: failed to fstat binary package `%s': %s",
-		    pkgver, pkgfile, strerror(rv));
-		goto out;
-	}
-	if (archive_read_open_fd(ar, pkg_fd, st.st_blksize) == ARCHIVE_FATAL) {
-		rv = xbps_archive_errno(ar);
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL,
-		    -rv, pkgver,
-		    "%s: failed to read binary package `%s': %s",
-		    pkgver, pkgfile, strerror(rv));
-		goto out;
-	}
 
-	for (uint8_t i = 0; i < 4; i++) {
-		const char *entry_pname;
-		int ar_rv = archive_read_next_header(ar, &entry);
-		if (ar_rv == ARCHIVE_EOF || ar_rv == ARCHIVE_FATAL)
-			break;
-		else if (ar_rv == ARCHIVE_RETRY)
-			continue;
-
-		entry_pname = archive_entry_pathname(entry);
-		if (!entry_pname)
-			xbps_unreachable();
-
-		if (strcmp("./INSTALL", entry_pname) == 0) {
-			rv = internalize_script(pkg_repod, "install-script", ar, entry);
-			if (rv < 0)
-				goto out;
-		} else if (strcmp("./REMOVE", entry_pname) == 0) {
-			rv = internalize_script(pkg_repod, "remove-script", ar, entry);
-			if (rv < 0)
-				goto out;
-		} else if ((strcmp("./files.plist", entry_pname)) == 0) {
-			filesd = xbps_archive_get_dictionary(ar, entry);
-			if (filesd == NULL) {
-				rv = -EINVAL;
-				goto out;
-			}
-		} else if (strcmp("./props.plist", entry_pname) == 0) {
-			propsd = xbps_archive_get_dictionary(ar, entry);
-			if (propsd == NULL) {
-				rv = -EINVAL;
-				goto out;
-			}
-		} else {
-			break;
-		}
-	}
-
-	/*
-	 * Bail out if required metadata files are not in archive.
-	 */
-	if (propsd == NULL || filesd == NULL) {
-		rv = -ENODEV;
-		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL, -rv, pkgver,
-		    "%s: [files] invalid binary package `%s'.", pkgver, pkgfile);
-		goto out;
-	}
+	rv = xbps_binpkg_open(xhp, pkg_repod, XBPS_STATE_FILES_FAIL, &bp);
+	if (rv < 0)
+		return rv;
 
 	/*
 	 * Bail out if repo pkgver does not match binpkg pkgver, i.e. downgrade attack
 	 * by advertising a old signed package with a new version.
 	 */
-	xbps_dictionary_get_cstring_nocopy(propsd, "pkgver", &binpkg_pkgver);
-	if (strcmp(pkgver, binpkg_pkgver) != 0) {
+	xbps_dictionary_get_cstring_nocopy(bp->propsd, "pkgver", &binpkg_pkgver);
+	if (binpkg_pkgver == NULL || strcmp(pkgver, binpkg_pkgver) != 0) {
 		rv = -EINVAL;
 		xbps_set_cb_state(xhp, XBPS_STATE_FILES_FAIL, -rv, pkgver,
 		    "%s: [files] pkgver mismatch repodata: `%s' binpkg: `%s'.",
-		    pkgfile, pkgver, binpkg_pkgver);
-		goto out;
+		    bp->path, pkgver, binpkg_pkgver ? binpkg_pkgver : "");
+		xbps_binpkg_close(bp);
+		return rv;
 	}
 
-out:
-	xbps_object_release(propsd);
-	xbps_object_release(filesd);
-	if (pkg_fd != -1)
-		close(pkg_fd);
-	if (ar != NULL)
-		archive_read_free(ar);
-	return rv;
+	if (bp->install != NULL)
+		xbps_dictionary_set(pkg_repod, "install-script", bp->install);
+	if (bp->remove != NULL)
+		xbps_dictionary_set(pkg_repod, "remove-script", bp->remove);
+
+	/*
+	 * Keep the decoded metadata and the stream positioned at the
+	 * payload for collecting the files and unpacking the package.
+	 */
+	xbps_binpkg_cache_put(bp);
+	return 0;
+}
+
+int HIDDEN
+xbps_transaction_internalize_pkg(struct xbps_handle *xhp, xbps_dictionary_t pkgd)
+{
+	switch (xbps_transaction_pkg_type(pkgd)) {
+	case XBPS_TRANS_INSTALL:
+	case XBPS_TRANS_UPDATE:
+	case XBPS_TRANS_REINSTALL:
+		return internalize_binpkg(xhp, pkgd);
+	default:
+		return 0;
+	}
 }
 
 int
@@ -210,19 +90,7 @@ xbps_transaction_internalize(struct xbps_handle *xhp, xbps_object_iterator_t ite
 	assert(iter);
 
 	while ((obj = xbps_object_iterator_next(iter)) != NULL) {
-		xbps_trans_type_t ttype;
-		int rv;
-
-		ttype = xbps_transaction_pkg_type(obj);
-		switch (ttype) {
-		case XBPS_TRANS_INSTALL:
-		case XBPS_TRANS_UPDATE:
-		case XBPS_TRANS_REINSTALL:
-			break;
-		default:
-			continue;
-		}
-		rv = internalize_binpkg(xhp, obj);
+		int rv = xbps_transaction_internalize_pkg(xhp, obj);
 		if (rv < 0)
 			return rv;
 	}
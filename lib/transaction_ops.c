@@ -230,7 +230,7 @@ trans_find_pkg(struct xbps_handle *xhp, const char *pkg, bool force)
 	if (ttype == XBPS_TRANS_INSTALL)
 		autoinst = xhp->flags & XBPS_FLAG_INSTALL_AUTO;
 
-	if (!xbps_transaction_store(xhp, pkgs, pkg_repod, autoinst)) {
+	if (!xbps_transaction_store(xhp, pkgs, NULL, pkg_repod, autoinst)) {
 		return EINVAL;
 	}
 
@@ -500,7 +500,7 @@ xbps_transaction_remove_pkg(struct xbps_handle *xhp,
 	for (unsigned int i = 0; i < xbps_array_count(orphans); i++) {
 		obj = xbps_array_get(orphans, i);
 		xbps_transaction_pkg_type_set(obj, XBPS_TRANS_REMOVE);
-		if (!xbps_transaction_store(xhp, pkgs, obj, false)) {
+		if (!xbps_transaction_store(xhp, pkgs, NULL, obj, false)) {
 			return EINVAL;
 		}
 	}
@@ -512,7 +512,7 @@ rmpkg:
 	 * Add pkg dictionary into the transaction pkgs queue.
 	 */
 	xbps_transaction_pkg_type_set(pkgd, XBPS_TRANS_REMOVE);
-	if (!xbps_transaction_store(xhp, pkgs, pkgd, false)) {
+	if (!xbps_transaction_store(xhp, pkgs, NULL, pkgd, false)) {
 		return EINVAL;
 	}
 	return rv;
@@ -543,7 +543,7 @@ xbps_transaction_autoremove_pkgs(struct xbps_handle *xhp)
 	for (unsigned int i = 0; i < xbps_array_count(orphans); i++) {
 		obj = xbps_array_get(orphans, i);
 		xbps_transaction_pkg_type_set(obj, XBPS_TRANS_REMOVE);
-		if (!xbps_transaction_store(xhp, pkgs, obj, false)) {
+		if (!xbps_transaction_store(xhp, pkgs, NULL, obj, false)) {
 			rv = EINVAL;
 			goto out;
 		}
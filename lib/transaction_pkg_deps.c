@@ -110,8 +110,8 @@ out:
 
 static int
 repo_deps(struct xbps_handle *xhp,
-	  xbps_array_t pkgs,		/* array of pkgs */
-	  xbps_array_t queued,		/* queued packages */
+	  struct xbps_pkgidx *pkgs,	/* array of pkgs */
+	  struct xbps_pkgidx *queued,	/* queued packages */
 	  xbps_dictionary_t pkg_repod,	/* pkg repo dictionary */
 	  unsigned short *depth)	/* max recursion depth */
 {
@@ -186,8 +186,8 @@ repo_deps(struct xbps_handle *xhp,
 		 * Pass 2: check if required dependency is currently queued or
 		 * has been already added in the transaction dictionary.
 		 */
-		if ((curpkgd = xbps_find_pkg_in_array(queued, reqpkg, 0)) ||
-		    (curpkgd = xbps_find_virtualpkg_in_array(xhp, queued, reqpkg, 0))) {
+		if ((curpkgd = xbps_pkgidx_find_pkg(queued, reqpkg, 0)) ||
+		    (curpkgd = xbps_pkgidx_find_virtualpkg(xhp, queued, reqpkg, 0))) {
 			xbps_trans_type_t ttype_q = xbps_transaction_pkg_type(curpkgd);
 			xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &pkgver_q);
 			xbps_dbg_printf_append(" (%s queued %d)\n", pkgver_q, ttype_q);
@@ -197,8 +197,8 @@ repo_deps(struct xbps_handle *xhp,
 		 * Pass 3: check if required dependency has been already added
 		 * in the transaction dictionary.
 		 */
-		if ((curpkgd = xbps_find_pkg_in_array(pkgs, reqpkg, 0)) ||
-		    (curpkgd = xbps_find_virtualpkg_in_array(xhp, pkgs, reqpkg, 0))) {
+		if ((curpkgd = xbps_pkgidx_find_pkg(pkgs, reqpkg, 0)) ||
+		    (curpkgd = xbps_pkgidx_find_virtualpkg(xhp, pkgs, reqpkg, 0))) {
 			xbps_trans_type_t ttype_q = xbps_transaction_pkg_type(curpkgd);
 			xbps_dictionary_get_cstring_nocopy(curpkgd, "pkgver", &pkgver_q);
 			if (ttype_q != XBPS_TRANS_REMOVE && ttype_q != XBPS_TRANS_HOLD) {
@@ -344,7 +344,7 @@ repo_deps(struct xbps_handle *xhp,
 				xbps_dbg_printf("xbps_transaction_pkg_type_set failed for `%s': %s\n", reqpkg, strerror(rv));
 				break;
 			}
-			if (!xbps_transaction_store(xhp, pkgs, curpkgd, autoinst)) {
+			if (!xbps_transaction_store(xhp, xbps_pkgidx_array(pkgs), pkgs, curpkgd, autoinst)) {
 				rv = EINVAL;
 				xbps_dbg_printf("xbps_transaction_store failed for `%s': %s\n", reqpkg, strerror(rv));
 				break;
@@ -428,7 +428,7 @@ repo_deps(struct xbps_handle *xhp,
 					 * So dependency pattern matching didn't
 					 * succeed... return ENODEV.
 					 */
-					if (xbps_find_pkg_in_array(pkgs, pkgname, XBPS_TRANS_UPDATE)) {
+					if (xbps_pkgidx_find_pkg(pkgs, pkgname, XBPS_TRANS_UPDATE)) {
 						error = true;
 						rv = ENODEV;
 					}
@@ -442,7 +442,7 @@ repo_deps(struct xbps_handle *xhp,
 				break;
 		}
 
-		if (!xbps_array_add(queued, repopkgd))
+		if (!xbps_pkgidx_add(queued, repopkgd))
 			return -xbps_error_oom();
 
 		pkg_rdeps = xbps_dictionary_get(repopkgd, "run_depends");
@@ -470,7 +470,7 @@ repo_deps(struct xbps_handle *xhp,
 			ttype = XBPS_TRANS_HOLD;
 		}
 
-		xbps_array_remove(queued, xbps_array_count(queued) - 1);
+		xbps_pkgidx_remove_last(queued);
 
 		/*
 		 * All deps were processed, store pkg in transaction.
@@ -480,7 +480,7 @@ repo_deps(struct xbps_handle *xhp,
 			xbps_dbg_printf("xbps_transaction_pkg_type_set failed for `%s': %s\n", reqpkg, strerror(rv));
 			break;
 		}
-		if (!xbps_transaction_store(xhp, pkgs, repopkgd, autoinst)) {
+		if (!xbps_transaction_store(xhp, xbps_pkgidx_array(pkgs), pkgs, repopkgd, autoinst)) {
 			rv = EINVAL;
 			xbps_dbg_printf("xbps_transaction_store failed for `%s': %s\n", reqpkg, strerror(rv));
 			break;
@@ -495,25 +495,31 @@ out:
 
 int HIDDEN
 xbps_transaction_pkg_deps(struct xbps_handle *xhp,
-			  xbps_array_t pkgs,
+			  struct xbps_pkgidx *pkgs,
 			  xbps_dictionary_t pkg_repod)
 {
 	const char *pkgver;
 	unsigned short depth = 0;
-	xbps_array_t queued;
+	struct xbps_pkgidx *queued;
+	xbps_array_t array;
 	int rv;
 
 	assert(xhp);
 	assert(pkgs);
 	assert(pkg_repod);
 
-	queued = xbps_array_create();
-	if (!queued)
-		return -xbps_error_oom();
-
 	if (!xbps_dictionary_get_cstring_nocopy(pkg_repod, "pkgver", &pkgver))
 		return EINVAL;
 
+	array = xbps_array_create();
+	if (!array)
+		return -xbps_error_oom();
+	queued = xbps_pkgidx_create(array);
+	if (!queued) {
+		xbps_object_release(array);
+		return -xbps_error_oom();
+	}
+
 	xbps_dbg_printf("Finding required dependencies for '%s':\n", pkgver);
 
 	/*
@@ -521,6 +527,7 @@ xbps_transaction_pkg_deps(struct xbps_handle *xhp,
 	 * there it will be added into the missing_deps array.
 	 */
 	rv = repo_deps(xhp, pkgs, queued, pkg_repod, &depth);
-	xbps_object_release(queued);
+	xbps_pkgidx_free(queued);
+	xbps_object_release(array);
 	return rv;
 }
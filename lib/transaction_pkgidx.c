@@ -0,0 +1,394 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uthash.h"
+
+#include "xbps_api_impl.h"
+
+/*
+ * Side index of a package array used while resolving dependencies.
+ *
+ * Every element of the array is linked into the list of its pkgname
+ * and into the list of every virtual package it provides. Elements are
+ * only appended or removed, so the lists keep the array order and a
+ * lookup returns the same element as a linear scan would, i.e the first
+ * one matching in the array.
+ *
+ * The index owns no references; the array does.
+ */
+struct pkgidx_node {
+	xbps_dictionary_t pkgd;
+	struct pkgidx_node *next;
+};
+
+struct pkgidx_list {
+	char *name;
+	struct pkgidx_node *head;
+	struct pkgidx_node *tail;
+	UT_hash_handle hh;
+};
+
+struct xbps_pkgidx {
+	xbps_array_t array;
+	struct pkgidx_list *names;
+	struct pkgidx_list *vpkgs;
+};
+
+static struct pkgidx_list *
+list_get(struct pkgidx_list **head, const char *name, bool create)
+{
+	struct pkgidx_list *list = NULL;
+
+	HASH_FIND_STR(*head, name, list);
+	if (list != NULL || !create)
+		return list;
+
+	list = calloc(1, sizeof(*list));
+	if (list == NULL)
+		return NULL;
+	if ((list->name = strdup(name)) == NULL) {
+		free(list);
+		return NULL;
+	}
+	HASH_ADD_KEYPTR(hh, *head, list->name, strlen(list->name), list);
+	return list;
+}
+
+static bool
+list_append(struct pkgidx_list **head, const char *name, xbps_dictionary_t pkgd)
+{
+	struct pkgidx_list *list;
+	struct pkgidx_node *node;
+
+	if ((list = list_get(head, name, true)) == NULL)
+		return false;
+	if ((node = calloc(1, sizeof(*node))) == NULL)
+		return false;
+	node->pkgd = pkgd;
+	if (list->tail != NULL)
+		list->tail->next = node;
+	else
+		list->head = node;
+	list->tail = node;
+	return true;
+}
+
+/*
+ * Unlink the first (or last) node of pkgd from the list of name.
+ */
+static void
+list_unlink(struct pkgidx_list **head, const char *name,
+		xbps_dictionary_t pkgd, bool last)
+{
+	struct pkgidx_list *list;
+	struct pkgidx_node *node, *prev = NULL, *found = NULL, *foundprev = NULL;
+
+	if ((list = list_get(head, name, false)) == NULL)
+		return;
+	for (node = list->head; node != NULL; prev = node, node = node->next) {
+		if (node->pkgd != pkgd)
+			continue;
+		found = node;
+		foundprev = prev;
+		if (!last)
+			break;
+	}
+	if (found == NULL)
+		return;
+	if (foundprev != NULL)
+		foundprev->next = found->next;
+	else
+		list->head = found->next;
+	if (list->tail == found)
+		list->tail = foundprev;
+	free(found);
+	if (list->head == NULL) {
+		HASH_DEL(*head, list);
+		free(list->name);
+		free(list);
+	}
+}
+
+static void
+list_free(struct pkgidx_list **head)
+{
+	struct pkgidx_list *list, *tmp;
+	struct pkgidx_node *node, *next;
+
+	HASH_ITER(hh, *head, list, tmp) {
+		HASH_DEL(*head, list);
+		for (node = list->head; node != NULL; node = next) {
+			next = node->next;
+			free(node);
+		}
+		free(list->name);
+		free(list);
+	}
+}
+
+static bool
+pkgd_name(xbps_dictionary_t pkgd, char *name, size_t namesz)
+{
+	const char *pkgver = NULL;
+
+	if (!xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver))
+		return false;
+	return xbps_pkg_name(name, namesz, pkgver);
+}
+
+static bool
+index_pkg(struct xbps_pkgidx *idx, xbps_dictionary_t pkgd)
+{
+	char name[XBPS_NAME_SIZE];
+	xbps_array_t provides;
+	const char *vpkg;
+
+	if (!pkgd_name(pkgd, name, sizeof(name))) {
+		errno = EINVAL;
+		return false;
+	}
+	if (!list_append(&idx->names, name, pkgd))
+		return false;
+
+	provides = xbps_dictionary_get(pkgd, "provides");
+	for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+		if (!xbps_array_get_cstring_nocopy(provides, i, &vpkg))
+			continue;
+		if (!xbps_pkg_name(name, sizeof(name), vpkg))
+			continue;
+		if (!list_append(&idx->vpkgs, name, pkgd))
+			return false;
+	}
+	return true;
+}
+
+static void
+unindex_pkg(struct xbps_pkgidx *idx, xbps_dictionary_t pkgd, bool last)
+{
+	char name[XBPS_NAME_SIZE];
+	xbps_array_t provides;
+	const char *vpkg;
+
+	if (!pkgd_name(pkgd, name, sizeof(name)))
+		return;
+	list_unlink(&idx->names, name, pkgd, last);
+
+	provides = xbps_dictionary_get(pkgd, "provides");
+	for (unsigned int i = 0; i < xbps_array_count(provides); i++) {
+		if (!xbps_array_get_cstring_nocopy(provides, i, &vpkg))
+			continue;
+		if (!xbps_pkg_name(name, sizeof(name), vpkg))
+			continue;
+		list_unlink(&idx->vpkgs, name, pkgd, last);
+	}
+}
+
+struct xbps_pkgidx HIDDEN *
+xbps_pkgidx_create(xbps_array_t array)
+{
+	struct xbps_pkgidx *idx;
+
+	assert(xbps_object_type(array) == XBPS_TYPE_ARRAY);
+
+	if ((idx = calloc(1, sizeof(*idx))) == NULL)
+		return NULL;
+	idx->array = array;
+	for (unsigned int i = 0; i < xbps_array_count(array); i++) {
+		if (!index_pkg(idx, xbps_array_get(array, i))) {
+			xbps_pkgidx_free(idx);
+			return NULL;
+		}
+	}
+	return idx;
+}
+
+void HIDDEN
+xbps_pkgidx_free(struct xbps_pkgidx *idx)
+{
+	if (idx == NULL)
+		return;
+	list_free(&idx->names);
+	list_free(&idx->vpkgs);
+	free(idx);
+}
+
+xbps_array_t HIDDEN
+xbps_pkgidx_array(struct xbps_pkgidx *idx)
+{
+	return idx->array;
+}
+
+bool HIDDEN
+xbps_pkgidx_add(struct xbps_pkgidx *idx, xbps_dictionary_t pkgd)
+{
+	if (!index_pkg(idx, pkgd)) {
+		unindex_pkg(idx, pkgd, true);
+		return false;
+	}
+	if (!xbps_array_add(idx->array, pkgd)) {
+		unindex_pkg(idx, pkgd, true);
+		return false;
+	}
+	return true;
+}
+
+void HIDDEN
+xbps_pkgidx_remove_last(struct xbps_pkgidx *idx)
+{
+	unsigned int cnt = xbps_array_count(idx->array);
+
+	if (cnt == 0)
+		return;
+	unindex_pkg(idx, xbps_array_get(idx->array, cnt - 1), true);
+	xbps_array_remove(idx->array, cnt - 1);
+}
+
+bool HIDDEN
+xbps_pkgidx_remove_pkgver(struct xbps_pkgidx *idx, const char *pkgver)
+{
+	char name[XBPS_NAME_SIZE];
+	struct pkgidx_list *list;
+	struct pkgidx_node *node;
+	const char *curpkgver;
+
+	if (!xbps_pkg_name(name, sizeof(name), pkgver))
+		return false;
+	if ((list = list_get(&idx->names, name, false)) == NULL)
+		return false;
+	for (node = list->head; node != NULL; node = node->next) {
+		if (!xbps_dictionary_get_cstring_nocopy(node->pkgd, "pkgver", &curpkgver))
+			continue;
+		if (strcmp(curpkgver, pkgver) == 0)
+			break;
+	}
+	if (node == NULL)
+		return false;
+	/* same element that the linear removal finds first */
+	unindex_pkg(idx, node->pkgd, false);
+	return xbps_remove_pkg_from_array_by_pkgver(idx->array, pkgver);
+}
+
+/*
+ * Returns the name to look up for a pkgname, pkgver or pkgpattern,
+ * or NULL if only a linear scan can resolve it (glob patterns).
+ */
+static const char *
+lookup_name(const char *str, char *name, size_t namesz)
+{
+	if (strpbrk(str, "*?[]") != NULL)
+		return NULL;
+	if (xbps_pkgpattern_version(str)) {
+		if (!xbps_pkgpattern_name(name, namesz, str))
+			return NULL;
+		return name;
+	}
+	if (xbps_pkg_version(str)) {
+		if (!xbps_pkg_name(name, namesz, str))
+			return NULL;
+		return name;
+	}
+	return str;
+}
+
+static bool
+match_pkg(xbps_dictionary_t pkgd, const char *str)
+{
+	char name[XBPS_NAME_SIZE];
+	const char *pkgver = NULL;
+
+	xbps_dictionary_get_cstring_nocopy(pkgd, "pkgver", &pkgver);
+	if (xbps_pkgpattern_version(str))
+		return xbps_pkgpattern_match(pkgver, str);
+	if (xbps_pkg_version(str))
+		return strcmp(pkgver, str) == 0;
+	return xbps_pkg_name(name, sizeof(name), pkgver) &&
+	    strcmp(name, str) == 0;
+}
+
+static xbps_dictionary_t
+find_in_list(struct pkgidx_list *list, const char *str,
+		xbps_trans_type_t tt, bool virtual)
+{
+	struct pkgidx_node *node;
+
+	for (node = list ? list->head : NULL; node != NULL; node = node->next) {
+		if (virtual ? !xbps_match_virtual_pkg_in_dict(node->pkgd, str) :
+		    !match_pkg(node->pkgd, str))
+			continue;
+		if (tt && xbps_transaction_pkg_type(node->pkgd) != tt)
+			break;
+		return node->pkgd;
+	}
+	errno = ENOENT;
+	return NULL;
+}
+
+xbps_dictionary_t HIDDEN
+xbps_pkgidx_find_pkg(struct xbps_pkgidx *idx, const char *str,
+		xbps_trans_type_t tt)
+{
+	char namebuf[XBPS_NAME_SIZE];
+	const char *name;
+
+	if ((name = lookup_name(str, namebuf, sizeof(namebuf))) == NULL)
+		return xbps_find_pkg_in_array(idx->array, str, tt);
+	return find_in_list(list_get(&idx->names, name, false), str, tt, false);
+}
+
+static xbps_dictionary_t
+find_virtualpkg(struct xbps_pkgidx *idx, const char *str, xbps_trans_type_t tt)
+{
+	char namebuf[XBPS_NAME_SIZE];
+	const char *name;
+
+	if ((name = lookup_name(str, namebuf, sizeof(namebuf))) == NULL)
+		return NULL;
+	return find_in_list(list_get(&idx->vpkgs, name, false), str, tt, true);
+}
+
+xbps_dictionary_t HIDDEN
+xbps_pkgidx_find_virtualpkg(struct xbps_handle *xhp, struct xbps_pkgidx *idx,
+		const char *str, xbps_trans_type_t tt)
+{
+	xbps_dictionary_t pkgd;
+	const char *vpkg;
+	char namebuf[XBPS_NAME_SIZE];
+
+	if (lookup_name(str, namebuf, sizeof(namebuf)) == NULL)
+		return xbps_find_virtualpkg_in_array(xhp, idx->array, str, tt);
+
+	if ((vpkg = vpkg_user_conf(xhp, str))) {
+		if (lookup_name(vpkg, namebuf, sizeof(namebuf)) == NULL)
+			return xbps_find_virtualpkg_in_array(xhp, idx->array, str, tt);
+		if ((pkgd = find_virtualpkg(idx, vpkg, tt)))
+			return pkgd;
+	}
+	return find_virtualpkg(idx, str, tt);
+}
@@ -278,6 +278,7 @@ xbps_transaction_init(struct xbps_handle *xhp)
 int
 xbps_transaction_prepare(struct xbps_handle *xhp)
 {
+	struct xbps_pkgidx *pkgsidx;
 	xbps_array_t pkgs, edges;
 	xbps_dictionary_t tpkgd;
 	xbps_trans_type_t ttype;
@@ -305,6 +306,15 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 	 */
 	pkgs = xbps_dictionary_get(xhp->transd, "packages");
 	assert(xbps_object_type(pkgs) == XBPS_TYPE_ARRAY);
+	/*
+	 * Index the packages by pkgname and virtual pkgname while
+	 * resolving dependencies, to avoid scanning the array for
+	 * every dependency.
+	 */
+	if ((pkgsidx = xbps_pkgidx_create(pkgs)) == NULL) {
+		xbps_object_release(edges);
+		return ENOMEM;
+	}
 	cnt = xbps_array_count(pkgs);
 	for (i = 0; i < cnt; i++) {
 		xbps_dictionary_t pkgd;
@@ -320,18 +330,21 @@ xbps_transaction_prepare(struct xbps_handle *xhp)
 		assert(xbps_object_type(str) == XBPS_TYPE_STRING);
 
 		if (!xbps_array_add(edges, str)) {
-			xbps_object_release(edges);
-			return ENOMEM;
-		}
-		if ((rv = xbps_transaction_pkg_deps(xhp, pkgs, pkgd)) != 0) {
-			xbps_object_release(edges);
-			return rv;
+			rv = ENOMEM;
+			break;
 		}
-		if (!xbps_array_add(pkgs, pkgd)) {
-			xbps_object_release(edges);
-			return ENOMEM;
+		if ((rv = xbps_transaction_pkg_deps(xhp, pkgsidx, pkgd)) != 0)
+			break;
+		if (!xbps_pkgidx_add(pkgsidx, pkgd)) {
+			rv = ENOMEM;
+			break;
 		}
 	}
+	xbps_pkgidx_free(pkgsidx);
+	if (rv != 0) {
+		xbps_object_release(edges);
+		return rv;
+	}
 	/* ... remove dup edges at head */
 	for (i = 0; i < xbps_array_count(edges); i++) {
 		const char *pkgver = NULL;
@@ -32,7 +32,7 @@
 
 bool HIDDEN
 xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
-		xbps_dictionary_t pkgrd, bool autoinst)
+		struct xbps_pkgidx *idx, xbps_dictionary_t pkgrd, bool autoinst)
 {
 	xbps_dictionary_t d, pkgd;
 	xbps_array_t replaces;
@@ -43,6 +43,7 @@ xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 	assert(xhp);
 	assert(pkgs);
 	assert(pkgrd);
+	assert(idx == NULL || xbps_pkgidx_array(idx) == pkgs);
 
 	if (!xbps_dictionary_get_cstring_nocopy(pkgrd, "pkgver", &pkgver)) {
 		return false;
@@ -50,7 +51,10 @@ xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 	if (!xbps_dictionary_get_cstring_nocopy(pkgrd, "pkgname", &pkgname)) {
 		return false;
 	}
-	d = xbps_find_pkg_in_array(pkgs, pkgname, 0);
+	if (idx != NULL)
+		d = xbps_pkgidx_find_pkg(idx, pkgname, 0);
+	else
+		d = xbps_find_pkg_in_array(pkgs, pkgname, 0);
 	if (xbps_object_type(d) == XBPS_TYPE_DICTIONARY) {
 		/* compare version stored in transaction vs current */
 		if (!xbps_dictionary_get_cstring_nocopy(d, "pkgver", &curpkgver)) {
@@ -65,7 +69,9 @@ xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 			 * Current version is greater than stored,
 			 * replace stored with current.
 			 */
-			if (!xbps_remove_pkg_from_array_by_pkgver(pkgs, curpkgver)) {
+			if (idx != NULL ?
+			    !xbps_pkgidx_remove_pkgver(idx, curpkgver) :
+			    !xbps_remove_pkg_from_array_by_pkgver(pkgs, curpkgver)) {
 				return false;
 			}
 			xbps_dbg_printf("[trans] replaced %s with %s\n", curpkgver, pkgver);
@@ -97,7 +103,7 @@ xbps_transaction_store(struct xbps_handle *xhp, xbps_array_t pkgs,
 	/*
 	 * Add the dictionary into the unsorted queue.
 	 */
-	if (!xbps_array_add(pkgs, pkgd))
+	if (idx != NULL ? !xbps_pkgidx_add(idx, pkgd) : !xbps_array_add(pkgs, pkgd))
 		goto err;
 
 	xbps_dictionary_get_cstring_nocopy(pkgd, "repository", &repo);
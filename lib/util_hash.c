@@ -29,13 +29,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 
 #include "xbps_api_impl.h"
 
@@ -112,13 +113,95 @@ xbps_mmap_file(const char *file, void **mmf, size_t *mmflen, size_t *filelen)
 	return true;
 }
 
+/*
+ * Files are hashed with the EVP interface, which uses the SHA extensions
+ * of the CPU when available. Small files are read at once into a stack
+ * buffer, bigger files in large chunks with sequential read-ahead. Reads
+ * are used rather than mmap(2) because a file truncated while hashed
+ * must not raise SIGBUS.
+ */
+#define SHA256_SMALL_BUFSIZ	(16 * 1024)
+#define SHA256_BUFSIZ		(256 * 1024)
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+static EVP_MD *sha256_md;
+static pthread_once_t sha256_md_once = PTHREAD_ONCE_INIT;
+
+static void
+sha256_md_init(void)
+{
+	/* avoid the implicit algorithm fetch on every digest */
+	sha256_md = EVP_MD_fetch(NULL, "SHA256", NULL);
+}
+
+static const EVP_MD *
+sha256_evp(void)
+{
+	pthread_once(&sha256_md_once, sha256_md_init);
+	return sha256_md ? sha256_md : EVP_sha256();
+}
+#else
+static const EVP_MD *
+sha256_evp(void)
+{
+	return EVP_sha256();
+}
+#endif
+
+static int
+sha256_fd(int fd, unsigned char *dst)
+{
+	char sbuf[SHA256_SMALL_BUFSIZ], *buf = sbuf;
+	size_t bufsz = sizeof(sbuf);
+	struct stat st;
+	EVP_MD_CTX *ctx;
+	ssize_t len;
+	int r = 0;
+
+	if (fstat(fd, &st) == -1)
+		return -errno;
+	if (st.st_size > (off_t)sizeof(sbuf)) {
+		(void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		bufsz = st.st_size < SHA256_BUFSIZ ? (size_t)st.st_size : SHA256_BUFSIZ;
+		if ((buf = malloc(bufsz)) == NULL) {
+			buf = sbuf;
+			bufsz = sizeof(sbuf);
+		}
+	}
+
+	if ((ctx = EVP_MD_CTX_new()) == NULL) {
+		r = -ENOMEM;
+		goto out;
+	}
+	if (EVP_DigestInit_ex(ctx, sha256_evp(), NULL) != 1) {
+		r = -EINVAL;
+		goto out;
+	}
+	while ((len = read(fd, buf, bufsz)) != 0) {
+		if (len == -1) {
+			if (errno == EINTR)
+				continue;
+			r = -errno;
+			goto out;
+		}
+		if (EVP_DigestUpdate(ctx, buf, len) != 1) {
+			r = -EINVAL;
+			goto out;
+		}
+	}
+	if (EVP_DigestFinal_ex(ctx, dst, NULL) != 1)
+		r = -EINVAL;
+out:
+	EVP_MD_CTX_free(ctx);
+	if (buf != sbuf)
+		free(buf);
+	return r;
+}
+
 bool
 xbps_file_sha256_raw(unsigned char *dst, size_t dstlen, const char *file)
 {
-	int fd;
-	ssize_t len;
-	char buf[65536];
-	SHA256_CTX sha256;
+	int fd, r;
 
 	assert(dstlen >= XBPS_SHA256_DIGEST_SIZE);
 	if (dstlen < XBPS_SHA256_DIGEST_SIZE) {
@@ -126,20 +209,15 @@ xbps_file_sha256_raw(unsigned char *dst, size_t dstlen, const char *file)
 		return false;
 	}
 
-	if ((fd = open(file, O_RDONLY)) < 0)
+	if ((fd = open(file, O_RDONLY|O_CLOEXEC)) < 0)
 		return false;
 
-	SHA256_Init(&sha256);
-
-	while ((len = read(fd, buf, sizeof(buf))) > 0)
-		SHA256_Update(&sha256, buf, len);
-
+	r = sha256_fd(fd, dst);
 	(void)close(fd);
-
-	if(len == -1)
+	if (r < 0) {
+		errno = -r;
 		return false;
-
-	SHA256_Final(dst, &sha256);
+	}
 
 	return true;
 }
@@ -163,6 +241,143 @@ xbps_file_sha256(char *dst, size_t dstlen, const char *file)
 	return true;
 }
 
+/*
+ * Streaming digests, to hash data while it is being copied.
+ */
+struct xbps_sha256 {
+	EVP_MD_CTX *ctx;
+};
+
+struct xbps_sha256 HIDDEN *
+xbps_sha256_new(void)
+{
+	struct xbps_sha256 *s;
+
+	if ((s = malloc(sizeof(*s))) == NULL)
+		return NULL;
+	if ((s->ctx = EVP_MD_CTX_new()) == NULL ||
+	    EVP_DigestInit_ex(s->ctx, sha256_evp(), NULL) != 1) {
+		EVP_MD_CTX_free(s->ctx);
+		free(s);
+		errno = ENOMEM;
+		return NULL;
+	}
+	return s;
+}
+
+bool HIDDEN
+xbps_sha256_update(struct xbps_sha256 *s, const void *buf, size_t len)
+{
+	return EVP_DigestUpdate(s->ctx, buf, len) == 1;
+}
+
+bool HIDDEN
+xbps_sha256_final(struct xbps_sha256 *s, unsigned char *digest)
+{
+	return EVP_DigestFinal_ex(s->ctx, digest, NULL) == 1;
+}
+
+void HIDDEN
+xbps_sha256_free(struct xbps_sha256 *s)
+{
+	if (s == NULL)
+		return;
+	EVP_MD_CTX_free(s->ctx);
+	free(s);
+}
+
+bool HIDDEN
+xbps_buffer_sha256(char *dst, size_t dstlen, const void *buf, size_t len)
+{
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+
+	assert(dstlen >= XBPS_SHA256_SIZE);
+	if (dstlen < XBPS_SHA256_SIZE) {
+		errno = ENOBUFS;
+		return false;
+	}
+	if (EVP_Digest(buf, len, digest, NULL, sha256_evp(), NULL) != 1) {
+		errno = EINVAL;
+		return false;
+	}
+	digest2string(digest, dst, XBPS_SHA256_DIGEST_SIZE);
+
+	return true;
+}
+
+struct sha256_multi {
+	pthread_mutex_t lock;
+	const char *const *files;
+	char (*sha256)[XBPS_SHA256_SIZE];
+	size_t nfiles;
+	size_t next;
+	int r;
+};
+
+static void *
+sha256_multi_worker(void *arg)
+{
+	struct sha256_multi *sm = arg;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&sm->lock);
+		if (sm->next == sm->nfiles) {
+			pthread_mutex_unlock(&sm->lock);
+			break;
+		}
+		i = sm->next++;
+		pthread_mutex_unlock(&sm->lock);
+
+		if (!xbps_file_sha256(sm->sha256[i], XBPS_SHA256_SIZE, sm->files[i])) {
+			int r = -errno;
+
+			sm->sha256[i][0] = '\0';
+			pthread_mutex_lock(&sm->lock);
+			if (sm->r == 0)
+				sm->r = r;
+			pthread_mutex_unlock(&sm->lock);
+		}
+	}
+	return NULL;
+}
+
+int
+xbps_file_sha256_multi(const char *const *files, char (*sha256)[XBPS_SHA256_SIZE],
+		size_t nfiles, unsigned int nthreads)
+{
+	struct sha256_multi sm = {
+		.files = files,
+		.sha256 = sha256,
+		.nfiles = nfiles,
+	};
+	pthread_t *thds = NULL;
+	unsigned int i;
+
+	if (nthreads == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? (unsigned int)ncpu : 1;
+	}
+	if (nthreads > nfiles)
+		nthreads = nfiles;
+	if (nthreads > 1 && (thds = calloc(nthreads, sizeof(*thds))) == NULL)
+		nthreads = 1;
+
+	pthread_mutex_init(&sm.lock, NULL);
+	for (i = 0; i + 1 < nthreads; i++) {
+		if (pthread_create(&thds[i], NULL, sha256_multi_worker, &sm) != 0)
+			break;
+	}
+	/* the calling thread hashes the remaining files */
+	sha256_multi_worker(&sm);
+	while (i > 0)
+		pthread_join(thds[--i], NULL);
+	pthread_mutex_destroy(&sm.lock);
+	free(thds);
+
+	return sm.r;
+}
+
 static bool
 sha256_digest_compare(const char *sha256, size_t shalen,
 		const unsigned char *digest, size_t digestlen)
@@ -0,0 +1,22 @@
+-include $(TOPDIR)/config.mk
+
+OBJS	?= main.o
+
+.PHONY: all
+all: $(BENCH)
+
+.PHONY: clean
+clean:
+	-rm -f $(BENCH) $(OBJS)
+
+.PHONY: install uninstall
+install uninstall:
+
+%.o: %.c
+	@printf " [CC]\t\t$@\n"
+	${SILENT}$(CC) $(CPPFLAGS) $(CFLAGS) -c $<
+
+$(BENCH): $(OBJS)
+	@printf " [CCLD]\t\t$@\n"
+	${SILENT}$(CC) $^ $(CPPFLAGS) -L$(TOPDIR)/lib $(CFLAGS) \
+		$(PROG_CFLAGS) $(LDFLAGS) $(PROG_LDFLAGS) -lxbps -o $@
@@ -0,0 +1,366 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures the throughput of downloads from a local HTTP server, which
+ * runs in a thread of the benchmark and sends one file with sendfile(2),
+ * and from file:// URLs, comparing:
+ *
+ * 	- legacy: 4 KiB reads from the socket, the SHA256_* interface and
+ * 	  4 KiB writes, as xbps_fetch_file_dest_sha256() used to do.
+ * 	- http: xbps_fetch_file_dest_sha256() from the local server.
+ * 	- file: xbps_fetch_file_dest_sha256() from a file:// URL.
+ * 	- file-copy: xbps_fetch_file_dest() from a file:// URL, without
+ * 	  digest, which copies the file in the kernel.
+ *
+ * The source file is read once before the measures, so the page cache
+ * is hot and the network stack, the copies and the hashing are measured.
+ */
+
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/sha.h>
+
+#include <xbps.h>
+
+struct server {
+	int lfd;
+	int fd;
+	off_t size;
+	unsigned short port;
+	pthread_t thread;
+};
+
+static void
+die(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *
+make_file(const char *dir, const char *name, size_t size)
+{
+	char *path, buf[65536];
+	size_t done = 0;
+	int fd;
+
+	path = xbps_xasprintf("%s/%s", dir, name);
+	if ((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1)
+		die(path);
+	while (done < size) {
+		size_t len = size - done < sizeof(buf) ? size - done : sizeof(buf);
+
+		for (size_t i = 0; i < len; i++)
+			buf[i] = (char)((done + i) * 2654435761u >> 13);
+		if (write(fd, buf, len) != (ssize_t)len)
+			die(path);
+		done += len;
+	}
+	(void)close(fd);
+	return path;
+}
+
+/* one response per connection, the client sees Connection: close */
+static void
+serve_one(struct server *srv, int c)
+{
+	char req[8192], hdr[256], date[64];
+	size_t len = 0;
+	off_t off = 0;
+	time_t t = 0;
+	ssize_t n;
+	int hlen;
+
+	while (len < sizeof(req) - 1) {
+		if ((n = read(c, req + len, sizeof(req) - 1 - len)) <= 0)
+			return;
+		len += n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n"))
+			break;
+	}
+	strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&t));
+	hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+	    "Content-Length: %jd\r\nLast-Modified: %s\r\n"
+	    "Connection: close\r\n\r\n", (intmax_t)srv->size, date);
+	if (write(c, hdr, hlen) != hlen)
+		return;
+	while (off < srv->size) {
+		if (sendfile(c, srv->fd, &off, srv->size - off) <= 0)
+			return;
+	}
+}
+
+static void *
+serve(void *arg)
+{
+	struct server *srv = arg;
+	int c;
+
+	while ((c = accept(srv->lfd, NULL, NULL)) != -1) {
+		serve_one(srv, c);
+		(void)close(c);
+	}
+	return NULL;
+}
+
+static void
+server_start(struct server *srv, const char *file)
+{
+	struct sockaddr_in sin;
+	socklen_t sinlen = sizeof(sin);
+	struct stat st;
+
+	if ((srv->fd = open(file, O_RDONLY)) == -1 || fstat(srv->fd, &st) == -1)
+		die(file);
+	srv->size = st.st_size;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((srv->lfd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		die("socket");
+	if (bind(srv->lfd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(srv->lfd, 16) == -1 ||
+	    getsockname(srv->lfd, (struct sockaddr *)&sin, &sinlen) == -1)
+		die("bind");
+	srv->port = ntohs(sin.sin_port);
+	if ((errno = pthread_create(&srv->thread, NULL, serve, srv)) != 0)
+		die("pthread_create");
+}
+
+static void
+server_stop(struct server *srv)
+{
+	(void)shutdown(srv->lfd, SHUT_RDWR);
+	(void)close(srv->lfd);
+	pthread_join(srv->thread, NULL);
+	(void)close(srv->fd);
+}
+
+/* the deprecated interface is part of the baseline being measured */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+static void
+legacy_fetch(const struct server *srv, const char *dest, unsigned char *digest)
+{
+	struct sockaddr_in sin;
+	SHA256_CTX sha256;
+	char buf[4096], req[128], *body;
+	size_t len = 0;
+	ssize_t n;
+	int s, fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(srv->port);
+	if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+	    connect(s, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		die("connect");
+	n = snprintf(req, sizeof(req), "GET /file HTTP/1.1\r\n"
+	    "Host: 127.0.0.1\r\n\r\n");
+	if (write(s, req, n) != n)
+		die("write");
+	if ((fd = open(dest, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1)
+		die(dest);
+	SHA256_Init(&sha256);
+	/* skip the response headers */
+	for (;;) {
+		if ((n = read(s, buf + len, sizeof(buf) - 1 - len)) <= 0)
+			die("read");
+		len += n;
+		buf[len] = '\0';
+		if ((body = strstr(buf, "\r\n\r\n")) != NULL) {
+			body += 4;
+			n = len - (body - buf);
+			SHA256_Update(&sha256, body, n);
+			if (write(fd, body, n) != n)
+				die(dest);
+			break;
+		}
+	}
+	while ((n = read(s, buf, sizeof(buf))) > 0) {
+		SHA256_Update(&sha256, buf, n);
+		if (write(fd, buf, n) != n)
+			die(dest);
+	}
+	if (n == -1)
+		die("read");
+	SHA256_Final(digest, &sha256);
+	(void)close(fd);
+	(void)close(s);
+}
+#pragma GCC diagnostic pop
+
+static void
+report(const char *name, size_t bytes, unsigned int rounds, double elapsed)
+{
+	double mbytes = (double)bytes * rounds / (1024 * 1024);
+
+	printf("%-10s %12.3f %12.1f\n", name, elapsed, mbytes / elapsed);
+}
+
+static void
+check(const char *name, const unsigned char *digest, const unsigned char *expected)
+{
+	if (memcmp(digest, expected, XBPS_SHA256_DIGEST_SIZE) != 0) {
+		fprintf(stderr, "%s: digest mismatch\n", name);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void __attribute__((noreturn))
+usage(void)
+{
+	fprintf(stderr, "Usage: download_bench [-b MiB] [-r rounds]\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct xbps_handle xh;
+	struct server srv;
+	unsigned char expected[XBPS_SHA256_DIGEST_SIZE];
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	char dir[] = "/tmp/download_bench.XXXXXX";
+	char *src, *dest, *httpuri, *fileuri;
+	unsigned int rounds = 3;
+	size_t size = 256;
+	double start;
+	int c;
+
+	while ((c = getopt(argc, argv, "b:r:")) != -1) {
+		switch (c) {
+		case 'b':
+			size = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (size == 0 || rounds == 0)
+		usage();
+	size *= 1024 * 1024;
+
+	if (mkdtemp(dir) == NULL)
+		die("mkdtemp");
+	src = make_file(dir, "file", size);
+	dest = xbps_xasprintf("%s/dest", dir);
+	if (!xbps_file_sha256_raw(expected, sizeof(expected), src))
+		die(src);
+
+	memset(&xh, 0, sizeof(xh));
+	xbps_strlcpy(xh.rootdir, dir, sizeof(xh.rootdir));
+	xbps_strlcpy(xh.confdir, dir, sizeof(xh.confdir));
+	if ((errno = xbps_init(&xh)) != 0)
+		die("xbps_init");
+
+	server_start(&srv, src);
+	httpuri = xbps_xasprintf("http://127.0.0.1:%u/file", srv.port);
+	fileuri = xbps_xasprintf("file://%s", src);
+
+	printf("1 file of %zu MiB, %u rounds\n", size / (1024 * 1024), rounds);
+	printf("%-10s %12s %12s\n", "method", "seconds", "MB/s");
+
+	start = now();
+	for (unsigned int r = 0; r < rounds; r++) {
+		legacy_fetch(&srv, dest, digest);
+		check("legacy", digest, expected);
+		unlink(dest);
+	}
+	report("legacy", size, rounds, now() - start);
+
+	start = now();
+	for (unsigned int r = 0; r < rounds; r++) {
+		if (xbps_fetch_file_dest_sha256(&xh, httpuri, dest, NULL,
+		    digest, sizeof(digest)) == -1)
+			die(httpuri);
+		check("http", digest, expected);
+		unlink(dest);
+	}
+	report("http", size, rounds, now() - start);
+
+	start = now();
+	for (unsigned int r = 0; r < rounds; r++) {
+		if (xbps_fetch_file_dest_sha256(&xh, fileuri, dest, NULL,
+		    digest, sizeof(digest)) == -1)
+			die(fileuri);
+		check("file", digest, expected);
+		unlink(dest);
+	}
+	report("file", size, rounds, now() - start);
+
+	start = now();
+	for (unsigned int r = 0; r < rounds; r++) {
+		if (xbps_fetch_file_dest(&xh, fileuri, dest, NULL) == -1)
+			die(fileuri);
+		if (r + 1 < rounds)
+			unlink(dest);
+	}
+	report("file-copy", size, rounds, now() - start);
+	if (!xbps_file_sha256_raw(digest, sizeof(digest), dest))
+		die(dest);
+	check("file-copy", digest, expected);
+	unlink(dest);
+
+	server_stop(&srv);
+	xbps_end(&xh);
+	unlink(src);
+	free(src);
+	free(dest);
+	free(httpuri);
+	free(fileuri);
+	rmdir(dir);
+	return EXIT_SUCCESS;
+}
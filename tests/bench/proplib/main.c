@@ -0,0 +1,218 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures the throughput of a multi-threaded foreach over a pkgdb-like
+ * dictionary, with a callback retaining and releasing objects the way
+ * the xbps_array_foreach_cb_multi() users do. The work is split like
+ * xbps_array_foreach_cb_multi() does, for 1 up to -t threads.
+ *
+ * To compare two builds of libxbps run the same binary with a different
+ * LD_LIBRARY_PATH.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <xbps.h>
+
+struct bench {
+	xbps_dictionary_t dict;
+	xbps_array_t keys;
+	unsigned int nthreads;
+	unsigned int rounds;
+};
+
+struct worker {
+	pthread_t thread;
+	struct bench *b;
+	unsigned int id;
+	unsigned long ops;
+};
+
+static xbps_dictionary_t
+make_dict(unsigned int npkgs)
+{
+	xbps_dictionary_t dict;
+	char buf[64];
+
+	dict = xbps_dictionary_create();
+	for (unsigned int i = 0; i < npkgs; i++) {
+		xbps_dictionary_t pkgd = xbps_dictionary_create();
+		xbps_array_t deps = xbps_array_create();
+
+		snprintf(buf, sizeof(buf), "pkg%u-1.0_1", i);
+		xbps_dictionary_set_cstring(pkgd, "pkgver", buf);
+		xbps_dictionary_set_cstring(pkgd, "short_desc", "package");
+		xbps_dictionary_set_cstring(pkgd, "architecture", "noarch");
+		xbps_dictionary_set_uint64(pkgd, "installed_size", i);
+		xbps_dictionary_set_bool(pkgd, "automatic-install", i % 2);
+		for (unsigned int j = 1; j <= 4; j++) {
+			snprintf(buf, sizeof(buf), "pkg%u>=0", (i + j) % npkgs);
+			xbps_array_add_cstring(deps, buf);
+		}
+		xbps_dictionary_set(pkgd, "run_depends", deps);
+		xbps_object_release(deps);
+		snprintf(buf, sizeof(buf), "pkg%u", i);
+		xbps_dictionary_set(dict, buf, pkgd);
+		xbps_object_release(pkgd);
+	}
+	return dict;
+}
+
+static unsigned long
+visit(xbps_dictionary_t pkgd)
+{
+	xbps_object_iterator_t iter;
+	xbps_object_t obj;
+	xbps_array_t keys;
+	unsigned long ops = 0;
+
+	xbps_object_retain(pkgd);
+	iter = xbps_dictionary_iterator(pkgd);
+	while ((obj = xbps_object_iterator_next(iter))) {
+		xbps_object_t v = xbps_dictionary_get_keysym(pkgd, obj);
+
+		xbps_object_retain(v);
+		xbps_object_release(v);
+		ops++;
+	}
+	xbps_object_iterator_release(iter);
+	keys = xbps_dictionary_all_keys(pkgd);
+	xbps_object_release(keys);
+	xbps_object_release(pkgd);
+	return ops;
+}
+
+static void *
+worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	struct bench *b = w->b;
+	unsigned int count = xbps_array_count(b->keys);
+	unsigned int slice = 32;
+
+	for (unsigned int r = 0; r < b->rounds; r++) {
+		for (unsigned int i = w->id * slice; i < count; i += b->nthreads * slice) {
+			for (unsigned int j = i; j < i + slice && j < count; j++) {
+				xbps_dictionary_keysym_t key = xbps_array_get(b->keys, j);
+
+				w->ops += visit(xbps_dictionary_get_keysym(b->dict, key));
+			}
+		}
+	}
+	return NULL;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void __attribute__((noreturn))
+usage(void)
+{
+	fprintf(stderr, "Usage: proplib_bench [-n packages] [-r rounds] [-t threads]\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench b;
+	struct worker *w;
+	unsigned int npkgs = 20000, maxthreads;
+	double base = 0;
+	long ncpu;
+	int c;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	maxthreads = ncpu > 0 ? (unsigned int)ncpu : 1;
+	b.rounds = 20;
+
+	while ((c = getopt(argc, argv, "n:r:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			npkgs = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			b.rounds = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			maxthreads = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (npkgs == 0 || b.rounds == 0 || maxthreads == 0)
+		usage();
+
+	b.dict = make_dict(npkgs);
+	b.keys = xbps_dictionary_all_keys(b.dict);
+	if ((w = calloc(maxthreads, sizeof(*w))) == NULL)
+		return EXIT_FAILURE;
+
+	printf("%u packages, %u rounds, %ld cpus\n", npkgs, b.rounds, ncpu);
+	printf("%8s %12s %14s %8s\n", "threads", "seconds", "objects/s", "speedup");
+	for (unsigned int t = 1; t <= maxthreads; t++) {
+		unsigned long ops = 0;
+		double start, elapsed;
+
+		b.nthreads = t;
+		start = now();
+		for (unsigned int i = 0; i < t; i++) {
+			w[i].b = &b;
+			w[i].id = i;
+			w[i].ops = 0;
+			if ((errno = pthread_create(&w[i].thread, NULL, worker_thread, &w[i]))) {
+				perror("pthread_create");
+				return EXIT_FAILURE;
+			}
+		}
+		for (unsigned int i = 0; i < t; i++) {
+			pthread_join(w[i].thread, NULL);
+			ops += w[i].ops;
+		}
+		elapsed = now() - start;
+		if (t == 1)
+			base = ops / elapsed;
+		printf("%8u %12.3f %14.0f %7.2fx\n", t, elapsed, ops / elapsed,
+		    (ops / elapsed) / base);
+	}
+	free(w);
+	xbps_object_release(b.keys);
+	xbps_object_release(b.dict);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures the throughput of file hashing, in MB/s for one big file and
+ * in files/s for many small files, comparing:
+ *
+ * 	- legacy: 64 KiB reads and the SHA256_* interface, as
+ * 	  xbps_file_sha256_raw() used to do.
+ * 	- raw: xbps_file_sha256_raw().
+ * 	- multi: xbps_file_sha256_multi() with up to -t threads.
+ *
+ * The files are created in a temporary directory and read once before
+ * the measures, so the page cache is hot and only the hashing and the
+ * system calls are measured.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/sha.h>
+
+#include <xbps.h>
+
+struct bench {
+	char **files;
+	size_t nfiles;
+	size_t bytes;
+	unsigned int rounds;
+};
+
+/* the deprecated interface is the baseline being measured */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+static bool
+legacy_sha256(unsigned char *dst, const char *file)
+{
+	SHA256_CTX sha256;
+	char buf[65536];
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY)) < 0)
+		return false;
+	SHA256_Init(&sha256);
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		SHA256_Update(&sha256, buf, len);
+	(void)close(fd);
+	if (len == -1)
+		return false;
+	SHA256_Final(dst, &sha256);
+	return true;
+}
+#pragma GCC diagnostic pop
+
+static void
+die(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *
+make_file(const char *dir, const char *name, size_t size)
+{
+	char *path, buf[4096];
+	size_t done = 0;
+	int fd;
+
+	path = xbps_xasprintf("%s/%s", dir, name);
+	if ((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644)) == -1)
+		die(path);
+	while (done < size) {
+		size_t len = size - done < sizeof(buf) ? size - done : sizeof(buf);
+
+		for (size_t i = 0; i < len; i++)
+			buf[i] = (char)((done + i) * 2654435761u >> 13);
+		if (write(fd, buf, len) != (ssize_t)len)
+			die(path);
+		done += len;
+	}
+	(void)close(fd);
+	return path;
+}
+
+static void
+report(const char *name, unsigned int threads, const struct bench *b,
+		double elapsed)
+{
+	double files = (double)b->nfiles * b->rounds;
+	double mbytes = (double)b->bytes * b->rounds / (1024 * 1024);
+
+	printf("%-8s %8u %12.3f %12.1f %14.0f\n", name, threads, elapsed,
+	    mbytes / elapsed, files / elapsed);
+}
+
+static void
+run(const struct bench *b, unsigned int maxthreads)
+{
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	char (*sha256)[XBPS_SHA256_SIZE];
+	double start;
+
+	if ((sha256 = calloc(b->nfiles, sizeof(*sha256))) == NULL)
+		die("calloc");
+
+	printf("%-8s %8s %12s %12s %14s\n", "method", "threads", "seconds",
+	    "MB/s", "files/s");
+	start = now();
+	for (unsigned int r = 0; r < b->rounds; r++) {
+		for (size_t i = 0; i < b->nfiles; i++) {
+			if (!legacy_sha256(digest, b->files[i]))
+				die(b->files[i]);
+		}
+	}
+	report("legacy", 1, b, now() - start);
+
+	start = now();
+	for (unsigned int r = 0; r < b->rounds; r++) {
+		for (size_t i = 0; i < b->nfiles; i++) {
+			if (!xbps_file_sha256_raw(digest, sizeof(digest), b->files[i]))
+				die(b->files[i]);
+		}
+	}
+	report("raw", 1, b, now() - start);
+
+	for (unsigned int t = 1;; t = t * 2 < maxthreads ? t * 2 : maxthreads) {
+		start = now();
+		for (unsigned int r = 0; r < b->rounds; r++) {
+			errno = -xbps_file_sha256_multi((const char *const *)b->files, sha256, b->nfiles, t);
+			if (errno != 0)
+				die("xbps_file_sha256_multi");
+		}
+		report("multi", t, b, now() - start);
+		if (t == maxthreads)
+			break;
+	}
+	free(sha256);
+}
+
+/* all methods must agree with the legacy implementation */
+static void
+check(const struct bench *b)
+{
+	unsigned char digest[XBPS_SHA256_DIGEST_SIZE];
+	char (*sha256)[XBPS_SHA256_SIZE], hex[XBPS_SHA256_SIZE];
+
+	if ((sha256 = calloc(b->nfiles, sizeof(*sha256))) == NULL)
+		die("calloc");
+	if ((errno = -xbps_file_sha256_multi((const char *const *)b->files, sha256, b->nfiles, 0)))
+		die("xbps_file_sha256_multi");
+	for (size_t i = 0; i < b->nfiles; i++) {
+		if (!legacy_sha256(digest, b->files[i]))
+			die(b->files[i]);
+		for (size_t j = 0; j < sizeof(digest); j++)
+			snprintf(hex + j * 2, 3, "%02x", digest[j]);
+		if (strcmp(hex, sha256[i]) != 0 ||
+		    xbps_file_sha256_check(b->files[i], hex) != 0) {
+			fprintf(stderr, "%s: digest mismatch\n", b->files[i]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	free(sha256);
+}
+
+static void __attribute__((noreturn))
+usage(void)
+{
+	fprintf(stderr, "Usage: sha256_bench [-b MiB] [-n files] [-r rounds] "
+	    "[-s bytes] [-t threads]\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct bench big = { 0 }, small = { 0 };
+	char dir[] = "/tmp/sha256_bench.XXXXXX", name[32];
+	unsigned int maxthreads, rounds = 3;
+	size_t bigsize = 256, nsmall = 5000, smallsize = 4096;
+	long ncpu;
+	int c;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	maxthreads = ncpu > 0 ? (unsigned int)ncpu : 1;
+
+	while ((c = getopt(argc, argv, "b:n:r:s:t:")) != -1) {
+		switch (c) {
+		case 'b':
+			bigsize = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			nsmall = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rounds = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			smallsize = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			maxthreads = (unsigned int)strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (bigsize == 0 || nsmall == 0 || rounds == 0 || maxthreads == 0)
+		usage();
+
+	if (mkdtemp(dir) == NULL)
+		die("mkdtemp");
+
+	big.rounds = small.rounds = rounds;
+	big.nfiles = 1;
+	big.bytes = bigsize * 1024 * 1024;
+	if ((big.files = calloc(1, sizeof(*big.files))) == NULL)
+		die("calloc");
+	big.files[0] = make_file(dir, "big", big.bytes);
+
+	small.nfiles = nsmall;
+	small.bytes = nsmall * smallsize;
+	if ((small.files = calloc(nsmall, sizeof(*small.files))) == NULL)
+		die("calloc");
+	for (size_t i = 0; i < nsmall; i++) {
+		snprintf(name, sizeof(name), "small%zu", i);
+		small.files[i] = make_file(dir, name, smallsize);
+	}
+
+	check(&big);
+	check(&small);
+
+	printf("1 file of %zu MiB, %u rounds, %ld cpus\n", bigsize, rounds, ncpu);
+	run(&big, 1);
+	printf("\n%zu files of %zu bytes, %u rounds, %ld cpus\n", nsmall,
+	    smallsize, rounds, ncpu);
+	run(&small, maxthreads);
+
+	unlink(big.files[0]);
+	free(big.files[0]);
+	free(big.files);
+	for (size_t i = 0; i < nsmall; i++) {
+		unlink(small.files[i]);
+		free(small.files[i]);
+	}
+	free(small.files);
+	rmdir(dir);
+	return EXIT_SUCCESS;
+}
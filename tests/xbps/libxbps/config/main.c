@@ -377,6 +377,51 @@ ATF_TC_BODY(config_no_trailing_newline, tc)
 	ATF_REQUIRE_STREQ(repo, "test");
 }
 
+ATF_TC(config_fetch_jobs);
+ATF_TC_HEAD(config_fetch_jobs, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test parallel download limits");
+}
+
+ATF_TC_BODY(config_fetch_jobs, tc)
+{
+	struct xbps_handle xh;
+	const char *tcsdir;
+	char *buf, *buf2, pwd[PATH_MAX];
+	int ret;
+
+	/* get test source dir */
+	tcsdir = atf_tc_get_config_var(tc, "srcdir");
+
+	memset(&xh, 0, sizeof(xh));
+	buf = getcwd(pwd, sizeof(pwd));
+
+	xbps_strlcpy(xh.rootdir, tcsdir, sizeof(xh.rootdir));
+	xbps_strlcpy(xh.metadir, tcsdir, sizeof(xh.metadir));
+	ret = snprintf(xh.confdir, sizeof(xh.confdir), "%s/xbps.d", pwd);
+	ATF_REQUIRE_EQ((ret >= 0), 1);
+	ATF_REQUIRE_EQ(((size_t)ret < sizeof(xh.confdir)), 1);
+	ret = snprintf(xh.sysconfdir, sizeof(xh.sysconfdir), "%s/sys-xbps.d", pwd);
+	ATF_REQUIRE_EQ((ret >= 0), 1);
+	ATF_REQUIRE_EQ(((size_t)ret < sizeof(xh.sysconfdir)), 1);
+
+	ATF_REQUIRE_EQ(xbps_mkpath(xh.confdir, 0755), 0);
+	ATF_REQUIRE_EQ(xbps_mkpath(xh.sysconfdir, 0755), 0);
+
+	buf = xbps_xasprintf("%s/fetchjobs.cf", tcsdir);
+	buf2 = xbps_xasprintf("%s/xbps.d/1.conf", pwd);
+	ATF_REQUIRE_EQ(symlink(buf, buf2), 0);
+	free(buf);
+	free(buf2);
+
+	xh.flags = XBPS_FLAG_DEBUG;
+	ATF_REQUIRE_EQ(xbps_init(&xh), 0);
+
+	ATF_REQUIRE_EQ(xh.fetch_jobs, 8);
+	/* capped to the libfetch per host connection cache limit */
+	ATF_REQUIRE_EQ(xh.fetch_host_jobs, XBPS_FETCH_CACHECONN_HOST);
+}
+
 ATF_TP_ADD_TCS(tp)
 {
 	ATF_TP_ADD_TC(tp, config_include_test);
@@ -386,6 +431,7 @@ ATF_TP_ADD_TCS(tp)
 	ATF_TP_ADD_TC(tp, config_masking);
 	ATF_TP_ADD_TC(tp, config_trim_values);
 	ATF_TP_ADD_TC(tp, config_no_trailing_newline);
+	ATF_TP_ADD_TC(tp, config_fetch_jobs);
 
 	return atf_no_error();
 }
@@ -0,0 +1,165 @@
+/*-
+ * Copyright (c) 2026 XBPS contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *-
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atf-c.h>
+#include <xbps.h>
+
+/* Big enough to use the hash table of big dictionaries. */
+#define NKEYS	1000
+
+static void
+check_dictionary(xbps_dictionary_t d, const bool *present)
+{
+	xbps_array_t keys;
+	const char *prev = NULL;
+	unsigned int count = 0;
+	char key[16];
+
+	for (unsigned int i = 0; i < NKEYS; i++) {
+		int32_t v = -1;
+
+		snprintf(key, sizeof(key), "key%04u", i);
+		ATF_REQUIRE_EQ(xbps_dictionary_get_int32(d, key, &v), present[i]);
+		if (present[i]) {
+			ATF_REQUIRE_EQ(v, (int32_t)i);
+			count++;
+		}
+	}
+	ATF_REQUIRE_EQ(xbps_dictionary_count(d), count);
+
+	keys = xbps_dictionary_all_keys(d);
+	ATF_REQUIRE_EQ(xbps_array_count(keys), count);
+	for (unsigned int i = 0; i < xbps_array_count(keys); i++) {
+		const char *k;
+
+		k = xbps_dictionary_keysym_cstring_nocopy(xbps_array_get(keys, i));
+		if (prev != NULL)
+			ATF_REQUIRE(strcmp(prev, k) < 0);
+		prev = k;
+	}
+	xbps_object_release(keys);
+}
+
+ATF_TC(dictionary_sorted_test);
+ATF_TC_HEAD(dictionary_sorted_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test big dictionaries built in key order");
+}
+
+ATF_TC_BODY(dictionary_sorted_test, tc)
+{
+	xbps_dictionary_t d, d2;
+	bool present[NKEYS];
+	char key[16], *xml;
+
+	d = xbps_dictionary_create();
+	ATF_REQUIRE(d != NULL);
+	for (unsigned int i = 0; i < NKEYS; i++) {
+		snprintf(key, sizeof(key), "key%04u", i);
+		ATF_REQUIRE(xbps_dictionary_set_int32(d, key, (int32_t)i));
+		present[i] = true;
+	}
+	check_dictionary(d, present);
+
+	xml = xbps_dictionary_externalize(d);
+	ATF_REQUIRE(xml != NULL);
+	d2 = xbps_dictionary_internalize(xml);
+	ATF_REQUIRE(d2 != NULL);
+	check_dictionary(d2, present);
+	ATF_REQUIRE(xbps_dictionary_equals(d, d2));
+
+	xbps_object_release(d2);
+	xbps_object_release(d);
+	free(xml);
+}
+
+ATF_TC(dictionary_random_test);
+ATF_TC_HEAD(dictionary_random_test, tc)
+{
+	atf_tc_set_md_var(tc, "descr", "Test big dictionaries with random updates");
+}
+
+ATF_TC_BODY(dictionary_random_test, tc)
+{
+	xbps_dictionary_t d, copy;
+	bool present[NKEYS];
+	char key[16];
+	unsigned int seed = 1;
+
+	memset(present, 0, sizeof(present));
+	d = xbps_dictionary_create();
+	ATF_REQUIRE(d != NULL);
+	for (unsigned int i = 0; i < 20 * NKEYS; i++) {
+		unsigned int k;
+
+		seed = seed * 1103515245 + 12345;
+		k = (seed >> 8) % NKEYS;
+		snprintf(key, sizeof(key), "key%04u", k);
+		if ((seed >> 4) % 3) {
+			ATF_REQUIRE(xbps_dictionary_set_int32(d, key, (int32_t)k));
+			present[k] = true;
+		} else {
+			xbps_dictionary_remove(d, key);
+			present[k] = false;
+		}
+		if (i % NKEYS == 0)
+			check_dictionary(d, present);
+	}
+	check_dictionary(d, present);
+
+	copy = xbps_dictionary_copy_mutable(d);
+	ATF_REQUIRE(copy != NULL);
+	check_dictionary(copy, present);
+	ATF_REQUIRE(xbps_dictionary_equals(d, copy));
+
+	/* Empty the dictionary and fill it again. */
+	for (unsigned int i = 0; i < NKEYS; i++) {
+		snprintf(key, sizeof(key), "key%04u", i);
+		xbps_dictionary_remove(copy, key);
+		present[i] = false;
+	}
+	check_dictionary(copy, present);
+	for (unsigned int i = 0; i < NKEYS; i += 2) {
+		snprintf(key, sizeof(key), "key%04u", i);
+		ATF_REQUIRE(xbps_dictionary_set_int32(copy, key, (int32_t)i));
+		present[i] = true;
+	}
+	check_dictionary(copy, present);
+
+	xbps_object_release(copy);
+	xbps_object_release(d);
+}
+
+ATF_TP_ADD_TCS(tp)
+{
+	ATF_TP_ADD_TC(tp, dictionary_sorted_test);
+	ATF_TP_ADD_TC(tp, dictionary_random_test);
+
+	return atf_no_error();
+}
@@ -31,6 +31,69 @@ EOF
 	atf_check_equal $perms 644
 }
 
+create_post_script() {
+	mkdir -p "$1"
+	cat > "$1/INSTALL" <<EOF
+#!/bin/sh
+case "\$1" in
+post)
+	$2
+	echo "\$2" >> log
+	;;
+esac
+EOF
+	chmod 755 "$1/INSTALL"
+}
+
+create_parallel_repo() {
+	create_post_script pkg_A "$1"
+	create_post_script pkg_B ":"
+	create_post_script pkg_C ":"
+	mkdir -p repo root/xbps.d
+	echo "configurejobs=4" > root/xbps.d/jobs.conf
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "A>=0" ../pkg_B
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" ../pkg_C
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+}
+
+atf_test_case parallel
+
+parallel_head() {
+	atf_set "descr" "Tests for pkg configuration: parallel configuration after dependencies"
+}
+
+parallel_body() {
+	create_parallel_repo "sleep 1"
+	atf_check -o ignore -- xbps-install -C xbps.d -r root --repository=$PWD/repo -y A B C
+	# C doesn't wait for A, B does
+	atf_check -o inline:"C\nA\nB\n" -- cat root/log
+	atf_check -o inline:"A-1.0_1\nB-1.0_1\nC-1.0_1\n" -- \
+		sh -c "xbps-query -r root -l | grep ^ii | cut -d ' ' -f 2"
+
+	rm root/log
+	atf_check -o ignore -- xbps-reconfigure -C xbps.d -r root -fa
+	atf_check -o inline:"C\nA\nB\n" -- cat root/log
+}
+
+atf_test_case parallel_fail
+
+parallel_fail_head() {
+	atf_set "descr" "Tests for pkg configuration: parallel configuration failures"
+}
+
+parallel_fail_body() {
+	create_parallel_repo "exit 1"
+	atf_check -s not-exit:0 -o ignore \
+		-e match:"B-1.0_1: \\[configure\\] not configured, dependency A-1.0_1 failed" -- \
+		xbps-install -C xbps.d -r root --repository=$PWD/repo -y A B C
+	atf_check -o inline:"C\n" -- cat root/log
+}
+
 atf_init_test_cases() {
 	atf_add_test_case filemode
+	atf_add_test_case parallel
+	atf_add_test_case parallel_fail
 }
@@ -772,12 +772,46 @@ update_issue_218_body() {
 	atf_check_equal $? 0
 }
 
+atf_test_case install_many
+
+install_many_head() {
+	atf_set "descr" "Tests for pkg installations: more packages than binary package handles kept open"
+}
+
+install_many_body() {
+	mkdir -p repo
+	for i in $(seq 1 12); do
+		mkdir -p pkg_$i/usr/share/pkg$i
+		for j in $(seq 1 $((i * 10))); do
+			echo "$i $j" > pkg_$i/usr/share/pkg$i/file$j
+		done
+		printf '#!/bin/sh\n[ "$1" = post ] && echo $1 > usr/share/pkg%s/$1\nexit 0\n' $i > pkg_$i/INSTALL
+		chmod +x pkg_$i/INSTALL
+		cd repo
+		xbps-create -A noarch -n pkg$i-1.0_1 -s "pkg$i" ../pkg_$i
+		atf_check_equal $? 0
+		cd ..
+	done
+	xbps-rindex -d -a $PWD/repo/*.xbps
+	atf_check_equal $? 0
+	pkgs=$(seq -f 'pkg%g' 1 12)
+	xbps-install -r root --repository=$PWD/repo -yd $pkgs
+	atf_check_equal $? 0
+	for i in $(seq 1 12); do
+		atf_check_equal $(ls root/usr/share/pkg$i | wc -l) $((i * 10 + 1))
+		atf_check_equal "$(cat root/usr/share/pkg$i/post)" post
+		atf_check_equal "$(cat root/usr/share/pkg$i/file$i)" "$i $i"
+		atf_check_equal $(xbps-query -r root -f pkg$i | wc -l) $((i * 10))
+	done
+}
+
 atf_init_test_cases() {
 	atf_add_test_case install_empty
 	atf_add_test_case install_with_deps
 	atf_add_test_case install_with_vpkg_deps
 	atf_add_test_case install_if_not_installed_on_update
 	atf_add_test_case install_dups
+	atf_add_test_case install_many
 	atf_add_test_case install_bestmatch
 	atf_add_test_case install_bestmatch_deps
 	atf_add_test_case install_bestmatch_disabled
@@ -56,6 +56,33 @@ tc1_body() {
 
 }
 
+atf_test_case tc2
+
+tc2_head() {
+	atf_set "descr" "Tests for pkg orphans: shared dependencies are orphans once all revdeps are"
+}
+
+tc2_body() {
+	mkdir -p repo pkg_A
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --dependencies "B>=0 C>=0" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "D>=0" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" --dependencies "D>=0" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n D-1.0_1 -s "D pkg" --dependencies "E>=0" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n E-1.0_1 -s "E pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n F-1.0_1 -s "F pkg" --dependencies "E>=0" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repo=repo -y A F
+	atf_check -o empty -- xbps-query -r root -O
+	atf_check -- xbps-pkgdb -r root -m auto A
+	# revdeps are listed before their dependencies
+	atf_check -o inline:"A-1.0_1\nB-1.0_1\nC-1.0_1\nD-1.0_1\n" -- xbps-query -r root -O
+	atf_check -o ignore -- xbps-remove -r root -yo
+	atf_check -o inline:"E-1.0_1\nF-1.0_1\n" -- sh -c "xbps-query -r root -l | cut -d ' ' -f 2"
+}
+
 atf_init_test_cases() {
 	atf_add_test_case tc1
+	atf_add_test_case tc2
 }
@@ -0,0 +1,93 @@
+#!/usr/bin/env atf-sh
+
+METADIR=root/var/db/xbps
+
+create_repo() {
+	mkdir -p repo pkg_A/usr/bin pkg_A/etc pkg_B/usr/lib
+	echo A > pkg_A/usr/bin/A
+	echo conf > pkg_A/etc/A.conf
+	ln -s A pkg_A/usr/bin/A2
+	echo B > pkg_B/usr/lib/B
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --config-files "/etc/A.conf" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_B
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+}
+
+atf_test_case batched
+
+batched_head() {
+	atf_set "descr" "Tests for package files plists: written along with the pkgdb"
+}
+
+batched_body() {
+	create_repo
+	atf_check -o ignore -- xbps-install -r root --repository=$PWD/repo -y A B
+	atf_check -- test -s $METADIR/.A-files.plist
+	atf_check -- test -s $METADIR/.B-files.plist
+	# no temporary files are left behind
+	atf_check -o inline:"2\n" -- sh -c "ls -A $METADIR | grep -c files.plist"
+	# the hash recorded in the pkgdb matches the plist
+	atf_check -o ignore -- xbps-pkgdb -r root -a
+	atf_check -o match:"/usr/lib/B" -- xbps-query -r root -f B
+
+	atf_check -o ignore -- xbps-remove -r root -y B
+	atf_check -s exit:1 -- test -e $METADIR/.B-files.plist
+	atf_check -- test -s $METADIR/.A-files.plist
+	atf_check -o ignore -- xbps-pkgdb -r root -a
+}
+
+atf_test_case from_index
+
+from_index_head() {
+	atf_set "descr" "Tests for package files plists: read from the files index"
+}
+
+from_index_body() {
+	create_repo
+	atf_check -o ignore -- xbps-install -r root --repository=$PWD/repo -y A B
+	atf_check -- test -s $METADIR/files.idx
+	xbps-query -r root -f A > A.files
+	atf_check -o match:"/etc/A.conf" -- cat A.files
+	atf_check -o match:"/usr/bin/A2 -> /usr/bin/A" -- cat A.files
+
+	# the plists are not read for packages in the index
+	mv $METADIR/.A-files.plist A-files.plist
+	atf_check -o file:A.files -- xbps-query -r root -f A
+	atf_check -o ignore -- xbps-install -r root --repository=$PWD/repo -yf A
+	atf_check -- cmp A-files.plist $METADIR/.A-files.plist
+
+	# without index the plists are read
+	rm $METADIR/files.idx
+	atf_check -o file:A.files -- xbps-query -r root -f A
+	mv $METADIR/.A-files.plist A-files.plist
+	atf_check -s exit:2 -o empty -e ignore -- xbps-query -r root -f A
+}
+
+atf_test_case many_fds
+
+many_fds_head() {
+	atf_set "descr" "Tests for package files plists: more packages than open files allowed"
+}
+
+many_fds_body() {
+	mkdir -p repo
+	cd repo
+	for i in $(seq 200); do
+		mkdir -p ../pkg_$i/usr/share/$i
+		echo $i > ../pkg_$i/usr/share/$i/file
+		atf_check -o ignore -- xbps-create -A noarch -n pkg$i-1.0_1 -s "pkg$i" ../pkg_$i
+	done
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- sh -c "ulimit -n 128 && xbps-install -r root --repository=$PWD/repo -y \$(seq -f pkg%g 200)"
+	atf_check -o inline:"200\n" -- sh -c "ls -A $METADIR | grep -c 'files.plist$'"
+	atf_check -o ignore -- xbps-pkgdb -r root -a
+}
+
+atf_init_test_cases() {
+	atf_add_test_case batched
+	atf_add_test_case many_fds
+	atf_add_test_case from_index
+}
@@ -0,0 +1,129 @@
+#!/usr/bin/env atf-sh
+
+PKGDB=root/var/db/xbps/pkgdb-0.38.plist
+
+create_repo() {
+	mkdir -p repo pkg_A root/xbps.d
+	echo "pkgdbjournal=true" > root/xbps.d/journal.conf
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --provides "vA-1_1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "vA>=0" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+}
+
+atf_test_case unchanged
+
+unchanged_head() {
+	atf_set "descr" "Tests for the pkgdb: an unchanged pkgdb is not written"
+}
+
+unchanged_body() {
+	create_repo
+	rm root/xbps.d/journal.conf
+	atf_check -o ignore -- xbps-install -C xbps.d -r root --repository=$PWD/repo -y A
+	cp $PKGDB pkgdb.plist
+	touch -d "2000-01-01" $PKGDB
+	atf_check -o ignore -e match:"unchanged, nothing to flush" -- xbps-pkgdb -C xbps.d -r root -d -a
+	atf_check -o match:"^2000-01-01" -- stat -c %y $PKGDB
+	atf_check -- cmp pkgdb.plist $PKGDB
+}
+
+atf_test_case journal
+
+journal_head() {
+	atf_set "descr" "Tests for the pkgdb journal: changes are appended and replayed"
+}
+
+journal_body() {
+	create_repo
+	atf_check -o ignore -- xbps-install -C xbps.d -r root --repository=$PWD/repo -y A
+	cp $PKGDB pkgdb.plist
+	atf_check -o ignore -- xbps-install -C xbps.d -r root --repository=$PWD/repo -y B C
+	atf_check -o ignore -- xbps-remove -C xbps.d -r root -y C
+	atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m hold A
+	# the plist was not written again
+	atf_check -- cmp pkgdb.plist $PKGDB
+	atf_check -- test -s $PKGDB.journal
+	atf_check -o inline:"A-1.0_1\nB-1.0_1\n" -- sh -c "xbps-query -r root -l | cut -d ' ' -f 2"
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root -H
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root --fulldeptree -x B
+
+	# without a snapshot the journal is replayed on the plist
+	rm -f $PKGDB.cache
+	atf_check -o inline:"A-1.0_1\nB-1.0_1\n" -- sh -c "xbps-query -r root -l | cut -d ' ' -f 2"
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root --fulldeptree -x B
+
+	# disabling the journal merges it into the plist
+	rm root/xbps.d/journal.conf
+	atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m unhold A
+	atf_check -s exit:1 -- test -e $PKGDB.journal
+	atf_check -o inline:"A-1.0_1\nB-1.0_1\n" -- sh -c "xbps-query -r root -l | cut -d ' ' -f 2"
+	atf_check -o empty -- xbps-query -r root -H
+}
+
+atf_test_case journal_torn
+
+journal_torn_head() {
+	atf_set "descr" "Tests for the pkgdb journal: a torn record is ignored"
+}
+
+journal_torn_body() {
+	create_repo
+	atf_check -o ignore -- xbps-install -C xbps.d -r root --repository=$PWD/repo -y A
+	atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m hold A
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root -H
+	rm -f $PKGDB.cache
+	truncate -s -10 $PKGDB.journal
+	atf_check -o empty -- xbps-query -r root -H
+	atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m hold A
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root -H
+}
+
+atf_test_case journal_stale
+
+journal_stale_head() {
+	atf_set "descr" "Tests for the pkgdb journal: ignored once the pkgdb plist changes"
+}
+
+journal_stale_body() {
+	create_repo
+	atf_check -o ignore -- xbps-install -C xbps.d -r root --repository=$PWD/repo -y A
+	atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m hold A
+	cp $PKGDB.journal stale.journal
+	rm root/xbps.d/journal.conf
+	atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m unhold A
+	cp stale.journal $PKGDB.journal
+	atf_check -o empty -- xbps-query -r root -H
+}
+
+atf_test_case journal_compact
+
+journal_compact_head() {
+	atf_set "descr" "Tests for the pkgdb journal: compacted when it grows too big"
+}
+
+journal_compact_body() {
+	create_repo
+	atf_check -o ignore -- xbps-install -C xbps.d -r root --repository=$PWD/repo -y A
+	i=0
+	while [ $i -lt 40 ]; do
+		atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m hold A
+		atf_check -o ignore -- xbps-pkgdb -C xbps.d -r root -m unhold A
+		i=$((i+1))
+	done
+	# 80 records of ~1KiB are over the 64KiB limit
+	size=$(stat -c %s $PKGDB.journal 2>/dev/null || echo 0)
+	atf_check -- test $size -lt 65536
+	atf_check -o empty -- xbps-query -r root -H
+	atf_check -o inline:"A-1.0_1\n" -- sh -c "xbps-query -r root -l | cut -d ' ' -f 2"
+}
+
+atf_init_test_cases() {
+	atf_add_test_case unchanged
+	atf_add_test_case journal
+	atf_add_test_case journal_torn
+	atf_add_test_case journal_stale
+	atf_add_test_case journal_compact
+}
@@ -0,0 +1,84 @@
+#!/usr/bin/env atf-sh
+
+atf_test_case snapshot
+
+snapshot_head() {
+	atf_set "descr" "Tests for the pkgdb snapshot: written on flush and used by queries"
+}
+
+snapshot_body() {
+	mkdir -p repo pkg_A
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --provides "vA-1_1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "vA>=0" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=$PWD/repo -y B
+	atf_check -- test -s root/var/db/xbps/pkgdb-0.38.plist.cache
+	atf_check -o ignore -e match:"loaded snapshot" -- xbps-query -r root -d -l
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root --fulldeptree -x B
+
+	# corrupted snapshot is ignored
+	echo garbage > root/var/db/xbps/pkgdb-0.38.plist.cache
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root --fulldeptree -x B
+	atf_check -o ignore -e match:"ignoring snapshot" -- xbps-query -r root -d -l
+
+	# and only regenerated with the pkgdb locked
+	atf_check -o ignore -e ignore -- xbps-pkgdb -r root -a
+	atf_check -o ignore -e match:"loaded snapshot" -- xbps-query -r root -d -l
+}
+
+atf_test_case snapshot_stale
+
+snapshot_stale_head() {
+	atf_set "descr" "Tests for the pkgdb snapshot: ignored once the pkgdb plist changes"
+}
+
+snapshot_stale_body() {
+	mkdir -p repo pkg_A
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=$PWD/repo -y A
+	cp root/var/db/xbps/pkgdb-0.38.plist.cache stale.cache
+	atf_check -o ignore -- xbps-pkgdb -r root -m hold A
+	cp stale.cache root/var/db/xbps/pkgdb-0.38.plist.cache
+	atf_check -o inline:"A-1.0_1\n" -- xbps-query -r root -H
+}
+
+atf_test_case snapshot_shlibs
+
+snapshot_shlibs_head() {
+	atf_set "descr" "Tests for the pkgdb snapshot: shlibs index used by transactions"
+}
+
+snapshot_shlibs_body() {
+	mkdir -p repo pkg_A
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --shlib-provides "libfoo.so.1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "A>=0" --shlib-requires "libfoo.so.1" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=$PWD/repo -y B
+	atf_check -o ignore -- xbps-install -r root --repository=$PWD/repo -y C
+
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n A-2.0_1 -s "A pkg" --shlib-provides "libfoo.so.2" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -s exit:8 -o ignore -e match:"B-1.0_1: broken, unresolvable shlib \`libfoo.so.1'" -- \
+		xbps-install -r root --repository=$PWD/repo -yu A
+
+	# the same result without a snapshot
+	rm root/var/db/xbps/pkgdb-0.38.plist.cache
+	atf_check -s exit:8 -o ignore -e match:"B-1.0_1: broken, unresolvable shlib \`libfoo.so.1'" -- \
+		xbps-install -r root --repository=$PWD/repo -yu A
+}
+
+atf_init_test_cases() {
+	atf_add_test_case snapshot
+	atf_add_test_case snapshot_stale
+	atf_add_test_case snapshot_shlibs
+}
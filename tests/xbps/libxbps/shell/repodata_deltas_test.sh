@@ -0,0 +1,127 @@
+#!/usr/bin/env atf-sh
+
+# Serves the `repo' directory over HTTP, sets $REPO to its url.
+start_httpd() {
+	python3 -u -m http.server -b 127.0.0.1 -d repo 0 >httpd.log 2>&1 &
+	echo $! > httpd.pid
+	for i in $(seq 50); do
+		port=$(sed -n 's/.* port \([0-9]*\) .*/\1/p' httpd.log)
+		[ -n "$port" ] && break
+		sleep 0.1
+	done
+	[ -n "$port" ] || atf_fail "failed to start the HTTP server"
+	REPO=http://127.0.0.1:$port
+}
+
+stop_httpd() {
+	[ -e httpd.pid ] && kill $(cat httpd.pid)
+	rm -f httpd.pid
+}
+
+# Prints the plists of the repodata synced to the metadir of root $1.
+synced_repodata() {
+	for f in index.plist index-meta.plist stage.plist; do
+		tar -xOf $1/var/db/xbps/http___127_0_0_1_${port}_/$(xbps-uhelper arch)-repodata $f
+	done
+}
+
+atf_test_case apply
+
+apply_head() {
+	atf_set "descr" "Tests for repodata deltas: applied deltas match a full fetch"
+	atf_set "require.progs" "python3"
+	atf_set "has.cleanup" "true"
+}
+
+apply_body() {
+	mkdir -p repo pkg_A
+	touch pkg_A/file00
+	cd repo
+	for p in a b c d e; do
+		atf_check -o ignore -- xbps-create -A noarch -n $p-1.0_1 -s "$p pkg" ../pkg_A
+	done
+	atf_check -o ignore -e ignore -- xbps-rindex --compression none --deltas -a $PWD/*.xbps
+	cd ..
+	start_httpd
+	atf_check -o ignore -e ignore -- xbps-install -r root --repository=$REPO -S
+
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n a-1.1_1 -s "a pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n f-1.0_1 -s "f pkg" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex --compression none --deltas -a $PWD/a-1.1_1.noarch.xbps
+	atf_check -o ignore -e ignore -- xbps-rindex --compression none --deltas -a $PWD/f-1.0_1.noarch.xbps
+	cd ..
+	atf_check -o ignore -e match:"applied 2 repodata deltas" -- \
+		xbps-install -r root --repository=$REPO -Sd
+
+	atf_check -o ignore -e ignore -- xbps-install -r full --repository=$REPO -S
+	synced_repodata full > full.out
+	atf_check -o file:full.out -- synced_repodata root
+	atf_check -o match:"a-1.1_1" -o match:"f-1.0_1" -- \
+		xbps-query -r root --repository=$REPO -Rs ''
+	stop_httpd
+}
+
+apply_cleanup() {
+	stop_httpd
+}
+
+atf_test_case fallback
+
+fallback_head() {
+	atf_set "descr" "Tests for repodata deltas: invalid deltas fall back to a full fetch"
+	atf_set "require.progs" "python3"
+	atf_set "has.cleanup" "true"
+}
+
+fallback_body() {
+	mkdir -p repo pkg_A
+	touch pkg_A/file00
+	cd repo
+	for p in a b c d e; do
+		atf_check -o ignore -- xbps-create -A noarch -n $p-1.0_1 -s "$p pkg" ../pkg_A
+	done
+	atf_check -o ignore -e ignore -- xbps-rindex --compression none --deltas -a $PWD/*.xbps
+	cd ..
+	start_httpd
+	atf_check -o ignore -e ignore -- xbps-install -r root --repository=$REPO -S
+
+	# corrupt delta, HTTP mtimes have a resolution of a second
+	sleep 1
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n a-1.1_1 -s "a pkg" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex --compression none --deltas -a $PWD/a-1.1_1.noarch.xbps
+	prev=$(xbps-uhelper arch)-repodata.$(xbps-digest $(xbps-uhelper arch)-repodata).delta
+	cp $prev prev.delta
+	echo garbage > $prev
+	cd ..
+	atf_check -o ignore -e match:"repodata deltas: Invalid argument" -- \
+		xbps-install -r root --repository=$REPO -Sd
+	atf_check -o ignore -e ignore -- xbps-install -r full --repository=$REPO -S
+	synced_repodata full > full.out
+	atf_check -o file:full.out -- synced_repodata root
+
+	# delta for another repodata
+	sleep 1
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n b-1.1_1 -s "b pkg" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-rindex --compression none --deltas -a $PWD/b-1.1_1.noarch.xbps
+	cp prev.delta $(xbps-uhelper arch)-repodata.$(xbps-digest $(xbps-uhelper arch)-repodata).delta
+	cd ..
+	atf_check -o ignore -e match:"repodata deltas: Invalid argument" -- \
+		xbps-install -r root --repository=$REPO -Sd
+	atf_check -o ignore -e ignore -- xbps-install -r full --repository=$REPO -S
+	synced_repodata full > full.out
+	atf_check -o file:full.out -- synced_repodata root
+	atf_check -o match:"b-1.1_1" -- xbps-query -r root --repository=$REPO -Rs b
+	stop_httpd
+}
+
+fallback_cleanup() {
+	stop_httpd
+}
+
+atf_init_test_cases() {
+	atf_add_test_case apply
+	atf_add_test_case fallback
+}
@@ -212,8 +212,77 @@ script_action_body() {
 	atf_check_equal $? 0
 }
 
+atf_test_case triggers_once
+
+triggers_once_head() {
+	atf_set "descr" "Tests for package triggers: run once per transaction"
+}
+
+triggers_once_body() {
+	mkdir some_repo root
+	mkdir -p pkg_T/usr/libexec/xbps-batch-triggers pkg_A/usr/bin pkg_B/usr/bin pkg_C/usr/bin
+	cat > pkg_T/usr/libexec/xbps-batch-triggers/log <<_EOF
+#!/bin/sh
+echo "\$@" >> trigger.log
+_EOF
+	chmod +x pkg_T/usr/libexec/xbps-batch-triggers/log
+	echo A > pkg_A/usr/bin/A
+	echo B > pkg_B/usr/bin/B
+	echo C > pkg_C/usr/bin/C
+
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n T-1.0_1 -s "T pkg" ../pkg_T
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --dependencies "T>=0" --triggers "log" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n B-1.0_1 -s "B pkg" --dependencies "T>=0" --triggers "log missing" ../pkg_B
+	atf_check -o ignore -- xbps-create -A noarch -n C-1.0_1 -s "C pkg" --dependencies "T>=0" --triggers "log" ../pkg_C
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o match:"1 trigger run for 3 packages, 2 runs saved" -- \
+		xbps-install -C empty.conf -r root --repository=$PWD/some_repo -y A B C
+	atf_check -o inline:"run-batch post-install A B C\n" -- cat root/trigger.log
+
+	rm root/trigger.log
+	atf_check -o match:"Running trigger \`log' for 2 packages" -- \
+		xbps-reconfigure -C empty.conf -r root -f A C
+	atf_check -o inline:"run-batch post-install A C\n" -- cat root/trigger.log
+
+	# packages without triggers don't run any
+	rm root/trigger.log
+	atf_check -o ignore -- xbps-reconfigure -C empty.conf -r root -f T
+	atf_check -s exit:1 -- test -e root/trigger.log
+}
+
+atf_test_case triggers_fail
+
+triggers_fail_head() {
+	atf_set "descr" "Tests for package triggers: failed triggers keep packages configured"
+}
+
+triggers_fail_body() {
+	mkdir some_repo root
+	mkdir -p pkg_T/usr/libexec/xbps-batch-triggers pkg_A/usr/bin
+	cat > pkg_T/usr/libexec/xbps-batch-triggers/fail <<_EOF
+#!/bin/sh
+exit 1
+_EOF
+	chmod +x pkg_T/usr/libexec/xbps-batch-triggers/fail
+	echo A > pkg_A/usr/bin/A
+
+	cd some_repo
+	atf_check -o ignore -- xbps-create -A noarch -n T-1.0_1 -s "T pkg" ../pkg_T
+	atf_check -o ignore -- xbps-create -A noarch -n A-1.0_1 -s "A pkg" --dependencies "T>=0" --triggers "fail" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -s not-exit:0 -o ignore -e match:"trigger \`fail' failed" -- \
+		xbps-install -C empty.conf -r root --repository=$PWD/some_repo -y A
+	atf_check -o inline:"installed\n" -- xbps-query -C empty.conf -r root -p state A
+	atf_check -o inline:"installed\n" -- xbps-query -C empty.conf -r root -p state T
+}
+
 atf_init_test_cases() {
 	atf_add_test_case script_nargs
 	atf_add_test_case script_arch
 	atf_add_test_case script_action
+	atf_add_test_case triggers_once
+	atf_add_test_case triggers_fail
 }
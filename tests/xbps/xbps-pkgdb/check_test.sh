@@ -0,0 +1,85 @@
+#! /usr/bin/env atf-sh
+# Test that xbps-pkgdb(1) checks work as expected.
+
+atf_test_case files_cache
+
+files_cache_head() {
+	atf_set "descr" "xbps-pkgdb(1): files modified after being verified are hashed"
+}
+
+files_cache_body() {
+	mkdir -p repo pkg_A/usr/bin
+	echo "original" > pkg_A/usr/bin/foo
+	echo "bar" > pkg_A/usr/bin/bar
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -r root --repository=$PWD/repo -yd A
+	atf_check_equal $? 0
+
+	xbps-pkgdb -r root -a
+	atf_check_equal $? 0
+	test -f root/var/db/xbps/verify.cache
+	atf_check_equal $? 0
+	xbps-pkgdb -r root -a
+	atf_check_equal $? 0
+
+	# same size and mtime, different content
+	cp -p root/usr/bin/foo foo.orig
+	echo "modified" > root/usr/bin/foo
+	touch -r foo.orig root/usr/bin/foo
+	atf_check -s exit:1 -o ignore -e match:"hash mismatch for /usr/bin/foo" \
+		xbps-pkgdb -r root -a
+	atf_check -s exit:1 -o ignore -e match:"hash mismatch for /usr/bin/foo" \
+		xbps-pkgdb -r root A
+
+	cp -p foo.orig root/usr/bin/foo
+	xbps-pkgdb -r root -a
+	atf_check_equal $? 0
+}
+
+atf_test_case files_full
+
+files_full_head() {
+	atf_set "descr" "xbps-pkgdb(1): --full hashes all files in parallel"
+}
+
+files_full_body() {
+	mkdir -p repo pkg_A/usr/bin pkg_B/usr/lib
+	for f in 1 2 3 4 5 6 7 8; do
+		echo "A$f" > pkg_A/usr/bin/a$f
+		echo "B$f" > pkg_B/usr/lib/b$f
+	done
+	cd repo
+	xbps-create -A noarch -n A-1.0_1 -s "A pkg" ../pkg_A
+	atf_check_equal $? 0
+	xbps-create -A noarch -n B-1.0_1 -s "B pkg" ../pkg_B
+	atf_check_equal $? 0
+	xbps-rindex -d -a $PWD/*.xbps
+	atf_check_equal $? 0
+	cd ..
+	xbps-install -r root --repository=$PWD/repo -yd A B
+	atf_check_equal $? 0
+
+	xbps-pkgdb -r root -a -j 4
+	atf_check_equal $? 0
+	xbps-pkgdb -r root -a --full -j 4
+	atf_check_equal $? 0
+	xbps-pkgdb -r root --full -j 4 B
+	atf_check_equal $? 0
+
+	rm root/usr/lib/b3
+	echo "changed" > root/usr/bin/a5
+	atf_check -s exit:1 -o ignore -e match:"B: unexistent file /usr/lib/b3" \
+		xbps-pkgdb -r root -a --full -j 4
+	atf_check -s exit:1 -o ignore -e match:"A: hash mismatch for /usr/bin/a5" \
+		xbps-pkgdb -r root -a -j 4
+}
+
+atf_init_test_cases() {
+	atf_add_test_case files_cache
+	atf_add_test_case files_full
+}
@@ -0,0 +1,139 @@
+#! /usr/bin/env atf-sh
+
+atf_test_case ownedby
+
+ownedby_head() {
+	atf_set "descr" "xbps-query(1) --ownedby: installed packages"
+}
+
+ownedby_body() {
+	mkdir -p repo pkg_A/bin pkg_B/bin
+	echo "A" > pkg_A/bin/foo
+	echo "B" > pkg_B/bin/bar
+	ln -s foo pkg_A/bin/foolink
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_B
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=repo -y foo bar
+	atf_check -s exit:0 -- test -f root/var/db/xbps/files.idx
+
+	atf_check -o inline:"foo-1.0_1: /bin/foo (regular file)\n" -- \
+		xbps-query -r root -o /bin/foo
+	atf_check -o inline:"foo-1.0_1: /bin/foolink -> /bin/foo (link)\n" -- \
+		xbps-query -r root -o /bin/foolink
+	atf_check -o empty -- xbps-query -r root -o /bin/baz
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\nfoo-1.0_1: /bin/foo (regular file)\n" -- \
+		xbps-query -r root -o '/bin/[bf]*[or]'
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\n" -- \
+		xbps-query -r root --regex -o 'ba.$'
+
+	# update and removal
+	echo "B2" > pkg_B/bin/baz
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.1_1 -s "bar pkg" ../pkg_B
+	atf_check -o ignore -- xbps-rindex -a $PWD/bar-1.1_1.noarch.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=repo -yu
+	atf_check -o inline:"bar-1.1_1: /bin/baz (regular file)\n" -- \
+		xbps-query -r root -o /bin/baz
+	atf_check -o ignore -- xbps-remove -r root -y foo
+	atf_check -o empty -- xbps-query -r root -o /bin/foo
+	atf_check -o inline:"bar-1.1_1: /bin/bar (regular file)\n" -- \
+		xbps-query -r root -o /bin/bar
+}
+
+atf_test_case ownedby_stale_index
+
+ownedby_stale_index_head() {
+	atf_set "descr" "xbps-query(1) --ownedby: missing or stale files index"
+}
+
+ownedby_stale_index_body() {
+	mkdir -p repo pkg_A/bin pkg_B/bin
+	echo "A" > pkg_A/bin/foo
+	echo "B" > pkg_B/bin/bar
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_B
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=repo -y foo
+	cp root/var/db/xbps/files.idx old.idx
+	atf_check -o ignore -- xbps-install -r root --repository=repo -y bar
+
+	# index without bar, read-only commands don't rewrite it
+	cp old.idx root/var/db/xbps/files.idx
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\n" -- \
+		xbps-query -r root -o /bin/bar
+	atf_check -- cmp -s old.idx root/var/db/xbps/files.idx
+
+	# missing and corrupted index
+	rm root/var/db/xbps/files.idx
+	atf_check -o inline:"foo-1.0_1: /bin/foo (regular file)\n" -- \
+		xbps-query -r root -o /bin/foo
+	atf_check -s exit:1 -- test -f root/var/db/xbps/files.idx
+	echo garbage > root/var/db/xbps/files.idx
+	atf_check -o inline:"foo-1.0_1: /bin/foo (regular file)\n" -- \
+		xbps-query -r root -o /bin/foo
+
+	# regenerated when the pkgdb is written
+	atf_check -- xbps-pkgdb -r root -m hold foo
+	atf_check -o inline:"foo-1.0_1: /bin/foo (regular file)\n" \
+		-e match:"/bin/foo: 1 matches in the index" -- \
+		xbps-query -r root -d -o /bin/foo
+
+	# plists not matching the pkgdb are ignored
+	rm root/var/db/xbps/files.idx
+	sed -i -e 's,/bin/foo,/bin/qux,' root/var/db/xbps/.foo-files.plist
+	atf_check -o empty -- xbps-query -r root -o /bin/qux
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\n" -- \
+		xbps-query -r root -o /bin/bar
+}
+
+atf_test_case ownedby_exact
+
+ownedby_exact_head() {
+	atf_set "descr" "xbps-query(1) --ownedby: exact paths looked up in the index"
+}
+
+ownedby_exact_body() {
+	mkdir -p repo pkg_A/bin pkg_B/bin
+	echo "A" > pkg_A/bin/foo
+	echo "B" > pkg_B/bin/bar
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_B
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	cd ..
+	atf_check -o ignore -- xbps-install -r root --repository=repo -y foo
+	cp root/var/db/xbps/files.idx old.idx
+	atf_check -o ignore -- xbps-install -r root --repository=repo -y bar
+
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\n" \
+		-e match:"/bin/bar: 1 matches in the index" -- \
+		xbps-query -r root -d -o /bin/bar
+	# the pkgdb is written again, the files are unchanged
+	atf_check -- xbps-pkgdb -r root -m hold bar
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\n" \
+		-e match:"/bin/bar: 1 matches in the index" -- \
+		xbps-query -r root -d -o /bin/bar
+
+	# the index of an older pkgdb is not trusted
+	cp old.idx root/var/db/xbps/files.idx
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\n" \
+		-e not-match:"matches in the index" -- \
+		xbps-query -r root -d -o /bin/bar
+	# and regenerated when the pkgdb is written
+	atf_check -- xbps-pkgdb -r root -m unhold bar
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\n" \
+		-e match:"/bin/bar: 1 matches in the index" -- \
+		xbps-query -r root -d -o /bin/bar
+}
+
+atf_init_test_cases() {
+	atf_add_test_case ownedby
+	atf_add_test_case ownedby_exact
+	atf_add_test_case ownedby_stale_index
+}
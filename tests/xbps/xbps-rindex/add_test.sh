@@ -194,10 +194,146 @@ stage_stacked_body() {
 
 }
 
+atf_test_case binary_index
+
+binary_index_head() {
+	atf_set "descr" "xbps-rindex(1) -a: binary index test"
+}
+
+binary_index_body() {
+	mkdir -p repo root pkg
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" --provides "vfoo-1_1" ../pkg
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" --dependencies "vfoo>=0" ../pkg
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/*.xbps
+	atf_check -- test -s $(xbps-uhelper arch)-repodata.idx
+	cd ..
+	atf_check -o match:"^foo-1\.0_1 install" -o match:"^bar-1\.0_1 install" -- \
+		xbps-install -r root --repository=repo -n bar
+	# stale binary index is ignored
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" --provides "vfoo-1_1" pkg
+	mv foo-1.1_1.noarch.xbps repo
+	cp repo/$(xbps-uhelper arch)-repodata.idx stale.idx
+	atf_check -o ignore -e ignore -- xbps-rindex -a $PWD/repo/foo-1.1_1.noarch.xbps
+	cp stale.idx repo/$(xbps-uhelper arch)-repodata.idx
+	atf_check -o match:"^foo-1\.1_1 install" -- \
+		xbps-install -r root --repository=repo -n bar
+	# truncated binary index is ignored
+	head -c 64 stale.idx > repo/$(xbps-uhelper arch)-repodata.idx
+	atf_check -o match:"^foo-1\.1_1 install" -- \
+		xbps-install -r root --repository=repo -n bar
+}
+
+atf_test_case files_index
+
+files_index_head() {
+	atf_set "descr" "xbps-rindex(1) -a --files: files index test"
+}
+
+files_index_body() {
+	mkdir -p repo pkg_A/bin pkg_B/bin
+	touch pkg_A/bin/foo pkg_B/bin/bar
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex -a $PWD/*.xbps
+	atf_check -s exit:1 -- test -e $(xbps-uhelper arch)-files
+	atf_check -o match:"^files: 1 packages registered" -e ignore -- \
+		xbps-rindex --files -a $PWD/foo-1.0_1.noarch.xbps
+	atf_check -- test -s $(xbps-uhelper arch)-files
+	# an existing files index is kept up to date
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_B
+	atf_check -o match:"^files: 2 packages registered" -- \
+		xbps-rindex -a $PWD/bar-1.0_1.noarch.xbps
+	mv foo-1.0_1.noarch.xbps bar-1.0_1.noarch.xbps ..
+	cd ..
+	atf_check -o inline:"bar-1.0_1: /bin/bar (regular file)\nfoo-1.0_1: /bin/foo (regular file)\n" -- \
+		sh -c "xbps-query -C empty.conf --repository=repo -Ro '/bin/*' | sort"
+	# stale entries are ignored
+	touch pkg_A/bin/foo2
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	cp $(xbps-uhelper arch)-files ../stale-files
+	atf_check -o ignore -- xbps-rindex -a $PWD/foo-1.1_1.noarch.xbps
+	cp ../stale-files $(xbps-uhelper arch)-files
+	cd ..
+	atf_check -o inline:"foo-1.1_1: /bin/foo2 (regular file)\n" -- \
+		xbps-query -C empty.conf --repository=repo -Ro /bin/foo2
+	# clean mode removes obsolete entries
+	rm repo/foo-1.1_1.noarch.xbps
+	atf_check -o match:"^files: 0 packages registered" -- xbps-rindex -c repo
+}
+
+atf_test_case jobs
+
+jobs_head() {
+	atf_set "descr" "xbps-rindex(1) -a: parallel jobs register the same packages"
+}
+
+jobs_body() {
+	mkdir -p repo1 repo2 pkg_A
+	touch pkg_A/file00
+	cd repo1
+	for v in 1.0_1 1.2_1 1.1_1; do
+		atf_check -o ignore -e ignore -- xbps-create -A noarch -n foo-$v -s "foo pkg" ../pkg_A
+	done
+	for p in a b c d e f; do
+		atf_check -o ignore -e ignore -- xbps-create -A noarch -n $p-1.0_1 -s "$p pkg" ../pkg_A
+	done
+	atf_check -o ignore -e ignore -- xbps-create -A noarch -n bar-1.1_1 -s "bar pkg" ../pkg_A
+	atf_check -o ignore -e ignore -- xbps-create -A noarch -n bar-1.0_1 -r "1.1_1" -s "bar pkg" ../pkg_A
+	cp *.xbps ../repo2
+	atf_check -o ignore -e ignore -- xbps-rindex -j1 -a $PWD/*.xbps
+	cd ../repo2
+	atf_check -o ignore -e ignore -- xbps-rindex -j4 -a $PWD/*.xbps
+	cd ..
+	atf_check -o save:expected -- xbps-query -r root -C empty.conf --repository=repo1 -Rs ''
+	atf_check -o file:expected -- xbps-query -r root -C empty.conf --repository=repo2 -Rs ''
+	atf_check -o match:"foo-1.2_1" -o match:"bar-1.0_1" -- cat expected
+	atf_check -o save:expected -- xbps-query -r root -C empty.conf --repository=repo1 -R --property filename-sha256 foo
+	atf_check -o file:expected -- xbps-query -r root -C empty.conf --repository=repo2 -R --property filename-sha256 foo
+}
+
+atf_test_case deltas
+
+deltas_head() {
+	atf_set "descr" "xbps-rindex(1) -a: publish repodata deltas"
+}
+
+deltas_body() {
+	mkdir -p repo pkg_A
+	touch pkg_A/file00
+	cd repo
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.0_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-create -A noarch -n bar-1.0_1 -s "bar pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex --compression none -a $PWD/foo-1.0_1.noarch.xbps
+	# deltas are not published unless requested
+	atf_check -s exit:1 -- test -e $(xbps-uhelper arch)-repodata.deltas
+	atf_check -o ignore -- xbps-rindex --compression none --deltas -a $PWD/bar-1.0_1.noarch.xbps
+	atf_check -o ignore -- test -e $(xbps-uhelper arch)-repodata.deltas
+	from=$(xbps-digest $(xbps-uhelper arch)-repodata)
+	atf_check -o ignore -- xbps-create -A noarch -n foo-1.1_1 -s "foo pkg" ../pkg_A
+	atf_check -o ignore -- xbps-rindex --compression none -a $PWD/foo-1.1_1.noarch.xbps
+	to=$(xbps-digest $(xbps-uhelper arch)-repodata)
+	delta=$(xbps-uhelper arch)-repodata.${to}.delta
+	atf_check -o ignore -- test -e $delta
+	atf_check -o match:"<string>${from}</string>" -o match:"<string>${to}</string>" -- \
+		tar -xOf $(xbps-uhelper arch)-repodata.deltas deltas.plist
+	atf_check -o match:"foo-1.1_1" -o not-match:"bar-1.0_1" -- tar -xOf $delta delta.plist
+	# clean mode keeps deltas up to date
+	rm bar-1.0_1.noarch.xbps
+	atf_check -o ignore -- xbps-rindex --compression none -c $PWD
+	atf_check -o match:"<string>bar</string>" -- \
+		tar -xOf $(xbps-uhelper arch)-repodata.$(xbps-digest $(xbps-uhelper arch)-repodata).delta delta.plist
+}
+
 atf_init_test_cases() {
 	atf_add_test_case update
 	atf_add_test_case revert
 	atf_add_test_case stage
 	atf_add_test_case stage_resolve_bug
 	atf_add_test_case stage_stacked
+	atf_add_test_case binary_index
+	atf_add_test_case files_index
+	atf_add_test_case jobs
+	atf_add_test_case deltas
 }